@@ -0,0 +1,15 @@
+FPIN_SUPPORT := 
+FORTIFY_OPT := -D_FORTIFY_SOURCE=3
+D_URCU_VERSION := 
+D_CMOCKA_VERSION := -DCMOCKA_VERSION=0x010100
+SYSTEMD := 252
+ANA_SUPPORT := 1
+STACKPROT := -fstack-protector-strong
+ERROR_DISCARDED_QUALIFIERS := -Werror=discarded-qualifiers
+WNOCLOBBERED := -Wno-clobbered -Wno-error=clobbered
+WFORMATOVERFLOW := -Wformat-overflow=2
+WSTRINGOP_TRUNCATION := -Wstringop-truncation
+W_MISSING_INITIALIZERS := 
+W_URCU_TYPE_LIMITS := -Wno-type-limits
+ENABLE_LIBDMMP := 0
+C_STD := gnu11
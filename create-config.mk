@@ -113,10 +113,6 @@ ifneq ($(call check_var,ELS_DTAG_LNK_INTEGRITY,$(kernel_incdir)/scsi/fc/fc_els.h
 endif
 
 libmount_h := $(shell $(PKG_CONFIG) --variable=includedir mount)/libmount/libmount.h
-ifneq ($(call check_func,mnt_unref_cache,$(libmount_h)),0)
-	DEFINES += LIBMOUNT_HAS_MNT_UNREF_CACHE
-endif
-
 ifneq ($(call check_func,mnt_table_parse_swaps,$(libmount_h)),0)
 	DEFINES += LIBMOUNT_SUPPORTS_SWAP
 endif
@@ -18,6 +18,8 @@
 #include <assert.h>
 #include <json.h>
 #include <time.h>
+#include <poll.h>
+#include <inttypes.h>
 #include <mpath_cmd.h>
 
 #include "libdmmp/libdmmp.h"
@@ -29,13 +31,22 @@
  */
 
 #define DMMP_IPC_SHOW_JSON_CMD			"show maps json"
+#define DMMP_IPC_SHOW_MAP_JSON_CMD		"show map %s json"
 #define DMMP_JSON_MAJOR_KEY			"major_version"
 #define DMMP_JSON_MAJOR_VERSION		0
 #define DMMP_JSON_MAPS_KEY			"maps"
+#define DMMP_JSON_MAP_KEY			"map"
+#define DMMP_EVENT_PATH_MAP_IDX		2
+/* ^ "path <dev> <devt> <map> <state>" */
 #define ERRNO_STR_BUFF_SIZE			256
 #define IPC_MAX_CMD_LEN			512
 /* ^ Was MAX_CMD_LEN in ./libmultipath/uxsock.h */
 #define LAST_ERR_MSG_BUFF_SIZE			1024
+#define DMMP_CACHE_MAX_AGE			30
+/*
+ * ^ Seconds. Some state changes, like path checker details, aren't
+ * reported as events. Re-read everything from time to time.
+ */
 
 struct dmmp_context {
 	void (*log_func)(struct dmmp_context *ctx, int priority,
@@ -45,6 +56,14 @@ struct dmmp_context {
 	void *userdata;
 	unsigned int tmo;
 	char last_err_msg[LAST_ERR_MSG_BUFF_SIZE];
+	int evt_fd;
+	/* ^ Subscribed to multipathd events, or -1 */
+	bool evt_unsupported;
+	bool cache_valid;
+	time_t cache_time;
+	/* ^ CLOCK_MONOTONIC time of the last full refresh */
+	uint32_t cache_count;
+	struct dmmp_mpath **cache;
 };
 
 /*
@@ -60,6 +79,8 @@ static int _process_cmd(struct dmmp_context *ctx, int fd, const char *cmd,
 
 static int _ipc_connect(struct dmmp_context *ctx, int *fd);
 
+static void _events_close(struct dmmp_context *ctx);
+
 _dmmp_getter_func_gen(dmmp_context_log_priority_get,
 		      struct dmmp_context, ctx, log_priority,
 		      int);
@@ -106,12 +127,21 @@ struct dmmp_context *dmmp_context_new(void)
 	ctx->userdata = NULL;
 	ctx->tmo = DEFAULT_UXSOCK_TIMEOUT;
 	memset(ctx->last_err_msg, 0, LAST_ERR_MSG_BUFF_SIZE);
+	ctx->evt_fd = -1;
+	ctx->evt_unsupported = false;
+	ctx->cache_valid = false;
+	ctx->cache_time = 0;
+	ctx->cache_count = 0;
+	ctx->cache = NULL;
 
 	return ctx;
 }
 
 void dmmp_context_free(struct dmmp_context *ctx)
 {
+	if (ctx == NULL)
+		return;
+	_events_close(ctx);
 	free(ctx);
 }
 
@@ -143,35 +173,176 @@ void dmmp_context_userdata_set(struct dmmp_context *ctx, void *userdata)
 	ctx->userdata = userdata;
 }
 
-int dmmp_mpath_array_get(struct dmmp_context *ctx,
-			 struct dmmp_mpath ***dmmp_mps, uint32_t *dmmp_mp_count)
+static void _cache_clear(struct dmmp_context *ctx)
 {
-	struct dmmp_mpath *dmmp_mp = NULL;
-	int rc = DMMP_OK;
-	char *j_str = NULL;
-	json_object *j_obj = NULL;
-	json_object *j_obj_map = NULL;
-	enum json_tokener_error j_err = json_tokener_success;
-	json_tokener *j_token = NULL;
-	struct array_list *ar_maps = NULL;
-	uint32_t i = 0;
-	int cur_json_major_version = -1;
-	int ar_maps_len = -1;
-	int ipc_fd = -1;
+	dmmp_mpath_array_free(ctx->cache, ctx->cache_count);
+	ctx->cache = NULL;
+	ctx->cache_count = 0;
+	ctx->cache_valid = false;
+}
 
-	assert(ctx != NULL);
-	assert(dmmp_mps != NULL);
-	assert(dmmp_mp_count != NULL);
+static void _events_close(struct dmmp_context *ctx)
+{
+	if (ctx->evt_fd >= 0)
+		mpath_disconnect(ctx->evt_fd);
+	ctx->evt_fd = -1;
+	_cache_clear(ctx);
+}
 
-	*dmmp_mps = NULL;
-	*dmmp_mp_count = 0;
+/*
+ * Subscribe to the multipathd event feed, which tells us which maps have
+ * changed since the cache was filled. Failure isn't an error, older
+ * multipathd versions don't support it. dmmp_mpath_array_get() falls back
+ * to fetching everything in this case.
+ */
+static void _events_subscribe(struct dmmp_context *ctx)
+{
+	unsigned int tmo = ctx->tmo ? ctx->tmo : DEFAULT_UXSOCK_TIMEOUT;
 
-	_good(_ipc_connect(ctx, &ipc_fd), rc, out);
+	_cache_clear(ctx);
+	if (ctx->evt_unsupported)
+		return;
+	ctx->evt_fd = mpath_connect();
+	if (ctx->evt_fd == -1)
+		return;
+	if (mpath_subscribe_events(ctx->evt_fd, tmo) != 0) {
+		if (errno == EPROTO)
+			ctx->evt_unsupported = true;
+		_debug(ctx, "Failed to subscribe to multipathd events, error %d, "
+		       "not caching mpaths", errno);
+		mpath_disconnect(ctx->evt_fd);
+		ctx->evt_fd = -1;
+	}
+}
 
-	_good(_process_cmd(ctx, ipc_fd, DMMP_IPC_SHOW_JSON_CMD, &j_str),
-	      rc, out);
+/*
+ * Return the map name of an event line "<seq> <event> <args>", or NULL if
+ * the cached data can't be updated from this event. The line is modified.
+ */
+static const char *_event_map_name(char *line)
+{
+	char *saveptr = NULL;
+	const char *event;
+	const char *name;
+	int i, idx;
 
-	_debug(ctx, "Got json output from multipathd: '%s'", j_str);
+	if (strtok_r(line, " ", &saveptr) == NULL ||
+	    (event = strtok_r(NULL, " ", &saveptr)) == NULL)
+		return NULL;
+
+	if (strcmp(event, "path") == 0)
+		idx = DMMP_EVENT_PATH_MAP_IDX;
+	else if (strcmp(event, "switchgroup") == 0 ||
+		 strcmp(event, "pathgroup") == 0 ||
+		 strcmp(event, "add_map") == 0 ||
+		 strcmp(event, "remove_map") == 0 ||
+		 strcmp(event, "reload") == 0 ||
+		 strcmp(event, "queueing") == 0)
+		idx = 0;
+	else
+		/* "lost", or an event we don't know */
+		return NULL;
+
+	for (i = 0, name = strtok_r(NULL, " ", &saveptr);
+	     i < idx && name != NULL; i++)
+		name = strtok_r(NULL, " ", &saveptr);
+	return name;
+}
+
+static int _changed_name_add(struct dmmp_context *ctx, char ***names,
+			     uint32_t *name_count, const char *name)
+{
+	char **tmp;
+	uint32_t i;
+
+	for (i = 0; i < *name_count; ++i)
+		if (strcmp((*names)[i], name) == 0)
+			return DMMP_OK;
+
+	tmp = realloc(*names, sizeof(char *) * (*name_count + 1));
+	if (tmp == NULL)
+		goto nomem;
+	*names = tmp;
+	(*names)[*name_count] = strdup(name);
+	if ((*names)[*name_count] == NULL)
+		goto nomem;
+	(*name_count)++;
+	return DMMP_OK;
+nomem:
+	_error(ctx, "%s", dmmp_strerror(DMMP_ERR_NO_MEMORY));
+	return DMMP_ERR_NO_MEMORY;
+}
+
+/*
+ * Collect the names of the maps that changed since the last call, without
+ * blocking. If the cache can't be updated incrementally, because events
+ * were lost or the event connection failed, it is invalidated instead.
+ * Pending events are consumed in any case.
+ */
+static int _events_read(struct dmmp_context *ctx, char ***names,
+			uint32_t *name_count)
+{
+	struct pollfd pfd;
+	char *events = NULL;
+	char *line = NULL;
+	char *saveptr = NULL;
+	const char *name = NULL;
+	int rc = DMMP_OK;
+
+	unsigned int tmo = ctx->tmo ? ctx->tmo : DEFAULT_UXSOCK_TIMEOUT;
+
+	pfd.fd = ctx->evt_fd;
+	pfd.events = POLLIN;
+	for (;;) {
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 0) == -1) {
+			if (errno == EINTR)
+				continue;
+			_debug(ctx, "poll() on event connection failed: %d",
+			       errno);
+			_events_close(ctx);
+			break;
+		}
+		if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+			break;
+		if (mpath_recv_events(ctx->evt_fd, &events, tmo) != 0) {
+			_debug(ctx, "Lost multipathd event connection: %d",
+			       errno);
+			_events_close(ctx);
+			break;
+		}
+		for (line = strtok_r(events, "\n", &saveptr); line != NULL;
+		     line = strtok_r(NULL, "\n", &saveptr)) {
+			_debug(ctx, "Got multipathd event '%s'", line);
+			name = _event_map_name(line);
+			if (name == NULL)
+				ctx->cache_valid = false;
+			if (!ctx->cache_valid)
+				continue;
+			_good(_changed_name_add(ctx, names, name_count, name),
+			      rc, out);
+		}
+		free(events);
+		events = NULL;
+	}
+out:
+	free(events);
+	return rc;
+}
+
+/*
+ * Parse a JSON reply of multipathd and check its version.
+ * The returned object must be released with json_object_put().
+ */
+static int _json_reply_parse(struct dmmp_context *ctx, const char *j_str,
+			     json_object **j_obj)
+{
+	int rc = DMMP_OK;
+	enum json_tokener_error j_err = json_tokener_success;
+	json_tokener *j_token = NULL;
+	int cur_json_major_version = -1;
+
+	*j_obj = NULL;
 
 	j_token = json_tokener_new();
 	if (j_token == NULL) {
@@ -179,9 +350,9 @@ int dmmp_mpath_array_get(struct dmmp_context *ctx,
 		_error(ctx, "BUG: json_tokener_new() returned NULL");
 		goto out;
 	}
-	j_obj = json_tokener_parse_ex(j_token, j_str, strlen(j_str) + 1);
+	*j_obj = json_tokener_parse_ex(j_token, j_str, strlen(j_str) + 1);
 
-	if (j_obj == NULL) {
+	if (*j_obj == NULL) {
 		rc = DMMP_ERR_IPC_ERROR;
 		j_err = json_tokener_get_error(j_token);
 		_error(ctx, "Failed to parse JSON output from multipathd IPC: "
@@ -189,7 +360,7 @@ int dmmp_mpath_array_get(struct dmmp_context *ctx,
 		goto out;
 	}
 
-	_json_obj_get_value(ctx, j_obj, cur_json_major_version,
+	_json_obj_get_value(ctx, *j_obj, cur_json_major_version,
 			    DMMP_JSON_MAJOR_KEY, json_type_int,
 			    json_object_get_int, rc, out);
 
@@ -203,6 +374,39 @@ int dmmp_mpath_array_get(struct dmmp_context *ctx,
 	_debug(ctx, "multipathd JSON major version(%d) check pass",
 	       DMMP_JSON_MAJOR_VERSION);
 
+out:
+	if (j_token != NULL)
+		json_tokener_free(j_token);
+	if ((rc != DMMP_OK) && (*j_obj != NULL)) {
+		json_object_put(*j_obj);
+		*j_obj = NULL;
+	}
+	return rc;
+}
+
+static int _mpath_array_fetch(struct dmmp_context *ctx, int ipc_fd,
+			      struct dmmp_mpath ***dmmp_mps,
+			      uint32_t *dmmp_mp_count)
+{
+	struct dmmp_mpath *dmmp_mp = NULL;
+	int rc = DMMP_OK;
+	char *j_str = NULL;
+	json_object *j_obj = NULL;
+	json_object *j_obj_map = NULL;
+	struct array_list *ar_maps = NULL;
+	uint32_t i = 0;
+	int ar_maps_len = -1;
+
+	*dmmp_mps = NULL;
+	*dmmp_mp_count = 0;
+
+	_good(_process_cmd(ctx, ipc_fd, DMMP_IPC_SHOW_JSON_CMD, &j_str),
+	      rc, out);
+
+	_debug(ctx, "Got json output from multipathd: '%s'", j_str);
+
+	_good(_json_reply_parse(ctx, j_str, &j_obj), rc, out);
+
 	_json_obj_get_value(ctx, j_obj, ar_maps, DMMP_JSON_MAPS_KEY,
 			    json_type_array, json_object_get_array, rc, out);
 
@@ -226,7 +430,7 @@ int dmmp_mpath_array_get(struct dmmp_context *ctx,
 
 	*dmmp_mps = (struct dmmp_mpath **)
 		malloc(sizeof(struct dmmp_mpath *) * (*dmmp_mp_count));
-	_dmmp_alloc_null_check(ctx, dmmp_mps, rc, out);
+	_dmmp_alloc_null_check(ctx, *dmmp_mps, rc, out);
 	for (; i < *dmmp_mp_count; ++i)
 		(*dmmp_mps)[i] = NULL;
 
@@ -240,16 +444,13 @@ int dmmp_mpath_array_get(struct dmmp_context *ctx,
 
 		dmmp_mp = dmmp_mpath_new();
 		_dmmp_alloc_null_check(ctx, dmmp_mp, rc, out);
-		(*dmmp_mps)[i] = dmmp_mp;
+		/* dmmp_mpath_update() frees dmmp_mp on failure */
 		_good(dmmp_mpath_update(ctx, dmmp_mp, j_obj_map), rc, out);
+		(*dmmp_mps)[i] = dmmp_mp;
 	}
 
 out:
-	if (ipc_fd >= 0)
-		mpath_disconnect(ipc_fd);
 	free(j_str);
-	if (j_token != NULL)
-		json_tokener_free(j_token);
 	if (j_obj != NULL)
 		json_object_put(j_obj);
 
@@ -262,6 +463,210 @@ out:
 	return rc;
 }
 
+/*
+ * Fetch a single mpath by name. If it doesn't exist any more, return
+ * DMMP_OK with *dmmp_mp set to NULL.
+ */
+static int _mpath_fetch(struct dmmp_context *ctx, int ipc_fd,
+			const char *name, struct dmmp_mpath **dmmp_mp)
+{
+	int rc = DMMP_OK;
+	char cmd[IPC_MAX_CMD_LEN];
+	char *j_str = NULL;
+	json_object *j_obj = NULL;
+	json_object *j_obj_map = NULL;
+
+	*dmmp_mp = NULL;
+
+	snprintf(cmd, IPC_MAX_CMD_LEN, DMMP_IPC_SHOW_MAP_JSON_CMD, name);
+	if (strlen(cmd) == IPC_MAX_CMD_LEN - 1) {
+		rc = DMMP_ERR_BUG;
+		_error(ctx, "BUG: Got too long mpath name %s", name);
+		goto out;
+	}
+
+	rc = _process_cmd(ctx, ipc_fd, cmd, &j_str);
+	if (rc == DMMP_ERR_MPATH_NOT_FOUND) {
+		_debug(ctx, "mpath %s is gone", name);
+		rc = DMMP_OK;
+		goto out;
+	}
+	if (rc != DMMP_OK)
+		goto out;
+
+	_debug(ctx, "Got json output from multipathd: '%s'", j_str);
+
+	_good(_json_reply_parse(ctx, j_str, &j_obj), rc, out);
+
+	if ((json_object_object_get_ex(j_obj, DMMP_JSON_MAP_KEY,
+				       &j_obj_map) != true) ||
+	    (json_object_get_type(j_obj_map) != json_type_object)) {
+		rc = DMMP_ERR_IPC_ERROR;
+		_error(ctx, "Invalid JSON output from multipathd IPC: "
+		       "no object for key '%s'", DMMP_JSON_MAP_KEY);
+		goto out;
+	}
+
+	*dmmp_mp = dmmp_mpath_new();
+	_dmmp_alloc_null_check(ctx, *dmmp_mp, rc, out);
+	rc = dmmp_mpath_update(ctx, *dmmp_mp, j_obj_map);
+	if (rc != DMMP_OK)
+		/* already freed by dmmp_mpath_update() */
+		*dmmp_mp = NULL;
+
+out:
+	free(j_str);
+	if (j_obj != NULL)
+		json_object_put(j_obj);
+	return rc;
+}
+
+static int64_t _cache_idx(struct dmmp_context *ctx,
+			  const char *(*key_get)(struct dmmp_mpath *),
+			  const char *key)
+{
+	uint32_t i;
+
+	for (i = 0; i < ctx->cache_count; ++i)
+		if (strcmp(key_get(ctx->cache[i]), key) == 0)
+			return i;
+	return -1;
+}
+
+/* Replace, add or remove the cached copy of the mpath with this name */
+static int _cache_mpath_refresh(struct dmmp_context *ctx, int ipc_fd,
+				const char *name)
+{
+	struct dmmp_mpath *dmmp_mp = NULL;
+	struct dmmp_mpath **tmp = NULL;
+	int64_t idx = -1;
+	int rc = DMMP_OK;
+
+	_good(_mpath_fetch(ctx, ipc_fd, name, &dmmp_mp), rc, out);
+
+	if (dmmp_mp == NULL) {
+		idx = _cache_idx(ctx, dmmp_mpath_name_get, name);
+		if (idx < 0)
+			goto out;
+		dmmp_mpath_free(ctx->cache[idx]);
+		memmove(&ctx->cache[idx], &ctx->cache[idx + 1],
+			sizeof(struct dmmp_mpath *) *
+			(ctx->cache_count - idx - 1));
+		ctx->cache_count--;
+		goto out;
+	}
+
+	/* Look up by WWID, the map may have been renamed */
+	idx = _cache_idx(ctx, dmmp_mpath_wwid_get,
+			 dmmp_mpath_wwid_get(dmmp_mp));
+	if (idx >= 0) {
+		dmmp_mpath_free(ctx->cache[idx]);
+		ctx->cache[idx] = dmmp_mp;
+		goto out;
+	}
+
+	tmp = (struct dmmp_mpath **)
+		realloc(ctx->cache, sizeof(struct dmmp_mpath *) *
+			(ctx->cache_count + 1));
+	if (tmp == NULL) {
+		dmmp_mpath_free(dmmp_mp);
+		_dmmp_alloc_null_check(ctx, tmp, rc, out);
+	}
+	ctx->cache = tmp;
+	ctx->cache[ctx->cache_count++] = dmmp_mp;
+
+out:
+	return rc;
+}
+
+static int _cache_update(struct dmmp_context *ctx, int ipc_fd)
+{
+	char **names = NULL;
+	uint32_t name_count = 0;
+	uint32_t i = 0;
+	int rc = DMMP_OK;
+	struct timespec now;
+
+	_good(_events_read(ctx, &names, &name_count), rc, out);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ctx->cache_valid &&
+	    now.tv_sec - ctx->cache_time >= DMMP_CACHE_MAX_AGE) {
+		_debug(ctx, "mpath cache is older than %d seconds, "
+		       "refreshing all mpaths", DMMP_CACHE_MAX_AGE);
+		ctx->cache_valid = false;
+	}
+
+	if (!ctx->cache_valid) {
+		_cache_clear(ctx);
+		_good(_mpath_array_fetch(ctx, ipc_fd, &ctx->cache,
+					 &ctx->cache_count), rc, out);
+		/* Without event connection, it's stale right away */
+		ctx->cache_valid = (ctx->evt_fd >= 0);
+		ctx->cache_time = now.tv_sec;
+		goto out;
+	}
+
+	if (name_count > 0)
+		_debug(ctx, "Refreshing %" PRIu32 " changed mpaths",
+		       name_count);
+	for (i = 0; i < name_count; ++i)
+		_good(_cache_mpath_refresh(ctx, ipc_fd, names[i]), rc, out);
+
+out:
+	for (i = 0; i < name_count; ++i)
+		free(names[i]);
+	free(names);
+	if (rc != DMMP_OK)
+		_cache_clear(ctx);
+	return rc;
+}
+
+int dmmp_mpath_array_get(struct dmmp_context *ctx,
+			 struct dmmp_mpath ***dmmp_mps, uint32_t *dmmp_mp_count)
+{
+	int rc = DMMP_OK;
+	uint32_t i = 0;
+	int ipc_fd = -1;
+
+	assert(ctx != NULL);
+	assert(dmmp_mps != NULL);
+	assert(dmmp_mp_count != NULL);
+
+	*dmmp_mps = NULL;
+	*dmmp_mp_count = 0;
+
+	_good(_ipc_connect(ctx, &ipc_fd), rc, out);
+
+	/*
+	 * Subscribe before filling the cache, so that no change in between
+	 * can be missed.
+	 */
+	if (ctx->evt_fd < 0)
+		_events_subscribe(ctx);
+	if (ctx->evt_fd < 0) {
+		rc = _mpath_array_fetch(ctx, ipc_fd, dmmp_mps, dmmp_mp_count);
+		goto out;
+	}
+
+	_good(_cache_update(ctx, ipc_fd), rc, out);
+
+	if (ctx->cache_count == 0)
+		goto out;
+
+	*dmmp_mps = (struct dmmp_mpath **)
+		malloc(sizeof(struct dmmp_mpath *) * ctx->cache_count);
+	_dmmp_alloc_null_check(ctx, *dmmp_mps, rc, out);
+	for (i = 0; i < ctx->cache_count; ++i)
+		(*dmmp_mps)[i] = _dmmp_mpath_hold(ctx->cache[i]);
+	*dmmp_mp_count = ctx->cache_count;
+
+out:
+	if (ipc_fd >= 0)
+		mpath_disconnect(ipc_fd);
+	return rc;
+}
+
 static int _process_cmd(struct dmmp_context *ctx, int fd, const char *cmd,
 			char **output)
 {
@@ -429,6 +834,8 @@ int dmmp_flush_mpath(struct dmmp_context *ctx, const char *mpath_name)
 
 	_good(_ipc_connect(ctx, &ipc_fd), rc, out);
 	_good(_process_cmd(ctx, ipc_fd, cmd, &output), rc, out);
+	/* Don't rely on the event for the removal having arrived yet */
+	_cache_clear(ctx);
 
 	/* _process_cmd() already make sure output is not NULL */
 	if (strncmp(output, "ok", strlen("ok")) != 0) {
@@ -455,6 +862,7 @@ int dmmp_reconfig(struct dmmp_context *ctx)
 
 	_good(_ipc_connect(ctx, &ipc_fd), rc, out);
 	_good(_process_cmd(ctx, ipc_fd, cmd, &output), rc, out);
+	_cache_clear(ctx);
 
 out:
 	if (ipc_fd >= 0)
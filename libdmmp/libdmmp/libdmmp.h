@@ -297,6 +297,15 @@ DMMP_DLL_EXPORT void *dmmp_context_userdata_get(struct dmmp_context *ctx);
  * Query all existing multipath devices and store them into a pointer array.
  * The memory of 'dmmp_mps' should be freed via dmmp_mpath_array_free().
  *
+ * The context keeps a cache of the multipath devices, which is updated from
+ * the event feed of multipathd. Repeated calls only query the multipath
+ * devices which have changed in the meantime, and return the same
+ * 'struct dmmp_mpath' objects for the unchanged ones. All multipath devices
+ * are queried again if the last full query is more than 30 seconds old.
+ * The objects are read-only and stay valid until dmmp_mpath_array_free() is
+ * called, even if the context is freed or the multipath device changes
+ * before.
+ *
  * @ctx:
  *	Pointer of 'struct dmmp_context'.
  *	If this pointer is NULL, your program will be terminated by assert.
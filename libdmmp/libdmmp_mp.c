@@ -23,6 +23,12 @@ struct dmmp_mpath {
 	uint32_t dmmp_pg_count;
 	struct dmmp_path_group **dmmp_pgs;
 	char *kdev_name;
+	unsigned int refcount;
+	/*
+	 * ^ Objects are shared between the cache of struct dmmp_context and
+	 *   the arrays returned by dmmp_mpath_array_get(), and are never
+	 *   modified after dmmp_mpath_update().
+	 */
 };
 
 _dmmp_getter_func_gen(dmmp_mpath_name_get, struct dmmp_mpath, dmmp_mp,
@@ -43,10 +49,20 @@ struct dmmp_mpath *dmmp_mpath_new(void)
 		dmmp_mp->alias = NULL;
 		dmmp_mp->dmmp_pg_count = 0;
 		dmmp_mp->dmmp_pgs = NULL;
+		dmmp_mp->kdev_name = NULL;
+		dmmp_mp->refcount = 1;
 	}
 	return dmmp_mp;
 }
 
+struct dmmp_mpath *_dmmp_mpath_hold(struct dmmp_mpath *dmmp_mp)
+{
+	assert(dmmp_mp != NULL);
+
+	__atomic_add_fetch(&dmmp_mp->refcount, 1, __ATOMIC_RELAXED);
+	return dmmp_mp;
+}
+
 int dmmp_mpath_update(struct dmmp_context *ctx, struct dmmp_mpath *dmmp_mp,
 		       json_object *j_obj_map)
 {
@@ -123,6 +139,9 @@ void dmmp_mpath_free(struct dmmp_mpath *dmmp_mp)
 	if (dmmp_mp == NULL)
 		return ;
 
+	if (__atomic_sub_fetch(&dmmp_mp->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+
 	free((char *) dmmp_mp->alias);
 	free((char *) dmmp_mp->wwid);
 	free((char *) dmmp_mp->kdev_name);
@@ -99,6 +99,9 @@ DMMP_DLL_LOCAL int _dmmp_ipc_exec(struct dmmp_context *ctx, const char *cmd,
 				  char **output);
 
 DMMP_DLL_LOCAL struct dmmp_mpath *dmmp_mpath_new(void);
+/* Take another reference, which is dropped by dmmp_mpath_free() */
+DMMP_DLL_LOCAL struct dmmp_mpath *_dmmp_mpath_hold
+	(struct dmmp_mpath *dmmp_mp);
 DMMP_DLL_LOCAL struct dmmp_path_group *dmmp_path_group_new(void);
 DMMP_DLL_LOCAL struct dmmp_path *dmmp_path_new(void);
 
@@ -15,6 +15,7 @@
 #include <stdbool.h>
 
 #include <libdmmp/libdmmp.h>
+#include <mpath_cmd.h>
 
 #define FAIL(rc, out, ...) \
 	do { \
@@ -25,6 +26,7 @@
 #define PASS(...) fprintf(stdout, "PASS: "__VA_ARGS__ );
 #define FILE_NAME_SIZE 256
 #define TMO 60000		/* Forcing timeout to 60 seconds */
+#define STATE_WAIT 10		/* Seconds to wait for a path state change */
 
 int test_paths(struct dmmp_path_group *mp_pg)
 {
@@ -90,6 +92,122 @@ out:
 	return rc;
 }
 
+/* Status of path blk_name of mpath mp_name, as cached by ctx */
+uint32_t path_status(struct dmmp_context *ctx, const char *mp_name,
+		     const char *blk_name)
+{
+	struct dmmp_mpath **dmmp_mps = NULL;
+	struct dmmp_path_group **dmmp_pgs = NULL;
+	struct dmmp_path **dmmp_ps = NULL;
+	uint32_t dmmp_mp_count = 0;
+	uint32_t dmmp_pg_count = 0;
+	uint32_t dmmp_p_count = 0;
+	uint32_t status = DMMP_PATH_STATUS_UNKNOWN;
+	uint32_t i, j, k;
+
+	if (dmmp_mpath_array_get(ctx, &dmmp_mps, &dmmp_mp_count) != 0)
+		return status;
+	for (i = 0; i < dmmp_mp_count; ++i) {
+		if (strcmp(dmmp_mpath_name_get(dmmp_mps[i]), mp_name) != 0)
+			continue;
+		dmmp_path_group_array_get(dmmp_mps[i], &dmmp_pgs,
+					  &dmmp_pg_count);
+		for (j = 0; j < dmmp_pg_count; ++j) {
+			dmmp_path_array_get(dmmp_pgs[j], &dmmp_ps,
+					    &dmmp_p_count);
+			for (k = 0; k < dmmp_p_count; ++k)
+				if (strcmp(dmmp_path_blk_name_get(dmmp_ps[k]),
+					   blk_name) == 0)
+					status = dmmp_path_status_get
+						(dmmp_ps[k]);
+		}
+	}
+	dmmp_mpath_array_free(dmmp_mps, dmmp_mp_count);
+	return status;
+}
+
+int wait_path_status(struct dmmp_context *ctx, const char *mp_name,
+		     const char *blk_name, uint32_t status)
+{
+	int i;
+
+	for (i = 0; i < STATE_WAIT; ++i) {
+		if (path_status(ctx, mp_name, blk_name) == status)
+			return 0;
+		sleep(1);
+	}
+	return -1;
+}
+
+int multipathd_cmd(const char *fmt, const char *arg)
+{
+	char cmd[FILE_NAME_SIZE];
+	char *reply = NULL;
+	int fd;
+	int rc = -1;
+
+	snprintf(cmd, sizeof(cmd), fmt, arg);
+	fd = mpath_connect();
+	if (fd == -1)
+		return rc;
+	if (mpath_process_cmd(fd, cmd, &reply, TMO) == 0 && reply != NULL &&
+	    strncmp(reply, "ok", 2) == 0)
+		rc = 0;
+	free(reply);
+	mpath_disconnect(fd);
+	return rc;
+}
+
+/*
+ * Fail a path through multipathd, and check that the cache of ctx picks
+ * up the change, and the reinstatement afterwards.
+ */
+int test_cache_state_change(struct dmmp_context *ctx,
+			    struct dmmp_mpath *dmmp_mp)
+{
+	struct dmmp_path_group **dmmp_pgs = NULL;
+	struct dmmp_path **dmmp_ps = NULL;
+	uint32_t dmmp_pg_count = 0;
+	uint32_t dmmp_p_count = 0;
+	char mp_name[FILE_NAME_SIZE];
+	char blk_name[FILE_NAME_SIZE];
+	uint32_t old_status;
+	int rc = EXIT_SUCCESS;
+
+	dmmp_path_group_array_get(dmmp_mp, &dmmp_pgs, &dmmp_pg_count);
+	if (dmmp_pg_count == 0)
+		FAIL(rc, out, "dmmp_path_group_array_get(): Got 0 path group\n");
+	dmmp_path_array_get(dmmp_pgs[0], &dmmp_ps, &dmmp_p_count);
+	if (dmmp_p_count == 0)
+		FAIL(rc, out, "dmmp_path_array_get(): Got no path\n");
+	snprintf(mp_name, sizeof(mp_name), "%s", dmmp_mpath_name_get(dmmp_mp));
+	snprintf(blk_name, sizeof(blk_name), "%s",
+		 dmmp_path_blk_name_get(dmmp_ps[0]));
+	old_status = dmmp_path_status_get(dmmp_ps[0]);
+
+	if (multipathd_cmd("fail path %s", blk_name) != 0)
+		FAIL(rc, out, "multipathd failed to fail path %s\n", blk_name);
+	if (wait_path_status(ctx, mp_name, blk_name,
+			     DMMP_PATH_STATUS_DOWN) != 0) {
+		multipathd_cmd("reinstate path %s", blk_name);
+		FAIL(rc, out, "dmmp_mpath_array_get(): failed path %s "
+		     "not reported as down\n", blk_name);
+	}
+	PASS("dmmp_mpath_array_get(): failed path %s is down\n", blk_name);
+
+	if (multipathd_cmd("reinstate path %s", blk_name) != 0)
+		FAIL(rc, out, "multipathd failed to reinstate path %s\n",
+		     blk_name);
+	if (wait_path_status(ctx, mp_name, blk_name, old_status) != 0)
+		FAIL(rc, out, "dmmp_mpath_array_get(): reinstated path %s "
+		     "not reported as %s\n", blk_name,
+		     dmmp_path_status_str(old_status));
+	PASS("dmmp_mpath_array_get(): reinstated path %s is %s\n", blk_name,
+	     dmmp_path_status_str(old_status));
+out:
+	return rc;
+}
+
 int main(void)
 {
 	struct dmmp_context *ctx = NULL;
@@ -142,6 +260,22 @@ int main(void)
 
 	dmmp_mpath_array_free(dmmp_mps, dmmp_mp_count);
 
+	/* Served from the cache of ctx */
+	if (dmmp_mpath_array_get(ctx, &dmmp_mps, &dmmp_mp_count) != 0)
+		FAIL(rc, out, "dmmp_mpath_array_get() failed: %s\n",
+		     dmmp_last_error_msg(ctx));
+	if (dmmp_mp_count != old_dmmp_mp_count)
+		FAIL(rc, out, "Got different mpath count on second query: "
+		     "old %" PRIu32 ", new %" PRIu32 "\n", old_dmmp_mp_count,
+		     dmmp_mp_count);
+	PASS("dmmp_mpath_array_get(): Got %" PRIu32 " mpath again\n",
+	     dmmp_mp_count);
+
+	rc = test_cache_state_change(ctx, dmmp_mps[dmmp_mp_count - 1]);
+	dmmp_mpath_array_free(dmmp_mps, dmmp_mp_count);
+	if (rc != 0)
+		goto out;
+
 	if (dmmp_flush_mpath(ctx, old_name) != DMMP_OK)
 		FAIL(rc, out, "dmmp_flush_mpath(): failed %s\n",
 		     dmmp_last_error_msg(ctx));
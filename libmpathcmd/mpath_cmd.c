@@ -142,18 +142,25 @@ int mpath_disconnect(int fd)
 	return close(fd);
 }
 
-ssize_t mpath_recv_reply_len(int fd, unsigned int timeout)
+/* Size of the receive buffer for mpath_recv_reply_stream() */
+#define REPLY_PIECE_LEN (64 * 1024)
+
+static int recv_exact(int fd, void *buf, size_t len, unsigned int timeout)
 {
-	size_t len;
 	ssize_t ret;
 
-	ret = read_all(fd, &len, sizeof(len), timeout);
+	ret = read_all(fd, buf, len, timeout);
 	if (ret < 0)
 		return ret;
-	if (ret != sizeof(len)) {
+	if ((size_t)ret != len) {
 		errno = EIO;
 		return -1;
 	}
+	return 0;
+}
+
+static ssize_t check_reply_len(size_t len)
+{
 	if (len <= 0 || len >= MAX_REPLY_LEN) {
 		errno = ERANGE;
 		return -1;
@@ -161,33 +168,154 @@ ssize_t mpath_recv_reply_len(int fd, unsigned int timeout)
 	return len;
 }
 
+ssize_t mpath_recv_reply_len(int fd, unsigned int timeout)
+{
+	size_t len;
+
+	if (recv_exact(fd, &len, sizeof(len), timeout) != 0)
+		return -1;
+	return check_reply_len(len);
+}
+
 int mpath_recv_reply_data(int fd, char *reply, size_t len,
 			  unsigned int timeout)
 {
-	ssize_t ret;
-
 	if (len <= 0)
 		return 0;
-	ret = read_all(fd, reply, len, timeout);
-	if (ret < 0)
-		return ret;
-	if ((size_t)ret != len) {
-		errno = EIO;
+	if (recv_exact(fd, reply, len, timeout) != 0)
 		return -1;
-	}
 	reply[len - 1] = '\0';
 	return 0;
 }
 
+/*
+ * Pass the chunks of a chunked reply to fn, after the
+ * MPATH_REPLY_CHUNKED marker has been read.
+ */
+static int recv_chunks(int fd, mpath_reply_fn fn, void *arg,
+		       unsigned int timeout)
+{
+	char *buf = NULL;
+	size_t size = 0, len;
+	int ret;
+
+	for (;;) {
+		ret = recv_exact(fd, &len, sizeof(len), timeout);
+		if (ret != 0 || len == 0)
+			break;
+		if (len >= MAX_REPLY_LEN) {
+			errno = ERANGE;
+			ret = -1;
+			break;
+		}
+		if (len > size) {
+			char *tmp = realloc(buf, len);
+
+			if (!tmp) {
+				ret = -1;
+				break;
+			}
+			buf = tmp;
+			size = len;
+		}
+		ret = recv_exact(fd, buf, len, timeout);
+		if (ret == 0)
+			ret = fn(buf, len, arg);
+		if (ret != 0)
+			break;
+	}
+	free(buf);
+	return ret;
+}
+
+int mpath_recv_reply_stream(int fd, mpath_reply_fn fn, void *arg,
+			    unsigned int timeout)
+{
+	char *buf;
+	size_t len, n;
+	int ret = 0;
+
+	if (recv_exact(fd, &len, sizeof(len), timeout) != 0)
+		return -1;
+	if (len == MPATH_REPLY_CHUNKED)
+		return recv_chunks(fd, fn, arg, timeout);
+	if (check_reply_len(len) < 0)
+		return -1;
+
+	buf = malloc(len < REPLY_PIECE_LEN ? len : REPLY_PIECE_LEN);
+	if (!buf)
+		return -1;
+	while (len > 0) {
+		n = len < REPLY_PIECE_LEN ? len : REPLY_PIECE_LEN;
+		ret = recv_exact(fd, buf, n, timeout);
+		if (ret != 0)
+			break;
+		len -= n;
+		/* don't pass on the terminating NUL byte */
+		if (len == 0)
+			n--;
+		if (n > 0)
+			ret = fn(buf, n, arg);
+		if (ret != 0)
+			break;
+	}
+	free(buf);
+	return ret;
+}
+
+struct reply_buf {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+static int append_reply(const char *data, size_t len, void *arg)
+{
+	struct reply_buf *rb = arg;
+
+	if (len >= MAX_REPLY_LEN - rb->len) {
+		errno = ERANGE;
+		return -1;
+	}
+	if (rb->len + len + 1 > rb->size) {
+		size_t size = rb->size ? rb->size : REPLY_PIECE_LEN;
+		char *tmp;
+
+		while (size < rb->len + len + 1)
+			size *= 2;
+		tmp = realloc(rb->buf, size);
+		if (!tmp)
+			return -1;
+		rb->buf = tmp;
+		rb->size = size;
+	}
+	memcpy(rb->buf + rb->len, data, len);
+	rb->len += len;
+	rb->buf[rb->len] = '\0';
+	return 0;
+}
+
 int mpath_recv_reply(int fd, char **reply, unsigned int timeout)
 {
 	int err;
-	ssize_t len;
+	size_t len;
 
 	*reply = NULL;
-	len = mpath_recv_reply_len(fd, timeout);
-	if (len <= 0)
-		return len;
+	if (recv_exact(fd, &len, sizeof(len), timeout) != 0)
+		return -1;
+	if (len == MPATH_REPLY_CHUNKED) {
+		struct reply_buf rb = { .buf = NULL, };
+
+		err = recv_chunks(fd, append_reply, &rb, timeout);
+		if (err) {
+			free(rb.buf);
+			return -1;
+		}
+		*reply = rb.buf;
+		return 0;
+	}
+	if (check_reply_len(len) < 0)
+		return -1;
 	*reply = malloc(len);
 	if (!*reply)
 		return -1;
@@ -200,21 +328,35 @@ int mpath_recv_reply(int fd, char **reply, unsigned int timeout)
 	return 0;
 }
 
-int mpath_send_cmd(int fd, const char *cmd)
+static int send_cmd(int fd, const char *cmd, const char *opt)
 {
-	size_t len;
+	size_t len, cmd_len = 0, opt_len = 0;
 
-	if (cmd != NULL)
-		len = strlen(cmd) + 1;
-	else
-		len = 0;
+	if (cmd != NULL) {
+		cmd_len = strlen(cmd) + 1;
+		if (opt != NULL)
+			opt_len = strlen(opt) + 1;
+	}
+	len = cmd_len + opt_len;
 	if (write_all(fd, &len, sizeof(len)) != sizeof(len))
 		return -1;
-	if (len && write_all(fd, cmd, len) != len)
+	if (cmd_len && write_all(fd, cmd, cmd_len) != cmd_len)
+		return -1;
+	if (opt_len && write_all(fd, opt, opt_len) != opt_len)
 		return -1;
 	return 0;
 }
 
+int mpath_send_cmd(int fd, const char *cmd)
+{
+	return send_cmd(fd, cmd, NULL);
+}
+
+int mpath_send_cmd_chunked(int fd, const char *cmd)
+{
+	return send_cmd(fd, cmd, MPATH_CMD_OPT_CHUNKED);
+}
+
 int mpath_process_cmd(int fd, const char *cmd, char **reply,
 		      unsigned int timeout)
 {
@@ -222,3 +364,283 @@ int mpath_process_cmd(int fd, const char *cmd, char **reply,
 		return -1;
 	return mpath_recv_reply(fd, reply, timeout);
 }
+
+int mpath_subscribe_events(int fd, unsigned int timeout)
+{
+	char *reply;
+	int ok;
+
+	if (mpath_process_cmd(fd, "subscribe events", &reply, timeout) != 0)
+		return -1;
+	ok = reply && !strcmp(reply, "ok\n");
+	free(reply);
+	if (!ok) {
+		errno = EPROTO;
+		return -1;
+	}
+	return 0;
+}
+
+int mpath_recv_events(int fd, char **events, unsigned int timeout)
+{
+	return mpath_recv_reply(fd, events, timeout);
+}
+
+struct mpath_async_req {
+	struct mpath_async_req *next;
+	unsigned int id;
+	char *reply;
+};
+
+struct mpath_async {
+	int fd;
+	int error;
+	unsigned int next_id;
+	unsigned int nr_reqs;
+	/* queued command data */
+	char *out;
+	size_t out_len;
+	size_t out_pos;
+	size_t out_size;
+	/* requests waiting for their reply, oldest first */
+	struct mpath_async_req *waiting, **waiting_tail;
+	/* requests with a reply, oldest first */
+	struct mpath_async_req *done, **done_tail;
+	/* reply being received; NULL while receiving its length */
+	char *reply;
+	size_t reply_len;
+	size_t got;
+};
+
+struct mpath_async *mpath_async_new(int fd)
+{
+	struct mpath_async *as = calloc(1, sizeof(*as));
+
+	if (!as)
+		return NULL;
+	as->fd = fd;
+	as->waiting_tail = &as->waiting;
+	as->done_tail = &as->done;
+	return as;
+}
+
+static void free_reqs(struct mpath_async_req *req)
+{
+	struct mpath_async_req *next;
+
+	for (; req; req = next) {
+		next = req->next;
+		free(req->reply);
+		free(req);
+	}
+}
+
+void mpath_async_free(struct mpath_async *as)
+{
+	if (!as)
+		return;
+	free_reqs(as->waiting);
+	free_reqs(as->done);
+	free(as->reply);
+	free(as->out);
+	free(as);
+}
+
+static int async_fail(struct mpath_async *as, int err)
+{
+	as->error = err;
+	errno = err;
+	return -1;
+}
+
+static int async_send(struct mpath_async *as)
+{
+	ssize_t n;
+
+	while (as->out_pos < as->out_len) {
+		n = send(as->fd, as->out + as->out_pos,
+			 as->out_len - as->out_pos, MSG_NOSIGNAL|MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				return 0;
+			return async_fail(as, errno);
+		}
+		as->out_pos += n;
+	}
+	as->out_pos = as->out_len = 0;
+	return 0;
+}
+
+/* Make room for len more bytes of command data */
+static int out_reserve(struct mpath_async *as, size_t len)
+{
+	if (as->out_len + len > as->out_size) {
+		size_t size = as->out_size ? as->out_size : 4096;
+		char *tmp;
+
+		/* drop the data that has been sent already */
+		if (as->out_pos > 0) {
+			memmove(as->out, as->out + as->out_pos,
+				as->out_len - as->out_pos);
+			as->out_len -= as->out_pos;
+			as->out_pos = 0;
+		}
+		while (size < as->out_len + len)
+			size *= 2;
+		if (size > as->out_size) {
+			tmp = realloc(as->out, size);
+			if (!tmp)
+				return -1;
+			as->out = tmp;
+			as->out_size = size;
+		}
+	}
+	return 0;
+}
+
+/* Only after out_reserve() */
+static void out_append(struct mpath_async *as, const void *data, size_t len)
+{
+	memcpy(as->out + as->out_len, data, len);
+	as->out_len += len;
+}
+
+int mpath_async_submit(struct mpath_async *as, const char *cmd,
+		       unsigned int *id)
+{
+	struct mpath_async_req *req;
+	size_t len = strlen(cmd) + 1;
+
+	if (as->error) {
+		errno = as->error;
+		return -1;
+	}
+	req = calloc(1, sizeof(*req));
+	if (!req)
+		return -1;
+	/* reserve space first, so that no partial command is queued */
+	if (out_reserve(as, sizeof(len) + len) != 0) {
+		free(req);
+		return -1;
+	}
+	out_append(as, &len, sizeof(len));
+	out_append(as, cmd, len);
+	req->id = as->next_id++;
+	*as->waiting_tail = req;
+	as->waiting_tail = &req->next;
+	as->nr_reqs++;
+	*id = req->id;
+	return async_send(as);
+}
+
+short mpath_async_events(const struct mpath_async *as)
+{
+	short events = 0;
+
+	if (as->error)
+		return 0;
+	if (as->out_pos < as->out_len)
+		events |= POLLOUT;
+	if (as->waiting)
+		events |= POLLIN;
+	return events;
+}
+
+/* The reply for the oldest waiting request is complete */
+static void reply_done(struct mpath_async *as)
+{
+	struct mpath_async_req *req = as->waiting;
+
+	as->waiting = req->next;
+	if (!as->waiting)
+		as->waiting_tail = &as->waiting;
+	req->next = NULL;
+	req->reply = as->reply;
+	*as->done_tail = req;
+	as->done_tail = &req->next;
+	as->reply = NULL;
+	as->got = 0;
+}
+
+static int async_recv(struct mpath_async *as)
+{
+	ssize_t n;
+
+	while (as->waiting) {
+		if (!as->reply)
+			n = recv(as->fd, (char *)&as->reply_len + as->got,
+				 sizeof(as->reply_len) - as->got,
+				 MSG_DONTWAIT);
+		else
+			n = recv(as->fd, as->reply + as->got,
+				 as->reply_len - as->got, MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				return 0;
+			return async_fail(as, errno);
+		}
+		if (n == 0)
+			return async_fail(as, ECONNRESET);
+		as->got += n;
+
+		if (!as->reply) {
+			if (as->got < sizeof(as->reply_len))
+				continue;
+			/* chunked replies are never requested */
+			if (check_reply_len(as->reply_len) < 0)
+				return async_fail(as, ERANGE);
+			as->reply = malloc(as->reply_len);
+			if (!as->reply)
+				return async_fail(as, ENOMEM);
+			as->got = 0;
+		} else if (as->got == as->reply_len) {
+			as->reply[as->reply_len - 1] = '\0';
+			reply_done(as);
+		}
+	}
+	return 0;
+}
+
+int mpath_async_handle(struct mpath_async *as, short revents)
+{
+	struct mpath_async_req *req;
+	int n = 0;
+
+	if (!as->error && (revents & POLLOUT))
+		async_send(as);
+	if (!as->error && (revents & (POLLIN|POLLHUP|POLLERR)))
+		async_recv(as);
+	if (as->error) {
+		errno = as->error;
+		return -1;
+	}
+	for (req = as->done; req; req = req->next)
+		n++;
+	return n;
+}
+
+int mpath_async_reply(struct mpath_async *as, unsigned int *id,
+		      char **reply)
+{
+	struct mpath_async_req *req = as->done;
+
+	if (!req)
+		return 0;
+	as->done = req->next;
+	if (!as->done)
+		as->done_tail = &as->done;
+	*id = req->id;
+	*reply = req->reply;
+	free(req);
+	as->nr_reqs--;
+	return 1;
+}
+
+unsigned int mpath_async_pending(const struct mpath_async *as)
+{
+	return as->nr_reqs;
+}
@@ -14,6 +14,110 @@
  */
 #define MAX_REPLY_LEN (32 * 1024 * 1024)
 
+/*
+ * Chunked replies.
+ *
+ * A reply normally consists of its length (as size_t), followed by the
+ * NUL-terminated reply string. If a client sends the option string
+ * MPATH_CMD_OPT_CHUNKED after the NUL byte terminating the command,
+ * multipathd may instead send MPATH_REPLY_CHUNKED as the reply length,
+ * followed by any number of chunks, each consisting of its length and
+ * the data, which is not NUL-terminated. A chunk length of 0 ends the
+ * reply. Short replies are always sent in the normal format.
+ */
+#define MPATH_CMD_OPT_CHUNKED "chunked"
+#define MPATH_REPLY_CHUNKED ((size_t)-1)
+
+/*
+ * Binary record format, used by "show paths binary", "show maps binary"
+ * and "show map $map binary".
+ *
+ * The reply data is a sequence of records. All integers are big-endian.
+ *
+ *	record:	u32 length of the rest of the record
+ *		u8  record type (MPATH_REC_*)
+ *		fields
+ *	field:	u8  field id
+ *		u16 length of the value
+ *		value
+ *
+ * Values are strings without terminating NUL byte, with the same content
+ * as the respective values in the JSON output. Field ids depend on the
+ * record type. Ids are never reused or renumbered; consumers must skip
+ * record types and fields they don't know.
+ *
+ * Every reply starts with a MPATH_REC_HEADER record. For maps, each
+ * MPATH_REC_MAP record is followed by MPATH_REC_PATHGROUP records for its
+ * path groups, each of which is followed by the MPATH_REC_PATH records of
+ * the paths in that group. As the reply contains NUL bytes, it must be
+ * received with mpath_recv_reply_len() and mpath_recv_reply_data(), or
+ * with mpath_recv_reply_stream(). Error replies are text, and never start
+ * with a NUL byte, unlike binary replies.
+ */
+#define MPATH_REC_VERSION	1
+
+enum mpath_rec_type {
+	MPATH_REC_HEADER	= 1,
+	MPATH_REC_MAP		= 2,
+	MPATH_REC_PATHGROUP	= 3,
+	MPATH_REC_PATH		= 4,
+};
+
+enum mpath_header_field {
+	MPATH_HDR_VERSION	= 1,
+};
+
+enum mpath_map_field {
+	MPATH_MAP_NAME		= 1,
+	MPATH_MAP_UUID		= 2,
+	MPATH_MAP_SYSFS		= 3,
+	MPATH_MAP_FAILBACK	= 4,
+	MPATH_MAP_QUEUEING	= 5,
+	MPATH_MAP_PATHS		= 6,
+	MPATH_MAP_WRITE_PROT	= 7,
+	MPATH_MAP_DM_ST		= 8,
+	MPATH_MAP_FEATURES	= 9,
+	MPATH_MAP_HWHANDLER	= 10,
+	MPATH_MAP_ACTION	= 11,
+	MPATH_MAP_PATH_FAULTS	= 12,
+	MPATH_MAP_VEND		= 13,
+	MPATH_MAP_PROD		= 14,
+	MPATH_MAP_REV		= 15,
+	MPATH_MAP_SWITCH_GRP	= 16,
+	MPATH_MAP_MAP_LOADS	= 17,
+	MPATH_MAP_TOTAL_Q_TIME	= 18,
+	MPATH_MAP_Q_TIMEOUTS	= 19,
+	MPATH_MAP_SIZE		= 20,
+};
+
+enum mpath_pathgroup_field {
+	MPATH_PG_GROUP		= 1,
+	MPATH_PG_SELECTOR	= 2,
+	MPATH_PG_PRI		= 3,
+	MPATH_PG_DM_ST		= 4,
+	MPATH_PG_MARGINAL_ST	= 5,
+};
+
+enum mpath_path_field {
+	MPATH_PATH_DEV		= 1,
+	MPATH_PATH_DEV_T	= 2,
+	MPATH_PATH_DM_ST	= 3,
+	MPATH_PATH_DEV_ST	= 4,
+	MPATH_PATH_CHK_ST	= 5,
+	MPATH_PATH_CHECKER	= 6,
+	MPATH_PATH_PRI		= 7,
+	MPATH_PATH_HOST_WWNN	= 8,
+	MPATH_PATH_TARGET_WWNN	= 9,
+	MPATH_PATH_HOST_WWPN	= 10,
+	MPATH_PATH_TARGET_WWPN	= 11,
+	MPATH_PATH_HOST_ADAPTER	= 12,
+	MPATH_PATH_LUN_HEX	= 13,
+	MPATH_PATH_MARGINAL_ST	= 14,
+	MPATH_PATH_UUID		= 15,
+	MPATH_PATH_HCIL		= 16,
+	MPATH_PATH_MAP		= 17,
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -85,12 +189,28 @@ int mpath_process_cmd(int fd, const char *cmd, char **reply,
 int mpath_send_cmd(int fd, const char *cmd);
 
 
+/*
+ * DESCRIPTION:
+ *	Same as mpath_send_cmd(), but allow multipathd to send the reply in
+ *	chunks. This lets multipathd start sending large replies, like the
+ *	output of "show paths", before it has rendered all of it. The
+ *	reply must be received with mpath_recv_reply() or
+ *	mpath_recv_reply_stream(). Older multipathd versions ignore the
+ *	request and send a normal reply.
+ *
+ * RETURNS:
+ *	0 on success. -1 on failure (with errno set)
+ */
+int mpath_send_cmd_chunked(int fd, const char *cmd);
+
+
 /*
  * DESCRIPTION:
  *	Return a reply from multipathd for a previously sent command.
  *	This is equivalent to calling mpath_recv_reply_len(), allocating
  *	a buffer of the appropriate size, and then calling
- *	mpath_recv_reply_data() with that buffer.
+ *	mpath_recv_reply_data() with that buffer. Chunked replies (see
+ *	mpath_send_cmd_chunked()) are collected into a single buffer.
  *
  * RETURNS:
  *	0 on success, and reply will either be NULL (if there was no
@@ -104,6 +224,8 @@ int mpath_recv_reply(int fd, char **reply, unsigned int timeout);
  * DESCRIPTION:
  *	Return the size of the upcoming reply data from the sent multipath
  *	command. This must be called before calling mpath_recv_reply_data().
+ *	It can't be used for chunked replies, and fails with ERANGE if
+ *	it encounters one.
  *
  * RETURNS:
  *	The required size of the reply data buffer on success. -1 on
@@ -125,6 +247,174 @@ ssize_t mpath_recv_reply_len(int fd, unsigned int timeout);
 int mpath_recv_reply_data(int fd, char *reply, size_t len,
 			  unsigned int timeout);
 
+
+typedef int (*mpath_reply_fn)(const char *data, size_t len, void *arg);
+
+/*
+ * DESCRIPTION:
+ *	Receive the reply for a previously sent command incrementally,
+ *	without buffering all of it. fn is called with arg for every piece
+ *	of reply data as it is received. The data passed to fn is not
+ *	NUL-terminated, and is only valid during the call. Both normal and
+ *	chunked replies are handled. timeout applies to receiving each
+ *	piece of data, not to the entire reply.
+ *
+ * RETURNS:
+ *	0 on success. -1 on failure (with errno set). If fn returns a
+ *	non-zero value, no more data is read, and that value is returned.
+ *	The connection can't be used for further commands in that case.
+ */
+int mpath_recv_reply_stream(int fd, mpath_reply_fn fn, void *arg,
+			    unsigned int timeout);
+
+
+
+/*
+ * DESCRIPTION:
+ *	Subscribe to multipathd events. After this, the connection can
+ *	only be used for receiving events with mpath_recv_events(). Sending
+ *	anything else, or closing the connection, ends the subscription.
+ *
+ * RETURNS:
+ *	0 on success. -1 on failure (with errno set). If multipathd rejects
+ *	the command, errno is set to EPROTO.
+ */
+int mpath_subscribe_events(int fd, unsigned int timeout);
+
+
+/*
+ * DESCRIPTION:
+ *	Wait for events after mpath_subscribe_events(). Events are returned
+ *	in batches of one or more lines of the form "<seq> <event> <args>",
+ *	where seq is an increasing sequence number. Events are:
+ *
+ *	path <dev> <devt> <map> <state>	path state changed
+ *	switchgroup <map> <pg>		path group switched
+ *	pathgroup <map> <pg> <state>	path group state changed
+ *	add_map <map>			map added
+ *	remove_map <map>		map removed
+ *	reload <map>			map reloaded
+ *	queueing <map> on|off		queue_if_no_path changed
+ *	lost <count>			events were dropped because the
+ *					client didn't read them quickly
+ *					enough
+ *
+ * RETURNS:
+ *	0 on success, and events will point to a string with the events,
+ *	which must be freed by the caller. -1 on failure (with errno set),
+ *	in particular ETIMEDOUT if no events arrived within timeout.
+ */
+int mpath_recv_events(int fd, char **events, unsigned int timeout);
+
+
+/*
+ * Asynchronous, pipelined command processing.
+ *
+ * multipathd processes the commands sent on a connection one after the
+ * other, and sends the replies in the same order. The functions below
+ * let a client submit several commands without waiting for the replies
+ * in between, and drive the connection from its own poll loop. All I/O
+ * is non-blocking. A connection used like this must not be used with
+ * the blocking functions above at the same time, and can't be used for
+ * "subscribe events".
+ *
+ * Typical use:
+ *
+ *	as = mpath_async_new(fd);
+ *	mpath_async_submit(as, "show map mpatha json", &id1);
+ *	mpath_async_submit(as, "show map mpathb json", &id2);
+ *	while (mpath_async_pending(as) > 0) {
+ *		pfd.fd = fd;
+ *		pfd.events = mpath_async_events(as);
+ *		poll(&pfd, 1, timeout);
+ *		if (mpath_async_handle(as, pfd.revents) < 0)
+ *			break;
+ *		while (mpath_async_reply(as, &id, &reply) == 1)
+ *			...
+ *	}
+ *	mpath_async_free(as);
+ */
+struct mpath_async;
+
+
+/*
+ * DESCRIPTION:
+ *	Create a context for asynchronous command processing on fd, which
+ *	must have been returned by mpath_connect(). The file descriptor is
+ *	not closed by mpath_async_free().
+ *
+ * RETURNS:
+ *	A pointer to the context on success. NULL on failure (with errno
+ *	set).
+ */
+struct mpath_async *mpath_async_new(int fd);
+
+
+/*
+ * DESCRIPTION:
+ *	Free a context created with mpath_async_new(), including all
+ *	replies which haven't been collected yet.
+ */
+void mpath_async_free(struct mpath_async *as);
+
+
+/*
+ * DESCRIPTION:
+ *	Queue a command for sending, and send as much of the queued data
+ *	as possible without blocking. id is set to a number identifying
+ *	the request, which is returned with the reply by
+ *	mpath_async_reply(). Ids are assigned in increasing order.
+ *
+ * RETURNS:
+ *	0 on success. -1 on failure (with errno set).
+ */
+int mpath_async_submit(struct mpath_async *as, const char *cmd,
+		       unsigned int *id);
+
+
+/*
+ * DESCRIPTION:
+ *	Return the poll events to wait for on the connection: POLLOUT while
+ *	command data remains to be sent, POLLIN while replies are
+ *	outstanding.
+ */
+short mpath_async_events(const struct mpath_async *as);
+
+
+/*
+ * DESCRIPTION:
+ *	Send and receive as much data as possible without blocking, after
+ *	poll() has returned revents for the connection.
+ *
+ * RETURNS:
+ *	The number of replies which are ready to be collected with
+ *	mpath_async_reply(). -1 on failure (with errno set). After a failure,
+ *	no more replies will be received; replies which have been received
+ *	before can still be collected.
+ */
+int mpath_async_handle(struct mpath_async *as, short revents);
+
+
+/*
+ * DESCRIPTION:
+ *	Collect the oldest received reply. reply points to the reply string,
+ *	which must be freed by the caller, and id is set to the id of the
+ *	request it belongs to.
+ *
+ * RETURNS:
+ *	1 if a reply was returned, 0 if no reply is ready.
+ */
+int mpath_async_reply(struct mpath_async *as, unsigned int *id,
+		      char **reply);
+
+
+/*
+ * DESCRIPTION:
+ *	Return the number of submitted requests whose replies haven't been
+ *	collected yet.
+ */
+unsigned int mpath_async_pending(const struct mpath_async *as);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,6 +8,7 @@
 
 #include "mpath_persist.h"
 #include "mpath_persist_int.h"
+#include "mpath_pr_pool.h"
 
 extern struct udev *udev;
 
@@ -26,7 +27,7 @@ int libmpathpersist_init(void)
 		condlog(0, "Failed to initialize libmultipath.");
 		return 1;
 	}
-	if (init_config(DEFAULT_CONFIGFILE)) {
+	if (init_config_cached(DEFAULT_CONFIGFILE)) {
 		condlog(0, "Failed to initialize multipath config.");
 		return 1;
 	}
@@ -52,6 +53,7 @@ mpath_lib_init (void)
 
 static void libmpathpersist_cleanup(void)
 {
+	pr_pool_exit();
 	libmultipath_exit();
 	dm_lib_exit();
 }
@@ -142,6 +144,13 @@ extern int __mpath_persistent_reserve_out(int, int, int, unsigned int,
 					  struct prout_param_descriptor *, int)
 	__attribute__((weak, alias("mpath_persistent_reserve_out__")));
 
+int mpath_persistent_reserve_out_batch__(struct mpath_prout_req *reqs,
+					 unsigned int nr_reqs, int noisy)
+{
+	return do_mpath_persistent_reserve_out_batch(curmp, pathvec, reqs,
+						     nr_reqs, noisy);
+}
+
 int mpath_persistent_reserve_in (int fd, int rq_servact,
 	struct prin_resp *resp, int noisy, int verbose)
 {
@@ -171,3 +180,19 @@ int mpath_persistent_reserve_out ( int fd, int rq_servact, int rq_scope,
 	mpath_persistent_reserve_free_vecs__(curmp, pathvec);
 	return ret;
 }
+
+int mpath_persistent_reserve_out_batch(struct mpath_prout_req *reqs,
+				       unsigned int nr_reqs,
+				       int noisy, int verbose)
+{
+	vector curmp = NULL, pathvec;
+	int ret = mpath_persistent_reserve_init_vecs__(&curmp, &pathvec,
+						       verbose);
+
+	if (ret != MPATH_PR_SUCCESS)
+		return ret;
+	ret = do_mpath_persistent_reserve_out_batch(curmp, pathvec, reqs,
+						    nr_reqs, noisy);
+	mpath_persistent_reserve_free_vecs__(curmp, pathvec);
+	return ret;
+}
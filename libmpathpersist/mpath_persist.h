@@ -171,6 +171,15 @@ struct prout_param_descriptor {		/* PROUT parameter descriptor */
 	struct transportid *trnptid_list[];
 };
 
+struct mpath_prout_req {		/* request for mpath_persistent_reserve_out_batch() */
+	int fd;				/* file descriptor of the multipath device */
+	int rq_servact;
+	int rq_scope;
+	unsigned int rq_type;
+	struct prout_param_descriptor *paramp;
+	int status;			/* output: result of this request */
+};
+
 
 /* Function declarations */
 
@@ -301,11 +310,51 @@ int mpath_persistent_reserve_out__(int fd, int rq_servact, int rq_scope,
 				   struct prout_param_descriptor *paramp,
 				   int noisy);
 
+/*
+ * DESCRIPTION :
+ * This function sends PROUT commands to several DM devices at once, e.g. to
+ * register a key on all multipath devices of a host. The commands for
+ * the different devices and their paths are sent concurrently by a bounded
+ * number of worker threads.
+ *
+ * @reqs: Array of requests. For each request, fd, rq_servact, rq_scope,
+ *	rq_type and paramp have the same meaning as the respective arguments
+ *	of mpath_persistent_reserve_out(). The result of each request is
+ *	stored in its status field. Input/Output argument.
+ * @nr_reqs: Number of elements in reqs. Input argument.
+ * @noisy: Turn on debugging trace: Input argument.0->Disable, 1->Enable.
+ * @verbose: Set verbosity level. Input argument. value:0 to 3. 0->disabled, 3->Max verbose
+ *
+ * RESTRICTIONS:
+ * Every request must refer to a different multipath device, and use its
+ * own paramp. Requests for a device that already occurs earlier in the
+ * array fail with MPATH_PR_SYNTAX_ERROR.
+ *
+ * RETURNS: MPATH_PR_SUCCESS if all PR commands were successful, else the
+ *	status of the first failed request.
+ */
+int mpath_persistent_reserve_out_batch(struct mpath_prout_req *reqs,
+				       unsigned int nr_reqs,
+				       int noisy, int verbose);
+
+/*
+ * DESCRIPTION :
+ * This function is like mpath_persistent_reserve_out_batch(), except that it
+ * requires mpath_persistent_reserve_init_vecs() to be called before the
+ * PR call to set up internal variables. These must later be cleanup up
+ * by calling mpath_persistent_reserve_free_vecs().
+ *
+ * RESTRICTIONS:
+ * This function uses static internal variables, and is not thread-safe.
+ */
+int mpath_persistent_reserve_out_batch__(struct mpath_prout_req *reqs,
+					 unsigned int nr_reqs, int noisy);
+
 /*
  * DESCRIPTION :
  * This function allocates data structures and performs basic initialization and
- * device discovery for later calls of mpath_persistent_reserve_in__() or
- * mpath_persistent_reserve_out__().
+ * device discovery for later calls of mpath_persistent_reserve_in__(),
+ * mpath_persistent_reserve_out__() or mpath_persistent_reserve_out_batch__().
  * @verbose: Set verbosity level. Input argument. value:0 to 3. 0->disabled, 3->Max verbose
  *
  * RESTRICTIONS:
@@ -32,6 +32,7 @@
 #include "mpath_persist_int.h"
 #include "mpathpr.h"
 #include "mpath_pr_ioctl.h"
+#include "mpath_pr_pool.h"
 
 struct prout_param {
 	char dev[FILE_NAME_SIZE];
@@ -43,9 +44,9 @@ struct prout_param {
 	int status;
 };
 
-struct threadinfo {
-	int status;
-	pthread_t id;
+struct prout_task {
+	struct pr_task task;
+	bool pending;
 	struct prout_param param;
 };
 
@@ -177,6 +178,14 @@ int do_mpath_persistent_reserve_in(vector curmp, vector pathvec,
 	if (ret != MPATH_PR_SUCCESS)
 		return ret;
 
+	/*
+	 * Try multipathd's cached state first, unless debugging output
+	 * of the actual SCSI command is requested.
+	 */
+	if (!noisy &&
+	    get_prin_cached(mpp->alias, rq_servact, resp) == MPATH_PR_SUCCESS)
+		return MPATH_PR_SUCCESS;
+
 	ret = get_path_info(mpp, pathvec);
 	if (ret != MPATH_PR_SUCCESS)
 		return ret;
@@ -186,15 +195,35 @@ int do_mpath_persistent_reserve_in(vector curmp, vector pathvec,
 	return ret;
 }
 
-static void *mpath_prout_pthread_fn(void *p)
+static void mpath_prout_task_fn(struct pr_task *task)
 {
-	int ret;
-	struct prout_param * param = (struct prout_param *)p;
+	struct prout_param *param =
+		&container_of(task, struct prout_task, task)->param;
+
+	param->status = prout_do_scsi_ioctl(param->dev, param->rq_servact,
+					    param->rq_scope, param->rq_type,
+					    param->paramp, param->noisy);
+}
 
-	ret = prout_do_scsi_ioctl( param->dev,param->rq_servact, param->rq_scope,
-			param->rq_type, param->paramp, param->noisy);
-	param->status = ret;
-	pthread_exit(NULL);
+/*
+ * Run the PR OUT commands of all pending tasks in the path worker pool,
+ * and wait for them to complete.
+ */
+static void run_prout_tasks(struct prout_task *tasks, int count)
+{
+	struct pr_batch batch;
+	int i;
+
+	pr_batch_init(&batch);
+	for (i = 0; i < count; i++) {
+		if (!tasks[i].pending)
+			continue;
+		tasks[i].pending = false;
+		tasks[i].task.fn = mpath_prout_task_fn;
+		pr_pool_submit(PR_POOL_PATH, &batch, &tasks[i].task);
+	}
+	pr_batch_wait(&batch);
+	pr_batch_destroy(&batch);
 }
 
 static int
@@ -353,7 +382,7 @@ void preempt_missing_path(struct multipath *mpp, uint8_t *key, uint8_t *sa_key,
  * the path is still usable. If it is, we must fail the registration.
  */
 static int
-check_failed_paths(struct multipath *mpp, struct threadinfo *thread, int count)
+check_failed_paths(struct multipath *mpp, struct prout_task *thread, int count)
 {
 	int i, j, k;
 	int ret;
@@ -399,7 +428,6 @@ static int mpath_prout_reg(struct multipath *mpp,int rq_servact, int rq_scope,
 	bool need_retry = false;
 	bool retryable_error = false;
 	int active_pathcount=0;
-	int rc;
 	int count=0;
 	int status = MPATH_PR_SUCCESS;
 	int all_tg_pt;
@@ -416,7 +444,7 @@ static int mpath_prout_reg(struct multipath *mpp,int rq_servact, int rq_scope,
 		return MPATH_PR_DMMP_ERROR;
 	}
 
-	struct threadinfo thread[active_pathcount];
+	struct prout_task thread[active_pathcount];
 	int hosts[active_pathcount];
 
 	memset(thread, 0, sizeof(thread));
@@ -442,10 +470,6 @@ static int mpath_prout_reg(struct multipath *mpp,int rq_servact, int rq_scope,
 		condlog (3, "status=%d ", thread[i].param.status);
 	}
 
-	pthread_attr_t attr;
-	pthread_attr_init(&attr);
-	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-
 	vector_foreach_slot (mpp->pg, pgp, j){
 		vector_foreach_slot (pgp->paths, pp, i){
 			if (!((pp->state == PATH_UP) || (pp->state == PATH_GHOST))){
@@ -465,33 +489,24 @@ static int mpath_prout_reg(struct multipath *mpp,int rq_servact, int rq_scope,
 			}
 			strlcpy(thread[count].param.dev, pp->dev,
 				FILE_NAME_SIZE);
-
-			if (count && (thread[count].param.paramp->sa_flags & MPATH_F_SPEC_I_PT_MASK)){
-				/*
-				 * Clearing SPEC_I_PT as transportids are already registered by now.
-				 */
-				thread[count].param.paramp->sa_flags &= (~MPATH_F_SPEC_I_PT_MASK);
-			}
-
 			condlog (3, "%s: sending pr out command to %s", mpp->wwid, pp->dev);
-
-			rc = pthread_create(&thread[count].id, &attr, mpath_prout_pthread_fn, (void *)(&thread[count].param));
-			if (rc){
-				condlog (0, "%s: failed to create thread %d", mpp->wwid, rc);
-				thread[count].param.status = MPATH_PR_THREAD_ERROR;
-			}
-			else
-				hosts[count] = pp->sg_id.host_no;
+			thread[count].pending = true;
+			hosts[count] = pp->sg_id.host_no;
 			count = count + 1;
 		}
 	}
+	if (count && (paramp->sa_flags & MPATH_F_SPEC_I_PT_MASK)) {
+		/*
+		 * Register the transportids through the first path, then
+		 * clear SPEC_I_PT for the others, as they are already
+		 * registered by then.
+		 */
+		run_prout_tasks(thread, 1);
+		paramp->sa_flags &= (~MPATH_F_SPEC_I_PT_MASK);
+	}
+	run_prout_tasks(thread, count);
+
 	for( i=0; i < count ; i++){
-		if (thread[i].param.status != MPATH_PR_THREAD_ERROR) {
-			rc = pthread_join(thread[i].id, NULL);
-			if (rc){
-				condlog (0, "%s: Thread[%d] failed to join thread %d", mpp->wwid, i, rc);
-			}
-		}
 		/*
 		 * We only retry if there is at least one registration that
 		 * returned a reservation conflict (which we need to retry)
@@ -526,25 +541,12 @@ static int mpath_prout_reg(struct multipath *mpp,int rq_servact, int rq_scope,
 			 * succeeded using MPATH_PROUT_REG_SA.
 			 */
 			thread[i].param.rq_servact = MPATH_PROUT_REG_IGN_SA;
-			rc = pthread_create(&thread[i].id, &attr,
-					    mpath_prout_pthread_fn,
-					    (void *)(&thread[i].param));
-			if (rc) {
-				condlog(0, "%s: failed to create thread for retry. %d",
-					mpp->wwid, rc);
-				thread[i].param.status = MPATH_PR_THREAD_ERROR;
-			}
+			thread[i].pending = true;
 		}
+		run_prout_tasks(thread, count);
 		for (i = 0; i < count; i++) {
 			if (thread[i].param.status == MPATH_PR_SKIP)
 				continue;
-			if (thread[i].param.status != MPATH_PR_THREAD_ERROR) {
-				rc = pthread_join(thread[i].id, NULL);
-				if (rc) {
-					condlog(3, "%s: failed to join thread while retrying %d",
-						mpp->wwid, i);
-				}
-			}
 			if (thread[i].param.status == MPATH_PR_RETRYABLE_ERROR)
 				retryable_error = true;
 			else if (status == MPATH_PR_SUCCESS)
@@ -553,7 +555,6 @@ static int mpath_prout_reg(struct multipath *mpp,int rq_servact, int rq_scope,
 		need_retry = false;
 	}
 
-	pthread_attr_destroy(&attr);
 	if (need_retry)
 		return MPATH_PR_RESERV_CONFLICT;
 	if (status != MPATH_PR_SUCCESS)
@@ -699,8 +700,6 @@ mpath_prout_rel(struct multipath *mpp, int rq_servact, int rq_scope,
 	struct pathgroup *pgp = NULL;
 	struct path *pp = NULL;
 	int active_pathcount = 0;
-	pthread_attr_t attr;
-	int rc;
 	int count = 0;
 	int status = MPATH_PR_SUCCESS;
 	bool all_threads_failed;
@@ -716,7 +715,7 @@ mpath_prout_rel(struct multipath *mpp, int rq_servact, int rq_scope,
 		return MPATH_PR_DMMP_ERROR;
 	}
 
-	struct threadinfo thread[active_pathcount];
+	struct prout_task thread[active_pathcount];
 	memset(thread, 0, sizeof(thread));
 	for (i = 0; i < active_pathcount; i++){
 		thread[i].param.rq_servact = rq_servact;
@@ -734,9 +733,6 @@ mpath_prout_rel(struct multipath *mpp, int rq_servact, int rq_scope,
 		condlog (3, "status=%d ", thread[i].param.status);
 	}
 
-	pthread_attr_init (&attr);
-	pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_JOINABLE);
-
 	vector_foreach_slot (mpp->pg, pgp, j){
 		vector_foreach_slot (pgp->paths, pp, i){
 			if (!((pp->state == PATH_UP) || (pp->state == PATH_GHOST))){
@@ -748,24 +744,11 @@ mpath_prout_rel(struct multipath *mpp, int rq_servact, int rq_scope,
 			strlcpy(thread[count].param.dev, pp->dev,
 				FILE_NAME_SIZE);
 			condlog (3, "%s: sending pr out command to %s", mpp->wwid, pp->dev);
-			rc = pthread_create (&thread[count].id, &attr, mpath_prout_pthread_fn,
-					(void *) (&thread[count].param));
-			if (rc) {
-				condlog (0, "%s: failed to create thread. %d",  mpp->wwid, rc);
-				thread[count].param.status = MPATH_PR_THREAD_ERROR;
-			}
+			thread[count].pending = true;
 			count = count + 1;
 		}
 	}
-	pthread_attr_destroy (&attr);
-	for (i = 0; i < count; i++){
-		if (thread[i].param.status != MPATH_PR_THREAD_ERROR) {
-			rc = pthread_join (thread[i].id, NULL);
-			if (rc){
-				condlog (1, "%s: failed to join thread.  %d",  mpp->wwid,  rc);
-			}
-		}
-	}
+	run_prout_tasks(thread, count);
 
 	all_threads_failed = true;
 	for (i = 0; i < count; i++){
@@ -829,37 +812,49 @@ static void set_ignored_key(struct multipath *mpp, uint8_t *curr_key, uint8_t *k
 	memcpy(key, curr_key, 8);
 }
 
-int do_mpath_persistent_reserve_out(vector curmp, vector pathvec, int fd,
-				    int rq_servact, int rq_scope, unsigned int rq_type,
-				    struct prout_param_descriptor *paramp, int noisy)
-{
+/* State of a PR OUT request between prout_prepare() and prout_execute() */
+struct prout_ctx {
 	struct multipath *mpp;
+	int rq_servact;
+	int rq_scope;
+	unsigned int rq_type;
+	struct prout_param_descriptor *paramp;
+	int noisy;
+	struct be64 oldkey;
+	bool unregistering;
+	bool updated_prkey;
+};
+
+/*
+ * Check the request against the configured reservation key, update the
+ * key in multipathd if necessary, and read the path information of the map.
+ * This must not run concurrently with other requests, as it modifies
+ * pathvec.
+ */
+static int prout_prepare(struct prout_ctx *ctx, vector pathvec)
+{
+	struct multipath *mpp = ctx->mpp;
+	struct prout_param_descriptor *paramp = ctx->paramp;
+	int rq_servact = ctx->rq_servact;
 	int ret;
 	uint64_t zerokey = 0;
-	struct be64 oldkey = {0};
 	struct config *conf;
-	bool unregistering, preempting_reservation = false;
-	bool updated_prkey = false;
-	bool failed_paths = false;
-
-	ret = mpath_get_map(curmp, fd, &mpp);
-	if (ret != MPATH_PR_SUCCESS)
-		return ret;
 
 	conf = get_multipath_config();
 	mpp->mpe = find_mpe(conf->mptable, mpp->wwid);
 	select_reservation_key(conf, mpp);
 	put_multipath_config(conf);
 
-	oldkey = mpp->reservation_key;
-	unregistering = (memcmp(&zerokey, paramp->sa_key, 8) == 0);
+	ctx->oldkey = mpp->reservation_key;
+	ctx->unregistering = (memcmp(&zerokey, paramp->sa_key, 8) == 0);
+	ctx->updated_prkey = false;
 	if (mpp->prkey_source == PRKEY_SOURCE_FILE &&
 	    (rq_servact == MPATH_PROUT_REG_IGN_SA ||
 	     (rq_servact == MPATH_PROUT_REG_SA &&
 	      (!get_be64(mpp->reservation_key) ||
 	       memcmp(paramp->key, &zerokey, 8) == 0 ||
 	       memcmp(paramp->key, &mpp->reservation_key, 8) == 0)))) {
-		updated_prkey = true;
+		ctx->updated_prkey = true;
 		memcpy(&mpp->reservation_key, paramp->sa_key, 8);
 		if (update_prkey_flags(mpp->alias, get_be64(mpp->reservation_key),
 				       paramp->sa_flags)) {
@@ -881,11 +876,11 @@ int do_mpath_persistent_reserve_out(vector curmp, vector pathvec, int fd,
 	 */
 	if ((rq_servact == MPATH_PROUT_REG_IGN_SA ||
 	     rq_servact == MPATH_PROUT_REG_SA)) {
-		if (!unregistering && !get_be64(mpp->reservation_key)) {
+		if (!ctx->unregistering && !get_be64(mpp->reservation_key)) {
 			condlog(0, "%s: no configured reservation key", mpp->alias);
 			return MPATH_PR_SYNTAX_ERROR;
 		}
-		if (!unregistering &&
+		if (!ctx->unregistering &&
 		    memcmp(paramp->sa_key, &mpp->reservation_key, 8)) {
 			condlog(0, "%s: configured reservation key doesn't match: 0x%" PRIx64,
 				mpp->alias, get_be64(mpp->reservation_key));
@@ -905,8 +900,8 @@ int do_mpath_persistent_reserve_out(vector curmp, vector pathvec, int fd,
 
 	ret = get_path_info(mpp, pathvec);
 	if (ret != MPATH_PR_SUCCESS) {
-		if (updated_prkey)
-			update_prkey_flags(mpp->alias, get_be64(oldkey),
+		if (ctx->updated_prkey)
+			update_prkey_flags(mpp->alias, get_be64(ctx->oldkey),
 					   mpp->sa_flags);
 		return ret;
 	}
@@ -920,19 +915,39 @@ int do_mpath_persistent_reserve_out(vector curmp, vector pathvec, int fd,
 	 */
 	select_skip_kpartx(conf, mpp);
 	put_multipath_config(conf);
+	return MPATH_PR_SUCCESS;
+}
+
+/*
+ * Send the PR OUT commands for a prepared request. This only touches
+ * the map and its paths, so it may run concurrently for different maps.
+ */
+static int prout_execute(struct prout_ctx *ctx)
+{
+	struct multipath *mpp = ctx->mpp;
+	struct prout_param_descriptor *paramp = ctx->paramp;
+	int rq_servact = ctx->rq_servact;
+	int rq_scope = ctx->rq_scope;
+	unsigned int rq_type = ctx->rq_type;
+	int noisy = ctx->noisy;
+	int ret;
+	uint64_t zerokey = 0;
+	bool unregistering = ctx->unregistering;
+	bool preempting_reservation = false;
+	bool failed_paths = false;
 
 	if (rq_servact == MPATH_PROUT_REG_IGN_SA)
-		set_ignored_key(mpp, (uint8_t *)&oldkey, paramp->key);
+		set_ignored_key(mpp, (uint8_t *)&ctx->oldkey, paramp->key);
 
 	switch(rq_servact)
 	{
 	case MPATH_PROUT_REG_SA:
 	case MPATH_PROUT_REG_IGN_SA:
 		if (unregistering &&
-		    check_holding_reservation(mpp, (uint8_t *)&oldkey, &rq_type)) {
+		    check_holding_reservation(mpp, (uint8_t *)&ctx->oldkey, &rq_type)) {
 			struct be64 newkey = mpp->reservation_key;
 			/* temporarily restore reservation key */
-			mpp->reservation_key = oldkey;
+			mpp->reservation_key = ctx->oldkey;
 			ret = mpath_prout_rel(mpp, MPATH_PROUT_REL_SA, rq_scope,
 					      rq_type, paramp, noisy, true);
 			mpp->reservation_key = newkey;
@@ -990,9 +1005,16 @@ int do_mpath_persistent_reserve_out(vector curmp, vector pathvec, int fd,
 		return MPATH_PR_OTHER;
 	}
 
+	/*
+	 * Even a failed command may have changed the PR state through
+	 * some paths. Don't let multipathd serve stale keys, e.g. a key
+	 * that has just been preempted.
+	 */
+	invalidate_prin_cache(mpp->alias);
+
 	if (ret != MPATH_PR_SUCCESS) {
-		if (updated_prkey)
-			update_prkey_flags(mpp->alias, get_be64(oldkey),
+		if (ctx->updated_prkey)
+			update_prkey_flags(mpp->alias, get_be64(ctx->oldkey),
 					   mpp->sa_flags);
 		return ret;
 	}
@@ -1021,3 +1043,106 @@ int do_mpath_persistent_reserve_out(vector curmp, vector pathvec, int fd,
 	}
 	return ret;
 }
+
+int do_mpath_persistent_reserve_out(vector curmp, vector pathvec, int fd,
+				    int rq_servact, int rq_scope, unsigned int rq_type,
+				    struct prout_param_descriptor *paramp, int noisy)
+{
+	struct prout_ctx ctx = {
+		.rq_servact = rq_servact,
+		.rq_scope = rq_scope,
+		.rq_type = rq_type,
+		.paramp = paramp,
+		.noisy = noisy,
+	};
+	int ret;
+
+	ret = mpath_get_map(curmp, fd, &ctx.mpp);
+	if (ret != MPATH_PR_SUCCESS)
+		return ret;
+
+	ret = prout_prepare(&ctx, pathvec);
+	if (ret != MPATH_PR_SUCCESS)
+		return ret;
+
+	return prout_execute(&ctx);
+}
+
+struct prout_batch_task {
+	struct pr_task task;
+	struct prout_ctx ctx;
+	struct mpath_prout_req *req;
+};
+
+static void prout_batch_task_fn(struct pr_task *task)
+{
+	struct prout_batch_task *bt =
+		container_of(task, struct prout_batch_task, task);
+
+	bt->req->status = prout_execute(&bt->ctx);
+}
+
+int do_mpath_persistent_reserve_out_batch(vector curmp, vector pathvec,
+					  struct mpath_prout_req *reqs,
+					  unsigned int nr_reqs, int noisy)
+{
+	struct prout_batch_task *tasks;
+	struct pr_batch batch;
+	unsigned int i, k;
+	int ret = MPATH_PR_SUCCESS;
+
+	if (!nr_reqs)
+		return MPATH_PR_SUCCESS;
+	tasks = calloc(nr_reqs, sizeof(*tasks));
+	if (!tasks)
+		return MPATH_PR_OTHER;
+
+	/*
+	 * Preparing a request modifies pathvec, so do it serially here.
+	 * Only the PR commands are sent concurrently.
+	 */
+	for (i = 0; i < nr_reqs; i++) {
+		struct prout_ctx *ctx = &tasks[i].ctx;
+
+		tasks[i].req = &reqs[i];
+		ctx->rq_servact = reqs[i].rq_servact;
+		ctx->rq_scope = reqs[i].rq_scope;
+		ctx->rq_type = reqs[i].rq_type;
+		ctx->paramp = reqs[i].paramp;
+		ctx->noisy = noisy;
+
+		reqs[i].status = mpath_get_map(curmp, reqs[i].fd, &ctx->mpp);
+		if (reqs[i].status != MPATH_PR_SUCCESS)
+			continue;
+		for (k = 0; k < i; k++) {
+			if (tasks[k].ctx.mpp == ctx->mpp)
+				break;
+		}
+		if (k < i) {
+			condlog(0, "%s: more than one request for this map in batch",
+				ctx->mpp->alias);
+			reqs[i].status = MPATH_PR_SYNTAX_ERROR;
+			continue;
+		}
+		reqs[i].status = prout_prepare(ctx, pathvec);
+	}
+
+	pr_batch_init(&batch);
+	for (i = 0; i < nr_reqs; i++) {
+		if (reqs[i].status != MPATH_PR_SUCCESS)
+			continue;
+		tasks[i].task.fn = prout_batch_task_fn;
+		pr_pool_submit(PR_POOL_MAP, &batch, &tasks[i].task);
+	}
+	pr_batch_wait(&batch);
+	pr_batch_destroy(&batch);
+
+	for (i = 0; i < nr_reqs; i++) {
+		if (reqs[i].status != MPATH_PR_SUCCESS) {
+			ret = reqs[i].status;
+			break;
+		}
+	}
+	free(tasks);
+	return ret;
+}
@@ -15,6 +15,9 @@ int do_mpath_persistent_reserve_out(vector curmp, vector pathvec, int fd,
 				    unsigned int rq_type,
 				    struct prout_param_descriptor *paramp,
 				    int noisy);
+int do_mpath_persistent_reserve_out_batch(vector curmp, vector pathvec,
+					  struct mpath_prout_req *reqs,
+					  unsigned int nr_reqs, int noisy);
 int prin_do_scsi_ioctl(char * dev, int rq_servact, struct prin_resp * resp, int noisy);
 int prout_do_scsi_ioctl( char * dev, int rq_servact, int rq_scope,
 			 unsigned int rq_type, struct prout_param_descriptor *paramp, int noisy);
@@ -0,0 +1,167 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "list.h"
+#include "debug.h"
+#include "mpath_pr_pool.h"
+
+/*
+ * Limits for the number of worker threads. A PR command takes a few
+ * milliseconds at most on a healthy path, so a handful of threads is
+ * sufficient even if hundreds of maps are registered at once, while
+ * keeping the number of threads independent of the number of paths.
+ */
+#define PR_PATH_WORKERS		32
+#define PR_MAP_WORKERS		8
+#define PR_MAX_WORKERS		32
+
+struct pr_pool {
+	const char *name;
+	unsigned int max_workers;
+	unsigned int nr_workers;
+	unsigned int nr_idle;
+	unsigned int nr_queued;
+	bool exiting;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct list_head queue;
+	pthread_t threads[PR_MAX_WORKERS];
+};
+
+static struct pr_pool pr_pools[__PR_POOL_MAX] = {
+	[PR_POOL_PATH] = {
+		.name = "path",
+		.max_workers = PR_PATH_WORKERS,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+		.queue = LIST_HEAD_INIT(pr_pools[PR_POOL_PATH].queue),
+	},
+	[PR_POOL_MAP] = {
+		.name = "map",
+		.max_workers = PR_MAP_WORKERS,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+		.queue = LIST_HEAD_INIT(pr_pools[PR_POOL_MAP].queue),
+	},
+};
+
+void pr_batch_init(struct pr_batch *batch)
+{
+	pthread_mutex_init(&batch->lock, NULL);
+	pthread_cond_init(&batch->cond, NULL);
+	batch->pending = 0;
+}
+
+void pr_batch_destroy(struct pr_batch *batch)
+{
+	pthread_cond_destroy(&batch->cond);
+	pthread_mutex_destroy(&batch->lock);
+}
+
+void pr_batch_wait(struct pr_batch *batch)
+{
+	pthread_mutex_lock(&batch->lock);
+	while (batch->pending > 0)
+		pthread_cond_wait(&batch->cond, &batch->lock);
+	pthread_mutex_unlock(&batch->lock);
+}
+
+/* The task must not be touched after this returns */
+static void pr_task_run(struct pr_task *task)
+{
+	struct pr_batch *batch = task->batch;
+
+	task->fn(task);
+	pthread_mutex_lock(&batch->lock);
+	if (--batch->pending == 0)
+		pthread_cond_broadcast(&batch->cond);
+	pthread_mutex_unlock(&batch->lock);
+}
+
+static void *pr_pool_worker(void *arg)
+{
+	struct pr_pool *pool = arg;
+	struct pr_task *task;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (list_empty(&pool->queue) && !pool->exiting) {
+			pool->nr_idle++;
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			pool->nr_idle--;
+		}
+		task = list_pop_entry(&pool->queue, struct pr_task, node);
+		if (!task)
+			break;
+		pool->nr_queued--;
+		pthread_mutex_unlock(&pool->lock);
+		pr_task_run(task);
+		pthread_mutex_lock(&pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+void pr_pool_submit(enum pr_pool_id id, struct pr_batch *batch,
+		    struct pr_task *task)
+{
+	struct pr_pool *pool = &pr_pools[id];
+	int rc;
+
+	task->batch = batch;
+	pthread_mutex_lock(&batch->lock);
+	batch->pending++;
+	pthread_mutex_unlock(&batch->lock);
+
+	pthread_mutex_lock(&pool->lock);
+	if (!pool->exiting) {
+		if (pool->nr_queued >= pool->nr_idle &&
+		    pool->nr_workers < pool->max_workers) {
+			rc = pthread_create(&pool->threads[pool->nr_workers],
+					    NULL, pr_pool_worker, pool);
+			if (rc)
+				condlog(1, "failed to create %s pool worker: %d",
+					pool->name, rc);
+			else
+				pool->nr_workers++;
+		}
+		if (pool->nr_workers > 0) {
+			list_add_tail(&task->node, &pool->queue);
+			pool->nr_queued++;
+			pthread_cond_signal(&pool->cond);
+			pthread_mutex_unlock(&pool->lock);
+			return;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	/* No worker available, do it ourselves */
+	pr_task_run(task);
+}
+
+static void pr_pool_stop(struct pr_pool *pool)
+{
+	unsigned int i, n;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->exiting = true;
+	n = pool->nr_workers;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < n; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->nr_workers = 0;
+	pool->exiting = false;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void pr_pool_exit(void)
+{
+	/* map tasks may still queue path tasks, stop them first */
+	pr_pool_stop(&pr_pools[PR_POOL_MAP]);
+	pr_pool_stop(&pr_pools[PR_POOL_PATH]);
+}
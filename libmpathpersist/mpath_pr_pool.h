@@ -0,0 +1,52 @@
+#ifndef MPATH_PR_POOL_H_INCLUDED
+#define MPATH_PR_POOL_H_INCLUDED
+
+/*
+ * Bounded worker pools for issuing persistent reservation commands
+ * concurrently.
+ *
+ * PR_POOL_PATH runs the SCSI commands for the individual paths of a map.
+ * PR_POOL_MAP runs whole per-map requests of a batch. Tasks in the map
+ * pool may wait for tasks in the path pool, but never the other way
+ * round, so the pools can't deadlock each other.
+ *
+ * Workers are started on demand, up to a fixed limit per pool, and stay
+ * around until pr_pool_exit() is called. If no worker can be started,
+ * tasks are run synchronously by the submitting thread.
+ */
+
+#include <pthread.h>
+#include "list.h"
+
+enum pr_pool_id {
+	PR_POOL_PATH,
+	PR_POOL_MAP,
+	__PR_POOL_MAX,
+};
+
+struct pr_batch {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int pending;
+};
+
+struct pr_task {
+	struct list_head node;
+	void (*fn)(struct pr_task *);
+	struct pr_batch *batch;
+};
+
+void pr_batch_init(struct pr_batch *batch);
+void pr_batch_destroy(struct pr_batch *batch);
+/* Wait until all tasks submitted with this batch have finished */
+void pr_batch_wait(struct pr_batch *batch);
+/*
+ * Queue a task. The task must stay valid, and must not be modified by
+ * the caller, until pr_batch_wait() has returned.
+ */
+void pr_pool_submit(enum pr_pool_id id, struct pr_batch *batch,
+		    struct pr_task *task);
+/* Stop all worker threads. Pending tasks are run before that. */
+void pr_pool_exit(void);
+
+#endif /* MPATH_PR_POOL_H_INCLUDED */
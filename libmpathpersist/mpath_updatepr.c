@@ -21,8 +21,9 @@
 #include "mpathpr.h"
 #include "structs.h"
 #include "strbuf.h"
+#include "unaligned.h"
 
-static char *do_pr(char *alias, const char *str)
+static char *__do_pr(char *alias, const char *str, int err_prio)
 {
 	int fd;
 	char *reply;
@@ -35,7 +36,7 @@ static char *do_pr(char *alias, const char *str)
 
 	fd = mpath_connect();
 	if (fd == -1) {
-		condlog (0, "ux socket connect error");
+		condlog(err_prio, "ux socket connect error");
 		return NULL;
 	}
 
@@ -52,6 +53,11 @@ static char *do_pr(char *alias, const char *str)
 	return reply;
 }
 
+static char *do_pr(char *alias, const char *str)
+{
+	return __do_pr(alias, str, 0);
+}
+
 static int do_update_pr(char *alias, char *cmd, const char *data)
 {
 	STRBUF_ON_STACK(buf);
@@ -150,3 +156,90 @@ int update_prkey_flags(char *mapname, uint64_t prkey, uint8_t sa_flags) {
 		(sa_flags & MPATH_F_APTPL_MASK) ? ":aptpl" : "");
 	return do_update_pr(mapname, "setprkey", str);
 }
+
+/* Make multipathd drop the PR state it has cached for the map */
+void invalidate_prin_cache(char *mapname)
+{
+	char str[256];
+
+	snprintf(str, sizeof(str), "invalidateprin map %s", mapname);
+	/* multipathd not running is not an error here */
+	free(__do_pr(mapname, str, 3));
+}
+
+/*
+ * Get the result of a READ KEYS or READ RESERVATION command from the
+ * PR state cached by multipathd. This avoids discovering all paths of
+ * the map. Returns MPATH_PR_SUCCESS, or MPATH_PR_OTHER if multipathd
+ * can't provide the information; the caller should send the command
+ * itself in that case.
+ */
+int get_prin_cached(char *mapname, int rq_servact, struct prin_resp *resp)
+{
+	char str[256];
+	char *reply, *line, *next;
+	uint32_t generation;
+	uint64_t key;
+	unsigned int scope_type, nr_keys = 0;
+	bool have_gen = false, have_resv = false;
+	int ret = MPATH_PR_OTHER;
+
+	/* An explicit allocation length means the caller wants raw results */
+	if ((rq_servact != MPATH_PRIN_RKEY_SA &&
+	     rq_servact != MPATH_PRIN_RRES_SA) || mpath_mx_alloc_len)
+		return MPATH_PR_OTHER;
+
+	snprintf(str, sizeof(str), "getprin map %s", mapname);
+	/* multipathd not running is not an error here */
+	reply = __do_pr(mapname, str, 3);
+	if (!reply)
+		return MPATH_PR_OTHER;
+
+	memset(resp, 0, sizeof(*resp));
+	for (line = reply; line && *line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		if (sscanf(line, "generation 0x%" SCNx32, &generation) == 1)
+			have_gen = true;
+		else if (sscanf(line, "key 0x%" SCNx64, &key) == 1) {
+			struct prin_readdescr *rk =
+				&resp->prin_descriptor.prin_readkeys;
+
+			if ((nr_keys + 1) * 8 > sizeof(rk->key_list))
+				continue;
+			if (rq_servact == MPATH_PRIN_RKEY_SA)
+				put_unaligned_be64(key, &rk->key_list[nr_keys * 8]);
+			nr_keys++;
+		} else if (!strcmp(line, "reservation none"))
+			have_resv = true;
+		else if (sscanf(line, "reservation 0x%" SCNx64 " 0x%x",
+				&key, &scope_type) == 2) {
+			struct prin_resvdescr *rr =
+				&resp->prin_descriptor.prin_readresv;
+
+			have_resv = true;
+			if (rq_servact == MPATH_PRIN_RRES_SA) {
+				rr->additional_length = 16;
+				put_unaligned_be64(key, rr->key);
+				rr->scope_type = scope_type;
+			}
+		} else
+			goto out;
+	}
+	if (!have_gen || !have_resv)
+		goto out;
+
+	if (rq_servact == MPATH_PRIN_RKEY_SA) {
+		resp->prin_descriptor.prin_readkeys.prgeneration = generation;
+		resp->prin_descriptor.prin_readkeys.additional_length =
+			nr_keys * 8;
+	} else
+		resp->prin_descriptor.prin_readresv.prgeneration = generation;
+	ret = MPATH_PR_SUCCESS;
+out:
+	if (ret != MPATH_PR_SUCCESS)
+		condlog(3, "%s: no cached PR state from multipathd", mapname);
+	free(reply);
+	return ret;
+}
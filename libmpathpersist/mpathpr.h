@@ -13,6 +13,9 @@ int update_prkey_flags(char *mapname, uint64_t prkey, uint8_t sa_flags);
 int get_prflag(char *mapname);
 int get_prhold(char *mapname);
 int update_prhold(char *mapname, bool set);
+struct prin_resp;
+int get_prin_cached(char *mapname, int rq_servact, struct prin_resp *resp);
+void invalidate_prin_cache(char *mapname);
 #define update_prkey(mapname, prkey) update_prkey_flags(mapname, prkey, 0)
 
 #endif
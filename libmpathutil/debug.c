@@ -42,3 +42,112 @@ void dlog(int prio, const char * fmt, ...)
 		log_safe(prio + 3, fmt, ap);
 	va_end(ap);
 }
+
+int log_coalesce_interval = DEFAULT_LOG_COALESCE_INTERVAL;
+int log_coalesce_level = DEFAULT_LOG_COALESCE_LEVEL;
+
+#define COALESCE_BUCKETS 64
+#define COALESCE_MSG_SIZE 256
+
+struct coalesce_entry {
+	struct coalesce_entry *next;
+	const char *fmt;
+	int prio;
+	time_t start;
+	unsigned int suppressed;
+	/* the last suppressed message */
+	char msg[COALESCE_MSG_SIZE];
+	char key[];
+};
+
+static pthread_mutex_t coalesce_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct coalesce_entry *coalesce_table[COALESCE_BUCKETS];
+
+static unsigned int coalesce_hash(const char *key, const char *fmt)
+{
+	unsigned int h = (uintptr_t)fmt >> 3;
+
+	for (; *key; key++)
+		h = h * 31 + (unsigned char)*key;
+	return h % COALESCE_BUCKETS;
+}
+
+static void log_suppressed(const struct coalesce_entry *ce, time_t now)
+{
+	if (ce->suppressed == 0)
+		return;
+	dlog(ce->prio, "%s: %u similar messages suppressed in %lds, last: \"%s\"\n",
+	     ce->key, ce->suppressed, (long)(now - ce->start), ce->msg);
+}
+
+bool log_coalesce(int prio, const char *key, const char *fmt, ...)
+{
+	struct coalesce_entry *ce;
+	struct timespec now;
+	int interval = log_coalesce_interval;
+	unsigned int h;
+	bool suppress = false;
+
+	if (interval <= 0 || prio < log_coalesce_level)
+		return false;
+	if (!key)
+		key = "";
+	get_monotonic_time(&now);
+	h = coalesce_hash(key, fmt);
+
+	pthread_mutex_lock(&coalesce_lock);
+	pthread_cleanup_push(cleanup_mutex, &coalesce_lock);
+	for (ce = coalesce_table[h]; ce; ce = ce->next)
+		if (ce->fmt == fmt && !strcmp(ce->key, key))
+			break;
+	if (!ce) {
+		ce = calloc(1, sizeof(*ce) + strlen(key) + 1);
+		if (ce) {
+			ce->fmt = fmt;
+			ce->prio = prio;
+			ce->start = now.tv_sec;
+			strcpy(ce->key, key);
+			ce->next = coalesce_table[h];
+			coalesce_table[h] = ce;
+		}
+	} else if (now.tv_sec - ce->start >= interval) {
+		log_suppressed(ce, now.tv_sec);
+		ce->start = now.tv_sec;
+		ce->suppressed = 0;
+	} else {
+		va_list ap;
+
+		va_start(ap, fmt);
+		vsnprintf(ce->msg, sizeof(ce->msg), fmt, ap);
+		va_end(ap);
+		ce->suppressed++;
+		suppress = true;
+	}
+	pthread_cleanup_pop(1);
+	return suppress;
+}
+
+void log_coalesce_flush(void)
+{
+	struct coalesce_entry **pce, *ce;
+	struct timespec now;
+	int interval = log_coalesce_interval;
+	int i;
+
+	get_monotonic_time(&now);
+	pthread_mutex_lock(&coalesce_lock);
+	pthread_cleanup_push(cleanup_mutex, &coalesce_lock);
+	for (i = 0; i < COALESCE_BUCKETS; i++) {
+		pce = &coalesce_table[i];
+		while ((ce = *pce)) {
+			if (interval > 0 && now.tv_sec - ce->start < interval) {
+				pce = &ce->next;
+				continue;
+			}
+			log_suppressed(ce, now.tv_sec);
+			*pce = ce->next;
+			free(ce);
+		}
+	}
+	pthread_cleanup_pop(1);
+}
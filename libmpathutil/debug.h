@@ -6,6 +6,7 @@ void dlog (int prio, const char *fmt, ...)
 
 #include <pthread.h>
 #include <stdarg.h>
+#include <stdbool.h>
 
 #include "log_pthread.h"
 
@@ -29,4 +30,31 @@ enum {
 		if (__p <= MAX_VERBOSITY && __p <= libmp_verbosity)	\
 			dlog(__p, fmt "\n", ##args);			\
 	} while (0)
+
+/*
+ * Coalesced logging for messages that may repeat for many paths in a
+ * short time, e.g. during an array outage. Of the messages from the same
+ * call site (identified by the format string) with the same key, e.g. a
+ * map alias or host, only the first one per log_coalesce_interval
+ * seconds is logged, followed by the number of suppressed messages and
+ * the last of them once the interval has passed. Messages with a
+ * priority value lower than log_coalesce_level are never coalesced.
+ */
+extern int log_coalesce_interval;
+extern int log_coalesce_level;
+
+/* Returns true if the message should be suppressed */
+bool log_coalesce(int prio, const char *key, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+/* Log the counts of expired intervals, and forget about them */
+void log_coalesce_flush(void);
+
+#define condlog_coalesce(prio, key, fmt, args...)			\
+	do {								\
+		int __p = (prio);					\
+									\
+		if (__p <= MAX_VERBOSITY && __p <= libmp_verbosity &&	\
+		    !log_coalesce(__p, key, fmt, ##args))		\
+			dlog(__p, fmt "\n", ##args);			\
+	} while (0)
 #endif /* DEBUG_H_INCLUDED */
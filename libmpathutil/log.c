@@ -10,32 +10,34 @@
 #include <syslog.h>
 #include <time.h>
 #include <pthread.h>
+#include <stdbool.h>
 
 #include "log.h"
 #include "util.h"
 
-#define ALIGN(len, s) (((len)+(s)-1)/(s)*(s))
-
 struct logarea* la;
 static pthread_mutex_t logq_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long log_dropped_msgs;
 
 #if LOGDBG
 static void dump_logarea (void)
 {
-	struct logmsg * msg;
-
-	logdbg(stderr, "\n==== area: start addr = %p, end addr = %p ====\n",
-		la->start, la->end);
-	logdbg(stderr, "|addr     |next     |prio|msg\n");
-
-	for (msg = (struct logmsg *)la->head; (void *)msg != la->tail;
-	     msg = msg->next)
-		logdbg(stderr, "|%p |%p |%i   |%s\n", (void *)msg, msg->next,
-				msg->prio, (char *)&msg->str);
-
-	logdbg(stderr, "|%p |%p |%i   |%s\n", (void *)msg, msg->next,
-			msg->prio, (char *)&msg->str);
-
+	struct logring *ring;
+	unsigned int i, n;
+	int r;
+
+	n = __atomic_load_n(&la->nr_rings, __ATOMIC_ACQUIRE);
+	logdbg(stderr, "\n==== area: %d rings ====\n", n);
+	for (r = 0; r < n; r++) {
+		ring = la->rings[r];
+		logdbg(stderr, "ring %d: head %u, tail %u\n", r,
+		       ring->head, ring->tail);
+		for (i = ring->head; i != ring->tail; i++)
+			logdbg(stderr, "|%lu |%i   |%s\n",
+			       ring->msgs[i % LOG_RING_SLOTS].seq,
+			       ring->msgs[i % LOG_RING_SLOTS].prio,
+			       ring->msgs[i % LOG_RING_SLOTS].str);
+	}
 	logdbg(stderr, "\n\n");
 }
 #endif
@@ -49,24 +51,16 @@ static int logarea_init (int size)
 		return 1;
 
 	if (size < MAX_MSG_SIZE)
-		size = DEFAULT_AREA_SIZE;
-
-	la->start = calloc(1, size);
-	if (!la->start) {
-		free(la);
-		la = NULL;
-		return 1;
-	}
+		la->max_rings = DEFAULT_LOG_RINGS;
+	else if ((la->max_rings = size / sizeof(struct logring)) == 0)
+		la->max_rings = 1;
 
-	la->empty = 1;
-	la->end = la->start + size;
-	la->head = la->start;
-	la->tail = la->start;
+	la->rings = calloc(la->max_rings, sizeof(*la->rings));
+	la->buff = calloc(1, sizeof(struct logmsg));
 
-	la->buff = calloc(1, MAX_MSG_SIZE + sizeof(struct logmsg));
-
-	if (!la->buff) {
-		free(la->start);
+	if (!la->rings || !la->buff) {
+		free(la->rings);
+		free(la->buff);
 		free(la);
 		la = NULL;
 		return 1;
@@ -95,7 +89,11 @@ int log_init(char *program_name, int size)
 
 static void free_logarea (void)
 {
-	free(la->start);
+	int i;
+
+	for (i = 0; i < la->nr_rings; i++)
+		free(la->rings[i]);
+	free(la->rings);
 	free(la->buff);
 	free(la);
 	la = NULL;
@@ -126,59 +124,83 @@ void log_reset (char *program_name)
 	pthread_cleanup_pop(1);
 }
 
-__attribute__((format(printf, 2, 0)))
-static int _log_enqueue(int prio, const char * fmt, va_list ap)
+static bool ring_full(struct logring *ring)
 {
-	int len, fwd;
-	char buff[MAX_MSG_SIZE];
-	struct logmsg * msg;
-	struct logmsg * lastmsg;
+	return __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) -
+		__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >= LOG_RING_SLOTS;
+}
 
-	lastmsg = (struct logmsg *)la->tail;
+static struct logring *alloc_ring(void)
+{
+	struct logring *ring = NULL;
 
-	if (!la->empty) {
-		fwd = sizeof(struct logmsg) +
-		      strlen((char *)&lastmsg->str) * sizeof(char) + 1;
-		la->tail += ALIGN(fwd, sizeof(void *));
+	pthread_mutex_lock(&logq_lock);
+	if (la->nr_rings < la->max_rings &&
+	    (ring = calloc(1, sizeof(*ring)))) {
+		ring->busy = 1;
+		la->rings[la->nr_rings] = ring;
+		__atomic_store_n(&la->nr_rings, la->nr_rings + 1,
+				 __ATOMIC_RELEASE);
 	}
-	vsnprintf(buff, MAX_MSG_SIZE, fmt, ap);
-	len = ALIGN(sizeof(struct logmsg) + strlen(buff) * sizeof(char) + 1,
-		    sizeof(void *));
-
-	/* not enough space on tail : rewind */
-	if (la->head <= la->tail && len > (la->end - la->tail)) {
-		logdbg(stderr, "enqueue: rewind tail to %p\n", la->tail);
-		if (la->head == la->start ) {
-			logdbg(stderr, "enqueue: cannot rewind tail, drop msg\n");
-			la->tail = lastmsg;
-			return 1;  /* can't reuse */
-		}
-		la->tail = la->start;
+	pthread_mutex_unlock(&logq_lock);
+	return ring;
+}
 
-		if (la->empty)
-			la->head = la->start;
+/*
+ * Find a ring that isn't used by another producer and has room for a
+ * message, starting at a position derived from the thread ID, so that
+ * threads tend to stick to "their" ring.
+ */
+static struct logring *claim_ring(void)
+{
+	int n = __atomic_load_n(&la->nr_rings, __ATOMIC_ACQUIRE);
+	unsigned long h = (unsigned long)pthread_self();
+	struct logring *ring;
+	int i, start;
+
+	if (n == 0)
+		return alloc_ring();
+
+	h ^= h >> 17;
+	start = (h * 0x9E3779B1UL) % n;
+	for (i = 0; i < n; i++) {
+		ring = la->rings[(start + i) % n];
+		if (__atomic_load_n(&ring->busy, __ATOMIC_RELAXED) ||
+		    ring_full(ring) ||
+		    __atomic_exchange_n(&ring->busy, 1, __ATOMIC_ACQUIRE))
+			continue;
+		/* the previous owner may have filled it in the meantime */
+		if (!ring_full(ring))
+			return ring;
+		__atomic_store_n(&ring->busy, 0, __ATOMIC_RELEASE);
 	}
+	return alloc_ring();
+}
 
-	/* not enough space on head : drop msg */
-	if (la->head > la->tail && len >= (la->head - la->tail)) {
-		logdbg(stderr, "enqueue: log area overrun, drop msg\n");
-
-		if (!la->empty)
-			la->tail = lastmsg;
+/*
+ * Called without locks. The caller must make sure that the log area
+ * isn't freed while this function runs.
+ */
+int log_enqueue(int prio, const char *fmt, va_list ap)
+{
+	struct logring *ring;
+	struct logmsg *msg;
 
+	if (!la || !(ring = claim_ring())) {
+		logdbg(stderr, "enqueue: log area overrun, drop msg\n");
+		__atomic_add_fetch(&log_dropped_msgs, 1, __ATOMIC_RELAXED);
 		return 1;
 	}
 
-	/* ok, we can stage the msg in the area */
-	la->empty = 0;
-	msg = (struct logmsg *)la->tail;
+	msg = &ring->msgs[ring->tail % LOG_RING_SLOTS];
 	msg->prio = prio;
-	memcpy((void *)&msg->str, buff, strlen(buff) + 1);
-	lastmsg->next = la->tail;
-	msg->next = la->head;
+	msg->seq = __atomic_fetch_add(&la->seq, 1, __ATOMIC_RELAXED);
+	vsnprintf(msg->str, MAX_MSG_SIZE, fmt, ap);
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->busy, 0, __ATOMIC_RELEASE);
 
-	logdbg(stderr, "enqueue: %p, %p, %i, %s\n", (void *)msg, msg->next,
-		msg->prio, (char *)&msg->str);
+	logdbg(stderr, "enqueue: %lu, %i, %s\n", msg->seq, msg->prio,
+	       msg->str);
 
 #if LOGDBG
 	dump_logarea();
@@ -186,57 +208,66 @@ static int _log_enqueue(int prio, const char * fmt, va_list ap)
 	return 0;
 }
 
-int log_enqueue(int prio, const char *fmt, va_list ap)
+static struct logring *find_oldest(int n)
 {
-	int ret = 1;
-
-	pthread_mutex_lock(&logq_lock);
-	pthread_cleanup_push(cleanup_mutex, &logq_lock);
-	if (la)
-		ret = _log_enqueue(prio, fmt, ap);
-	pthread_cleanup_pop(1);
-	return ret;
+	struct logring *ring, *oldest = NULL;
+	unsigned long seq = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		ring = la->rings[i];
+		if (ring->head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+			continue;
+		if (!oldest ||
+		    (long)(ring->msgs[ring->head % LOG_RING_SLOTS].seq - seq) < 0) {
+			oldest = ring;
+			seq = ring->msgs[ring->head % LOG_RING_SLOTS].seq;
+		}
+	}
+	return oldest;
 }
 
-static int _log_dequeue(void *buff)
+/*
+ * Dequeue the oldest message of all rings. Only one thread at a time
+ * may call this, i.e. the log thread, or log_thread_stop() after the log
+ * thread has exited.
+ */
+int log_dequeue(void *buff)
 {
-	struct logmsg * src = (struct logmsg *)la->head;
-	struct logmsg * dst = (struct logmsg *)buff;
-	struct logmsg * lst = (struct logmsg *)la->tail;
+	struct logring *oldest, *prev;
+	struct logmsg *msg;
+	int n;
 
-	if (la->empty)
+	if (!la)
 		return 1;
 
-	int len = strlen((char *)&src->str) * sizeof(char) +
-		  sizeof(struct logmsg) + 1;
-
-	dst->prio = src->prio;
-	memcpy(dst, src,  len);
-
-	if (la->tail == la->head)
-		la->empty = 1; /* we purge the last logmsg */
-	else {
-		la->head = src->next;
-		lst->next = la->head;
-	}
-	logdbg(stderr, "dequeue: %p, %p, %i, %s\n",
-		(void *)src, src->next, src->prio, (char *)&src->str);
-
-	memset((void *)src, 0,  len);
+	/*
+	 * A thread's earlier messages may sit in a ring that was scanned
+	 * before they were published. They are visible once a later message
+	 * of the same thread has been seen, so scan until the result is
+	 * stable.
+	 */
+	n = __atomic_load_n(&la->nr_rings, __ATOMIC_ACQUIRE);
+	oldest = find_oldest(n);
+	do {
+		prev = oldest;
+		n = __atomic_load_n(&la->nr_rings, __ATOMIC_ACQUIRE);
+		oldest = find_oldest(n);
+	} while (oldest != prev);
+	if (!oldest)
+		return 1;
 
+	msg = &oldest->msgs[oldest->head % LOG_RING_SLOTS];
+	memcpy(buff, msg, sizeof(*msg));
+	logdbg(stderr, "dequeue: %lu, %i, %s\n", msg->seq, msg->prio,
+	       msg->str);
+	__atomic_store_n(&oldest->head, oldest->head + 1, __ATOMIC_RELEASE);
 	return 0;
 }
 
-int log_dequeue(void *buff)
+unsigned long log_dropped(void)
 {
-	int ret = 1;
-
-	pthread_mutex_lock(&logq_lock);
-	pthread_cleanup_push(cleanup_mutex, &logq_lock);
-	if (la)
-		ret = _log_dequeue(buff);
-	pthread_cleanup_pop(1);
-	return ret;
+	return __atomic_load_n(&log_dropped_msgs, __ATOMIC_RELAXED);
 }
 
 /*
@@ -1,8 +1,9 @@
 #ifndef LOG_H_INCLUDED
 #define LOG_H_INCLUDED
 
-#define DEFAULT_AREA_SIZE 16384
 #define MAX_MSG_SIZE 256
+#define LOG_RING_SLOTS 16
+#define DEFAULT_LOG_RINGS 32
 
 #ifndef LOGLEVEL
 #define LOGLEVEL 5
@@ -16,17 +17,35 @@
 
 struct logmsg {
 	short int prio;
-	void * next;
-	char str[0];
+	unsigned long seq;
+	char str[MAX_MSG_SIZE];
 };
 
+/*
+ * Single-producer, single-consumer message ring.
+ *
+ * A producer owns the ring while "busy" is set. "tail" is only written
+ * by the producer, "head" only by the log thread.
+ */
+struct logring {
+	int busy;
+	unsigned int head;
+	unsigned int tail;
+	struct logmsg msgs[LOG_RING_SLOTS];
+};
+
+/*
+ * Rings are allocated on demand, when all existing rings are owned by
+ * other producers or full, up to max_rings. They are only freed by
+ * log_close(). Messages are stamped with a global sequence number, so
+ * that the log thread can write them in order.
+ */
 struct logarea {
-	int empty;
-	void * head;
-	void * tail;
-	void * start;
-	void * end;
-	char * buff;
+	int nr_rings;
+	int max_rings;
+	unsigned long seq;
+	struct logring **rings;
+	struct logmsg *buff;
 };
 
 extern struct logarea* la;
@@ -39,5 +58,6 @@ int log_enqueue (int prio, const char * fmt, va_list ap)
 int log_dequeue (void *);
 void log_syslog (void *);
 void dump_logmsg (void *);
+unsigned long log_dropped (void);
 
 #endif /* LOG_H_INCLUDED */
@@ -7,6 +7,8 @@
 #include <syslog.h>
 #include <pthread.h>
 #include <sys/mman.h>
+#include <sched.h>
+#include <stdbool.h>
 
 #include "log_pthread.h"
 #include "log.h"
@@ -21,6 +23,18 @@ static pthread_cond_t logev_cond = PTHREAD_COND_INITIALIZER;
 
 static int logq_running;
 static int log_messages_pending;
+/* number of threads in log_safe() that may be writing to the log area */
+static int log_producers;
+
+static void wake_log_thread(void)
+{
+	/* Only the first message after the log thread went to sleep signals */
+	if (__atomic_exchange_n(&log_messages_pending, 1, __ATOMIC_SEQ_CST))
+		return;
+	pthread_mutex_lock(&logev_lock);
+	pthread_cond_signal(&logev_cond);
+	pthread_mutex_unlock(&logev_lock);
+}
 
 void log_safe (int prio, const char * fmt, va_list ap)
 {
@@ -30,25 +44,28 @@ void log_safe (int prio, const char * fmt, va_list ap)
 		prio = LOG_DEBUG;
 
 	/*
-	 * logev_lock protects logq_running. By holding it, we avoid a race
-	 * with log_thread_stop() -> log_close(), which would free the logarea.
+	 * log_producers keeps log_thread_stop() -> log_close() from freeing
+	 * the logarea while we're writing to it. log_thread_stop() waits for
+	 * it to drop to 0 after the log thread has cleared logq_running.
 	 */
-	pthread_mutex_lock(&logev_lock);
-	pthread_cleanup_push(cleanup_mutex, &logev_lock);
-	running = logq_running;
+	__atomic_add_fetch(&log_producers, 1, __ATOMIC_SEQ_CST);
+	running = __atomic_load_n(&logq_running, __ATOMIC_SEQ_CST);
 
 	if (running) {
 		log_enqueue(prio, fmt, ap);
-
-		log_messages_pending = 1;
-		pthread_cond_signal(&logev_cond);
+		wake_log_thread();
 	}
-	pthread_cleanup_pop(1);
+	__atomic_sub_fetch(&log_producers, 1, __ATOMIC_SEQ_CST);
 
 	if (!running)
 		vsyslog(prio, fmt, ap);
 }
 
+unsigned long log_thread_dropped(void)
+{
+	return log_dropped();
+}
+
 static void flush_logqueue (void)
 {
 	int empty;
@@ -64,7 +81,7 @@ static void cleanup_log_thread(__attribute__((unused)) void *arg)
 {
 	logdbg(stderr, "log thread exiting");
 	pthread_mutex_lock(&logev_lock);
-	logq_running = 0;
+	__atomic_store_n(&logq_running, 0, __ATOMIC_SEQ_CST);
 	pthread_mutex_unlock(&logev_lock);
 }
 
@@ -75,7 +92,7 @@ static void * log_thread (__attribute__((unused)) void * et)
 	pthread_mutex_lock(&logev_lock);
 	running = logq_running;
 	if (!running)
-		logq_running = 1;
+		__atomic_store_n(&logq_running, 1, __ATOMIC_SEQ_CST);
 	pthread_cond_signal(&logev_cond);
 	pthread_mutex_unlock(&logev_lock);
 	if (running)
@@ -89,11 +106,13 @@ static void * log_thread (__attribute__((unused)) void * et)
 	while (1) {
 		pthread_mutex_lock(&logev_lock);
 		pthread_cleanup_push(cleanup_mutex, &logev_lock);
-		while (!log_messages_pending)
+		while (!__atomic_load_n(&log_messages_pending,
+					__ATOMIC_SEQ_CST))
 			/* this is a cancellation point */
 			pthread_cond_wait(&logev_cond, &logev_lock);
-		log_messages_pending = 0;
 		pthread_cleanup_pop(1);
+		/* clear before draining, so that no wakeup gets lost */
+		__atomic_store_n(&log_messages_pending, 0, __ATOMIC_SEQ_CST);
 
 		flush_logqueue();
 	}
@@ -154,6 +173,9 @@ void log_thread_stop (void)
 	if (running)
 		pthread_join(log_thr, NULL);
 
+	while (__atomic_load_n(&log_producers, __ATOMIC_SEQ_CST) > 0)
+		sched_yield();
+
 	flush_logqueue();
 	log_close();
 }
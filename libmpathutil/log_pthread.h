@@ -8,5 +8,7 @@ void log_safe(int prio, const char * fmt, va_list ap)
 void log_thread_start(pthread_attr_t *attr);
 void log_thread_reset (void);
 void log_thread_stop(void);
+/* Number of messages dropped because the log buffers were full */
+unsigned long log_thread_dropped(void);
 
 #endif /* LOG_PTHREAD_H_INCLUDED */
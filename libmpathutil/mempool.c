@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Slab allocator for fixed size objects, see mempool.h
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "list.h"
+#include "util.h"
+#include "debug.h"
+#include "strbuf.h"
+#include "mempool.h"
+
+#define SLAB_SIZE (64 * 1024)
+#define MIN_SLAB_OBJS 8
+#define OBJ_ALIGN 16
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+struct slab {
+	struct list_head node;	/* in the full or partial list of the pool */
+	struct mem_pool *pool;
+	void *freelist;
+	unsigned int nr_free;
+};
+
+/*
+ * Every object is preceded by a header pointing to its slab.
+ * While an object is free, its first bytes link it into the freelist.
+ */
+#define OBJ_HDR_SIZE ALIGN_UP(sizeof(struct slab *), OBJ_ALIGN)
+#define SLAB_HDR_SIZE ALIGN_UP(sizeof(struct slab), OBJ_ALIGN)
+
+static inline struct slab **obj_slab(void *obj)
+{
+	return (struct slab **)((char *)obj - OBJ_HDR_SIZE);
+}
+
+static LIST_HEAD(pools);
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void register_pool(struct mem_pool *pool)
+{
+	pthread_mutex_lock(&pools_lock);
+	if (list_empty(&pool->node))
+		list_add_tail(&pool->node, &pools);
+	__atomic_store_n(&pool->registered, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&pools_lock);
+}
+
+/* Called with the pool lock held */
+static struct slab *new_slab(struct mem_pool *pool)
+{
+	struct slab *slab;
+	char *obj;
+	unsigned int i;
+
+	if (!pool->slab_size) {
+		pool->stride = OBJ_HDR_SIZE + ALIGN_UP(pool->obj_size, OBJ_ALIGN);
+		pool->slab_size = SLAB_HDR_SIZE + MIN_SLAB_OBJS * pool->stride;
+		if (pool->slab_size < SLAB_SIZE)
+			pool->slab_size = SLAB_SIZE;
+		pool->slab_size = ALIGN_UP(pool->slab_size, getpagesize());
+		pool->objs_per_slab =
+			(pool->slab_size - SLAB_HDR_SIZE) / pool->stride;
+	}
+
+	slab = mmap(NULL, pool->slab_size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (slab == MAP_FAILED)
+		return NULL;
+
+	slab->pool = pool;
+	slab->freelist = NULL;
+	slab->nr_free = pool->objs_per_slab;
+	/* Build the freelist backwards, so that objects are used in order */
+	obj = (char *)slab + SLAB_HDR_SIZE + OBJ_HDR_SIZE +
+		(pool->objs_per_slab - 1) * pool->stride;
+	for (i = 0; i < pool->objs_per_slab; i++, obj -= pool->stride) {
+		*obj_slab(obj) = slab;
+		*(void **)obj = slab->freelist;
+		slab->freelist = obj;
+	}
+	list_add(&slab->node, &pool->partial);
+	pool->nr_slabs++;
+	pool->nr_free += pool->objs_per_slab;
+	return slab;
+}
+
+void *mem_pool_alloc(struct mem_pool *pool)
+{
+	struct slab *slab;
+	void *obj;
+
+	if (!__atomic_load_n(&pool->registered, __ATOMIC_ACQUIRE))
+		register_pool(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	if (list_empty(&pool->partial) && !new_slab(pool)) {
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+	slab = list_entry(pool->partial.next, struct slab, node);
+	obj = slab->freelist;
+	slab->freelist = *(void **)obj;
+	if (--slab->nr_free == 0)
+		list_move(&slab->node, &pool->full);
+	pool->nr_free--;
+	pool->allocs++;
+	if (++pool->in_use > pool->peak)
+		pool->peak = pool->in_use;
+	pthread_mutex_unlock(&pool->lock);
+
+	memset(obj, 0, pool->obj_size);
+	return obj;
+}
+
+void mem_pool_free(struct mem_pool *pool, void *obj)
+{
+	struct slab *slab, *release = NULL;
+
+	if (!obj)
+		return;
+
+	slab = *obj_slab(obj);
+	if (slab->pool != pool) {
+		condlog(0, "%s: INTERNAL ERROR: object %p doesn't belong to pool %s",
+			__func__, obj, pool->name);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	*(void **)obj = slab->freelist;
+	slab->freelist = obj;
+	pool->in_use--;
+	pool->nr_free++;
+	if (++slab->nr_free == 1)
+		/* Previously full slabs are reused first */
+		list_move(&slab->node, &pool->partial);
+	else if (slab->nr_free == pool->objs_per_slab) {
+		if (pool->nr_free > pool->objs_per_slab) {
+			list_del(&slab->node);
+			pool->nr_slabs--;
+			pool->nr_free -= pool->objs_per_slab;
+			release = slab;
+		} else
+			list_move_tail(&slab->node, &pool->partial);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if (release)
+		munmap(release, pool->slab_size);
+}
+
+void mem_pool_destroy(struct mem_pool *pool)
+{
+	struct slab *slab, *tmp;
+
+	pthread_mutex_lock(&pools_lock);
+	list_del_init(&pool->node);
+	__atomic_store_n(&pool->registered, 0, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&pools_lock);
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->in_use)
+		/* Leak the slabs rather than freeing objects in use */
+		condlog(0, "%s: INTERNAL ERROR: %lu %s objects still in use",
+			__func__, pool->in_use, pool->name);
+	else {
+		list_for_each_entry_safe(slab, tmp, &pool->partial, node)
+			munmap(slab, pool->slab_size);
+		INIT_LIST_HEAD(&pool->partial);
+		pool->nr_slabs = 0;
+		pool->nr_free = 0;
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void mem_pool_get_stats(struct mem_pool *pool, struct mem_pool_stats *st)
+{
+	pthread_mutex_lock(&pool->lock);
+	st->obj_size = pool->obj_size;
+	st->in_use = pool->in_use;
+	st->nr_free = pool->nr_free;
+	st->peak = pool->peak;
+	st->allocs = pool->allocs;
+	st->nr_slabs = pool->nr_slabs;
+	st->slab_size = pool->slab_size;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+int print_mem_pools(struct strbuf *buf)
+{
+	struct mem_pool *pool;
+	struct mem_pool_stats st;
+	size_t len = get_strbuf_len(buf);
+	int rc;
+
+	if ((rc = print_strbuf(buf, "%-12s %6s %8s %8s %8s %6s %10s %9s\n",
+			       "pool", "size", "in use", "free", "peak",
+			       "slabs", "allocs", "memory kB")) < 0)
+		return rc;
+
+	pthread_mutex_lock(&pools_lock);
+	pthread_cleanup_push(cleanup_mutex, &pools_lock);
+	list_for_each_entry(pool, &pools, node) {
+		mem_pool_get_stats(pool, &st);
+		if ((rc = print_strbuf(buf, "%-12s %6zu %8lu %8lu %8lu %6u %10lu %9zu\n",
+				       pool->name, st.obj_size, st.in_use,
+				       st.nr_free, st.peak, st.nr_slabs,
+				       st.allocs,
+				       st.nr_slabs * st.slab_size / 1024)) < 0)
+			break;
+	}
+	pthread_cleanup_pop(1);
+
+	return rc < 0 ? rc : (int)(get_strbuf_len(buf) - len);
+}
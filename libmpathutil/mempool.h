@@ -0,0 +1,76 @@
+#ifndef MEMPOOL_H_INCLUDED
+#define MEMPOOL_H_INCLUDED
+#include <stddef.h>
+#include <pthread.h>
+#include "list.h"
+
+/*
+ * Type-specific object pools
+ *
+ * Objects that are created and destroyed at a high rate, like paths and
+ * uevents during uevent storms, are allocated from slabs of fixed size
+ * objects. Slabs are mapped separately from the malloc heap, so churning
+ * objects doesn't fragment the heap, which can't be shrunk easily in a
+ * process that has called mlockall(). Freed objects are kept on the
+ * freelist of their slab. A slab is unmapped when all of its objects
+ * are free, unless the pool would be left without free objects.
+ *
+ * Pools are defined statically with DEFINE_MEM_POOL(), and show up in
+ * print_mem_pools() once the first object has been allocated.
+ * mem_pool_alloc() returns zeroed memory, like calloc(). All functions
+ * are thread-safe.
+ */
+
+struct strbuf;
+
+struct mem_pool {
+	const char *name;
+	size_t obj_size;
+	pthread_mutex_t lock;
+	int registered;			/* atomic access only */
+	struct list_head node;		/* in the list of all pools */
+	struct list_head partial;	/* slabs with free objects */
+	struct list_head full;
+	size_t stride;
+	size_t slab_size;
+	unsigned int objs_per_slab;
+	unsigned int nr_slabs;
+	unsigned long in_use;
+	unsigned long nr_free;
+	unsigned long peak;
+	unsigned long allocs;
+};
+
+#define DEFINE_MEM_POOL(var, nm, size)					\
+	struct mem_pool var = {						\
+		.name = (nm),						\
+		.obj_size = (size),					\
+		.lock = PTHREAD_MUTEX_INITIALIZER,			\
+		.node = LIST_HEAD_INIT((var).node),			\
+		.partial = LIST_HEAD_INIT((var).partial),		\
+		.full = LIST_HEAD_INIT((var).full),			\
+	}
+
+struct mem_pool_stats {
+	size_t obj_size;
+	unsigned long in_use;
+	unsigned long nr_free;
+	unsigned long peak;
+	unsigned long allocs;
+	unsigned int nr_slabs;
+	size_t slab_size;
+};
+
+void *mem_pool_alloc(struct mem_pool *pool);
+void mem_pool_free(struct mem_pool *pool, void *obj);
+/*
+ * Unmap all slabs and remove the pool from the list of pools. All
+ * objects must have been freed. The pool can be used again afterwards.
+ */
+void mem_pool_destroy(struct mem_pool *pool);
+void mem_pool_get_stats(struct mem_pool *pool, struct mem_pool_stats *st);
+
+/* Print a table with the statistics of all pools in use */
+int print_mem_pools(struct strbuf *buf);
+
+#endif
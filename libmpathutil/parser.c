@@ -20,6 +20,20 @@
 /* local vars */
 static int sublevel = 0;
 static int line_nr;
+static struct parse_recorder *recorder;
+
+static void count_warning(void)
+{
+	if (recorder)
+		recorder->warnings++;
+}
+
+/* Report a problem with the configuration file syntax */
+#define parse_warn(prio, fmt, args...)			\
+	do {						\
+		condlog(prio, fmt, ##args);		\
+		count_warning();			\
+	} while (0)
 
 int
 keyword_alloc(vector keywords, char *string,
@@ -105,11 +119,109 @@ free_keywords(vector keywords)
 		keyword = VECTOR_SLOT(keywords, i);
 		if (keyword->sub)
 			free_keywords(keyword->sub);
+		free(keyword->sub_table);
 		free(keyword);
 	}
 	vector_free(keywords);
 }
 
+/*
+ * Open addressing hash table of the keywords in one keyword vector.
+ * slot[] holds the index of a keyword in the vector plus one, 0 marks
+ * an empty slot. The table is at most half full.
+ */
+struct keyword_table {
+	unsigned int mask;
+	int slot[];
+};
+
+static unsigned int
+keyword_hash(const char *str)
+{
+	unsigned int h = 2166136261U;
+
+	while (*str) {
+		h ^= (unsigned char)*str++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* Find the slot holding str, or the empty slot where it belongs */
+static unsigned int
+keyword_table_slot(const struct keyword_table *tbl, vector keywords,
+		   const char *str)
+{
+	unsigned int h = keyword_hash(str) & tbl->mask;
+	struct keyword *kw;
+
+	while (tbl->slot[h]) {
+		kw = VECTOR_SLOT(keywords, tbl->slot[h] - 1);
+		if (!strcmp(kw->string, str))
+			break;
+		h = (h + 1) & tbl->mask;
+	}
+	return h;
+}
+
+static struct keyword_table *
+alloc_keyword_table(vector keywords)
+{
+	struct keyword_table *tbl;
+	struct keyword *kw;
+	unsigned int size = 8, h;
+	int i;
+
+	while (size < 2U * VECTOR_SIZE(keywords))
+		size <<= 1;
+	tbl = calloc(1, sizeof(*tbl) + size * sizeof(tbl->slot[0]));
+	if (!tbl)
+		return NULL;
+	tbl->mask = size - 1;
+
+	vector_foreach_slot(keywords, kw, i) {
+		h = keyword_table_slot(tbl, keywords, kw->string);
+		/* like the linear search, prefer the first of duplicates */
+		if (!tbl->slot[h])
+			tbl->slot[h] = i + 1;
+	}
+	return tbl;
+}
+
+struct keyword_table *
+index_keywords(vector keywords)
+{
+	struct keyword *kw;
+	int i;
+
+	if (!keywords)
+		return NULL;
+
+	vector_foreach_slot(keywords, kw, i) {
+		if (kw->sub && !kw->sub_table)
+			kw->sub_table = index_keywords(kw->sub);
+	}
+	return alloc_keyword_table(keywords);
+}
+
+/* Returns the index of the keyword str in keywords, or -1 */
+static int
+lookup_keyword(vector keywords, const struct keyword_table *tbl,
+	       const char *str)
+{
+	struct keyword *kw;
+	int i;
+
+	if (tbl)
+		return tbl->slot[keyword_table_slot(tbl, keywords, str)] - 1;
+
+	vector_foreach_slot(keywords, kw, i) {
+		if (!strcmp(kw->string, str))
+			return i;
+	}
+	return -1;
+}
+
 struct keyword *
 find_keyword(vector keywords, vector v, char * name)
 {
@@ -369,6 +481,7 @@ int warn_on_duplicates(vector uniques, char *str, const char *file)
 		if (!strcmp(str, tmp)) {
 			condlog(1, "%s line %d, duplicate keyword: %s",
 				file, line_nr, str);
+			count_warning();
 			return 0;
 		}
 	}
@@ -411,84 +524,85 @@ validate_config_strvec(vector strvec, const char *file)
 		str = VECTOR_SLOT(strvec, 0);
 
 	if (str == NULL) {
-		condlog(0, "can't parse option on line %d of %s",
+		parse_warn(0, "can't parse option on line %d of %s",
 			line_nr, file);
 		return -1;
 	}
 	if (*str == '}') {
 		if (VECTOR_SIZE(strvec) > 1)
-			condlog(0, "ignoring extra data starting with '%s' on line %d of %s", (char *)VECTOR_SLOT(strvec, 1), line_nr, file);
+			parse_warn(0, "ignoring extra data starting with '%s' on line %d of %s", (char *)VECTOR_SLOT(strvec, 1), line_nr, file);
 		return 0;
 	}
 	if (*str == '{') {
-		condlog(0, "invalid keyword '%s' on line %d of %s",
+		parse_warn(0, "invalid keyword '%s' on line %d of %s",
 			str, line_nr, file);
 		return -1;
 	}
 	if (is_sublevel_keyword(str)) {
 		str = VECTOR_SIZE(strvec) > 1 ? VECTOR_SLOT(strvec, 1) : NULL;
 		if (str == NULL)
-			condlog(0, "missing '{' on line %d of %s",
+			parse_warn(0, "missing '{' on line %d of %s",
 				line_nr, file);
 		else if (*str != '{')
-			condlog(0, "expecting '{' on line %d of %s. found '%s'",
+			parse_warn(0, "expecting '{' on line %d of %s. found '%s'",
 				line_nr, file, str);
 		else if (VECTOR_SIZE(strvec) > 2)
-			condlog(0, "ignoring extra data starting with '%s' on line %d of %s", (char *)VECTOR_SLOT(strvec, 2), line_nr, file);
+			parse_warn(0, "ignoring extra data starting with '%s' on line %d of %s", (char *)VECTOR_SLOT(strvec, 2), line_nr, file);
 		return 0;
 	}
 	str = VECTOR_SIZE(strvec) > 1 ? VECTOR_SLOT(strvec, 1) : NULL;
 	if (str == NULL) {
-		condlog(0, "missing value for option '%s' on line %d of %s",
+		parse_warn(0, "missing value for option '%s' on line %d of %s",
 			(char *)VECTOR_SLOT(strvec, 0), line_nr, file);
 		return -1;
 	}
 	if (!is_quote(str)) {
 		if (VECTOR_SIZE(strvec) > 2)
-			condlog(0, "ignoring extra data starting with '%s' on line %d of %s", (char *)VECTOR_SLOT(strvec, 2), line_nr, file);
+			parse_warn(0, "ignoring extra data starting with '%s' on line %d of %s", (char *)VECTOR_SLOT(strvec, 2), line_nr, file);
 		return 0;
 	}
 	if (VECTOR_SIZE(strvec) == 2) {
-		condlog(0, "missing closing quotes on line %d of %s",
+		parse_warn(0, "missing closing quotes on line %d of %s",
 			line_nr, file);
 		return 0;
 	}
 	str = VECTOR_SLOT(strvec, 2);
 	if (str == NULL) {
-		condlog(0, "can't parse value on line %d of %s",
+		parse_warn(0, "can't parse value on line %d of %s",
 			line_nr, file);
 		return -1;
 	}
 	if (is_quote(str)) {
 		if (VECTOR_SIZE(strvec) > 3)
-			condlog(0, "ignoring extra data starting with '%s' on line %d of %s", (char *)VECTOR_SLOT(strvec, 3), line_nr, file);
+			parse_warn(0, "ignoring extra data starting with '%s' on line %d of %s", (char *)VECTOR_SLOT(strvec, 3), line_nr, file);
 		return 0;
 	}
 	if (VECTOR_SIZE(strvec) == 3) {
-		condlog(0, "missing closing quotes on line %d of %s",
+		parse_warn(0, "missing closing quotes on line %d of %s",
 			line_nr, file);
 		return 0;
 	}
 	str = VECTOR_SLOT(strvec, 3);
 	if (str == NULL) {
-		condlog(0, "can't parse value on line %d of %s",
+		parse_warn(0, "can't parse value on line %d of %s",
 			line_nr, file);
 		return -1;
 	}
 	if (!is_quote(str)) {
 		/* There should only ever be one token between quotes */
-		condlog(0, "parsing error starting with '%s' on line %d of %s",
+		parse_warn(0, "parsing error starting with '%s' on line %d of %s",
 			str, line_nr, file);
 		return -1;
 	}
 	if (VECTOR_SIZE(strvec) > 4)
-		condlog(0, "ignoring extra data starting with '%s' on line %d of %s", (char *)VECTOR_SLOT(strvec, 4), line_nr, file);
+		parse_warn(0, "ignoring extra data starting with '%s' on line %d of %s", (char *)VECTOR_SLOT(strvec, 4), line_nr, file);
 	return 0;
 }
 
 static int
 process_stream(struct config *conf, FILE *stream, vector keywords,
-	       const char *section, const char *file)
+	       const struct keyword_table *table, const char *section,
+	       const char *file)
 {
 	int i;
 	int r = 0, t;
@@ -527,52 +641,56 @@ process_stream(struct config *conf, FILE *stream, vector keywords,
 				free_strvec(strvec);
 				goto out;
 			}
-			condlog(0, "unmatched '%s' at line %d of %s",
+			parse_warn(0, "unmatched '%s' at line %d of %s",
 				EOB, line_nr, file);
 		}
 
-		for (i = 0; i < VECTOR_SIZE(keywords); i++) {
+		i = lookup_keyword(keywords, table, str);
+		if (i >= 0) {
 			keyword = VECTOR_SLOT(keywords, i);
 
-			if (!strcmp(keyword->string, str)) {
-				if (keyword->unique &&
-				    warn_on_duplicates(uniques, str, file)) {
-						r = 1;
-						free_strvec(strvec);
-						goto out;
-				}
-				if (keyword->handler) {
-				    t = keyword->handler(conf, strvec, file,
-							 line_nr);
-					r += t;
-					if (t)
-						condlog(1, "%s line %d, parsing failed: %s",
-							file, line_nr, buf);
-				}
+			if (keyword->unique &&
+			    warn_on_duplicates(uniques, str, file)) {
+				r = 1;
+				free_strvec(strvec);
+				goto out;
+			}
+			if (recorder &&
+			    recorder->record(recorder, i, keyword,
+					     strvec, line_nr))
+				r++;
+			if (keyword->handler) {
+				t = keyword->handler(conf, strvec, file,
+						     line_nr);
+				r += t;
+				if (t)
+					parse_warn(1, "%s line %d, parsing failed: %s",
+						file, line_nr, buf);
+			}
 
-				if (keyword->sub) {
-					kw_level++;
-					r += process_stream(conf, stream,
-							    keyword->sub,
-							    keyword->string,
-							    file);
-					kw_level--;
-				}
-				break;
+			if (keyword->sub) {
+				kw_level++;
+				r += process_stream(conf, stream,
+						    keyword->sub,
+						    keyword->sub_table,
+						    keyword->string,
+						    file);
+				kw_level--;
+				if (recorder &&
+				    recorder->record(recorder, -1, NULL,
+						     NULL, line_nr))
+					r++;
 			}
-		}
-		if (i >= VECTOR_SIZE(keywords)) {
-			if (section)
-				condlog(1, "%s line %d, invalid keyword in the %s section: %s",
-					file, line_nr, section, str);
-			else
-				condlog(1, "%s line %d, invalid keyword: %s",
-					file, line_nr, str);
-		}
+		} else if (section)
+			parse_warn(1, "%s line %d, invalid keyword in the %s section: %s",
+				file, line_nr, section, str);
+		else
+			parse_warn(1, "%s line %d, invalid keyword: %s",
+				file, line_nr, str);
 		free_strvec(strvec);
 	}
 	if (kw_level == 1)
-		condlog(1, "missing '%s' at end of %s", EOB, file);
+		parse_warn(1, "missing '%s' at end of %s", EOB, file);
 out:
 	free(buf);
 	free_uniques(uniques);
@@ -580,6 +698,18 @@ out:
 }
 
 /* Data initialization */
+int
+process_file_recorded(struct config *conf, const char *file,
+		      struct parse_recorder *rec)
+{
+	int r;
+
+	recorder = rec;
+	r = process_file(conf, file);
+	recorder = NULL;
+	return r;
+}
+
 int
 process_file(struct config *conf, const char *file)
 {
@@ -599,7 +729,8 @@ process_file(struct config *conf, const char *file)
 
 	/* Stream handling */
 	line_nr = 0;
-	r = process_stream(conf, stream, conf->keywords, NULL, file);
+	r = process_stream(conf, stream, conf->keywords,
+			   conf->keyword_table, NULL, file);
 	fclose(stream);
 	//free_keywords(keywords);
 
@@ -35,12 +35,14 @@ struct config;
 /* keyword definition */
 typedef int print_fn(struct config *, struct strbuf *, const void *);
 typedef int handler_fn(struct config *, vector, const char *file, int line_nr);
+struct keyword_table;
 
 struct keyword {
 	char *string;
 	handler_fn *handler;
 	print_fn *print;
 	vector sub;
+	struct keyword_table *sub_table;
 	int unique;
 };
 
@@ -66,9 +68,31 @@ int install_keyword__(vector keywords, char *string, handler_fn *handler,
 #define install_keyword_multi(str, vec, pri) install_keyword__(keywords, str, vec, pri, 0)
 void dump_keywords(vector keydump, int level);
 void free_keywords(vector keywords);
+/*
+ * Build the hash tables used by process_file() to look up keywords by
+ * name. The tables of the sublevels are stored in their parent keywords,
+ * the table for the top level is returned. It must be freed with free().
+ * If it is NULL, process_file() falls back to a linear search.
+ */
+struct keyword_table *index_keywords(vector keywords);
 vector alloc_strvec(char *string);
 void *set_value(vector strvec);
 int process_file(struct config *conf, const char *conf_file);
+
+/*
+ * Hook for recording the keywords accepted by process_file(), used by
+ * the compiled configuration cache in libmultipath. record() is called
+ * with the slot index of every keyword in its keyword vector before the
+ * keyword's handler is run, and with kw == NULL after the end of a
+ * section. warnings counts the syntax problems reported while parsing.
+ */
+struct parse_recorder {
+	int (*record)(struct parse_recorder *rec, int index,
+		      const struct keyword *kw, vector strvec, int line_nr);
+	int warnings;
+};
+int process_file_recorded(struct config *conf, const char *conf_file,
+			  struct parse_recorder *rec);
 struct keyword * find_keyword(vector keywords, vector v, char * name);
 int snprint_keyword(struct strbuf *buff, const char *fmt, struct keyword *kw,
 		    const void *data);
@@ -85,7 +85,7 @@ load_default_config(int verbosity)
 {
 	/* need to set verbosity here to control logging during init_config() */
 	libmp_verbosity = verbosity;
-	if (init_config(DEFAULT_CONFIGFILE))
+	if (init_config_cached(DEFAULT_CONFIGFILE))
 		return -1;
 	/* Need to override verbosity from init_config() */
 	libmp_verbosity = verbosity;
@@ -148,6 +148,7 @@ mpathvalid_is_path(const char *name, unsigned int mode, char **wwid,
 	int find_multipaths_saved, r = MPATH_IS_ERROR;
 	unsigned int i;
 	struct path *pp;
+	bool ask_daemon;
 
 	if (!name || mode >= MPATH_MODE_ERROR)
 		return r;
@@ -169,12 +170,25 @@ mpathvalid_is_path(const char *name, unsigned int mode, char **wwid,
 	conf = get_multipath_config();
 	if (!conf)
 		goto out_wwid;
-	find_multipaths_saved = conf->find_multipaths;
-	if (mode != MPATH_DEFAULT)
-		set_conf_mode(conf, mode);
-	r = convert_result(is_path_valid(name, conf, pp, true));
-	conf->find_multipaths = find_multipaths_saved;
+	/*
+	 * multipathd evaluates the path with its own configuration, so
+	 * it can only answer for the configured claim mode.
+	 */
+	ask_daemon = mode == MPATH_DEFAULT || mode == get_conf_mode(conf);
 	put_multipath_config(conf);
+	if (ask_daemon)
+		r = convert_result(daemon_is_path_valid(name, pp->wwid,
+							WWID_SIZE, false));
+
+	if (r == MPATH_IS_ERROR) {
+		conf = get_multipath_config();
+		find_multipaths_saved = conf->find_multipaths;
+		if (mode != MPATH_DEFAULT)
+			set_conf_mode(conf, mode);
+		r = convert_result(is_path_valid(name, conf, pp, true));
+		conf->find_multipaths = find_multipaths_saved;
+		put_multipath_config(conf);
+	}
 
 	if (r == MPATH_IS_MAYBE_VALID) {
 		for (i = 0; i < nr_paths; i++) {
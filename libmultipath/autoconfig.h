@@ -0,0 +1,3 @@
+#ifndef AUTOCONFIG_H_INCLUDED
+#define AUTOCONFIG_H_INCLUDED
+#endif
@@ -11,6 +11,7 @@
 #include "checkers.h"
 #include "vector.h"
 #include "util.h"
+#include "mempool.h"
 
 static const char * const checker_dir = MULTIPATH_DIR;
 
@@ -28,6 +29,7 @@ struct checker_class {
 	void *(*thread)(void *);	     /* async thread entry point */
 	int (*pending)(struct checker *);    /* to recheck pending paths */
 	bool (*need_wait)(struct checker *); /* checker needs waiting for */
+	struct mem_pool *pool;		     /* checker contexts */
 	const char **msgtable;
 	short msgtable_size;
 };
@@ -96,6 +98,9 @@ void free_checker_class(struct checker_class *c)
 	list_del(&c->node);
 	if (c->reset)
 		c->reset();
+	/* Checkers and checker threads hold refs, no contexts are left */
+	if (c->pool)
+		mem_pool_destroy(c->pool);
 	if (c->handle) {
 		if (dlclose(c->handle) != 0) {
 			condlog(0, "Cannot unload checker %s: %s",
@@ -185,8 +190,9 @@ static struct checker_class *add_checker_class(const char *name)
 	c->thread = (void *(*)(void*)) dlsym(c->handle, "libcheck_thread");
 	c->pending = (int (*)(struct checker *)) dlsym(c->handle, "libcheck_pending");
 	c->need_wait = (bool (*)(struct checker *)) dlsym(c->handle, "libcheck_need_wait");
-	/* These 5 functions can be NULL. call dlerror() to clear out any
-	 * error string */
+	c->pool = dlsym(c->handle, "libcheck_pool");
+	/* These 5 functions and the pool can be NULL. call dlerror() to
+	 * clear out any error string */
 	dlerror();
 
 	c->free = (void (*)(struct checker *)) dlsym(c->handle, "libcheck_free");
@@ -218,4 +218,11 @@ bool libcheck_need_wait(struct checker *c);
  */
 extern const char *libcheck_msgtable[];
 
+/*
+ * Optional pool for the checker contexts, see mempool.h.
+ * It is destroyed before the checker is unloaded.
+ */
+struct mem_pool;
+extern struct mem_pool libcheck_pool;
+
 #endif /* CHECKERS_H_INCLUDED */
@@ -17,6 +17,7 @@
 #include "checkers.h"
 #include "debug.h"
 #include "time-util.h"
+#include "mempool.h"
 
 #define AIO_GROUP_SIZE 1024
 
@@ -67,6 +68,8 @@ struct directio_context {
 	bool checked_state;
 };
 
+DEFINE_MEM_POOL(libcheck_pool, "directio", sizeof(struct directio_context));
+
 static bool is_running(struct directio_context *ct) {
 	return (ct->timeout.tv_sec != 0 || ct->timeout.tv_nsec != 0);
 }
@@ -170,10 +173,9 @@ int libcheck_init (struct checker * c)
 	struct async_req *req = NULL;
 	long flags;
 
-	ct = malloc(sizeof(struct directio_context));
+	ct = mem_pool_alloc(&libcheck_pool);
 	if (!ct)
 		return 1;
-	memset(ct, 0, sizeof(struct directio_context));
 
 	if (set_aio_group(ct) < 0)
 		goto out;
@@ -224,7 +226,7 @@ out:
 	}
 	if (ct->aio_grp)
 		ct->aio_grp->holders--;
-	free(ct);
+	mem_pool_free(&libcheck_pool, ct);
 	return 1;
 }
 
@@ -261,7 +263,7 @@ void libcheck_free (struct checker * c)
 		check_orphaned_group(ct->aio_grp);
 	}
 
-	free(ct);
+	mem_pool_free(&libcheck_pool, ct);
 	c->context = NULL;
 }
 
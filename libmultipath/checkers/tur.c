@@ -24,6 +24,7 @@
 #include "sg_include.h"
 #include "util.h"
 #include "time-util.h"
+#include "mempool.h"
 
 #define TUR_CMD_LEN 6
 #define HEAVY_CHECK_COUNT       10
@@ -62,15 +63,16 @@ struct tur_checker_context {
 	bool checked_state;
 };
 
+DEFINE_MEM_POOL(libcheck_pool, "tur", sizeof(struct tur_checker_context));
+
 int libcheck_init (struct checker * c)
 {
 	struct tur_checker_context *ct;
 	struct stat sb;
 
-	ct = malloc(sizeof(struct tur_checker_context));
+	ct = mem_pool_alloc(&libcheck_pool);
 	if (!ct)
 		return 1;
-	memset(ct, 0, sizeof(struct tur_checker_context));
 
 	ct->state = PATH_UNCHECKED;
 	ct->fd = -1;
@@ -89,7 +91,7 @@ static void cleanup_context(struct tur_checker_context *ct)
 {
 	pthread_mutex_destroy(&ct->lock);
 	pthread_cond_destroy(&ct->active);
-	free(ct);
+	mem_pool_free(&libcheck_pool, ct);
 }
 
 void libcheck_free (struct checker * c)
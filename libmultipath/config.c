@@ -26,6 +26,7 @@
 #include "mpath_cmd.h"
 #include "propsel.h"
 #include "foreign.h"
+#include "config_cache.h"
 
 /*
  * We don't support re-initialization after
@@ -477,7 +478,9 @@ merge_hwe (struct hwentry * dst, struct hwentry * src)
 	merge_num(marginal_path_err_rate_threshold);
 	merge_num(marginal_path_err_recheck_gap_time);
 	merge_num(marginal_path_double_failed_time);
+	merge_num(marginal_path_err_method);
 	merge_num(purge_disconnected);
+	merge_num(adaptive_weights);
 
 	snprintf(id, sizeof(id), "%s/%s", dst->vendor, dst->product);
 	reconcile_features_with_options(id, &dst->features,
@@ -522,10 +525,12 @@ merge_mpe(struct mpentry *dst, struct mpentry *src)
 	merge_num(marginal_path_err_rate_threshold);
 	merge_num(marginal_path_err_recheck_gap_time);
 	merge_num(marginal_path_double_failed_time);
+	merge_num(marginal_path_err_method);
 	merge_num(skip_kpartx);
 	merge_num(max_sectors_kb);
 	merge_num(ghost_delay);
 	merge_num(purge_disconnected);
+	merge_num(adaptive_weights);
 	merge_num(uid);
 	merge_num(gid);
 	merge_num(mode);
@@ -794,6 +799,8 @@ static void _uninit_config(struct config *conf)
 	free_hwtable(conf->hwtable);
 	free_hwe(conf->overrides);
 	free_keywords(conf->keywords);
+	free(conf->keyword_table);
+	free_mp_settings(conf);
 
 	memset(conf, 0, sizeof(*conf));
 }
@@ -820,7 +827,7 @@ void free_config(struct config *conf)
 /* if multipath fails to process the config directory, it should continue,
  * with just a warning message */
 static void
-process_config_dir(struct config *conf, char *dir)
+process_config_dir(struct config *conf, char *dir, struct config_cache *cc)
 {
 	struct dirent **namelist;
 	struct scandir_result sr;
@@ -834,6 +841,8 @@ process_config_dir(struct config *conf, char *dir)
 			dir);
 		return;
 	}
+	/* adding or removing files changes the directory */
+	config_cache_add_source(cc, dir, true);
 	n = scandir(dir, &namelist, NULL, alphasort);
 	if (n < 0) {
 		if (errno == ENOENT)
@@ -858,7 +867,7 @@ process_config_dir(struct config *conf, char *dir)
 				   VECTOR_SIZE(conf->overrides->pctable) : 0;
 		snprintf(path, LINE_MAX, "%s/%s", dir, namelist[i]->d_name);
 		path[LINE_MAX-1] = '\0';
-		process_file(conf, path);
+		config_cache_process_file(cc, conf, path, true);
 		factorize_hwtable(conf->hwtable, old_hwtable_size,
 				  namelist[i]->d_name);
 		validate_pctable(conf->overrides, old_pctable_size,
@@ -867,26 +876,73 @@ process_config_dir(struct config *conf, char *dir)
 	pthread_cleanup_pop(1);
 }
 
-static int init_config__ (const char *file, struct config *conf);
+/*
+ * Replay the configuration files recorded in the cache, with the same
+ * post-processing as after parsing them.
+ */
+static int
+replay_config(struct config *conf, struct config_cache *cc)
+{
+	const char *file, *desc;
+	bool in_dir;
+	int old_hwtable_size, old_pctable_size;
+
+	while ((file = config_cache_next_file(cc, &in_dir)) != NULL) {
+		old_hwtable_size = VECTOR_SIZE(conf->hwtable);
+		old_pctable_size = 0;
+		if (in_dir) {
+			conf->processed_main_config = 1;
+			if (conf->overrides)
+				old_pctable_size =
+					VECTOR_SIZE(conf->overrides->pctable);
+			desc = strrchr(file, '/') ? strrchr(file, '/') + 1 : file;
+		} else
+			desc = file;
+		if (config_cache_replay_file(cc, conf, file) && !in_dir) {
+			condlog(0, "error parsing config file");
+			return 1;
+		}
+		factorize_hwtable(conf->hwtable, old_hwtable_size, desc);
+		validate_pctable(conf->overrides, old_pctable_size, desc);
+	}
+	conf->processed_main_config = 1;
+	return config_cache_failed(cc) ? 1 : 0;
+}
+
+static int init_config__ (const char *file, struct config *conf,
+			  bool *use_cache);
 
 int init_config(const char *file)
 {
-	return init_config__(file, &internal_config);
+	return init_config__(file, &internal_config, NULL);
+}
+
+int init_config_cached(const char *file)
+{
+	bool use_cache = true;
+	int r;
+
+	r = init_config__(file, &internal_config, &use_cache);
+	/* use_cache is cleared if the cache turned out to be unusable */
+	if (r && !use_cache)
+		r = init_config__(file, &internal_config, NULL);
+	return r;
 }
 
 struct config *load_config(const char *file)
 {
 	struct config *conf = alloc_config();
 
-	if (conf && !init_config__(file, conf))
+	if (conf && !init_config__(file, conf, NULL))
 		return conf;
 
 	free(conf);
 	return NULL;
 }
 
-int init_config__ (const char *file, struct config *conf)
+int init_config__ (const char *file, struct config *conf, bool *use_cache)
 {
+	struct config_cache *cc = NULL;
 
 	if (!conf)
 		conf = &internal_config;
@@ -914,6 +970,8 @@ int init_config__ (const char *file, struct config *conf)
 	conf->retrigger_tries = DEFAULT_RETRIGGER_TRIES;
 	conf->retrigger_delay = DEFAULT_RETRIGGER_DELAY;
 	conf->uev_wait_timeout = DEFAULT_UEV_WAIT_TIMEOUT;
+	conf->log_coalesce_interval = DEFAULT_LOG_COALESCE_INTERVAL;
+	conf->log_coalesce_level = DEFAULT_LOG_COALESCE_LEVEL;
 	conf->auto_resize = DEFAULT_AUTO_RESIZE;
 	conf->remove_retries = 0;
 	conf->ghost_delay = DEFAULT_GHOST_DELAY;
@@ -936,20 +994,38 @@ int init_config__ (const char *file, struct config *conf)
 	 */
 	conf->keywords = vector_alloc();
 	init_keywords(conf->keywords);
-	if (filepresent(file)) {
-		int builtin_hwtable_size;
-
-		builtin_hwtable_size = VECTOR_SIZE(conf->hwtable);
-		if (process_file(conf, file)) {
-			condlog(0, "error parsing config file");
+	conf->keyword_table = index_keywords(conf->keywords);
+	if (use_cache && *use_cache)
+		cc = config_cache_open(DEFAULT_CONFIG_CACHE, file, conf);
+	if (config_cache_replaying(cc)) {
+		if (replay_config(conf, cc)) {
+			if (config_cache_failed(cc)) {
+				condlog(2, "%s is corrupt, ignoring it",
+					DEFAULT_CONFIG_CACHE);
+				*use_cache = false;
+			}
 			goto out;
 		}
-		factorize_hwtable(conf->hwtable, builtin_hwtable_size, file);
-		validate_pctable(conf->overrides, 0, file);
-	}
+	} else {
+		if (filepresent(file)) {
+			int builtin_hwtable_size;
 
-	conf->processed_main_config = 1;
-	process_config_dir(conf, CONFIG_DIR);
+			builtin_hwtable_size = VECTOR_SIZE(conf->hwtable);
+			if (config_cache_process_file(cc, conf, file, false)) {
+				condlog(0, "error parsing config file");
+				goto out;
+			}
+			factorize_hwtable(conf->hwtable, builtin_hwtable_size,
+					  file);
+			validate_pctable(conf->overrides, 0, file);
+		}
+
+		conf->processed_main_config = 1;
+		process_config_dir(conf, CONFIG_DIR, cc);
+		config_cache_write(cc);
+	}
+	config_cache_free(cc);
+	cc = NULL;
 
 	/*
 	 * fill the voids left in the config file
@@ -1064,8 +1140,11 @@ int init_config__ (const char *file, struct config *conf)
 	merge_blacklist_device(conf->elist_device);
 
 	libmp_verbosity = conf->verbosity;
+	log_coalesce_interval = conf->log_coalesce_interval;
+	log_coalesce_level = conf->log_coalesce_level;
 	return 0;
 out:
+	config_cache_free(cc);
 	_uninit_config(conf);
 	return 1;
 }
@@ -88,7 +88,9 @@ struct hwentry {
 	int marginal_path_err_rate_threshold;
 	int marginal_path_err_recheck_gap_time;
 	int marginal_path_double_failed_time;
+	int marginal_path_err_method;
 	int purge_disconnected;
+	int adaptive_weights;
 	int skip_kpartx;
 	int max_sectors_kb;
 	int ghost_delay;
@@ -131,7 +133,9 @@ struct mpentry {
 	int marginal_path_err_rate_threshold;
 	int marginal_path_err_recheck_gap_time;
 	int marginal_path_double_failed_time;
+	int marginal_path_err_method;
 	int purge_disconnected;
+	int adaptive_weights;
 	int skip_kpartx;
 	int max_sectors_kb;
 	int ghost_delay;
@@ -143,6 +147,8 @@ struct mpentry {
 struct config {
 	struct rcu_head rcu;
 	int verbosity;
+	int log_coalesce_interval;
+	int log_coalesce_level;
 	int pgpolicy_flag;
 	int pgpolicy;
 	int minio;
@@ -190,7 +196,9 @@ struct config {
 	int marginal_path_err_rate_threshold;
 	int marginal_path_err_recheck_gap_time;
 	int marginal_path_double_failed_time;
+	int marginal_path_err_method;
 	int purge_disconnected;
+	int adaptive_weights;
 	int uxsock_timeout;
 	int strict_timing;
 	int retrigger_tries;
@@ -223,6 +231,8 @@ struct config {
 	uint8_t sa_flags;
 
 	vector keywords;
+	struct keyword_table *keyword_table;
+	struct mp_settings_table *mp_settings;
 	vector mptable;
 	vector hwtable;
 	struct hwentry *overrides;
@@ -308,6 +318,11 @@ int store_hwe (vector hwtable, struct hwentry *);
 struct config *load_config (const char *file);
 void free_config (struct config * conf);
 int init_config(const char *file);
+/*
+ * Like init_config(), but use the compiled configuration cache,
+ * see config_cache.h. For short-lived programs.
+ */
+int init_config_cached(const char *file);
 void uninit_config(void);
 
 struct config *libmp_get_multipath_config(void);
@@ -0,0 +1,609 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Compiled configuration cache, see config_cache.h
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vector.h"
+#include "parser.h"
+#include "config.h"
+#include "debug.h"
+#include "util.h"
+#include "version.h"
+#include "config_cache.h"
+
+#define CC_MAGIC	"MPCC"
+#define CC_FORMAT	1
+/* token length marking the quote token of alloc_strvec() */
+#define CC_QUOTE	0xffff
+
+enum {
+	CC_SRC_FILE,
+	CC_SRC_DIR,
+	CC_SRC_MISSING,
+};
+
+enum {
+	CC_OP_FILE = 1,	/* u8 in_dir, u16 name length, name */
+	CC_OP_KW,	/* u16 index, u32 line, u8 ntok, tokens */
+	CC_OP_END,	/* end of section */
+	CC_OP_EOF,	/* end of file */
+};
+
+/*
+ * File layout: header, nr_sources sources (each followed by its name),
+ * records. Integers are in host byte order; the cache is never shared
+ * between hosts.
+ */
+struct cc_header {
+	char magic[4];
+	uint32_t format;
+	uint32_t layout;
+	uint32_t nr_sources;
+	uint32_t data_len;
+	uint32_t data_hash;
+	int64_t created;
+};
+
+struct cc_source {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint32_t hash;
+	uint16_t type;
+	uint16_t name_len;	/* including the terminating 0 */
+};
+
+struct cc_buf {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+struct config_cache {
+	struct parse_recorder rec;	/* must be first */
+	char *cache_file;
+	bool replay;
+	bool failed;
+	uint32_t layout;
+	int64_t created;
+	/* recording mode */
+	struct cc_buf sources;
+	struct cc_buf records;
+	unsigned int nr_sources;
+	int errors;
+	/* replay mode */
+	char *map;
+	size_t map_len;
+	char *pos;
+	char *end;
+};
+
+static char quote_token[] = { '\0', '"', '\0' };
+
+#define FNV_INIT	2166136261U
+
+static uint32_t fnv1a(uint32_t h, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		h ^= *p++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/*
+ * Records refer to keywords by their slot index, so the cache is only
+ * valid for the keyword tables it was written with.
+ */
+static uint32_t layout_hash(uint32_t h, const struct vector_s *keywords)
+{
+	struct keyword *kw;
+	int i;
+
+	vector_foreach_slot(keywords, kw, i) {
+		h = fnv1a(h, kw->string, strlen(kw->string) + 1);
+		if (kw->sub) {
+			h = fnv1a(h, "{", 1);
+			h = layout_hash(h, kw->sub);
+			h = fnv1a(h, "}", 1);
+		}
+	}
+	return h;
+}
+
+static int file_hash(const char *path, uint32_t *hash)
+{
+	char buf[4096];
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+		return -errno;
+	*hash = FNV_INIT;
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+		*hash = fnv1a(*hash, buf, len);
+	close(fd);
+	return len < 0 ? -EIO : 0;
+}
+
+static int cc_put(struct cc_buf *b, const void *data, size_t len)
+{
+	if (b->len + len > b->size) {
+		size_t size = b->size ? b->size : 4096;
+		char *tmp;
+
+		while (size < b->len + len)
+			size *= 2;
+		tmp = realloc(b->data, size);
+		if (!tmp)
+			return -ENOMEM;
+		b->data = tmp;
+		b->size = size;
+	}
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+	return 0;
+}
+
+#define cc_put_var(b, v) cc_put(b, &(v), sizeof(v))
+
+static bool cc_get(struct config_cache *cc, void *dst, size_t len)
+{
+	if ((size_t)(cc->end - cc->pos) < len) {
+		cc->failed = true;
+		return false;
+	}
+	memcpy(dst, cc->pos, len);
+	cc->pos += len;
+	return true;
+}
+
+/* Returns a pointer to a 0-terminated string of len bytes in the map */
+static char *cc_get_str(struct config_cache *cc, size_t len)
+{
+	char *str = cc->pos;
+
+	if ((size_t)(cc->end - cc->pos) <= len || str[len] != '\0') {
+		cc->failed = true;
+		return NULL;
+	}
+	cc->pos += len + 1;
+	return str;
+}
+
+static int stat_source(const char *path, bool is_dir, struct cc_source *src)
+{
+	struct stat st;
+
+	memset(src, 0, sizeof(*src));
+	if (stat(path, &st) == -1) {
+		if (errno != ENOENT)
+			return -errno;
+		src->type = CC_SRC_MISSING;
+		return 0;
+	}
+	if (is_dir != !!S_ISDIR(st.st_mode))
+		return -EINVAL;
+	src->type = is_dir ? CC_SRC_DIR : CC_SRC_FILE;
+	src->dev = st.st_dev;
+	src->ino = st.st_ino;
+	src->size = st.st_size;
+	src->mtime_sec = st.st_mtim.tv_sec;
+	src->mtime_nsec = st.st_mtim.tv_nsec;
+	return 0;
+}
+
+int config_cache_add_source(struct config_cache *cc, const char *path,
+			    bool is_dir)
+{
+	struct cc_source src;
+	size_t len = strlen(path) + 1;
+	int r;
+
+	if (!cc || cc->replay)
+		return 0;
+	if (len > UINT16_MAX ||
+	    (r = stat_source(path, is_dir, &src)) != 0 ||
+	    (src.type == CC_SRC_FILE && (r = file_hash(path, &src.hash)) != 0))
+		goto fail;
+	src.name_len = len;
+	if ((r = cc_put_var(&cc->sources, src)) != 0 ||
+	    (r = cc_put(&cc->sources, path, len)) != 0)
+		goto fail;
+	cc->nr_sources++;
+	return 0;
+fail:
+	condlog(3, "%s: can't add %s: %d", __func__, path, r);
+	cc->errors++;
+	return r;
+}
+
+static int cc_record(struct parse_recorder *rec, int index,
+		     const struct keyword *kw, vector strvec, int line_nr)
+{
+	struct config_cache *cc = (struct config_cache *)rec;
+	uint8_t op = kw ? CC_OP_KW : CC_OP_END;
+	uint16_t idx = index, len;
+	uint32_t line = line_nr;
+	uint8_t ntok;
+	const char *tok;
+	int i;
+
+	if (cc_put_var(&cc->records, op) != 0)
+		goto fail;
+	if (!kw)
+		return 0;
+	if (index < 0 || index > UINT16_MAX || VECTOR_SIZE(strvec) > UINT8_MAX)
+		goto fail;
+	ntok = VECTOR_SIZE(strvec);
+	if (cc_put_var(&cc->records, idx) != 0 ||
+	    cc_put_var(&cc->records, line) != 0 ||
+	    cc_put_var(&cc->records, ntok) != 0)
+		goto fail;
+	vector_foreach_slot(strvec, tok, i) {
+		if (is_quote(tok)) {
+			len = CC_QUOTE;
+			if (cc_put_var(&cc->records, len) != 0)
+				goto fail;
+			continue;
+		}
+		if (strlen(tok) >= CC_QUOTE)
+			goto fail;
+		len = strlen(tok);
+		if (cc_put_var(&cc->records, len) != 0 ||
+		    cc_put(&cc->records, tok, len + 1) != 0)
+			goto fail;
+	}
+	return 0;
+fail:
+	cc->errors++;
+	return 1;
+}
+
+int config_cache_process_file(struct config_cache *cc, struct config *conf,
+			      const char *file, bool in_dir)
+{
+	uint8_t op = CC_OP_FILE, dir = in_dir;
+	uint16_t len = strlen(file) + 1;
+	int r;
+
+	if (!cc || cc->replay)
+		return process_file(conf, file);
+
+	/* the main configuration file was added in config_cache_open() */
+	if (in_dir)
+		config_cache_add_source(cc, file, false);
+	if (cc_put_var(&cc->records, op) != 0 ||
+	    cc_put_var(&cc->records, dir) != 0 ||
+	    cc_put_var(&cc->records, len) != 0 ||
+	    cc_put(&cc->records, file, len) != 0)
+		cc->errors++;
+	r = process_file_recorded(conf, file, &cc->rec);
+	op = CC_OP_EOF;
+	if (r != 0 || cc_put_var(&cc->records, op) != 0)
+		cc->errors++;
+	return r;
+}
+
+static void cleanup_tmpfile(char *tmp, int fd)
+{
+	if (fd != -1)
+		close(fd);
+	unlink(tmp);
+}
+
+void config_cache_write(struct config_cache *cc)
+{
+	struct cc_header hdr = { .format = CC_FORMAT };
+	char tmp[PATH_MAX];
+	char *p;
+	int fd;
+
+	if (!cc || cc->replay || cc->failed || cc->errors ||
+	    cc->rec.warnings || geteuid() != 0)
+		return;
+
+	memcpy(hdr.magic, CC_MAGIC, sizeof(hdr.magic));
+	hdr.layout = cc->layout;
+	hdr.nr_sources = cc->nr_sources;
+	hdr.data_len = cc->sources.len + cc->records.len;
+	hdr.data_hash = fnv1a(fnv1a(FNV_INIT, cc->sources.data,
+				    cc->sources.len),
+			      cc->records.data, cc->records.len);
+	hdr.created = cc->created;
+
+	if (safe_sprintf(tmp, "%s", cc->cache_file))
+		return;
+	p = strrchr(tmp, '/');
+	if (p && p != tmp) {
+		*p = '\0';
+		if (mkdir(tmp, 0755) == -1 && errno != EEXIST) {
+			condlog(3, "%s: can't create %s: %m", __func__, tmp);
+			return;
+		}
+	}
+	if (safe_sprintf(tmp, "%s.XXXXXX", cc->cache_file))
+		return;
+	fd = mkstemp(tmp);
+	if (fd == -1) {
+		condlog(3, "%s: can't create %s: %m", __func__, tmp);
+		return;
+	}
+	if (safe_write(fd, &hdr, sizeof(hdr)) < 0 ||
+	    safe_write(fd, cc->sources.data, cc->sources.len) < 0 ||
+	    safe_write(fd, cc->records.data, cc->records.len) < 0 ||
+	    fchmod(fd, 0644) == -1) {
+		condlog(3, "%s: failed to write %s: %m", __func__, tmp);
+		cleanup_tmpfile(tmp, fd);
+		return;
+	}
+	close(fd);
+	if (rename(tmp, cc->cache_file) == -1) {
+		condlog(3, "%s: failed to rename %s: %m", __func__, tmp);
+		cleanup_tmpfile(tmp, -1);
+		return;
+	}
+	condlog(4, "%s: wrote %s", __func__, cc->cache_file);
+}
+
+/*
+ * The cache is trusted only if it's owned by root and not writable by
+ * anyone else, like the configuration files themselves.
+ */
+static int cc_map(struct config_cache *cc)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(cc->cache_file, O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+		return -errno;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_uid != 0 ||
+	    (st.st_mode & (S_IWGRP|S_IWOTH)) ||
+	    (size_t)st.st_size < sizeof(struct cc_header)) {
+		close(fd);
+		return -EINVAL;
+	}
+	/* private, writable mapping: handlers get non-const tokens */
+	map = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -errno;
+	cc->map = map;
+	cc->map_len = st.st_size;
+	return 0;
+}
+
+static void cc_unmap(struct config_cache *cc)
+{
+	if (cc->map)
+		munmap(cc->map, cc->map_len);
+	cc->map = NULL;
+	cc->pos = cc->end = NULL;
+}
+
+static bool cc_source_unchanged(const struct cc_source *old, const char *name,
+				int64_t created)
+{
+	struct cc_source cur;
+	uint32_t hash;
+
+	if (stat_source(name, old->type == CC_SRC_DIR, &cur) != 0 ||
+	    cur.type != old->type)
+		return false;
+	if (cur.type == CC_SRC_MISSING)
+		return true;
+	if (cur.dev != old->dev || cur.ino != old->ino ||
+	    cur.size != old->size || cur.mtime_sec != old->mtime_sec ||
+	    cur.mtime_nsec != old->mtime_nsec)
+		return false;
+	/*
+	 * A file modified in the same second the cache was created in
+	 * might have changed again without changing its timestamp, if
+	 * the file system has coarse timestamps. Compare the contents.
+	 */
+	if (cur.type == CC_SRC_FILE && old->mtime_sec >= created - 1)
+		return file_hash(name, &hash) == 0 && hash == old->hash;
+	return true;
+}
+
+static int cc_check(struct config_cache *cc, const char *conf_file)
+{
+	struct cc_header hdr;
+	struct cc_source src;
+	const char *name;
+	unsigned int i;
+
+	cc->pos = cc->map;
+	cc->end = cc->map + cc->map_len;
+	if (!cc_get(cc, &hdr, sizeof(hdr)) ||
+	    memcmp(hdr.magic, CC_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.format != CC_FORMAT || hdr.layout != cc->layout ||
+	    hdr.data_len != cc->map_len - sizeof(hdr) ||
+	    hdr.data_hash != fnv1a(FNV_INIT, cc->pos, hdr.data_len))
+		return -EINVAL;
+
+	for (i = 0; i < hdr.nr_sources; i++) {
+		if (!cc_get(cc, &src, sizeof(src)) || src.name_len == 0 ||
+		    !(name = cc_get_str(cc, src.name_len - 1)))
+			return -EINVAL;
+		/* the first source is always the main configuration file */
+		if (i == 0 && strcmp(name, conf_file))
+			return -EINVAL;
+		if (!cc_source_unchanged(&src, name, hdr.created)) {
+			condlog(4, "%s: %s has changed", __func__, name);
+			return -ESTALE;
+		}
+	}
+	return hdr.nr_sources > 0 ? 0 : -EINVAL;
+}
+
+struct config_cache *config_cache_open(const char *cache_file,
+				       const char *conf_file,
+				       const struct config *conf)
+{
+	struct config_cache *cc;
+
+	if (!cache_file || !conf_file || !conf || !conf->keywords)
+		return NULL;
+	cc = calloc(1, sizeof(*cc));
+	if (!cc)
+		return NULL;
+	cc->cache_file = strdup(cache_file);
+	if (!cc->cache_file) {
+		free(cc);
+		return NULL;
+	}
+	cc->rec.record = cc_record;
+	cc->layout = layout_hash(fnv1a(FNV_INIT, &(uint32_t){ VERSION_CODE },
+				       sizeof(uint32_t)),
+				 conf->keywords);
+	cc->created = time(NULL);
+
+	if (cc_map(cc) == 0) {
+		if (cc_check(cc, conf_file) == 0) {
+			condlog(4, "using configuration cache %s", cache_file);
+			cc->replay = true;
+			return cc;
+		}
+		cc_unmap(cc);
+	}
+	/* recording mode, the main configuration file is the first source */
+	config_cache_add_source(cc, conf_file, false);
+	return cc;
+}
+
+bool config_cache_replaying(const struct config_cache *cc)
+{
+	return cc && cc->replay;
+}
+
+bool config_cache_failed(const struct config_cache *cc)
+{
+	return cc && cc->failed;
+}
+
+void config_cache_free(struct config_cache *cc)
+{
+	if (!cc)
+		return;
+	cc_unmap(cc);
+	free(cc->sources.data);
+	free(cc->records.data);
+	free(cc->cache_file);
+	free(cc);
+}
+
+const char *config_cache_next_file(struct config_cache *cc, bool *in_dir)
+{
+	uint8_t op, dir;
+	uint16_t len;
+	const char *name;
+
+	if (!cc || !cc->replay || cc->failed || cc->pos == cc->end)
+		return NULL;
+	if (!cc_get(cc, &op, sizeof(op)) || op != CC_OP_FILE ||
+	    !cc_get(cc, &dir, sizeof(dir)) || !cc_get(cc, &len, sizeof(len)) ||
+	    len == 0 || !(name = cc_get_str(cc, len - 1))) {
+		cc->failed = true;
+		return NULL;
+	}
+	*in_dir = dir;
+	return name;
+}
+
+static vector cc_get_strvec(struct config_cache *cc)
+{
+	uint8_t ntok;
+	uint16_t len;
+	vector strvec;
+	char *tok;
+	int i;
+
+	if (!cc_get(cc, &ntok, sizeof(ntok)))
+		return NULL;
+	strvec = vector_alloc();
+	if (!strvec)
+		goto fail;
+	for (i = 0; i < ntok; i++) {
+		if (!cc_get(cc, &len, sizeof(len)))
+			goto fail;
+		if (len == CC_QUOTE)
+			tok = quote_token;
+		else if (!(tok = cc_get_str(cc, len)))
+			goto fail;
+		if (!vector_alloc_slot(strvec))
+			goto fail;
+		vector_set_slot(strvec, tok);
+	}
+	return strvec;
+fail:
+	/* the tokens belong to the map, don't free them */
+	vector_free(strvec);
+	cc->failed = true;
+	return NULL;
+}
+
+static int cc_replay_section(struct config_cache *cc, struct config *conf,
+			     vector keywords, const char *file, int level)
+{
+	struct keyword *kw;
+	vector strvec;
+	uint8_t op;
+	uint16_t index;
+	uint32_t line;
+	int r = 0, t;
+
+	while (cc_get(cc, &op, sizeof(op))) {
+		if (op == CC_OP_EOF && level == 0)
+			return r;
+		if (op == CC_OP_END && level > 0)
+			return r;
+		if (op != CC_OP_KW || !cc_get(cc, &index, sizeof(index)) ||
+		    !cc_get(cc, &line, sizeof(line)) ||
+		    index >= VECTOR_SIZE(keywords))
+			break;
+		if (!(strvec = cc_get_strvec(cc)))
+			return r;
+		kw = keywords->slot[index];
+		if (kw->handler) {
+			t = kw->handler(conf, strvec, file, line);
+			r += t;
+			if (t)
+				condlog(1, "%s line %d, parsing failed: %s",
+					file, line, kw->string);
+		}
+		vector_free(strvec);
+		if (kw->sub) {
+			r += cc_replay_section(cc, conf, kw->sub, file,
+					       level + 1);
+			if (cc->failed)
+				return r;
+		}
+	}
+	cc->failed = true;
+	return r;
+}
+
+int config_cache_replay_file(struct config_cache *cc, struct config *conf,
+			     const char *file)
+{
+	if (!cc || !cc->replay || cc->failed)
+		return 1;
+	return cc_replay_section(cc, conf, conf->keywords, file, 0);
+}
@@ -0,0 +1,61 @@
+#ifndef CONFIG_CACHE_H_INCLUDED
+#define CONFIG_CACHE_H_INCLUDED
+
+#include <stdbool.h>
+
+/*
+ * Compiled configuration cache
+ *
+ * Parsing multipath.conf and the files in the configuration directory
+ * is a significant part of the startup time of short-lived tools like
+ * "multipath -u". The cache stores the keywords accepted by the parser,
+ * pre-tokenized and identified by their position in the keyword
+ * tables, together with the identity (device, inode, size, mtime and
+ * content hash) of all configuration files and of the configuration
+ * directory. If none of these has changed, the keywords are replayed
+ * from the memory-mapped cache file by calling their handlers directly,
+ * without reading, tokenizing and looking up the configuration text.
+ *
+ * Keyword handlers are still run, so the resulting configuration is
+ * exactly the same as after parsing. The cache is only written if the
+ * configuration files could be parsed without any warnings.
+ */
+
+struct config;
+struct config_cache;
+
+/*
+ * Map the cache file and check that it is up to date for conf_file.
+ * Returns a cache in replay mode if so, and one in recording mode if
+ * not. Returns NULL if the cache can't be used at all.
+ */
+struct config_cache *config_cache_open(const char *cache_file,
+				       const char *conf_file,
+				       const struct config *conf);
+bool config_cache_replaying(const struct config_cache *cc);
+void config_cache_free(struct config_cache *cc);
+
+/* Recording mode */
+/* Add a file or directory whose identity must be checked */
+int config_cache_add_source(struct config_cache *cc, const char *path,
+			    bool is_dir);
+/* Parse a configuration file, recording its keywords */
+int config_cache_process_file(struct config_cache *cc, struct config *conf,
+			      const char *file, bool in_dir);
+/* Write the cache file, if parsing went well */
+void config_cache_write(struct config_cache *cc);
+
+/* Replay mode */
+/*
+ * Returns the name of the next configuration file in the cache,
+ * and whether it's in the configuration directory,
+ * or NULL at the end of the cache.
+ */
+const char *config_cache_next_file(struct config_cache *cc, bool *in_dir);
+/* Replay the keywords of the current file */
+int config_cache_replay_file(struct config_cache *cc, struct config *conf,
+			     const char *file);
+/* True if the cache turned out to be inconsistent during replay */
+bool config_cache_failed(const struct config_cache *cc);
+
+#endif
@@ -0,0 +1,315 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Structural comparison of configurations, see config_diff.h
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "vector.h"
+#include "parser.h"
+#include "structs.h"
+#include "config.h"
+#include "blacklist.h"
+#include "debug.h"
+#include "strbuf.h"
+#include "util.h"
+#include "config_diff.h"
+
+static int strcmp_null(const char *s1, const char *s2)
+{
+	if (!s1 || !s2)
+		return s1 != s2;
+	return strcmp(s1, s2);
+}
+
+/* Print the values of all keywords in the section of rootkw */
+static int print_section(struct config *conf, struct strbuf *buf,
+			 const struct keyword *rootkw, const void *data)
+{
+	struct keyword *kw;
+	int i, rc;
+
+	if (!rootkw->sub)
+		return 0;
+
+	iterate_sub_keywords(rootkw, kw, i) {
+		if (!kw->print)
+			continue;
+		if ((rc = append_strbuf_str(buf, kw->string)) < 0 ||
+		    (rc = fill_strbuf(buf, ' ', 1)) < 0 ||
+		    (rc = kw->print(conf, buf, data)) < 0 ||
+		    (rc = fill_strbuf(buf, '\n', 1)) < 0)
+			return rc;
+	}
+	return 0;
+}
+
+/* Returns 1 if the section values differ, 0 if not, < 0 on error */
+static int section_differs(struct config *old, const void *old_data,
+			   struct config *new, const void *new_data,
+			   const struct keyword *rootkw)
+{
+	STRBUF_ON_STACK(obuf);
+	STRBUF_ON_STACK(nbuf);
+
+	if (!rootkw)
+		return -1;
+	if (print_section(old, &obuf, rootkw, old_data) < 0 ||
+	    print_section(new, &nbuf, rootkw, new_data) < 0)
+		return -1;
+	if (get_strbuf_len(&obuf) != get_strbuf_len(&nbuf))
+		return 1;
+	return get_strbuf_len(&obuf) > 0 &&
+		strcmp(get_strbuf_str(&obuf), get_strbuf_str(&nbuf)) != 0;
+}
+
+/* Compare two vectors of entries of the section of rootkw pairwise */
+static int entries_differ(struct config *old, const struct vector_s *ovec,
+			  struct config *new, const struct vector_s *nvec,
+			  const struct keyword *rootkw)
+{
+	int i, rc;
+
+	if (VECTOR_SIZE(ovec) != VECTOR_SIZE(nvec))
+		return 1;
+	for (i = 0; i < VECTOR_SIZE(ovec); i++) {
+		rc = section_differs(old, VECTOR_SLOT(ovec, i),
+				     new, VECTOR_SLOT(nvec, i), rootkw);
+		if (rc != 0)
+			return rc;
+	}
+	return 0;
+}
+
+static const struct keyword *
+get_keyword(const struct config *conf, char *section, char *name)
+{
+	struct keyword *kw;
+
+	kw = find_keyword(conf->keywords, NULL, section);
+	if (kw && name)
+		kw = kw->sub ? find_keyword(conf->keywords, kw->sub, name) :
+			NULL;
+	return kw;
+}
+
+static int diff_overrides(struct config *old, struct config *new)
+{
+	const struct keyword *kw;
+	int rc;
+
+	if (!old->overrides || !new->overrides)
+		return old->overrides != new->overrides;
+
+	kw = get_keyword(new, "overrides", NULL);
+	if ((rc = section_differs(old, NULL, new, NULL, kw)) != 0)
+		return rc;
+
+	kw = get_keyword(new, "overrides", "protocol");
+	return entries_differ(old, old->overrides->pctable,
+			      new, new->overrides->pctable, kw);
+}
+
+static bool blentries_differ(const struct vector_s *ovec,
+			     const struct vector_s *nvec)
+{
+	struct blentry *ble, *nble;
+	int i;
+
+	if (VECTOR_SIZE(ovec) != VECTOR_SIZE(nvec))
+		return true;
+	vector_foreach_slot(ovec, ble, i) {
+		nble = VECTOR_SLOT(nvec, i);
+		if (strcmp_null(ble->str, nble->str) ||
+		    ble->invert != nble->invert)
+			return true;
+	}
+	return false;
+}
+
+static bool blentries_device_differ(const struct vector_s *ovec,
+				    const struct vector_s *nvec)
+{
+	struct blentry_device *ble, *nble;
+	int i;
+
+	if (VECTOR_SIZE(ovec) != VECTOR_SIZE(nvec))
+		return true;
+	vector_foreach_slot(ovec, ble, i) {
+		nble = VECTOR_SLOT(nvec, i);
+		if (strcmp_null(ble->vendor, nble->vendor) ||
+		    strcmp_null(ble->product, nble->product) ||
+		    ble->vendor_invert != nble->vendor_invert ||
+		    ble->product_invert != nble->product_invert)
+			return true;
+	}
+	return false;
+}
+
+static bool diff_blacklist(const struct config *old, const struct config *new)
+{
+	return blentries_differ(old->blist_devnode, new->blist_devnode) ||
+		blentries_differ(old->blist_wwid, new->blist_wwid) ||
+		blentries_differ(old->blist_property, new->blist_property) ||
+		blentries_differ(old->blist_protocol, new->blist_protocol) ||
+		blentries_device_differ(old->blist_device, new->blist_device) ||
+		blentries_differ(old->elist_devnode, new->elist_devnode) ||
+		blentries_differ(old->elist_wwid, new->elist_wwid) ||
+		blentries_differ(old->elist_property, new->elist_property) ||
+		blentries_differ(old->elist_protocol, new->elist_protocol) ||
+		blentries_device_differ(old->elist_device, new->elist_device);
+}
+
+static int add_wwid(struct config_diff *diff, const char *wwid)
+{
+	char *str;
+
+	condlog(3, "%s: multipaths entry changed", wwid);
+	if (!(str = strdup(wwid)))
+		return -1;
+	if (!vector_alloc_slot(diff->wwids)) {
+		free(str);
+		return -1;
+	}
+	vector_set_slot(diff->wwids, str);
+	return 0;
+}
+
+/*
+ * load_config() sorts the mptable by WWID and merges duplicates,
+ * so the two tables can be compared in a single pass.
+ */
+static int diff_mptable(struct config *old, struct config *new,
+			struct config_diff *diff)
+{
+	const struct keyword *kw = get_keyword(new, "multipaths", "multipath");
+	struct mpentry *ompe, *nmpe;
+	int i = 0, j = 0, cmp, rc;
+
+	while (i < VECTOR_SIZE(old->mptable) || j < VECTOR_SIZE(new->mptable)) {
+		ompe = i < VECTOR_SIZE(old->mptable) ?
+			VECTOR_SLOT(old->mptable, i) : NULL;
+		nmpe = j < VECTOR_SIZE(new->mptable) ?
+			VECTOR_SLOT(new->mptable, j) : NULL;
+
+		if (!ompe)
+			cmp = 1;
+		else if (!nmpe)
+			cmp = -1;
+		else
+			cmp = strcmp(ompe->wwid, nmpe->wwid);
+
+		if (cmp < 0) {
+			/* removed */
+			rc = add_wwid(diff, ompe->wwid);
+			i++;
+		} else if (cmp > 0) {
+			/* added */
+			rc = add_wwid(diff, nmpe->wwid);
+			j++;
+		} else {
+			rc = section_differs(old, ompe, new, nmpe, kw);
+			if (rc > 0)
+				rc = add_wwid(diff, nmpe->wwid);
+			i++;
+			j++;
+		}
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
+}
+
+int diff_config(struct config *old, struct config *new,
+		struct config_diff *diff)
+{
+	int rc;
+
+	diff->sections = 0;
+	diff->wwids = vector_alloc();
+	if (!diff->wwids)
+		return -1;
+
+	if ((rc = section_differs(old, NULL, new, NULL,
+				  get_keyword(new, "defaults", NULL))) < 0)
+		goto fail;
+	if (rc)
+		diff->sections |= CONFIG_DIFF_DEFAULTS;
+
+	if ((rc = diff_overrides(old, new)) < 0)
+		goto fail;
+	if (rc)
+		diff->sections |= CONFIG_DIFF_OVERRIDES;
+
+	if ((rc = entries_differ(old, old->hwtable, new, new->hwtable,
+				 get_keyword(new, "devices", "device"))) < 0)
+		goto fail;
+	if (rc)
+		diff->sections |= CONFIG_DIFF_HWTABLE;
+
+	if (diff_blacklist(old, new))
+		diff->sections |= CONFIG_DIFF_BLACKLIST;
+
+	if (diff_mptable(old, new, diff) < 0)
+		goto fail;
+	if (VECTOR_SIZE(diff->wwids) > 0)
+		diff->sections |= CONFIG_DIFF_MPTABLE;
+
+	condlog(3, "%s: changed sections: 0x%x, multipaths entries: %d",
+		__func__, diff->sections, VECTOR_SIZE(diff->wwids));
+	return 0;
+
+fail:
+	condlog(1, "%s: failed to compare configurations", __func__);
+	free_config_diff(diff);
+	return -1;
+}
+
+void free_config_diff(struct config_diff *diff)
+{
+	char *wwid;
+	int i;
+
+	vector_foreach_slot(diff->wwids, wwid, i)
+		free(wwid);
+	vector_free(diff->wwids);
+	diff->wwids = NULL;
+}
+
+bool mpe_change_affects_paths(const struct mpentry *old,
+			      const struct mpentry *new)
+{
+	const char *oalias = old ? old->alias : NULL;
+	const char *nalias = new ? new->alias : NULL;
+	int oufn = old ? old->user_friendly_names : 0;
+	int nufn = new ? new->user_friendly_names : 0;
+
+	if (strcmp_null(oalias, nalias) || oufn != nufn)
+		return true;
+	return strcmp_null(old ? old->prio_name : NULL,
+			   new ? new->prio_name : NULL) ||
+		strcmp_null(old ? old->prio_args : NULL,
+			    new ? new->prio_args : NULL);
+}
+
+struct mpentry *find_mpe_sorted(const struct config *conf, const char *wwid)
+{
+	struct mpentry *mpe;
+	int lo = 0, hi = VECTOR_SIZE(conf->mptable) - 1, mid, cmp;
+
+	if (!wwid || !*wwid)
+		return NULL;
+
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		mpe = VECTOR_SLOT(conf->mptable, mid);
+		cmp = strcmp(mpe->wwid, wwid);
+		if (cmp == 0)
+			return mpe;
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return NULL;
+}
@@ -0,0 +1,54 @@
+#ifndef CONFIG_DIFF_H_INCLUDED
+#define CONFIG_DIFF_H_INCLUDED
+
+#include <stdbool.h>
+#include "vector.h"
+
+/*
+ * Structural comparison of two configurations
+ *
+ * multipathd uses this on reconfigure to find out which parts of the
+ * configuration have changed. The sections are compared by printing the
+ * values of all their keywords, so every setting that can be written in
+ * multipath.conf is taken into account. Multipaths entries are compared
+ * one by one; the WWIDs of the added, removed and changed entries are
+ * collected in the diff.
+ */
+
+struct config;
+struct mpentry;
+
+enum {
+	CONFIG_DIFF_DEFAULTS	= (1 << 0),
+	CONFIG_DIFF_OVERRIDES	= (1 << 1),
+	CONFIG_DIFF_HWTABLE	= (1 << 2),
+	CONFIG_DIFF_BLACKLIST	= (1 << 3),
+	CONFIG_DIFF_MPTABLE	= (1 << 4),
+};
+
+struct config_diff {
+	int sections;	/* CONFIG_DIFF_* flags of the changed sections */
+	vector wwids;	/* WWIDs of changed multipaths entries */
+};
+
+/*
+ * Compare old and new. Both configurations must have been set up by
+ * load_config(). Returns 0 on success, and -1 if the comparison failed,
+ * in which case the caller must assume that everything has changed.
+ */
+int diff_config(struct config *old, struct config *new,
+		struct config_diff *diff);
+void free_config_diff(struct config_diff *diff);
+
+/*
+ * Returns true if the difference between two multipaths entries for the
+ * same WWID affects more than the map's table and options, i.e. the map
+ * alias or the path priorities. Either entry may be NULL.
+ */
+bool mpe_change_affects_paths(const struct mpentry *old,
+			      const struct mpentry *new);
+
+/* Binary search in the mptable of a configuration set up by load_config() */
+struct mpentry *find_mpe_sorted(const struct config *conf, const char *wwid);
+
+#endif
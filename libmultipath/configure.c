@@ -302,6 +302,8 @@ int setup_map(struct multipath *mpp, char **params, struct vectors *vecs)
 	 */
 	conf = get_multipath_config();
 	pthread_cleanup_push(put_multipath_config, conf);
+	get_mp_settings(conf, mpp);
+	pthread_cleanup_push(drop_mp_settings, mpp);
 
 	select_pgfailback(conf, mpp);
 	select_detect_pgpolicy(conf, mpp);
@@ -347,6 +349,7 @@ int setup_map(struct multipath *mpp, char **params, struct vectors *vecs)
 	select_marginal_path_err_rate_threshold(conf, mpp);
 	select_marginal_path_err_recheck_gap_time(conf, mpp);
 	select_marginal_path_double_failed_time(conf, mpp);
+	select_marginal_path_err_method(conf, mpp);
 	select_san_path_err_threshold(conf, mpp);
 	select_san_path_err_forget_rate(conf, mpp);
 	select_san_path_err_recovery_time(conf, mpp);
@@ -356,6 +359,9 @@ int setup_map(struct multipath *mpp, char **params, struct vectors *vecs)
 	select_ghost_delay(conf, mpp);
 	select_flush_on_last_del(conf, mpp);
 	select_purge_disconnected(conf, mpp);
+	select_adaptive_weights(conf, mpp);
+	put_mp_settings(conf, mpp);
+	pthread_cleanup_pop(0);
 
 	sysfs_set_scsi_tmo(conf, mpp);
 	marginal_pathgroups = conf->marginal_pathgroups;
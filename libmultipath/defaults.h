@@ -21,8 +21,11 @@
 #define DEFAULT_PGPOLICY	FAILOVER
 #define DEFAULT_FAILBACK	-FAILBACK_MANUAL
 #define DEFAULT_RR_WEIGHT	RR_WEIGHT_NONE
+#define DEFAULT_MARGINAL_PATH_ERR_METHOD MARGINAL_PATH_ERR_METHOD_ACTIVE
 #define DEFAULT_NO_PATH_RETRY	NO_PATH_RETRY_UNDEF
 #define DEFAULT_VERBOSITY	2
+#define DEFAULT_LOG_COALESCE_INTERVAL	5
+#define DEFAULT_LOG_COALESCE_LEVEL	2
 #define DEFAULT_REASSIGN_MAPS	0
 #define DEFAULT_FIND_MULTIPATHS	FIND_MULTIPATHS_STRICT
 #define DEFAULT_FAST_IO_FAIL	5
@@ -59,6 +62,7 @@
 #define DEFAULT_RECHECK_WWID RECHECK_WWID_OFF
 #define DEFAULT_AUTO_RESIZE AUTO_RESIZE_NEVER
 #define DEFAULT_PURGE_DISCONNECTED PURGE_DISCONNECTED_OFF
+#define DEFAULT_ADAPTIVE_WEIGHTS ADAPTIVE_WEIGHTS_OFF
 /* Enable no foreign libraries by default */
 #define DEFAULT_ENABLE_FOREIGN "NONE"
 
@@ -72,6 +76,7 @@
 #define DEFAULT_WWIDS_FILE	STATE_DIR "/wwids"
 #define DEFAULT_PRKEYS_FILE	STATE_DIR "/prkeys"
 #define MULTIPATH_SHM_BASE	RUNTIME_DIR "/multipath/"
+#define DEFAULT_CONFIG_CACHE	RUNTIME_DIR "/multipath/config.cache"
 
 
 static inline char *set_default(char *str)
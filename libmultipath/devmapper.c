@@ -1175,16 +1175,31 @@ _dm_queue_if_no_path(const char *mapname, int enable)
 	return dm_message(mapname, message);
 }
 
+static void
+libmp_queueing_changed(const struct multipath *mpp __attribute__((unused)),
+		       int enable __attribute__((unused)))
+{
+	/* empty */
+}
+
+/* multipathd overrides this to notify subscribers */
+void queueing_changed(const struct multipath *mpp, int enable)
+	__attribute__((weak, alias("libmp_queueing_changed")));
+
 int dm_queue_if_no_path(struct multipath *mpp, int enable)
 {
 	int r;
 	static const char no_path_retry[] = "queue_if_no_path";
+	bool queueing = mpp->features &&
+		strstr(mpp->features, no_path_retry) != NULL;
 
 	if ((r = _dm_queue_if_no_path(mpp->alias, enable)) == 0) {
 		if (enable)
 			add_feature(&mpp->features, no_path_retry);
 		else
 			remove_feature(&mpp->features, no_path_retry);
+		if (queueing != !!enable)
+			queueing_changed(mpp, enable);
 	}
 	return r;
 }
@@ -521,6 +521,12 @@ declare_def_snprint(max_checkint, print_int)
 declare_def_range_handler(verbosity, 0, MAX_VERBOSITY)
 declare_def_snprint(verbosity, print_int)
 
+declare_def_range_handler(log_coalesce_interval, 0, INT_MAX)
+declare_def_snprint(log_coalesce_interval, print_int)
+
+declare_def_range_handler(log_coalesce_level, 0, MAX_VERBOSITY)
+declare_def_snprint(log_coalesce_level, print_int)
+
 declare_def_handler(reassign_maps, set_yes_no)
 declare_def_snprint(reassign_maps, print_yes_no)
 
@@ -951,6 +957,16 @@ declare_hw_snprint(purge_disconnected, print_yes_no_undef)
 declare_mp_handler(purge_disconnected, set_yes_no_undef)
 declare_mp_snprint(purge_disconnected, print_yes_no_undef)
 
+declare_def_handler(adaptive_weights, set_yes_no_undef)
+declare_def_snprint_defint(adaptive_weights, print_yes_no_undef,
+	DEFAULT_ADAPTIVE_WEIGHTS)
+declare_ovr_handler(adaptive_weights, set_yes_no_undef)
+declare_ovr_snprint(adaptive_weights, print_yes_no_undef)
+declare_hw_handler(adaptive_weights, set_yes_no_undef)
+declare_hw_snprint(adaptive_weights, print_yes_no_undef)
+declare_mp_handler(adaptive_weights, set_yes_no_undef)
+declare_mp_snprint(adaptive_weights, print_yes_no_undef)
+
 declare_def_range_handler(remove_retries, 0, INT_MAX)
 declare_def_snprint(remove_retries, print_int)
 
@@ -1705,6 +1721,52 @@ declare_hw_snprint(marginal_path_double_failed_time, print_off_int_undef)
 declare_mp_handler(marginal_path_double_failed_time, set_off_int_undef)
 declare_mp_snprint(marginal_path_double_failed_time, print_off_int_undef)
 
+static int
+set_marginal_path_err_method(vector strvec, void *ptr, const char *file,
+			     int line_nr)
+{
+	int *int_ptr = (int *)ptr;
+	char * buff;
+
+	buff = set_value(strvec);
+
+	if (!buff)
+		return 1;
+
+	if (!strcmp(buff, "active"))
+		*int_ptr = MARGINAL_PATH_ERR_METHOD_ACTIVE;
+	else if (!strcmp(buff, "passive"))
+		*int_ptr = MARGINAL_PATH_ERR_METHOD_PASSIVE;
+	else
+		condlog(1, "%s line %d, invalid value for marginal_path_err_method: \"%s\"",
+			file, line_nr, buff);
+	free(buff);
+
+	return 0;
+}
+
+int
+print_marginal_path_err_method(struct strbuf *buff, long v)
+{
+	if (v == MARGINAL_PATH_ERR_METHOD_ACTIVE)
+		return append_strbuf_quoted(buff, "active");
+	if (v == MARGINAL_PATH_ERR_METHOD_PASSIVE)
+		return append_strbuf_quoted(buff, "passive");
+
+	return 0;
+}
+
+declare_def_handler(marginal_path_err_method, set_marginal_path_err_method)
+declare_def_snprint_defint(marginal_path_err_method,
+			   print_marginal_path_err_method,
+			   DEFAULT_MARGINAL_PATH_ERR_METHOD)
+declare_ovr_handler(marginal_path_err_method, set_marginal_path_err_method)
+declare_ovr_snprint(marginal_path_err_method, print_marginal_path_err_method)
+declare_hw_handler(marginal_path_err_method, set_marginal_path_err_method)
+declare_hw_snprint(marginal_path_err_method, print_marginal_path_err_method)
+declare_mp_handler(marginal_path_err_method, set_marginal_path_err_method)
+declare_mp_snprint(marginal_path_err_method, print_marginal_path_err_method)
+
 declare_def_handler(ghost_delay, set_off_int_undef)
 declare_def_snprint(ghost_delay, print_off_int_undef)
 declare_ovr_handler(ghost_delay, set_off_int_undef)
@@ -2171,6 +2233,8 @@ init_keywords(vector keywords)
 {
 	install_keyword_root("defaults", NULL);
 	install_keyword("verbosity", &def_verbosity_handler, &snprint_def_verbosity);
+	install_keyword("log_coalesce_interval", &def_log_coalesce_interval_handler, &snprint_def_log_coalesce_interval);
+	install_keyword("log_coalesce_level", &def_log_coalesce_level_handler, &snprint_def_log_coalesce_level);
 	install_keyword("polling_interval", &checkint_handler, &snprint_def_checkint);
 	install_keyword("max_polling_interval", &def_max_checkint_handler, &snprint_def_max_checkint);
 	install_keyword("reassign_maps", &def_reassign_maps_handler, &snprint_def_reassign_maps);
@@ -2230,6 +2294,7 @@ init_keywords(vector keywords)
 	install_keyword("marginal_path_err_rate_threshold", &def_marginal_path_err_rate_threshold_handler, &snprint_def_marginal_path_err_rate_threshold);
 	install_keyword("marginal_path_err_recheck_gap_time", &def_marginal_path_err_recheck_gap_time_handler, &snprint_def_marginal_path_err_recheck_gap_time);
 	install_keyword("marginal_path_double_failed_time", &def_marginal_path_double_failed_time_handler, &snprint_def_marginal_path_double_failed_time);
+	install_keyword("marginal_path_err_method", &def_marginal_path_err_method_handler, &snprint_def_marginal_path_err_method);
 
 	install_keyword("find_multipaths", &def_find_multipaths_handler, &snprint_def_find_multipaths);
 	install_keyword("uxsock_timeout", &def_uxsock_timeout_handler, &snprint_def_uxsock_timeout);
@@ -2238,6 +2303,7 @@ init_keywords(vector keywords)
 	install_keyword("missing_uev_wait_timeout", &def_uev_wait_timeout_handler, &snprint_def_uev_wait_timeout);
 	install_keyword("skip_kpartx", &def_skip_kpartx_handler, &snprint_def_skip_kpartx);
 	install_keyword("purge_disconnected", &def_purge_disconnected_handler, &snprint_def_purge_disconnected);
+	install_keyword("adaptive_weights", &def_adaptive_weights_handler, &snprint_def_adaptive_weights);
 	install_keyword("disable_changed_wwids", &deprecated_disable_changed_wwids_handler, &snprint_deprecated);
 	install_keyword("remove_retries", &def_remove_retries_handler, &snprint_def_remove_retries);
 	install_keyword("max_sectors_kb", &def_max_sectors_kb_handler, &snprint_def_max_sectors_kb);
@@ -2320,8 +2386,10 @@ init_keywords(vector keywords)
 	install_keyword("marginal_path_err_rate_threshold", &hw_marginal_path_err_rate_threshold_handler, &snprint_hw_marginal_path_err_rate_threshold);
 	install_keyword("marginal_path_err_recheck_gap_time", &hw_marginal_path_err_recheck_gap_time_handler, &snprint_hw_marginal_path_err_recheck_gap_time);
 	install_keyword("marginal_path_double_failed_time", &hw_marginal_path_double_failed_time_handler, &snprint_hw_marginal_path_double_failed_time);
+	install_keyword("marginal_path_err_method", &hw_marginal_path_err_method_handler, &snprint_hw_marginal_path_err_method);
 	install_keyword("skip_kpartx", &hw_skip_kpartx_handler, &snprint_hw_skip_kpartx);
 	install_keyword("purge_disconnected", &hw_purge_disconnected_handler, &snprint_hw_purge_disconnected);
+	install_keyword("adaptive_weights", &hw_adaptive_weights_handler, &snprint_hw_adaptive_weights);
 	install_keyword("max_sectors_kb", &hw_max_sectors_kb_handler, &snprint_hw_max_sectors_kb);
 	install_keyword("ghost_delay", &hw_ghost_delay_handler, &snprint_hw_ghost_delay);
 	install_keyword("all_tg_pt", &hw_all_tg_pt_handler, &snprint_hw_all_tg_pt);
@@ -2365,9 +2433,11 @@ init_keywords(vector keywords)
 	install_keyword("marginal_path_err_rate_threshold", &ovr_marginal_path_err_rate_threshold_handler, &snprint_ovr_marginal_path_err_rate_threshold);
 	install_keyword("marginal_path_err_recheck_gap_time", &ovr_marginal_path_err_recheck_gap_time_handler, &snprint_ovr_marginal_path_err_recheck_gap_time);
 	install_keyword("marginal_path_double_failed_time", &ovr_marginal_path_double_failed_time_handler, &snprint_ovr_marginal_path_double_failed_time);
+	install_keyword("marginal_path_err_method", &ovr_marginal_path_err_method_handler, &snprint_ovr_marginal_path_err_method);
 
 	install_keyword("skip_kpartx", &ovr_skip_kpartx_handler, &snprint_ovr_skip_kpartx);
 	install_keyword("purge_disconnected", &ovr_purge_disconnected_handler, &snprint_ovr_purge_disconnected);
+	install_keyword("adaptive_weights", &ovr_adaptive_weights_handler, &snprint_ovr_adaptive_weights);
 	install_keyword("max_sectors_kb", &ovr_max_sectors_kb_handler, &snprint_ovr_max_sectors_kb);
 	install_keyword("ghost_delay", &ovr_ghost_delay_handler, &snprint_ovr_ghost_delay);
 	install_keyword("all_tg_pt", &ovr_all_tg_pt_handler, &snprint_ovr_all_tg_pt);
@@ -2412,8 +2482,10 @@ init_keywords(vector keywords)
 	install_keyword("marginal_path_err_rate_threshold", &mp_marginal_path_err_rate_threshold_handler, &snprint_mp_marginal_path_err_rate_threshold);
 	install_keyword("marginal_path_err_recheck_gap_time", &mp_marginal_path_err_recheck_gap_time_handler, &snprint_mp_marginal_path_err_recheck_gap_time);
 	install_keyword("marginal_path_double_failed_time", &mp_marginal_path_double_failed_time_handler, &snprint_mp_marginal_path_double_failed_time);
+	install_keyword("marginal_path_err_method", &mp_marginal_path_err_method_handler, &snprint_mp_marginal_path_err_method);
 	install_keyword("skip_kpartx", &mp_skip_kpartx_handler, &snprint_mp_skip_kpartx);
 	install_keyword("purge_disconnected", &mp_purge_disconnected_handler, &snprint_mp_purge_disconnected);
+	install_keyword("adaptive_weights", &mp_adaptive_weights_handler, &snprint_mp_adaptive_weights);
 	install_keyword("max_sectors_kb", &mp_max_sectors_kb_handler, &snprint_mp_max_sectors_kb);
 	install_keyword("ghost_delay", &mp_ghost_delay_handler, &snprint_mp_ghost_delay);
 	install_sublevel_end();
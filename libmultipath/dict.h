@@ -8,6 +8,7 @@ struct strbuf;
 void init_keywords(vector keywords);
 int get_sys_max_fds(int *);
 int print_rr_weight(struct strbuf *buff, long v);
+int print_marginal_path_err_method(struct strbuf *buff, long v);
 int print_pgfailback(struct strbuf *buff, long v);
 int print_pgpolicy(struct strbuf *buff, long v);
 int print_no_path_retry(struct strbuf *buff, long v);
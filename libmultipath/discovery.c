@@ -2014,9 +2014,13 @@ get_state (struct path * pp)
 	condlog(lvl, "%s: %s state = %s", pp->dev,
 		checker_name(c), checker_state_name(state));
 	if (state != PATH_UP && state != PATH_GHOST &&
-	    strlen(checker_message(c)))
-		condlog(lvl, "%s: %s checker%s",
-			pp->dev, checker_name(c), checker_message(c));
+	    strlen(checker_message(c)) && lvl <= libmp_verbosity) {
+		char host[16];
+
+		safe_sprintf(host, "host%d", pp->sg_id.host_no);
+		condlog_coalesce(lvl, host, "%s: %s checker%s",
+				 pp->dev, checker_name(c), checker_message(c));
+	}
 	if (state != PATH_PENDING)
 		pp->oldstate = state;
 
@@ -2024,11 +2028,54 @@ get_state (struct path * pp)
 }
 
 static int
-get_prio (struct path * pp)
+set_prio(struct path *pp, int prio, int old_prio)
+{
+	struct prio *p = &pp->prio;
+
+	pp->priority = prio;
+	if (pp->priority < 0) {
+		int state = path_sysfs_state(pp);
+
+		if (state == PATH_DOWN || state == PATH_PENDING) {
+			pp->priority = old_prio;
+			condlog(3, "%s: %s prio error in state %d, keeping prio = %d",
+				pp->dev, prio_name(p), state, pp->priority);
+		} else {
+			condlog(3, "%s: %s prio error in state %d",
+				pp->dev, prio_name(p), state);
+			pp->priority = PRIO_UNDEF;
+		}
+		return 1;
+	}
+	condlog((old_prio == pp->priority ? 4 : 3), "%s: %s prio = %u",
+		pp->dev, prio_name(p), pp->priority);
+	return 0;
+}
+
+int
+poll_prio(struct path *pp)
+{
+	int prio;
+
+	if (!pp)
+		return 0;
+	switch (prio_async_poll(&pp->prio, pp, &prio)) {
+	case PRIO_ASYNC_DONE:
+		set_prio(pp, prio, pp->priority);
+		return 1;
+	case PRIO_ASYNC_TIMEOUT:
+		set_prio(pp, -1, pp->priority);
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static int
+get_prio (struct path * pp, bool async)
 {
 	struct prio * p;
 	struct config *conf;
-	int old_prio;
 
 	if (!pp)
 		return 0;
@@ -2046,25 +2093,17 @@ get_prio (struct path * pp)
 			return 1;
 		}
 	}
-	old_prio = pp->priority;
-	pp->priority = prio_getprio(p, pp);
-	if (pp->priority < 0) {
-		int state = path_sysfs_state(pp);
-
-		if (state == PATH_DOWN || state == PATH_PENDING) {
-			pp->priority = old_prio;
-			condlog(3, "%s: %s prio error in state %d, keeping prio = %d",
-				pp->dev, prio_name(p), state, pp->priority);
-		} else {
-			condlog(3, "%s: %s prio error in state %d",
-				pp->dev, prio_name(p), state);
-			pp->priority = PRIO_UNDEF;
-		}
-		return 1;
-	}
-	condlog((old_prio == pp->priority ? 4 : 3), "%s: %s prio = %u",
-		pp->dev, prio_name(p), pp->priority);
-	return 0;
+	/*
+	 * A request may be in flight even if the caller doesn't ask for
+	 * async mode. Don't start another one for the same path. After a
+	 * timeout, don't fall back to a synchronous call either, it would
+	 * most likely block just the same. The path keeps the priority set
+	 * by poll_prio() until the request completes.
+	 */
+	if (poll_prio(pp) || p->async ||
+	    (async && prio_async_submit(p, pp) == 0))
+		return 0;
+	return set_prio(pp, prio_getprio(p, pp), pp->priority);
 }
 
 /*
@@ -2570,7 +2609,7 @@ int pathinfo(struct path *pp, struct config *conf, int mask)
 	  */
 	if ((mask & DI_PRIO) && path_state == PATH_UP && strlen(pp->wwid)) {
 		if (pp->state != PATH_DOWN || pp->priority == PRIO_UNDEF) {
-			get_prio(pp);
+			get_prio(pp, mask & DI_ASYNC_PRIO);
 		}
 	}
 
@@ -37,6 +37,7 @@ int path_sysfs_state(struct path *);
 int start_checker(struct path * pp, struct config * conf, int daemon,
 		  int state);
 int get_state(struct path * pp);
+int poll_prio(struct path *pp);
 int get_vpd_sgio (int fd, int pg, int vend_id, char * str, int maxlen);
 int pathinfo (struct path * pp, struct config * conf, int mask);
 int alloc_path_with_pathinfo (struct config *conf, struct udev_device *udevice,
@@ -75,6 +76,7 @@ enum discovery_mode {
 	DI_NOIO__,
 	DI_NOFALLBACK__,
 	DI_DISCOVERY__,
+	DI_ASYNC_PRIO__,
 };
 
 #define DI_SYSFS	(1 << DI_SYSFS__)
@@ -86,6 +88,7 @@ enum discovery_mode {
 #define DI_NOIO		(1 << DI_NOIO__) /* Avoid IO on the device */
 #define DI_NOFALLBACK	(1 << DI_NOFALLBACK__) /* do not allow wwid fallback */
 #define DI_DISCOVERY	(1 << DI_DISCOVERY__) /* set only during map discovery */
+#define DI_ASYNC_PRIO	(1 << DI_ASYNC_PRIO__) /* run prioritizer in a worker */
 
 #define DI_ALL		(DI_SYSFS  | DI_IOCTL | DI_CHECKER | DI_PRIO | DI_WWID)
 
@@ -84,8 +84,9 @@ int assemble_map(struct multipath *mp, char **params)
 
 	vector_foreach_slot (mp->pg, pgp, i) {
 		pgp = VECTOR_SLOT(mp->pg, i);
-		if (print_strbuf(&buff, " %s %i 1", mp->selector,
-				 VECTOR_SIZE(pgp->paths)) < 0)
+		if (print_strbuf(&buff, " %s %i %i", mp->selector,
+				 VECTOR_SIZE(pgp->paths),
+				 adaptive_weights_enabled(mp) ? 2 : 1) < 0)
 			goto err;
 
 		vector_foreach_slot (pgp->paths, pp, j) {
@@ -100,6 +101,11 @@ int assemble_map(struct multipath *mp, char **params)
 			}
 			if (print_strbuf(&buff, " %s %d", pp->dev_t, tmp_minio) < 0)
 				goto err;
+			/* service-time relative_throughput */
+			if (adaptive_weights_enabled(mp) &&
+			    print_strbuf(&buff, " %u",
+					 path_rel_throughput(pp)) < 0)
+				goto err;
 		}
 	}
 
@@ -327,6 +333,13 @@ int disassemble_map(const struct vector_s *pathvec,
 					if (def_minio != mpp->minio)
 						mpp->minio = def_minio;
 				}
+				else if (k == 1 &&
+					 !strncmp(mpp->selector,
+						  "service-time", 12)) {
+					p += get_word(p, &word);
+					pp->dm_rel_throughput = atoi(word);
+					free(word);
+				}
 				else
 					p += get_word(p, NULL);
 
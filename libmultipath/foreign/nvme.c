@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include "util.h"
 #include "vector.h"
 #include "generic.h"
@@ -57,6 +58,8 @@ struct nvme_map {
 	struct vector_s pgvec;
 	int nr_live;
 	int ana_supported;
+	/* number of controllers in subsys at the last full scan */
+	int nr_ctrls;
 };
 
 #define NAME_LEN 64 /* buffer length for temp attributes */
@@ -487,6 +490,55 @@ _find_path_by_syspath(struct nvme_map *map, const char *syspath)
 	return NULL;
 }
 
+/*
+ * Native NVMe multipath path devices are named nvme${SUBSYS}c${CTRL}n${NS},
+ * the namespace head they belong to is nvme${SUBSYS}n${NS}.
+ */
+static struct nvme_map *_find_map_for_path(const struct context *ctx,
+					   struct udev_device *ud)
+{
+	const char *name = udev_device_get_sysname(ud);
+	char head[NAME_LEN];
+	struct nvme_map *nm;
+	int s, c, n, i;
+
+	if (name == NULL || sscanf(name, "nvme%dc%dn%d", &s, &c, &n) != 3 ||
+	    safe_sprintf(head, "nvme%dn%d", s, n))
+		return NULL;
+
+	vector_foreach_slot(ctx->mpvec, nm, i) {
+		const char *mname = udev_device_get_sysname(nm->udev);
+
+		if (mname && !strcmp(mname, head))
+			return nm;
+	}
+	return NULL;
+}
+
+/*
+ * Unlike _find_path_by_syspath(), this doesn't use realpath(), which
+ * fails for removed devices. udev syspaths are canonical anyway.
+ */
+static struct nvme_path *_find_path_by_udev(const struct nvme_map *map,
+					    struct udev_device *ud)
+{
+	const char *syspath = udev_device_get_syspath(ud);
+	struct nvme_pathgroup *pg;
+	int i;
+
+	if (syspath == NULL)
+		return NULL;
+
+	vector_foreach_slot(&map->pgvec, pg, i) {
+		struct nvme_path *path = nvme_pg_to_path(pg);
+		const char *psyspath = udev_device_get_syspath(path->udev);
+
+		if (psyspath && !strcmp(syspath, psyspath))
+			return path;
+	}
+	return NULL;
+}
+
 static void _udev_device_unref(void *p)
 {
 	udev_device_unref(p);
@@ -616,6 +668,70 @@ static void test_ana_support(struct nvme_map *map, struct udev_device *ctl)
 	pthread_cleanup_pop(1);
 }
 
+static void _update_nr_live(struct nvme_map *map)
+{
+	static const char live_state[] = "live";
+	struct nvme_pathgroup *pg;
+	struct nvme_path *path;
+	char state[16];
+	int i;
+
+	map->nr_live = 0;
+	vector_foreach_slot(&map->pgvec, pg, i) {
+		path = nvme_pg_to_path(pg);
+		if ((sysfs_attr_get_value(path->ctl, "state", state,
+					  sizeof(state)) > 0) &&
+		    !strncmp(state, live_state, sizeof(live_state) - 1))
+			map->nr_live++;
+	}
+	condlog(3, "%s: %s: map %s has %d/%d live paths", __func__, THIS,
+		udev_device_get_sysname(map->udev), map->nr_live,
+		VECTOR_SIZE(&map->pgvec));
+}
+
+/*
+ * Add a new path to map. On success, the reference to udev is
+ * taken over by the path.
+ */
+static struct nvme_path *_add_path(struct nvme_map *map,
+				   struct udev_device *udev)
+{
+	struct nvme_path *path;
+
+	path = calloc(1, sizeof(*path));
+	if (path == NULL)
+		return NULL;
+
+	path->gen.ops = &nvme_path_ops;
+	path->map = map;
+	path->ctl = udev_device_get_parent_with_subsystem_devtype
+		(udev, "nvme", NULL);
+	if (path->ctl == NULL) {
+		condlog(1, "%s: %s: failed to get controller for %s",
+			__func__, THIS, udev_device_get_sysname(udev));
+		cleanup_nvme_path(path);
+		return NULL;
+	}
+	test_ana_support(map, path->ctl);
+
+	path->pg.gen.ops = &nvme_pg_ops;
+	if (!vector_alloc_slot(&path->pg.pathvec)) {
+		cleanup_nvme_path(path);
+		return NULL;
+	}
+	vector_set_slot(&path->pg.pathvec, path);
+	if (!vector_alloc_slot(&map->pgvec)) {
+		cleanup_nvme_path(path);
+		return NULL;
+	}
+	vector_set_slot(&map->pgvec, &path->pg);
+	path->udev = udev;
+	condlog(3, "%s: %s: new path %s added to %s",
+		__func__, THIS, udev_device_get_sysname(path->udev),
+		udev_device_get_sysname(map->udev));
+	return path;
+}
+
 static void _find_controllers(struct context *ctx, struct nvme_map *map)
 {
 	char pathbuf[PATH_MAX], realbuf[PATH_MAX];
@@ -646,6 +762,7 @@ static void _find_controllers(struct context *ctx, struct nvme_map *map)
 	n = snprintf(pathbuf, sizeof(pathbuf), "%s",
 		     udev_device_get_syspath(subsys));
 	r = scandir(pathbuf, &di, _dirent_controller, alphasort);
+	map->nr_ctrls = r;
 
 	if (r == 0) {
 		condlog(3, "%s: %s: no controllers for %s", __func__, THIS,
@@ -703,42 +820,15 @@ static void _find_controllers(struct context *ctx, struct nvme_map *map)
 			continue;
 		}
 
-		path = calloc(1, sizeof(*path));
-		if (path == NULL)
-			continue;
-
-		path->gen.ops = &nvme_path_ops;
-		path->udev = steal_ptr(udev);
-		path->seen = true;
-		path->map = map;
-		path->ctl = udev_device_get_parent_with_subsystem_devtype
-			(path->udev, "nvme", NULL);
-		if (path->ctl == NULL) {
-			condlog(1, "%s: %s: failed to get controller for %s",
-				__func__, THIS, fn);
-			cleanup_nvme_path(path);
-			continue;
-		}
-		test_ana_support(map, path->ctl);
-
-		path->pg.gen.ops = &nvme_pg_ops;
-		if (!vector_alloc_slot(&path->pg.pathvec)) {
-			cleanup_nvme_path(path);
-			continue;
-		}
-		vector_set_slot(&path->pg.pathvec, path);
-		if (!vector_alloc_slot(&map->pgvec)) {
-			cleanup_nvme_path(path);
-			continue;
+		path = _add_path(map, udev);
+		if (path != NULL) {
+			/* _add_path() took over the reference */
+			udev = NULL;
+			path->seen = true;
 		}
-		vector_set_slot(&map->pgvec, &path->pg);
-		condlog(3, "%s: %s: new path %s added to %s",
-			__func__, THIS, udev_device_get_sysname(path->udev),
-			udev_device_get_sysname(map->udev));
 	}
 	pthread_cleanup_pop(1);
 
-	map->nr_live = 0;
 	vector_foreach_slot_backwards(&map->pgvec, pg, i) {
 		path = nvme_pg_to_path(pg);
 		if (!path->seen) {
@@ -746,19 +836,9 @@ static void _find_controllers(struct context *ctx, struct nvme_map *map)
 				i, udev_device_get_sysname(map->udev));
 			vector_del_slot(&map->pgvec, i);
 			cleanup_nvme_path(path);
-		} else {
-			static const char live_state[] = "live";
-			char state[16];
-
-			if ((sysfs_attr_get_value(path->ctl, "state", state,
-						  sizeof(state)) > 0) &&
-			    !strncmp(state, live_state, sizeof(live_state) - 1))
-				map->nr_live++;
 		}
 	}
-	condlog(3, "%s: %s: map %s has %d/%d live paths", __func__, THIS,
-		udev_device_get_sysname(map->udev), map->nr_live,
-		VECTOR_SIZE(&map->pgvec));
+	_update_nr_live(map);
 }
 
 static int _add_map(struct context *ctx, struct udev_device *ud,
@@ -793,6 +873,24 @@ static int _add_map(struct context *ctx, struct udev_device *ud,
 	return FOREIGN_CLAIMED;
 }
 
+static int _add_path_dev(struct context *ctx, struct udev_device *ud)
+{
+	struct nvme_map *map;
+
+	map = _find_map_for_path(ctx, ud);
+	if (map == NULL)
+		/* will be found when the map is added */
+		return FOREIGN_IGNORED;
+	if (_find_path_by_udev(map, ud) != NULL)
+		return FOREIGN_OK;
+	if (_add_path(map, udev_device_ref(ud)) == NULL) {
+		udev_device_unref(ud);
+		return FOREIGN_ERR;
+	}
+	_update_nr_live(map);
+	return FOREIGN_CLAIMED;
+}
+
 int add(struct context *ctx, struct udev_device *ud)
 {
 	struct udev_device *subsys;
@@ -810,8 +908,16 @@ int add(struct context *ctx, struct udev_device *ud)
 	subsys = udev_device_get_parent_with_subsystem_devtype(ud,
 							       "nvme-subsystem",
 							       NULL);
-	if (subsys == NULL)
-		return FOREIGN_IGNORED;
+	if (subsys == NULL) {
+		if (udev_device_get_parent_with_subsystem_devtype(ud, "nvme",
+								  NULL) == NULL)
+			return FOREIGN_IGNORED;
+		lock(ctx);
+		pthread_cleanup_push(unlock, ctx);
+		rc = _add_path_dev(ctx, ud);
+		pthread_cleanup_pop(1);
+		return rc;
+	}
 
 	lock(ctx);
 	pthread_cleanup_push(unlock, ctx);
@@ -828,11 +934,61 @@ int add(struct context *ctx, struct udev_device *ud)
 	return rc;
 }
 
-int change(__attribute__((unused)) struct context *ctx,
-	   __attribute__((unused)) struct udev_device *ud)
+static int _change(struct context *ctx, struct udev_device *ud)
+{
+	struct nvme_map *map;
+
+	if (_find_nvme_map_by_devt(ctx, udev_device_get_devnum(ud)) != NULL)
+		return FOREIGN_OK;
+
+	map = _find_map_for_path(ctx, ud);
+	if (map == NULL || _find_path_by_udev(map, ud) == NULL)
+		return FOREIGN_IGNORED;
+	_update_nr_live(map);
+	return FOREIGN_OK;
+}
+
+int change(struct context *ctx, struct udev_device *ud)
 {
+	int rc;
+
 	condlog(5, "%s called for \"%s\"", __func__, THIS);
-	return FOREIGN_IGNORED;
+
+	if (ud == NULL)
+		return FOREIGN_ERR;
+
+	lock(ctx);
+	pthread_cleanup_push(unlock, ctx);
+	rc = _change(ctx, ud);
+	pthread_cleanup_pop(1);
+
+	return rc;
+}
+
+static int _delete_path_dev(struct context *ctx, struct udev_device *ud)
+{
+	struct nvme_map *map;
+	struct nvme_path *path;
+	int k;
+
+	map = _find_map_for_path(ctx, ud);
+	if (map == NULL)
+		return FOREIGN_IGNORED;
+	path = _find_path_by_udev(map, ud);
+	if (path == NULL)
+		return FOREIGN_IGNORED;
+
+	k = find_slot(&map->pgvec, &path->pg);
+	if (k == -1)
+		return FOREIGN_ERR;
+	vector_del_slot(&map->pgvec, k);
+	condlog(3, "%s: %s: path %s removed from %s", __func__, THIS,
+		udev_device_get_sysname(path->udev),
+		udev_device_get_sysname(map->udev));
+	cleanup_nvme_path(path);
+	_update_nr_live(map);
+
+	return FOREIGN_OK;
 }
 
 static int _delete_map(struct context *ctx, struct udev_device *ud)
@@ -843,7 +999,7 @@ static int _delete_map(struct context *ctx, struct udev_device *ud)
 
 	map = _find_nvme_map_by_devt(ctx, devt);
 	if (map ==NULL)
-		return FOREIGN_IGNORED;
+		return _delete_path_dev(ctx, ud);
 
 	k = find_slot(ctx->mpvec, map);
 	if (k == -1)
@@ -880,16 +1036,83 @@ int delete(struct context *ctx, struct udev_device *ud)
 	return rc;
 }
 
+static int _count_controllers(struct udev_device *subsys)
+{
+	struct dirent **di = NULL;
+	int r, i;
+
+	r = scandir(udev_device_get_syspath(subsys), &di, _dirent_controller,
+		    NULL);
+	for (i = 0; i < r; i++)
+		free(di[i]);
+	free(di);
+	return r;
+}
+
+struct subsys_ctrls {
+	const char *syspath;
+	int nr_ctrls;
+};
+
+/*
+ * The topology is updated from uevents. Controllers being added to or
+ * removed from a subsystem don't generate block uevents, though. Count
+ * the controllers of every subsystem once, and rescan only maps whose
+ * subsystem has changed since the last full scan. Drop paths whose
+ * devices have vanished without a uevent.
+ * Every map holds its own udev_device for the subsystem, so subsystems
+ * are identified by their syspath.
+ */
 void check__(struct context *ctx)
 {
 	struct gen_multipath *gm;
-	int i;
+	struct subsys_ctrls *sc = NULL;
+	int i, j, n_sc = 0;
+
+	sc = calloc(VECTOR_SIZE(ctx->mpvec), sizeof(*sc));
+	if (sc == NULL)
+		return;
+	pthread_cleanup_push(free, sc);
 
 	vector_foreach_slot(ctx->mpvec, gm, i) {
 		struct nvme_map *map = gen_mp_to_nvme(gm);
+		struct nvme_pathgroup *pg;
+		struct nvme_path *path;
+		const char *syspath = udev_device_get_syspath(map->subsys);
+		bool rescan = false;
 
-		_find_controllers(ctx, map);
+		if (syspath == NULL)
+			continue;
+		for (j = 0; j < n_sc && strcmp(sc[j].syspath, syspath); j++)
+			;
+		if (j == n_sc) {
+			sc[n_sc].syspath = syspath;
+			sc[n_sc++].nr_ctrls = _count_controllers(map->subsys);
+		}
+		if (sc[j].nr_ctrls != map->nr_ctrls) {
+			condlog(3, "%s: %s: controllers of %s changed: %d -> %d",
+				__func__, THIS,
+				udev_device_get_sysname(map->udev),
+				map->nr_ctrls, sc[j].nr_ctrls);
+			rescan = true;
+		}
+		vector_foreach_slot(&map->pgvec, pg, j) {
+			path = nvme_pg_to_path(pg);
+			if (access(udev_device_get_syspath(path->udev),
+				   F_OK) != 0) {
+				condlog(3, "%s: %s: path %s vanished",
+					__func__, THIS,
+					udev_device_get_sysname(path->udev));
+				rescan = true;
+				break;
+			}
+		}
+		if (rescan)
+			_find_controllers(ctx, map);
+		else
+			_update_nr_live(map);
 	}
+	pthread_cleanup_pop(1);
 }
 
 void check(struct context *ctx)
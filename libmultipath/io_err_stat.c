@@ -32,6 +32,8 @@
 #include "time-util.h"
 #include "io_err_stat.h"
 #include "util.h"
+#include "sysfs.h"
+#include "mt-udev-wrap.h"
 
 #define TIMEOUT_NO_IO_NSEC		10000000 /*10ms = 10000000ns*/
 #define FLAKY_PATHFAIL_THRESHOLD	2
@@ -61,6 +63,12 @@ struct io_err_stat_path {
 
 	int		total_time;
 	int		err_rate_threshold;
+
+	/* passive checking, see get_passive_io_counters() */
+	bool		passive;
+	unsigned long long	done_start;
+	unsigned long long	err_start;
+	int		dm_failures;
 };
 
 static pthread_t	io_err_stat_thr;
@@ -235,6 +243,57 @@ out:
 	pthread_cleanup_pop(1);
 }
 
+/*
+ * For the passive method, the number of commands completed by the path,
+ * and how many of them failed. For SCSI, these are the counters of the
+ * SCSI midlayer. Otherwise, only the completed I/Os are known from the
+ * block layer statistics, and errors are counted from dm-multipath path
+ * failure events.
+ */
+static int get_passive_io_counters(struct path *path, unsigned long long *done,
+				   unsigned long long *err)
+{
+	struct udev_device *parent;
+	struct io_stats st;
+	char buf[32];
+
+	if (path->bus == SYSFS_BUS_SCSI && path->udev) {
+		parent = udev_device_get_parent_with_subsystem_devtype(
+			path->udev, "scsi", "scsi_device");
+		if (parent &&
+		    sysfs_attr_get_value_ok(parent, "iodone_cnt", buf,
+					    sizeof(buf)) &&
+		    sscanf(buf, "%llx", done) == 1 &&
+		    sysfs_attr_get_value_ok(parent, "ioerr_cnt", buf,
+					    sizeof(buf)) &&
+		    sscanf(buf, "%llx", err) == 1)
+			return 0;
+	}
+	if (sysfs_get_io_stats(path, &st) != 0)
+		return 1;
+	*done = st.ios;
+	*err = 0;
+	return 0;
+}
+
+static void account_passive_io_state(struct io_err_stat_path *pp,
+				     struct path *path)
+{
+	unsigned long long done, err;
+
+	if (get_passive_io_counters(path, &done, &err) != 0 ||
+	    done < pp->done_start || err < pp->err_start) {
+		io_err_stat_log(3, "%s: I/O counters unavailable or reset",
+				pp->devname);
+		return;
+	}
+	pp->io_nr = done - pp->done_start;
+	/* a path failure event is caused by errors counted above */
+	pp->io_err_nr = err - pp->err_start;
+	if (pp->io_err_nr < pp->dm_failures)
+		pp->io_err_nr = pp->dm_failures;
+}
+
 /*
  * return value
  * 0: enqueue OK
@@ -260,7 +319,14 @@ static int enqueue_io_err_stat_by_path(struct path *path)
 	p->total_time = path->mpp->marginal_path_err_sample_time;
 	p->err_rate_threshold = path->mpp->marginal_path_err_rate_threshold;
 
-	if (setup_directio_ctx(p))
+	if (path->mpp->marginal_path_err_method ==
+	    MARGINAL_PATH_ERR_METHOD_PASSIVE) {
+		p->passive = true;
+		if (get_passive_io_counters(path, &p->done_start,
+					    &p->err_start))
+			goto free_ioerr_path;
+		get_monotonic_time(&p->start_time);
+	} else if (setup_directio_ctx(p))
 		goto free_ioerr_path;
 	pthread_mutex_lock(&io_err_pathvec_lock);
 	if (!vector_alloc_slot(io_err_pathvec))
@@ -280,6 +346,57 @@ free_ioerr_path:
 	return 1;
 }
 
+static void mark_path_failed(struct path *path)
+{
+	struct config *conf;
+	int oldstate = path->state;
+	unsigned int checkint;
+
+	if (path->state == PATH_DOWN)
+		return;
+
+	conf = get_multipath_config();
+	checkint = conf->checkint;
+	put_multipath_config(conf);
+	io_err_stat_log(2, "%s: mark as failed", path->dev);
+	path->mpp->stat_path_failures++;
+	set_path_state(path, PATH_DOWN);
+	path->dmstate = PSTATE_FAILED;
+	if (oldstate == PATH_UP || oldstate == PATH_GHOST)
+		update_queue_mode_del_path(path->mpp);
+	if (path->tick > checkint)
+		path->tick = checkint;
+}
+
+/*
+ * A path under passive checking has failed in the kernel.
+ * Count the failure, and don't reinstate the path before the
+ * check has ended. Paths that aren't checked passively are left alone.
+ */
+static void passive_check_pathfail(struct path *path)
+{
+	struct io_err_stat_path *p;
+	bool passive = false;
+
+	if (!path->mpp || path->mpp->marginal_path_err_method !=
+	    MARGINAL_PATH_ERR_METHOD_PASSIVE)
+		return;
+
+	pthread_mutex_lock(&io_err_pathvec_lock);
+	p = find_err_path_by_dev(io_err_pathvec, path->dev);
+	if (p && p->passive) {
+		p->dm_failures++;
+		passive = true;
+	}
+	pthread_mutex_unlock(&io_err_pathvec_lock);
+	if (!passive)
+		return;
+
+	io_err_stat_log(3, "%s: failed during passive checking", path->dev);
+	path->io_err_disable_reinstate = 1;
+	mark_path_failed(path);
+}
+
 int io_err_stat_handle_pathfail(struct path *path)
 {
 	struct timespec curr_time;
@@ -292,6 +409,8 @@ int io_err_stat_handle_pathfail(struct path *path)
 				path->dev);
 		return 0;
 	}
+	if (path->io_err_pathfail_cnt == PATH_IO_ERR_IN_CHECKING)
+		passive_check_pathfail(path);
 	if (path->io_err_pathfail_cnt < 0)
 		return 0;
 
@@ -329,23 +448,7 @@ int io_err_stat_handle_pathfail(struct path *path)
 		path->io_err_pathfail_cnt = PATH_IO_ERR_WAITING_TO_CHECK;
 		/* enqueue path as soon as it comes up */
 		path->io_err_dis_reinstate_time = 0;
-		if (path->state != PATH_DOWN) {
-			struct config *conf;
-			int oldstate = path->state;
-			unsigned int checkint;
-
-			conf = get_multipath_config();
-			checkint = conf->checkint;
-			put_multipath_config(conf);
-			io_err_stat_log(2, "%s: mark as failed", path->dev);
-			path->mpp->stat_path_failures++;
-			path->state = PATH_DOWN;
-			path->dmstate = PSTATE_FAILED;
-			if (oldstate == PATH_UP || oldstate == PATH_GHOST)
-				update_queue_mode_del_path(path->mpp);
-			if (path->tick > checkint)
-				path->tick = checkint;
-		}
+		mark_path_failed(path);
 	}
 
 	return 0;
@@ -382,6 +485,17 @@ int need_io_err_check(struct path *pp)
 			goto recover;
 		} else
 			pp->io_err_pathfail_cnt = PATH_IO_ERR_IN_CHECKING;
+		/*
+		 * With passive checking, errors are only seen if the path
+		 * carries I/O. Reinstate it while it's being checked.
+		 */
+		if (pp->mpp->marginal_path_err_method ==
+		    MARGINAL_PATH_ERR_METHOD_PASSIVE) {
+			io_err_stat_log(3, "%s: reinstate for passive checking",
+					pp->dev);
+			pp->io_err_disable_reinstate = 0;
+			return 0;
+		}
 	}
 
 	return 1;
@@ -430,13 +544,15 @@ static void end_io_err_stat(struct io_err_stat_path *pp)
 
 	io_err_stat_log(4, "%s: check end", pp->devname);
 
-	err_rate = pp->io_nr == 0 ? 0 : (pp->io_err_nr * 1000.0f) / pp->io_nr;
-	io_err_stat_log(3, "%s: IO error rate (%.1f/1000)",
-			pp->devname, err_rate);
 	pthread_cleanup_push(cleanup_lock, &vecs->lock);
 	lock(&vecs->lock);
 	pthread_testcancel();
 	path = find_path_by_dev(vecs->pathvec, pp->devname);
+	if (path && pp->passive)
+		account_passive_io_state(pp, path);
+	err_rate = pp->io_nr == 0 ? 0 : (pp->io_err_nr * 1000.0f) / pp->io_nr;
+	io_err_stat_log(3, "%s: IO error rate (%.1f/1000)",
+			pp->devname, err_rate);
 	if (!path) {
 		io_err_stat_log(4, "path %s not found'", pp->devname);
 	} else if (err_rate <= pp->err_rate_threshold) {
@@ -450,7 +566,8 @@ static void end_io_err_stat(struct io_err_stat_path *pp)
 		 */
 		path->tick = 1;
 
-	} else if (path->mpp && count_active_paths(path->mpp) > 0) {
+	} else if (path->mpp && count_active_paths(path->mpp) >
+		   (path->state == PATH_UP || path->state == PATH_GHOST)) {
 		io_err_stat_log(3, "%s: keep failing the dm path %s",
 				path->mpp->alias, path->dev);
 		path->io_err_pathfail_cnt = PATH_IO_ERR_WAITING_TO_CHECK;
@@ -458,6 +575,11 @@ static void end_io_err_stat(struct io_err_stat_path *pp)
 		path->io_err_dis_reinstate_time = currtime.tv_sec;
 		io_err_stat_log(3, "%s: disable reinstating of %s",
 				path->mpp->alias, path->dev);
+		/* passively checked paths have been reinstated meanwhile */
+		if (pp->passive && path->state != PATH_DOWN) {
+			dm_fail_path(path->mpp->alias, path->dev_t);
+			mark_path_failed(path);
+		}
 	} else {
 		path->io_err_pathfail_cnt = 0;
 		path->io_err_disable_reinstate = 0;
@@ -549,6 +671,8 @@ static void poll_async_io_timeout(void)
 
 	get_monotonic_time(&curr_time);
 	vector_foreach_slot(io_err_pathvec, pp, i) {
+		if (pp->passive)
+			continue;
 		for (j = 0; j < CONCUR_NR_EVENT; j++) {
 			rc = try_to_cancel_timeout_io(pp->dio_ctx_array + j,
 					&curr_time, pp->devname);
@@ -590,6 +714,8 @@ static void handle_async_io_done_event(struct io_event *io_evt)
 	int i, j;
 
 	vector_foreach_slot(io_err_pathvec, pp, i) {
+		if (pp->passive)
+			continue;
 		for (j = 0; j < CONCUR_NR_EVENT; j++) {
 			ct = pp->dio_ctx_array + j;
 			if (&ct->io == io_evt->obj) {
@@ -629,9 +755,12 @@ static void service_paths(void)
 	pthread_mutex_lock(&io_err_pathvec_lock);
 	pthread_cleanup_push(cleanup_mutex, &io_err_pathvec_lock);
 	vector_foreach_slot(io_err_pathvec, pp, i) {
-		send_batch_async_ios(pp);
-		process_async_ios_event(TIMEOUT_NO_IO_NSEC, pp->devname);
-		poll_async_io_timeout();
+		if (!pp->passive) {
+			send_batch_async_ios(pp);
+			process_async_ios_event(TIMEOUT_NO_IO_NSEC,
+						pp->devname);
+			poll_async_io_timeout();
+		}
 		if (io_err_stat_time_up(pp)) {
 			if (!vector_alloc_slot(tmp_pathvec))
 				continue;
@@ -32,6 +32,8 @@
 #include "util.h"
 #include "foreign.h"
 #include "strbuf.h"
+#include "mpath_cmd.h"
+#include "unaligned.h"
 #include "sysfs.h"
 
 #define PRINT_PATH_LONG      "%w %i %d %D %p %t %T %s %o"
@@ -1458,6 +1460,281 @@ int snprint_multipath_topology_json (struct strbuf *buff,
 	return get_strbuf_len(buff) - initial_len;
 }
 
+/*
+ * Compact output formats: JSON lines, with one minified object per map or
+ * path, and the binary record format described in mpath_cmd.h. Unlike the
+ * formats above, these don't need layout passes.
+ */
+struct compact_field {
+	uint8_t id;
+	char wildcard;
+	bool numeric;
+	const char *name;
+};
+
+static const struct compact_field compact_map_fields[] = {
+	{MPATH_MAP_NAME,         'n', false, "name"},
+	{MPATH_MAP_UUID,         'w', false, "uuid"},
+	{MPATH_MAP_SYSFS,        'd', false, "sysfs"},
+	{MPATH_MAP_FAILBACK,     'F', false, "failback"},
+	{MPATH_MAP_QUEUEING,     'Q', false, "queueing"},
+	{MPATH_MAP_PATHS,        'N', true,  "paths"},
+	{MPATH_MAP_WRITE_PROT,   'r', false, "write_prot"},
+	{MPATH_MAP_DM_ST,        't', false, "dm_st"},
+	{MPATH_MAP_FEATURES,     'f', false, "features"},
+	{MPATH_MAP_HWHANDLER,    'h', false, "hwhandler"},
+	{MPATH_MAP_ACTION,       'A', false, "action"},
+	{MPATH_MAP_PATH_FAULTS,  '0', true,  "path_faults"},
+	{MPATH_MAP_VEND,         'v', false, "vend"},
+	{MPATH_MAP_PROD,         'p', false, "prod"},
+	{MPATH_MAP_REV,          'e', false, "rev"},
+	{MPATH_MAP_SWITCH_GRP,   '1', true,  "switch_grp"},
+	{MPATH_MAP_MAP_LOADS,    '2', true,  "map_loads"},
+	{MPATH_MAP_TOTAL_Q_TIME, '3', true,  "total_q_time"},
+	{MPATH_MAP_Q_TIMEOUTS,   '4', true,  "q_timeouts"},
+	{MPATH_MAP_SIZE,         'S', false, "size"},
+};
+
+static const struct compact_field compact_pg_fields[] = {
+	{MPATH_PG_SELECTOR,      's', false, "selector"},
+	{MPATH_PG_PRI,           'p', true,  "pri"},
+	{MPATH_PG_DM_ST,         't', false, "dm_st"},
+	{MPATH_PG_MARGINAL_ST,   'M', false, "marginal_st"},
+};
+
+static const struct compact_field compact_path_fields[] = {
+	{MPATH_PATH_DEV,          'd', false, "dev"},
+	{MPATH_PATH_DEV_T,        'D', false, "dev_t"},
+	{MPATH_PATH_MAP,          'm', false, "map"},
+	{MPATH_PATH_UUID,         'w', false, "uuid"},
+	{MPATH_PATH_HCIL,         'i', false, "hcil"},
+	{MPATH_PATH_DM_ST,        't', false, "dm_st"},
+	{MPATH_PATH_DEV_ST,       'o', false, "dev_st"},
+	{MPATH_PATH_CHK_ST,       'T', false, "chk_st"},
+	{MPATH_PATH_CHECKER,      'c', false, "checker"},
+	{MPATH_PATH_PRI,          'p', true,  "pri"},
+	{MPATH_PATH_HOST_WWNN,    'N', false, "host_wwnn"},
+	{MPATH_PATH_TARGET_WWNN,  'n', false, "target_wwnn"},
+	{MPATH_PATH_HOST_WWPN,    'R', false, "host_wwpn"},
+	{MPATH_PATH_TARGET_WWPN,  'r', false, "target_wwpn"},
+	{MPATH_PATH_HOST_ADAPTER, 'a', false, "host_adapter"},
+	{MPATH_PATH_LUN_HEX,      'L', false, "lun_hex"},
+	{MPATH_PATH_MARGINAL_ST,  'M', false, "marginal_st"},
+};
+
+typedef int (compact_attr_fn)(struct strbuf *, const void *, char);
+
+static int map_attr(struct strbuf *buff, const void *mpp, char wildcard)
+{
+	int i = mpd_lookup(wildcard);
+
+	return i == -1 ? 0 : mpd[i].snprint(buff, mpp);
+}
+
+static int pg_attr(struct strbuf *buff, const void *pgp, char wildcard)
+{
+	int i = pgd_lookup(wildcard);
+
+	return i == -1 ? 0 : pgd[i].snprint(buff, pgp);
+}
+
+static int path_attr(struct strbuf *buff, const void *pp, char wildcard)
+{
+	int i = pd_lookup(wildcard);
+
+	return i == -1 ? 0 : pd[i].snprint(buff, pp);
+}
+
+static int snprint_binary_field(struct strbuf *buff, uint8_t id,
+				const char *val, size_t len)
+{
+	char hdr[3];
+	int rc;
+
+	if (len > UINT16_MAX)
+		len = UINT16_MAX;
+	hdr[0] = id;
+	put_unaligned_be16(len, &hdr[1]);
+	if ((rc = append_strbuf_str__(buff, hdr, sizeof(hdr))) < 0 ||
+	    (rc = append_strbuf_str__(buff, val, len)) < 0)
+		return rc;
+	return sizeof(hdr) + len;
+}
+
+static int snprint_binary_record(struct strbuf *buff, uint8_t type,
+				 const struct strbuf *rec)
+{
+	char hdr[5];
+	size_t len = get_strbuf_len(rec);
+	int rc;
+
+	put_unaligned_be32(len + 1, &hdr[0]);
+	hdr[4] = type;
+	if ((rc = append_strbuf_str__(buff, hdr, sizeof(hdr))) < 0 ||
+	    (rc = append_strbuf_str__(buff, get_strbuf_str(rec), len)) < 0)
+		return rc;
+	return sizeof(hdr) + len;
+}
+
+/* In JSON mode, fields are appended to an open object */
+static int snprint_compact_fields(struct strbuf *buff, enum print_compact fmt,
+				  const struct compact_field *fields,
+				  unsigned int n_fields, compact_attr_fn *attr,
+				  const void *obj)
+{
+	STRBUF_ON_STACK(val);
+	size_t initial_len = get_strbuf_len(buff);
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < n_fields; i++) {
+		truncate_strbuf(&val, 0);
+		if ((rc = attr(&val, obj, fields[i].wildcard)) < 0)
+			return rc;
+		if (fmt == PRINT_BINARY)
+			rc = snprint_binary_field(buff, fields[i].id,
+						  get_strbuf_str(&val),
+						  get_strbuf_len(&val));
+		else
+			rc = print_strbuf(buff, fields[i].numeric ?
+					  "%s\"%s\":%s" : "%s\"%s\":\"%s\"",
+					  i ? "," : "", fields[i].name,
+					  get_strbuf_str(&val));
+		if (rc < 0)
+			return rc;
+	}
+	return get_strbuf_len(buff) - initial_len;
+}
+
+int snprint_compact_header(struct strbuf *buff, enum print_compact fmt)
+{
+	STRBUF_ON_STACK(rec);
+	char version[16];
+	int rc, len;
+
+	/* JSON lines have no header */
+	if (fmt != PRINT_BINARY)
+		return 0;
+	len = snprintf(version, sizeof(version), "%d", MPATH_REC_VERSION);
+	if ((rc = snprint_binary_field(&rec, MPATH_HDR_VERSION,
+				       version, len)) < 0)
+		return rc;
+	return snprint_binary_record(buff, MPATH_REC_HEADER, &rec);
+}
+
+/*
+ * Binary: append a complete record.
+ * JSON: append the opening brace and the fields, but don't close the
+ * object, so that the caller can add nested objects.
+ */
+static int snprint_compact_object(struct strbuf *buff, enum print_compact fmt,
+				  uint8_t type,
+				  const struct compact_field *fields,
+				  unsigned int n_fields, compact_attr_fn *attr,
+				  const void *obj)
+{
+	STRBUF_ON_STACK(rec);
+	int rc;
+
+	if (fmt == PRINT_BINARY) {
+		if ((rc = snprint_compact_fields(&rec, fmt, fields, n_fields,
+						 attr, obj)) < 0)
+			return rc;
+		return snprint_binary_record(buff, type, &rec);
+	}
+	if ((rc = append_strbuf_str(buff, "{")) < 0)
+		return rc;
+	return snprint_compact_fields(buff, fmt, fields, n_fields, attr, obj);
+}
+
+#define snprint_compact_path(buff, fmt, pp)				\
+	snprint_compact_object(buff, fmt, MPATH_REC_PATH,		\
+			       compact_path_fields,			\
+			       ARRAY_SIZE(compact_path_fields), path_attr, pp)
+
+int snprint_path_compact(struct strbuf *buff, const struct path *pp,
+			 enum print_compact fmt)
+{
+	size_t initial_len = get_strbuf_len(buff);
+	int rc;
+
+	if ((rc = snprint_compact_path(buff, fmt, pp)) < 0)
+		return rc;
+	if (fmt != PRINT_BINARY && (rc = append_strbuf_str(buff, "}\n")) < 0)
+		return rc;
+	return get_strbuf_len(buff) - initial_len;
+}
+
+static int snprint_pathgroup_compact(struct strbuf *buff,
+				     const struct pathgroup *pgp, int group,
+				     enum print_compact fmt)
+{
+	STRBUF_ON_STACK(rec);
+	struct path *pp;
+	char num[16];
+	int i, rc, len;
+
+	len = snprintf(num, sizeof(num), "%d", group);
+	if (fmt == PRINT_BINARY) {
+		if ((rc = snprint_binary_field(&rec, MPATH_PG_GROUP,
+					       num, len)) < 0 ||
+		    (rc = snprint_compact_fields(&rec, fmt, compact_pg_fields,
+						 ARRAY_SIZE(compact_pg_fields),
+						 pg_attr, pgp)) < 0 ||
+		    (rc = snprint_binary_record(buff, MPATH_REC_PATHGROUP,
+						&rec)) < 0)
+			return rc;
+		vector_foreach_slot (pgp->paths, pp, i)
+			if ((rc = snprint_compact_path(buff, fmt, pp)) < 0)
+				return rc;
+		return 0;
+	}
+
+	if ((rc = print_strbuf(buff, "{\"group\":%s,", num)) < 0 ||
+	    (rc = snprint_compact_fields(buff, fmt, compact_pg_fields,
+					 ARRAY_SIZE(compact_pg_fields),
+					 pg_attr, pgp)) < 0 ||
+	    (rc = append_strbuf_str(buff, ",\"paths\":[")) < 0)
+		return rc;
+	vector_foreach_slot (pgp->paths, pp, i) {
+		if ((i > 0 && (rc = append_strbuf_str(buff, ",")) < 0) ||
+		    (rc = snprint_compact_path(buff, fmt, pp)) < 0 ||
+		    (rc = append_strbuf_str(buff, "}")) < 0)
+			return rc;
+	}
+	if ((rc = append_strbuf_str(buff, "]}")) < 0)
+		return rc;
+	return 0;
+}
+
+int snprint_multipath_compact(struct strbuf *buff,
+			      const struct multipath *mpp,
+			      enum print_compact fmt)
+{
+	size_t initial_len = get_strbuf_len(buff);
+	struct pathgroup *pgp;
+	int i, rc;
+
+	if ((rc = snprint_compact_object(buff, fmt, MPATH_REC_MAP,
+					 compact_map_fields,
+					 ARRAY_SIZE(compact_map_fields),
+					 map_attr, mpp)) < 0)
+		return rc;
+	if (fmt != PRINT_BINARY &&
+	    (rc = append_strbuf_str(buff, ",\"path_groups\":[")) < 0)
+		return rc;
+	vector_foreach_slot (mpp->pg, pgp, i) {
+		if (fmt != PRINT_BINARY && i > 0 &&
+		    (rc = append_strbuf_str(buff, ",")) < 0)
+			return rc;
+		if ((rc = snprint_pathgroup_compact(buff, pgp, i + 1, fmt)) < 0)
+			return rc;
+	}
+	if (fmt != PRINT_BINARY && (rc = append_strbuf_str(buff, "]}\n")) < 0)
+		return rc;
+	return get_strbuf_len(buff) - initial_len;
+}
+
 static int
 snprint_pcentry (const struct config *conf, struct strbuf *buff,
 		 const struct pcentry *pce)
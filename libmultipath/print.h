@@ -46,6 +46,16 @@ char *snprint_config(const struct config *conf, int *len,
 		     const struct vector_s *hwtable,
 		     const struct vector_s *mpvec);
 int snprint_multipath_map_json(struct strbuf *, const struct multipath *mpp);
+/* compact output formats */
+enum print_compact {
+	PRINT_JSONL,
+	PRINT_BINARY,
+};
+int snprint_compact_header(struct strbuf *, enum print_compact);
+int snprint_multipath_compact(struct strbuf *, const struct multipath *mpp,
+			      enum print_compact);
+int snprint_path_compact(struct strbuf *, const struct path *pp,
+			 enum print_compact);
 int snprint_blacklist_report(struct config *, struct strbuf *);
 int snprint_wildcards(struct strbuf *);
 int snprint_status(struct strbuf *, const struct vectors *);
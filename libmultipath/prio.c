@@ -2,11 +2,16 @@
 #include <string.h>
 #include <stddef.h>
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <urcu/uatomic.h>
 #include "mt-udev-wrap.h"
 
 #include "debug.h"
 #include "util.h"
+#include "time-util.h"
 #include "prio.h"
 #include "structs.h"
 #include "discovery.h"
@@ -14,6 +19,31 @@
 static const char * const prio_dir = MULTIPATH_DIR;
 static LIST_HEAD(prioritizers);
 
+struct prio_async_ctx {
+	struct list_head node;
+	int holders; /* uatomic access only */
+	int state;   /* protected by prio_async_lock */
+	int result;
+	bool running;
+	bool timed_out;
+	time_t deadline;
+	struct prio *src;
+	int (*getprio)(struct path *, char *);
+	char args[PRIO_ARGS_LEN];
+	char devnode[FILE_NAME_SIZE];
+	struct path path;
+};
+
+static pthread_mutex_t prio_async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prio_async_cond = PTHREAD_COND_INITIALIZER;
+static LIST_HEAD(prio_async_queue);
+/* requests still running after their owner has gone */
+static LIST_HEAD(prio_async_orphans);
+static unsigned int nr_prio_workers;
+static unsigned int max_prio_workers;
+static unsigned int nr_stuck_workers;
+static bool prio_workers_stopped = true;
+
 unsigned int get_prio_timeout_ms(const struct path *pp)
 {
 	if (pp->state == PATH_DOWN)
@@ -40,6 +70,7 @@ int init_prio(void)
 		PRIO_WEIGHTED_PATH,
 		PRIO_SYSFS,
 		PRIO_PATH_LATENCY,
+		PRIO_STAT_LATENCY,
 		PRIO_ANA,
 	};
 	unsigned int i;
@@ -176,6 +207,31 @@ const char * prio_args (const struct prio * p)
 	return p->args;
 }
 
+static void prio_async_put(struct prio_async_ctx *ctx)
+{
+	if (uatomic_sub_return(&ctx->holders, 1) != 0)
+		return;
+	if (ctx->path.fd >= 0)
+		close(ctx->path.fd);
+	if (ctx->path.udev)
+		udev_device_unref(ctx->path.udev);
+	free(ctx);
+}
+
+static void cleanup_prio_async_ctx(void *arg)
+{
+	prio_async_put(arg);
+}
+
+static void prio_async_release(struct prio *p)
+{
+	struct prio_async_ctx *ctx = p->async;
+
+	p->async = NULL;
+	free_prio(ctx->src);
+	prio_async_put(ctx);
+}
+
 void prio_get(struct prio *dst, const char *name, const char *args)
 {
 	struct prio * src = NULL;
@@ -202,6 +258,28 @@ void prio_get(struct prio *dst, const char *name, const char *args)
 	src->refcount++;
 }
 
+/*
+ * Release the orphaned requests that have completed. free_prio() isn't
+ * thread-safe, so this is done by the owner threads, not the workers.
+ */
+static void reap_prio_async_orphans(void)
+{
+	struct prio_async_ctx *ctx, *tmp;
+	LIST_HEAD(done);
+
+	pthread_mutex_lock(&prio_async_lock);
+	list_for_each_entry_safe(ctx, tmp, &prio_async_orphans, node)
+		if (ctx->state == PRIO_ASYNC_DONE)
+			list_move_tail(&ctx->node, &done);
+	pthread_mutex_unlock(&prio_async_lock);
+
+	list_for_each_entry_safe(ctx, tmp, &done, node) {
+		list_del_init(&ctx->node);
+		free_prio(ctx->src);
+		prio_async_put(ctx);
+	}
+}
+
 void prio_put (struct prio * dst)
 {
 	struct prio * src;
@@ -209,7 +287,285 @@ void prio_put (struct prio * dst)
 	if (!dst || !dst->getprio)
 		return;
 
+	if (dst->async) {
+		struct prio_async_ctx *ctx = dst->async;
+		bool running;
+
+		pthread_mutex_lock(&prio_async_lock);
+		running = ctx->running;
+		if (running)
+			/*
+			 * The worker may be executing library code. Keep
+			 * the library loaded until the request is done.
+			 */
+			list_add_tail(&ctx->node, &prio_async_orphans);
+		else if (ctx->state == PRIO_ASYNC_PENDING) {
+			/* Still queued, no worker will see it */
+			list_del_init(&ctx->node);
+			ctx->state = PRIO_ASYNC_DONE;
+			prio_async_put(ctx);
+		}
+		pthread_mutex_unlock(&prio_async_lock);
+		if (running)
+			dst->async = NULL;
+		else
+			prio_async_release(dst);
+	}
+	reap_prio_async_orphans();
 	src = prio_lookup(dst->name);
 	memset(dst, 0x0, sizeof(struct prio));
 	free_prio(src);
 }
+
+/*
+ * Prioritizers that don't do any I/O on the device. Running them
+ * asynchronously would only add overhead.
+ */
+static const char * const sync_prios[] = {
+	PRIO_CONST,
+	PRIO_RANDOM,
+	PRIO_SYSFS,
+	PRIO_WEIGHTED_PATH,
+	PRIO_STAT_LATENCY,
+};
+
+static void *prio_worker(__attribute__((unused)) void *arg)
+{
+	struct prio_async_ctx *ctx;
+	bool stuck;
+
+	while (1) {
+		int prio;
+
+		pthread_cleanup_push(cleanup_mutex, &prio_async_lock);
+		pthread_mutex_lock(&prio_async_lock);
+		while (list_empty(&prio_async_queue) && !prio_workers_stopped)
+			pthread_cond_wait(&prio_async_cond, &prio_async_lock);
+		if (prio_workers_stopped)
+			ctx = NULL;
+		else {
+			ctx = list_pop_entry(&prio_async_queue,
+					     struct prio_async_ctx, node);
+			ctx->running = true;
+		}
+		pthread_cleanup_pop(1);
+		if (!ctx)
+			break;
+
+		pthread_cleanup_push(cleanup_prio_async_ctx, ctx);
+		ctx->path.fd = open(ctx->devnode, O_RDONLY | O_CLOEXEC);
+		if (ctx->path.fd < 0) {
+			condlog(3, "%s: failed to open %s for prio: %m",
+				ctx->path.dev, ctx->devnode);
+			prio = -1;
+		} else
+			prio = ctx->getprio(&ctx->path, ctx->args);
+
+		pthread_mutex_lock(&prio_async_lock);
+		ctx->result = prio;
+		ctx->state = PRIO_ASYNC_DONE;
+		ctx->running = false;
+		/*
+		 * If this request ran into its deadline, a replacement
+		 * worker has been started. Make way for it.
+		 */
+		stuck = ctx->timed_out && !prio_workers_stopped;
+		if (stuck) {
+			nr_stuck_workers--;
+			nr_prio_workers--;
+		}
+		pthread_mutex_unlock(&prio_async_lock);
+		pthread_cleanup_pop(1);
+		if (stuck)
+			break;
+	}
+	return NULL;
+}
+
+static int start_prio_worker(void)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	int rc;
+
+	setup_thread_attr(&attr, 64 * 1024, 1);
+	rc = pthread_create(&thread, &attr, prio_worker, NULL);
+	pthread_attr_destroy(&attr);
+	if (rc) {
+		condlog(1, "failed to start prio worker: %s", strerror(rc));
+		return 1;
+	}
+	nr_prio_workers++;
+	return 0;
+}
+
+/*
+ * The workers are detached. A worker blocked in I/O on a hung device
+ * is never joined or cancelled, same as the async path checker threads.
+ */
+int start_prio_workers(unsigned int nr_workers)
+{
+	unsigned int i;
+	int ret = 0;
+
+	pthread_mutex_lock(&prio_async_lock);
+	if (!prio_workers_stopped || nr_workers == 0)
+		goto out;
+	prio_workers_stopped = false;
+	max_prio_workers = nr_workers;
+	for (i = 0; i < nr_workers; i++)
+		if (start_prio_worker() != 0)
+			break;
+	if (nr_prio_workers == 0) {
+		prio_workers_stopped = true;
+		ret = 1;
+	} else
+		condlog(3, "started %u prio workers", nr_prio_workers);
+out:
+	pthread_mutex_unlock(&prio_async_lock);
+	return ret;
+}
+
+void stop_prio_workers(void)
+{
+	struct prio_async_ctx *ctx, *tmp;
+	LIST_HEAD(drained);
+
+	pthread_mutex_lock(&prio_async_lock);
+	prio_workers_stopped = true;
+	nr_prio_workers = 0;
+	nr_stuck_workers = 0;
+	/* The owners see the drained requests as failed */
+	list_for_each_entry(ctx, &prio_async_queue, node)
+		ctx->state = PRIO_ASYNC_DONE;
+	list_splice_init(&prio_async_queue, &drained);
+	pthread_cond_broadcast(&prio_async_cond);
+	pthread_mutex_unlock(&prio_async_lock);
+
+	list_for_each_entry_safe(ctx, tmp, &drained, node) {
+		list_del_init(&ctx->node);
+		prio_async_put(ctx);
+	}
+}
+
+bool prio_async_capable(const struct prio *p)
+{
+	unsigned int i;
+
+	if (!prio_selected(p) || uatomic_read(&prio_workers_stopped))
+		return false;
+	for (i = 0; i < ARRAY_SIZE(sync_prios); i++)
+		if (!strncmp(p->name, sync_prios[i], PRIO_NAME_LEN))
+			return false;
+	return true;
+}
+
+bool prio_pending(const struct prio *p)
+{
+	bool pending;
+
+	if (!p || !p->async)
+		return false;
+	pthread_mutex_lock(&prio_async_lock);
+	pending = p->async->state == PRIO_ASYNC_PENDING &&
+		!p->async->timed_out;
+	pthread_mutex_unlock(&prio_async_lock);
+	return pending;
+}
+
+/*
+ * Called from the thread owning the path. Takes a private copy of the
+ * path, so that the worker never touches memory that may be freed
+ * under it. The copy holds a reference to the udev device and to the
+ * prioritizer library.
+ */
+int prio_async_submit(struct prio *p, struct path *pp)
+{
+	struct prio_async_ctx *ctx;
+	struct prio *src;
+	const char *devnode;
+	struct timespec now;
+
+	reap_prio_async_orphans();
+	if (p->async || !prio_async_capable(p) || !pp->udev)
+		return 1;
+	devnode = udev_device_get_devnode(pp->udev);
+	src = prio_lookup(p->name);
+	if (!devnode || !src)
+		return 1;
+
+	ctx = malloc(sizeof(*ctx));
+	if (!ctx)
+		return 1;
+	memcpy(&ctx->path, pp, sizeof(ctx->path));
+	ctx->path.fd = -1;
+	ctx->path.udev = udev_device_ref(pp->udev);
+	ctx->path.vpd_data = NULL;
+	ctx->path.uid_attribute = NULL;
+	ctx->path.mpp = NULL;
+	ctx->path.hwe = NULL;
+	checker_clear(&ctx->path.checker);
+	ctx->path.prio.async = NULL;
+	strlcpy(ctx->devnode, devnode, sizeof(ctx->devnode));
+	strlcpy(ctx->args, p->args, sizeof(ctx->args));
+	ctx->getprio = p->getprio;
+	ctx->result = -1;
+	ctx->running = false;
+	ctx->timed_out = false;
+	get_monotonic_time(&now);
+	ctx->deadline = now.tv_sec + get_prio_timeout_ms(pp) / 1000 + 1;
+	ctx->src = src;
+	src->refcount++;
+	INIT_LIST_HEAD(&ctx->node);
+	/* one reference for the owner, one for the worker */
+	uatomic_set(&ctx->holders, 2);
+
+	pthread_mutex_lock(&prio_async_lock);
+	ctx->state = PRIO_ASYNC_PENDING;
+	list_add_tail(&ctx->node, &prio_async_queue);
+	pthread_cond_signal(&prio_async_cond);
+	pthread_mutex_unlock(&prio_async_lock);
+
+	p->async = ctx;
+	condlog(4, "%s: %s prio queued", pp->dev, prio_name(p));
+	return 0;
+}
+
+int prio_async_poll(struct prio *p, struct path *pp, int *prio)
+{
+	struct prio_async_ctx *ctx = p->async;
+	struct timespec now;
+	int state;
+	bool start_worker = false;
+
+	if (!ctx)
+		return PRIO_ASYNC_IDLE;
+
+	pthread_mutex_lock(&prio_async_lock);
+	state = ctx->state;
+	if (state == PRIO_ASYNC_DONE) {
+		*prio = ctx->result;
+		/* The only field prioritizers update */
+		pp->tpg_id = ctx->path.tpg_id;
+	} else if (!ctx->timed_out) {
+		get_monotonic_time(&now);
+		if (now.tv_sec > ctx->deadline) {
+			ctx->timed_out = true;
+			state = PRIO_ASYNC_TIMEOUT;
+			if (ctx->running &&
+			    nr_stuck_workers < max_prio_workers) {
+				nr_stuck_workers++;
+				start_worker = true;
+			}
+		}
+	}
+	if (start_worker && start_prio_worker() != 0)
+		nr_stuck_workers--;
+	pthread_mutex_unlock(&prio_async_lock);
+
+	if (state == PRIO_ASYNC_DONE)
+		prio_async_release(p);
+	else if (state == PRIO_ASYNC_TIMEOUT)
+		condlog(2, "%s: %s prio timed out", pp->dev, prio_name(p));
+	return state;
+}
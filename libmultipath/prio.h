@@ -29,6 +29,7 @@ struct path;
 #define PRIO_WEIGHTED_PATH	"weightedpath"
 #define PRIO_SYSFS		"sysfs"
 #define PRIO_PATH_LATENCY	"path_latency"
+#define PRIO_STAT_LATENCY	"stat_latency"
 #define PRIO_ANA		"ana"
 
 /*
@@ -43,6 +44,29 @@ struct path;
 #define PRIO_NAME_LEN 16
 #define PRIO_ARGS_LEN 255
 
+/*
+ * Number of worker threads for asynchronous prioritizer evaluation
+ */
+#define PRIO_ASYNC_WORKERS 4
+
+/*
+ * Return values of prio_async_poll()
+ *
+ * PRIO_ASYNC_IDLE: no request in flight
+ * PRIO_ASYNC_PENDING: request queued or running
+ * PRIO_ASYNC_DONE: request finished, result returned
+ * PRIO_ASYNC_TIMEOUT: request ran into its deadline. It stays in flight,
+ *   subsequent calls return PRIO_ASYNC_PENDING until it finishes.
+ */
+enum prio_async_states {
+	PRIO_ASYNC_IDLE,
+	PRIO_ASYNC_PENDING,
+	PRIO_ASYNC_DONE,
+	PRIO_ASYNC_TIMEOUT,
+};
+
+struct prio_async_ctx;
+
 struct prio {
 	void *handle;
 	int refcount;
@@ -50,6 +74,7 @@ struct prio {
 	char name[PRIO_NAME_LEN];
 	char args[PRIO_ARGS_LEN];
 	int (*getprio)(struct path *, char *);
+	struct prio_async_ctx *async;
 };
 
 unsigned int get_prio_timeout_ms(const struct path *);
@@ -64,6 +89,30 @@ const char * prio_name (const struct prio *);
 const char * prio_args (const struct prio *);
 int prio_set_args (struct prio *, const char *);
 
+/*
+ * Asynchronous prioritizer evaluation
+ *
+ * Prioritizers that send commands to the device (alua, ontap,
+ * path_latency, ...) may block for the full checker_timeout.
+ * multipathd runs them on a small pool of worker threads, so that
+ * the checker thread doesn't stall. Each request works on a private
+ * copy of the path, with its own file descriptor; at most one request
+ * per path is in flight.
+ *
+ * start_prio_workers(): start the pool. Without it, prio_async_capable()
+ * returns false, and callers fall back to prio_getprio().
+ * prio_async_submit(): queue a request for the path. Returns 0 on success.
+ * prio_async_poll(): check the state of the request without blocking,
+ * see enum prio_async_states.
+ * prio_pending(): true if a request is in flight and not timed out.
+ */
+int start_prio_workers(unsigned int nr_workers);
+void stop_prio_workers(void);
+bool prio_async_capable(const struct prio *);
+int prio_async_submit(struct prio *, struct path *);
+int prio_async_poll(struct prio *, struct path *, int *prio);
+bool prio_pending(const struct prio *);
+
 /* The only function exported by prioritizer dynamic libraries (.so) */
 int getprio(struct path *, char *);
 
@@ -0,0 +1,310 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * stat_latency.c
+ *
+ * Prioritizer for device mapper multipath, where the priority of a path
+ * is derived from the service time observed by the block layer, without
+ * sending any I/O to the device.
+ *
+ * Every time the prioritizer is called, it reads the I/O statistics of the
+ * path device (/sys/block/sdX/stat) and computes the average service time
+ * of the I/Os completed since the previous call:
+ *
+ *   (delta read ticks + delta write ticks) / (delta reads + delta writes)
+ *
+ * The samples are smoothed with an exponentially weighted moving average
+ * (EWMA), and mapped to priorities on the same logarithmic scale as the
+ * path_latency prioritizer, determined by "base_num".
+ *
+ * A path that completed no I/O since the last call keeps its previous
+ * estimate. A path that has never been sampled gets a neutral priority:
+ * that of the average service time of the other paths to the same
+ * device, or the middle of the scale if none of them has been sampled
+ * either. This way a fresh path is neither preferred over the paths that
+ * have been measured, nor moved out of their path group before it has
+ * received any I/O.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/sysmacros.h>
+
+#include "debug.h"
+#include "prio.h"
+#include "structs.h"
+#include "sysfs.h"
+#include "util.h"
+#include "time-util.h"
+#include "mt-udev-wrap.h"
+
+#define pp_sl_log(prio, fmt, args...) \
+	condlog(prio, "stat_latency prio: " fmt, ##args)
+
+#define MAX_BASE_NUM		10
+#define MIN_BASE_NUM		1.1
+/* This is 10**(1/4). 4 prio steps correspond to a factor of 10. */
+#define DEF_BASE_NUM		1.77827941004
+
+#define MAX_EWMA_WEIGHT		1.
+#define MIN_EWMA_WEIGHT		0.01
+#define DEF_EWMA_WEIGHT		0.25
+
+#define MAX_AVG_LATENCY		100000000.	/* Unit: us */
+#define MIN_AVG_LATENCY		1.		/* Unit: us */
+
+#define USEC_PER_MSEC		1000.
+
+/* Forget devices that haven't been sampled for this long */
+#define STALE_SECS		3600
+
+#define HASH_SIZE		256
+/* If there are more devices, the least recently sampled one is dropped */
+#define MAX_ENTRIES		65536
+
+struct stat_latency_path {
+	struct list_head node;
+	dev_t devt;
+	char wwid[WWID_SIZE];
+	unsigned long long ios;
+	unsigned long long ticks;
+	double ewma;		/* Unit: us, < 0 if no sample yet */
+	time_t last_seen;
+};
+
+static pthread_mutex_t stat_latency_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head stat_latency_hash[HASH_SIZE];
+static bool stat_latency_hash_initialized;
+static unsigned int nr_entries;
+
+static unsigned int hash_devt(dev_t devt)
+{
+	return (major(devt) * 31 + minor(devt)) % HASH_SIZE;
+}
+
+/* Call with stat_latency_lock held */
+static void drop_entry(struct stat_latency_path *sp)
+{
+	list_del(&sp->node);
+	free(sp);
+	nr_entries--;
+}
+
+/* Call with stat_latency_lock held */
+static void drop_oldest_entry(void)
+{
+	struct stat_latency_path *sp, *oldest = NULL;
+	unsigned int i;
+
+	for (i = 0; i < HASH_SIZE; i++)
+		list_for_each_entry(sp, &stat_latency_hash[i], node)
+			if (!oldest || sp->last_seen < oldest->last_seen)
+				oldest = sp;
+	if (oldest)
+		drop_entry(oldest);
+}
+
+/*
+ * The state is lost when the prioritizer is unloaded, e.g. on
+ * reconfigure. The paths are then sampled anew.
+ */
+static void __attribute__((destructor)) free_stat_latency_hash(void)
+{
+	struct stat_latency_path *sp, *tmp;
+	unsigned int i;
+
+	pthread_mutex_lock(&stat_latency_lock);
+	if (stat_latency_hash_initialized) {
+		for (i = 0; i < HASH_SIZE; i++)
+			list_for_each_entry_safe(sp, tmp,
+						 &stat_latency_hash[i], node)
+				drop_entry(sp);
+	}
+	pthread_mutex_unlock(&stat_latency_lock);
+}
+
+/*
+ * Look up the entry for devt, creating it if necessary.
+ * Drops stale entries in the same bucket on the way.
+ * Call with stat_latency_lock held.
+ */
+static struct stat_latency_path *get_entry(dev_t devt, time_t now)
+{
+	struct list_head *head;
+	struct stat_latency_path *sp, *tmp, *found = NULL;
+	unsigned int i;
+
+	if (!stat_latency_hash_initialized) {
+		for (i = 0; i < HASH_SIZE; i++)
+			INIT_LIST_HEAD(&stat_latency_hash[i]);
+		stat_latency_hash_initialized = true;
+	}
+
+	head = &stat_latency_hash[hash_devt(devt)];
+	list_for_each_entry_safe(sp, tmp, head, node) {
+		if (sp->devt == devt)
+			found = sp;
+		else if (now - sp->last_seen > STALE_SECS)
+			drop_entry(sp);
+	}
+	if (found)
+		return found;
+
+	if (nr_entries >= MAX_ENTRIES)
+		drop_oldest_entry();
+	sp = calloc(1, sizeof(*sp));
+	if (!sp)
+		return NULL;
+	sp->devt = devt;
+	sp->ewma = -1.;
+	list_add(&sp->node, head);
+	nr_entries++;
+	return sp;
+}
+
+/*
+ * The geometric mean of the service time of the sampled paths with the
+ * given WWID, or < 0 if there are none.
+ * Call with stat_latency_lock held.
+ */
+static double wwid_avg_latency(const char *wwid, time_t now)
+{
+	struct stat_latency_path *sp;
+	double sum = 0.;
+	unsigned int i, n = 0;
+
+	if (!*wwid)
+		return -1.;
+	for (i = 0; i < HASH_SIZE; i++) {
+		list_for_each_entry(sp, &stat_latency_hash[i], node) {
+			if (sp->ewma < 0 || now - sp->last_seen > STALE_SECS ||
+			    strcmp(sp->wwid, wwid))
+				continue;
+			sum += log(sp->ewma > MIN_AVG_LATENCY ?
+				   sp->ewma : MIN_AVG_LATENCY);
+			n++;
+		}
+	}
+	return n ? exp(sum / n) : -1.;
+}
+
+/*
+ * In multipath.conf, args form: base_num=m ewma_weight=w. Both are optional.
+ */
+static void get_args(const char *args, double *basenum, double *weight)
+{
+	char split_char[] = " \t";
+	char *arg, *temp, *str, *str_inval;
+	double val;
+
+	*basenum = DEF_BASE_NUM;
+	*weight = DEF_EWMA_WEIGHT;
+	if (!args)
+		return;
+
+	arg = temp = strdup(args);
+	if (!arg)
+		return;
+
+	while ((str = get_next_string(&temp, split_char)) != NULL) {
+		if (!strncmp(str, "base_num=", 9) && strlen(str) > 9) {
+			val = strtod(str + 9, &str_inval);
+			if (str_inval == str + 9 ||
+			    val < MIN_BASE_NUM || val > MAX_BASE_NUM)
+				pp_sl_log(0, "invalid base_num \"%s\", using default",
+					  str + 9);
+			else
+				*basenum = val;
+		} else if (!strncmp(str, "ewma_weight=", 12) &&
+			   strlen(str) > 12) {
+			val = strtod(str + 12, &str_inval);
+			if (str_inval == str + 12 ||
+			    val < MIN_EWMA_WEIGHT || val > MAX_EWMA_WEIGHT)
+				pp_sl_log(0, "invalid ewma_weight \"%s\", using default",
+					  str + 12);
+			else
+				*weight = val;
+		} else
+			pp_sl_log(1, "ignoring unknown argument \"%s\"", str);
+	}
+	free(arg);
+}
+
+static int calc_prio(double latency, double lg_base)
+{
+	double lg_max = log(MAX_AVG_LATENCY) / lg_base;
+	double lg_min = log(MIN_AVG_LATENCY) / lg_base;
+	double lg_lat;
+
+	if (latency <= MIN_AVG_LATENCY)
+		return lg_max - lg_min;
+	lg_lat = log(latency) / lg_base;
+	if (lg_lat >= lg_max)
+		return 0;
+	return lg_max - lg_lat;
+}
+
+int getprio(struct path *pp, char *args)
+{
+	struct stat_latency_path *sp;
+	struct io_stats st;
+	double base_num, weight, ewma, neutral = -1.;
+	struct timespec now;
+	dev_t devt;
+	int rc;
+
+	if (!pp->udev)
+		return -1;
+	devt = udev_device_get_devnum(pp->udev);
+	if (sysfs_get_io_stats(pp, &st) != 0) {
+		pp_sl_log(2, "%s: failed to read I/O statistics", pp->dev);
+		return -1;
+	}
+	get_args(args, &base_num, &weight);
+	get_monotonic_time(&now);
+
+	pthread_mutex_lock(&stat_latency_lock);
+	sp = get_entry(devt, now.tv_sec);
+	if (!sp) {
+		pthread_mutex_unlock(&stat_latency_lock);
+		return -1;
+	}
+	if (sp->last_seen == 0 || st.ios < sp->ios || st.ticks < sp->ticks) {
+		/* first sample, or the device has been re-created */
+		pp_sl_log(4, "%s: starting new sample", pp->dev);
+		sp->ewma = -1.;
+	} else if (st.ios > sp->ios) {
+		double sample = (st.ticks - sp->ticks) * USEC_PER_MSEC /
+			(st.ios - sp->ios);
+
+		if (sp->ewma < 0)
+			sp->ewma = sample;
+		else
+			sp->ewma = weight * sample + (1. - weight) * sp->ewma;
+	}
+	sp->ios = st.ios;
+	sp->ticks = st.ticks;
+	sp->last_seen = now.tv_sec;
+	strlcpy(sp->wwid, pp->wwid, WWID_SIZE);
+	ewma = sp->ewma;
+	if (ewma < 0)
+		neutral = wwid_avg_latency(pp->wwid, now.tv_sec);
+	pthread_mutex_unlock(&stat_latency_lock);
+
+	if (ewma < 0) {
+		if (neutral < 0)
+			/* middle of the logarithmic scale */
+			neutral = sqrt(MAX_AVG_LATENCY * MIN_AVG_LATENCY);
+		rc = calc_prio(neutral, log(base_num));
+		pp_sl_log(3, "%s: no completed I/O yet, assuming %.0f us prio=%d",
+			  pp->dev, neutral, rc);
+	} else {
+		rc = calc_prio(ewma, log(base_num));
+		pp_sl_log(3, "%s: service time avg=%.0f us prio=%d", pp->dev,
+			  ewma, rc);
+	}
+	return rc;
+}
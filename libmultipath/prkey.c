@@ -6,8 +6,12 @@
 #include "propsel.h"
 #include "strbuf.h"
 #include "prkey.h"
+#include "list.h"
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
@@ -64,121 +68,260 @@ int parse_prkey_flags(char *ptr, uint64_t *prkey, uint8_t *flags)
 	return parse_prkey(ptr, prkey);
 }
 
-static int do_prkey(int fd, char *wwid, char *keystr, int cmd)
+/*
+ * The prkeys file is indexed in memory, so that looking up the key of a
+ * map doesn't require reading the whole file. The index is rebuilt
+ * whenever the file has been changed by another process, which is
+ * detected by comparing inode, size and mtime with the values seen
+ * when the file was last read or written by us.
+ *
+ * Every key is stored in a line of the form "<prkey> <wwid>\n", where
+ * <prkey> has PRKEY_SIZE - 1 characters. Keys are removed by replacing
+ * the first character with '#', and re-added in place, so existing
+ * lines never change their position in the file.
+ */
+#define PRKEY_HASH_SIZE 1024
+
+struct prkey_entry {
+	struct list_head node;
+	off_t offset;		/* start of the line in the prkeys file */
+	char keystr[PRKEY_SIZE];
+	char wwid[];
+};
+
+static pthread_mutex_t prkey_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head prkey_hash[PRKEY_HASH_SIZE];
+static bool prkey_hash_initialized;
+static bool prkey_index_valid;
+static struct stat prkey_stat;
+
+static unsigned int hash_wwid(const char *wwid)
 {
-	char buf[4097];
-	char *ptr;
-	off_t start = 0;
-	int bytes;
+	unsigned int h = 5381;
 
-	while (1) {
-		if (lseek(fd, start, SEEK_SET) < 0) {
-			condlog(0, "prkey file read lseek failed : %s",
-				strerror(errno));
-			return 1;
+	while (*wwid)
+		h = h * 33 + (unsigned char)*wwid++;
+	return h % PRKEY_HASH_SIZE;
+}
+
+static bool prkey_file_unchanged(const struct stat *st)
+{
+	return prkey_index_valid &&
+		st->st_dev == prkey_stat.st_dev &&
+		st->st_ino == prkey_stat.st_ino &&
+		st->st_size == prkey_stat.st_size &&
+		st->st_mtim.tv_sec == prkey_stat.st_mtim.tv_sec &&
+		st->st_mtim.tv_nsec == prkey_stat.st_mtim.tv_nsec;
+}
+
+static void free_prkey_index(void)
+{
+	struct prkey_entry *pe, *tmp;
+	unsigned int i;
+
+	for (i = 0; i < PRKEY_HASH_SIZE; i++) {
+		if (!prkey_hash_initialized) {
+			INIT_LIST_HEAD(&prkey_hash[i]);
+			continue;
 		}
-		bytes = read(fd, buf, 4096);
+		list_for_each_entry_safe(pe, tmp, &prkey_hash[i], node) {
+			list_del(&pe->node);
+			free(pe);
+		}
+	}
+	prkey_hash_initialized = true;
+	prkey_index_valid = false;
+}
+
+static struct prkey_entry *find_prkey_entry(const char *wwid)
+{
+	struct prkey_entry *pe;
+
+	list_for_each_entry(pe, &prkey_hash[hash_wwid(wwid)], node) {
+		if (!strcmp(pe->wwid, wwid))
+			return pe;
+	}
+	return NULL;
+}
+
+static struct prkey_entry *add_prkey_entry(const char *wwid, size_t len,
+					   const char *keystr, off_t offset)
+{
+	struct prkey_entry *pe;
+
+	pe = malloc(sizeof(*pe) + len + 1);
+	if (!pe)
+		return NULL;
+	memcpy(pe->wwid, wwid, len);
+	pe->wwid[len] = '\0';
+	memcpy(pe->keystr, keystr, PRKEY_SIZE - 1);
+	pe->keystr[PRKEY_SIZE - 1] = '\0';
+	pe->offset = offset;
+	list_add_tail(&pe->node, &prkey_hash[hash_wwid(pe->wwid)]);
+	return pe;
+}
+
+/* Read the whole prkeys file and rebuild the index. Call with prkey_lock held. */
+static int load_prkey_index(int fd)
+{
+	struct stat st;
+	char *buf, *line, *eol;
+	ssize_t bytes;
+	size_t len = 0;
+
+	free_prkey_index();
+	if (fstat(fd, &st) < 0) {
+		condlog(0, "cannot stat prkey file : %s", strerror(errno));
+		return 1;
+	}
+	buf = malloc(st.st_size + 1);
+	if (!buf)
+		return 1;
+	while (len < (size_t)st.st_size) {
+		bytes = pread(fd, buf + len, st.st_size - len, len);
 		if (bytes < 0) {
 			if (errno == EINTR || errno == EAGAIN)
 				continue;
 			condlog(0, "failed to read from prkey file : %s",
 				strerror(errno));
+			free(buf);
 			return 1;
 		}
-		if (!bytes) {
-			ptr = NULL;
-			break;
-		}
-		buf[bytes] = '\0';
-		ptr = strstr(buf, wwid);
-		while (ptr) {
-			if (ptr == buf || *(ptr - 1) != ' ' ||
-			    *(ptr + strlen(wwid)) != '\n')
-				ptr = strstr(ptr + strlen(wwid), wwid);
-			else
-				break;
-		}
-		if (ptr) {
-			condlog(3, "found prkey for '%s'", wwid);
-			ptr[strlen(wwid)] = '\0';
-			if (ptr - PRKEY_SIZE < buf ||
-			    (ptr - PRKEY_SIZE != buf &&
-			     *(ptr - PRKEY_SIZE - 1) != '\n')) {
-				condlog(0, "malformed prkey file line for wwid: '%s'", ptr);
-				return 1;
-			}
-			ptr = ptr - PRKEY_SIZE;
-			break;
-		}
-		ptr = strrchr(buf, '\n');
-		if (ptr == NULL) {
-			condlog(4, "couldn't file newline, assuming end of file");
+		if (bytes == 0)
 			break;
+		len += bytes;
+	}
+	buf[len] = '\0';
+
+	for (line = buf; (eol = strchr(line, '\n')) != NULL; line = eol + 1) {
+		const char *wwid = line + PRKEY_SIZE;
+
+		if (eol - line <= PRKEY_SIZE || line[PRKEY_SIZE - 1] != ' ')
+			continue;
+		/* only the first line for a wwid is used */
+		*eol = '\0';
+		if (find_prkey_entry(wwid))
+			continue;
+		if (!add_prkey_entry(wwid, eol - wwid, line, line - buf)) {
+			free_prkey_index();
+			free(buf);
+			return 1;
 		}
-		start = start + (ptr - buf) + 1;
 	}
+	free(buf);
+	prkey_stat = st;
+	prkey_index_valid = true;
+	condlog(4, "read prkeys file");
+	return 0;
+}
+
+/*
+ * Call with prkey_lock held, and the prkeys file locked. For reading,
+ * fd may be -1 if the caller has checked that the index is up to date.
+ */
+static int do_prkey(int fd, char *wwid, char *keystr, int cmd)
+{
+	struct prkey_entry *pe;
+	struct stat st;
+	char buf[PRKEY_SIZE + WWID_SIZE + 1];
+	off_t end;
+	int bytes;
+
+	if (fd >= 0) {
+		if (fstat(fd, &st) < 0 ||
+		    (!prkey_file_unchanged(&st) && load_prkey_index(fd) != 0))
+			return 1;
+	} else if (!prkey_index_valid || cmd != PRKEY_READ)
+		return 1;
+
+	pe = find_prkey_entry(wwid);
 	if (cmd == PRKEY_READ) {
-		if (!ptr || *ptr == '#')
+		if (!pe || *pe->keystr == '#')
 			return 1;
-		memcpy(keystr, ptr, PRKEY_SIZE - 1);
-		keystr[PRKEY_SIZE - 1] = '\0';
+		condlog(3, "found prkey for '%s'", wwid);
+		strlcpy(keystr, pe->keystr, PRKEY_SIZE);
 		return 0;
 	}
-	if (!ptr && !keystr)
+	if (!pe && !keystr)
 		return 0;
-	if (ptr) {
-		if (lseek(fd, start + (ptr - buf), SEEK_SET) < 0) {
+	if (pe) {
+		if (lseek(fd, pe->offset, SEEK_SET) < 0) {
 			condlog(0, "prkey write lseek failed : %s",
 				strerror(errno));
-			return 1;
+			goto fail;
 		}
-	}
-	if (!keystr) {
-		if (safe_write(fd, "#", 1) < 0) {
-			condlog(0, "failed to write to prkey file : %s",
-				strerror(errno));
-			return 1;
+		if (!keystr) {
+			if (safe_write(fd, "#", 1) < 0) {
+				condlog(0, "failed to write to prkey file : %s",
+					strerror(errno));
+				goto fail;
+			}
+			*pe->keystr = '#';
+		} else {
+			if (safe_write(fd, keystr, PRKEY_SIZE - 1) < 0) {
+				condlog(0, "failed to write to prkey file: %s",
+					strerror(errno));
+				goto fail;
+			}
+			strlcpy(pe->keystr, keystr, PRKEY_SIZE);
 		}
-		return 0;
-	}
-	if (!ptr) {
-		if (lseek(fd, 0, SEEK_END) < 0) {
+	} else {
+		end = lseek(fd, 0, SEEK_END);
+		if (end < 0) {
 			condlog(0, "prkey write lseek failed : %s",
 				strerror(errno));
-			return 1;
+			goto fail;
 		}
+		bytes = snprintf(buf, sizeof(buf), "%s %s\n", keystr, wwid);
+		if (safe_write(fd, buf, bytes) < 0) {
+			condlog(0, "failed to write to prkey file: %s",
+				strerror(errno));
+			goto fail;
+		}
+		if (!add_prkey_entry(wwid, strlen(wwid), keystr, end))
+			goto fail;
 	}
-	bytes = sprintf(buf, "%s %s\n", keystr, wwid);
-	if (safe_write(fd, buf, bytes) < 0) {
-		condlog(0, "failed to write to prkey file: %s",
-			strerror(errno));
-		return 1;
-	}
+	/* remember our own modification, so that we don't reread the file */
+	if (fstat(fd, &st) < 0)
+		goto fail;
+	prkey_stat = st;
 	return 0;
+fail:
+	free_prkey_index();
+	return 1;
 }
 
 int get_prkey(struct multipath *mpp, uint64_t *prkey, uint8_t *sa_flags)
 {
 	int fd;
 	int unused;
+	struct stat st;
 	int ret = 1;
 	char keystr[PRKEY_SIZE];
 
 	if (!strlen(mpp->wwid))
 		goto out;
 
-	fd = open_file(DEFAULT_PRKEYS_FILE, &unused, PRKEYS_FILE_HEADER);
-	if (fd < 0)
-		goto out;
-	ret = do_prkey(fd, mpp->wwid, keystr, PRKEY_READ);
+	pthread_mutex_lock(&prkey_lock);
+	pthread_cleanup_push(cleanup_mutex, &prkey_lock);
+	/* Only open the file if it was changed since we last read it */
+	if (stat(DEFAULT_PRKEYS_FILE, &st) == 0 && prkey_file_unchanged(&st))
+		ret = do_prkey(-1, mpp->wwid, keystr, PRKEY_READ);
+	else {
+		fd = open_file(DEFAULT_PRKEYS_FILE, &unused,
+			       PRKEYS_FILE_HEADER);
+		if (fd >= 0) {
+			ret = do_prkey(fd, mpp->wwid, keystr, PRKEY_READ);
+			close(fd);
+		}
+	}
+	pthread_cleanup_pop(1);
 	if (ret)
-		goto out_file;
+		goto out;
 	*sa_flags = 0;
 	if (strchr(keystr, 'X'))
 		*sa_flags = MPATH_F_APTPL_MASK;
 	ret = !!parse_prkey(keystr, prkey);
-out_file:
-	close(fd);
 out:
 	return ret;
 }
@@ -218,10 +361,11 @@ int set_prkey(struct config *conf, struct multipath *mpp, uint64_t prkey,
 		else
 			snprintf(keystr, PRKEY_SIZE, "0x%016" PRIx64, prkey);
 		keystr[PRKEY_SIZE - 1] = '\0';
-		ret = do_prkey(fd, mpp->wwid, keystr, PRKEY_WRITE);
 	}
-	else
-		ret = do_prkey(fd, mpp->wwid, NULL, PRKEY_WRITE);
+	pthread_mutex_lock(&prkey_lock);
+	pthread_cleanup_push(cleanup_mutex, &prkey_lock);
+	ret = do_prkey(fd, mpp->wwid, prkey ? keystr : NULL, PRKEY_WRITE);
+	pthread_cleanup_pop(1);
 	if (ret == 0) {
 		/*
 		 * If you are reverting back to the old key, because you
@@ -4,6 +4,8 @@
  * Copyright (c) 2005 Kiyoshi Ueda, NEC
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #include "autoconfig.h"
 #include "nvme-lib.h"
@@ -103,16 +105,287 @@ do {									\
 	origin = default_origin;					\
 } while(0)
 
+/*
+ * Resolved map settings
+ *
+ * The result of walking the precedence chain (multipaths entry,
+ * overrides, hwe vector, defaults) for a map property depends only on
+ * the configuration, mp->mpe and mp->hwe. setup_map() runs all selectors
+ * on every reload, and maps of the same storage array usually share the
+ * same hwe vector. Therefore the resolved values and their origins are
+ * cached per configuration, keyed by the (mpe, hwe vector) combination.
+ *
+ * get_mp_settings() attaches the settings block for mp's combination to
+ * the map. If none exists yet, a new block is attached and filled by the
+ * mp_set_*() macros as the selectors run; put_mp_settings() then adds it
+ * to the cache. Only the chain itself is cached. Selector logic that
+ * depends on the paths or the state of the map, e.g. alua autodetection
+ * or disabled queueing, runs every time, and properties that weren't
+ * set from the chain when the block was filled are looked up again.
+ */
+#define MP_SETTING(var)							\
+struct {								\
+	typeof(((struct multipath *)0)->var) value;			\
+	const char *origin;						\
+} var
+
+struct mp_settings {
+	struct mp_settings *next;
+	bool published;
+	unsigned int hash;
+	MP_SETTING(rr_weight);
+	MP_SETTING(pgfailback);
+	MP_SETTING(detect_pgpolicy);
+	MP_SETTING(detect_pgpolicy_use_tpg);
+	MP_SETTING(pgpolicy);
+	MP_SETTING(selector);
+	MP_SETTING(alias_prefix);
+	MP_SETTING(features);
+	MP_SETTING(hwhandler);
+	MP_SETTING(no_path_retry);
+	MP_SETTING(minio);
+	MP_SETTING(flush_on_last_del);
+	MP_SETTING(retain_hwhandler);
+	MP_SETTING(deferred_remove);
+	MP_SETTING(san_path_err_threshold);
+	MP_SETTING(san_path_err_forget_rate);
+	MP_SETTING(san_path_err_recovery_time);
+	MP_SETTING(marginal_path_err_sample_time);
+	MP_SETTING(marginal_path_err_rate_threshold);
+	MP_SETTING(marginal_path_err_recheck_gap_time);
+	MP_SETTING(marginal_path_double_failed_time);
+	MP_SETTING(marginal_path_err_method);
+	MP_SETTING(skip_kpartx);
+	MP_SETTING(max_sectors_kb);
+	MP_SETTING(ghost_delay);
+	MP_SETTING(purge_disconnected);
+	MP_SETTING(adaptive_weights);
+	MP_SETTING(all_tg_pt);
+	/* key */
+	const struct mpentry *mpe;
+	int nr_hwe;
+	const struct hwentry *hwe[];
+};
+
+struct mp_settings_table {
+	unsigned int mask;
+	unsigned int count;
+	struct mp_settings *buckets[];
+};
+
+#define MP_SETTINGS_MIN_BUCKETS 64
+
+/* Protects the settings tables of all configurations */
+static pthread_mutex_t mp_settings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int mp_settings_hash(const struct multipath *mp)
+{
+	const struct hwentry *hwe;
+	unsigned int hash = (uintptr_t)mp->mpe >> 4;
+	int i;
+
+	vector_foreach_slot(mp->hwe, hwe, i)
+		hash = hash * 31 + ((uintptr_t)hwe >> 4);
+	return hash ^ (hash >> 16);
+}
+
+static bool mp_settings_match(const struct mp_settings *ms,
+			      const struct multipath *mp, unsigned int hash)
+{
+	const struct hwentry *hwe;
+	int i;
+
+	if (ms->hash != hash || ms->mpe != mp->mpe ||
+	    ms->nr_hwe != VECTOR_SIZE(mp->hwe))
+		return false;
+	vector_foreach_slot(mp->hwe, hwe, i)
+		if (ms->hwe[i] != hwe)
+			return false;
+	return true;
+}
+
+static struct mp_settings *
+find_mp_settings(const struct mp_settings_table *tbl,
+		 const struct multipath *mp, unsigned int hash)
+{
+	struct mp_settings *ms;
+
+	if (!tbl)
+		return NULL;
+	for (ms = tbl->buckets[hash & tbl->mask]; ms; ms = ms->next)
+		if (mp_settings_match(ms, mp, hash))
+			return ms;
+	return NULL;
+}
+
+static struct mp_settings_table *alloc_mp_settings_table(unsigned int size)
+{
+	struct mp_settings_table *tbl;
+
+	tbl = calloc(1, sizeof(*tbl) + size * sizeof(tbl->buckets[0]));
+	if (tbl)
+		tbl->mask = size - 1;
+	return tbl;
+}
+
+static void insert_mp_settings(struct mp_settings_table *tbl,
+			       struct mp_settings *ms)
+{
+	ms->next = tbl->buckets[ms->hash & tbl->mask];
+	tbl->buckets[ms->hash & tbl->mask] = ms;
+	tbl->count++;
+}
+
+/* Called with mp_settings_lock held */
+static void add_mp_settings(struct config *conf, struct mp_settings *ms)
+{
+	struct mp_settings_table *tbl = conf->mp_settings, *new;
+	struct mp_settings *next;
+	unsigned int i;
+
+	if (!tbl) {
+		tbl = alloc_mp_settings_table(MP_SETTINGS_MIN_BUCKETS);
+		if (!tbl) {
+			free(ms);
+			return;
+		}
+		conf->mp_settings = tbl;
+	} else if (tbl->count > tbl->mask &&
+		   (new = alloc_mp_settings_table(2 * (tbl->mask + 1)))) {
+		for (i = 0; i <= tbl->mask; i++) {
+			for (next = tbl->buckets[i]; next; ) {
+				struct mp_settings *cur = next;
+
+				next = cur->next;
+				insert_mp_settings(new, cur);
+			}
+		}
+		free(tbl);
+		conf->mp_settings = tbl = new;
+	}
+	ms->published = true;
+	insert_mp_settings(tbl, ms);
+}
+
+void get_mp_settings(struct config *conf, struct multipath *mp)
+{
+	struct mp_settings *ms;
+	const struct hwentry *hwe;
+	unsigned int hash = mp_settings_hash(mp);
+	int i;
+
+	pthread_mutex_lock(&mp_settings_lock);
+	ms = find_mp_settings(conf->mp_settings, mp, hash);
+	pthread_mutex_unlock(&mp_settings_lock);
+	if (ms) {
+		mp->settings = ms;
+		return;
+	}
+
+	ms = calloc(1, sizeof(*ms) +
+		    VECTOR_SIZE(mp->hwe) * sizeof(ms->hwe[0]));
+	if (!ms)
+		return;
+	ms->hash = hash;
+	ms->mpe = mp->mpe;
+	ms->nr_hwe = VECTOR_SIZE(mp->hwe);
+	vector_foreach_slot(mp->hwe, hwe, i)
+		ms->hwe[i] = hwe;
+	mp->settings = ms;
+}
+
+void put_mp_settings(struct config *conf, struct multipath *mp)
+{
+	struct mp_settings *ms = steal_ptr(mp->settings);
+
+	if (!ms || ms->published)
+		return;
+
+	pthread_mutex_lock(&mp_settings_lock);
+	/* another thread may have filled a block for the same key */
+	if (find_mp_settings(conf->mp_settings, mp, ms->hash))
+		free(ms);
+	else
+		add_mp_settings(conf, ms);
+	pthread_mutex_unlock(&mp_settings_lock);
+}
+
+/* Cancellation cleanup for get_mp_settings() */
+void drop_mp_settings(void *arg)
+{
+	struct multipath *mp = arg;
+	struct mp_settings *ms = steal_ptr(mp->settings);
+
+	if (ms && !ms->published)
+		free(ms);
+}
+
+void free_mp_settings(struct config *conf)
+{
+	struct mp_settings_table *tbl = steal_ptr(conf->mp_settings);
+	struct mp_settings *ms;
+	unsigned int i;
+
+	if (!tbl)
+		return;
+	for (i = 0; i <= tbl->mask; i++) {
+		while ((ms = tbl->buckets[i])) {
+			tbl->buckets[i] = ms->next;
+			free(ms);
+		}
+	}
+	free(tbl);
+}
+
+#define mp_get_setting(var)						\
+do {									\
+	if (mp->settings && mp->settings->var.origin) {			\
+		mp->var = mp->settings->var.value;			\
+		origin = mp->settings->var.origin;			\
+		goto out;						\
+	}								\
+} while(0)
+
+#define mp_put_setting(var)						\
+do {									\
+	if (mp->settings && !mp->settings->published) {		\
+		mp->settings->var.value = mp->var;			\
+		mp->settings->var.origin = origin;			\
+	}								\
+} while(0)
+
+#define mp_set_from(var, src, msg)					\
+do {									\
+	mp_get_setting(var);						\
+	if (src && src->var) {						\
+		mp->var = src->var;					\
+		origin = msg;						\
+		mp_put_setting(var);					\
+		goto out;						\
+	}								\
+} while(0)
+
 #define mp_set_mpe(var)							\
-do_set(var, mp->mpe, mp->var, multipaths_origin)
+mp_set_from(var, mp->mpe, multipaths_origin)
 #define mp_set_hwe(var)							\
-do_set_from_hwe(var, mp, mp->var, hwe_origin)
+do {									\
+	mp_get_setting(var);						\
+	if (mp->hwe && do_set_from_hwe__(var, mp, mp->var)) {		\
+		origin = hwe_origin;					\
+		mp_put_setting(var);					\
+		goto out;						\
+	}								\
+} while(0)
 #define mp_set_ovr(var)							\
-do_set(var, conf->overrides, mp->var, overrides_origin)
+mp_set_from(var, conf->overrides, overrides_origin)
 #define mp_set_conf(var)						\
-do_set(var, conf, mp->var, conf_origin)
+mp_set_from(var, conf, conf_origin)
 #define mp_set_default(var, value)					\
-do_default(mp->var, value)
+do {									\
+	mp_get_setting(var);						\
+	do_default(mp->var, value);					\
+	mp_put_setting(var);						\
+} while(0)
 
 #define pp_set_mpe(var)							\
 do_set(var, mpe, pp->var, multipaths_origin)
@@ -1355,6 +1628,25 @@ out:
 	return 0;
 }
 
+int select_marginal_path_err_method(struct config *conf, struct multipath *mp)
+{
+	const char *origin;
+	STRBUF_ON_STACK(buff);
+
+	mp_set_mpe(marginal_path_err_method);
+	mp_set_ovr(marginal_path_err_method);
+	mp_set_hwe(marginal_path_err_method);
+	mp_set_conf(marginal_path_err_method);
+	mp_set_default(marginal_path_err_method,
+		       DEFAULT_MARGINAL_PATH_ERR_METHOD);
+out:
+	if (print_marginal_path_err_method(&buff,
+					   mp->marginal_path_err_method) > 0)
+		condlog(3, "%s: marginal_path_err_method = %s %s",
+			mp->alias, get_strbuf_str(&buff), origin);
+	return 0;
+}
+
 int select_skip_kpartx (struct config *conf, struct multipath * mp)
 {
 	const char *origin;
@@ -1387,6 +1679,22 @@ out:
 	return 0;
 }
 
+int select_adaptive_weights(struct config *conf, struct multipath *mp)
+{
+	const char *origin;
+
+	mp_set_mpe(adaptive_weights);
+	mp_set_ovr(adaptive_weights);
+	mp_set_hwe(adaptive_weights);
+	mp_set_conf(adaptive_weights);
+	mp_set_default(adaptive_weights, DEFAULT_ADAPTIVE_WEIGHTS);
+out:
+	condlog(3, "%s: adaptive_weights = %s %s", mp->alias,
+		(mp->adaptive_weights == ADAPTIVE_WEIGHTS_ON) ? "yes" : "no",
+		origin);
+	return 0;
+}
+
 int select_max_sectors_kb(struct config *conf, struct multipath * mp)
 {
 	const char *origin;
@@ -1396,15 +1704,15 @@ int select_max_sectors_kb(struct config *conf, struct multipath * mp)
 	mp_set_hwe(max_sectors_kb);
 	mp_set_conf(max_sectors_kb);
 	mp_set_default(max_sectors_kb, DEFAULT_MAX_SECTORS_KB);
+out:
 	/*
 	 * In the default case, we will not modify max_sectors_kb in sysfs
 	 * (see sysfs_set_max_sectors_kb()).
 	 * Don't print a log message here to avoid user confusion.
 	 */
-	return 0;
-out:
-	condlog(3, "%s: max_sectors_kb = %i %s", mp->alias, mp->max_sectors_kb,
-		origin);
+	if (origin != default_origin)
+		condlog(3, "%s: max_sectors_kb = %i %s", mp->alias,
+			mp->max_sectors_kb, origin);
 	return 0;
 }
 
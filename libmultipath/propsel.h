@@ -1,5 +1,14 @@
 #ifndef PROPSEL_H_INCLUDED
 #define PROPSEL_H_INCLUDED
+/*
+ * Cache of the resolved map settings per (mpe, hwe vector) combination,
+ * see propsel.c. Calls to the map selectors between get_mp_settings()
+ * and put_mp_settings() use and fill the cache of conf.
+ */
+void get_mp_settings(struct config *conf, struct multipath *mp);
+void put_mp_settings(struct config *conf, struct multipath *mp);
+void drop_mp_settings(void *mp);
+void free_mp_settings(struct config *conf);
 int select_rr_weight (struct config *conf, struct multipath * mp);
 int select_pgfailback (struct config *conf, struct multipath * mp);
 int select_detect_pgpolicy (struct config *conf, struct multipath * mp);
@@ -38,8 +47,10 @@ int select_marginal_path_err_sample_time(struct config *conf, struct multipath *
 int select_marginal_path_err_rate_threshold(struct config *conf, struct multipath *mp);
 int select_marginal_path_err_recheck_gap_time(struct config *conf, struct multipath *mp);
 int select_marginal_path_double_failed_time(struct config *conf, struct multipath *mp);
+int select_marginal_path_err_method(struct config *conf, struct multipath *mp);
 int select_ghost_delay(struct config *conf, struct multipath * mp);
 int select_purge_disconnected(struct config *conf, struct multipath *mp);
+int select_adaptive_weights(struct config *conf, struct multipath *mp);
 void reconcile_features_with_options(const char *id, char **features,
 				     int* no_path_retry,
 				     int *retain_hwhandler);
@@ -20,6 +20,7 @@
 #include "prioritizers/alua_spc3.h"
 #include "dm-generic.h"
 #include "devmapper.h"
+#include "mempool.h"
 
 const char * const protocol_name[LAST_BUS_PROTOCOL_ID + 1] = {
 	[SYSFS_BUS_UNDEF] = "undef",
@@ -109,12 +110,15 @@ alloc_hostgroup(void)
 	return hgp;
 }
 
+static DEFINE_MEM_POOL(path_pool, "path", sizeof(struct path));
+static DEFINE_MEM_POOL(multipath_pool, "multipath", sizeof(struct multipath));
+
 struct path *
 alloc_path (void)
 {
 	struct path * pp;
 
-	pp = (struct path *)calloc(1, sizeof(struct path));
+	pp = mem_pool_alloc(&path_pool);
 
 	if (pp) {
 		pp->initialized = INIT_NEW;
@@ -132,7 +136,7 @@ alloc_path (void)
 		dm_path_to_gen(pp)->ops = &dm_gen_path_ops;
 		pp->hwe = vector_alloc();
 		if (pp->hwe == NULL) {
-			free(pp);
+			mem_pool_free(&path_pool, pp);
 			return NULL;
 		}
 	}
@@ -184,7 +188,7 @@ free_path (struct path * pp)
 
 	vector_free(pp->hwe);
 
-	free(pp);
+	mem_pool_free(&path_pool, pp);
 }
 
 void
@@ -257,7 +261,7 @@ alloc_multipath (void)
 {
 	struct multipath * mpp;
 
-	mpp = (struct multipath *)calloc(1, sizeof(struct multipath));
+	mpp = mem_pool_alloc(&multipath_pool);
 
 	if (mpp) {
 		mpp->bestpg = 1;
@@ -331,7 +335,8 @@ void free_multipath(struct multipath *mpp)
 		mpp->hwe = NULL;
 	}
 	free(mpp->mpcontext);
-	free(mpp);
+	free(mpp->pr_cache);
+	mem_pool_free(&multipath_pool, mpp);
 }
 
 void cleanup_multipath(struct multipath **pmpp)
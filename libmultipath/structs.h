@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include <string.h>
 #include <libdevmapper.h>
 
 #include "prio.h"
@@ -49,6 +50,12 @@ enum rr_weight_mode {
 	RR_WEIGHT_PRIO
 };
 
+enum marginal_path_err_methods {
+	MARGINAL_PATH_ERR_METHOD_UNDEF,
+	MARGINAL_PATH_ERR_METHOD_ACTIVE,	/* send test I/O */
+	MARGINAL_PATH_ERR_METHOD_PASSIVE,	/* watch error counters */
+};
+
 enum failback_mode {
 	FAILBACK_UNDEF,
 	FAILBACK_MANUAL,
@@ -197,6 +204,17 @@ enum purge_disconnected_states {
 	PURGE_DISCONNECTED_ON = YNU_YES, /* Purge disconnected paths */
 };
 
+/*
+ * adaptive_weights configuration option (per multipath device)
+ * Controls whether multipathd sets the relative_throughput argument of
+ * the service-time path selector from the measured path throughput.
+ */
+enum adaptive_weights_states {
+	ADAPTIVE_WEIGHTS_UNDEF = YNU_UNDEF,
+	ADAPTIVE_WEIGHTS_OFF = YNU_NO,
+	ADAPTIVE_WEIGHTS_ON = YNU_YES,
+};
+
 /*
  * Path disconnection state (per path)
  * Tracks whether a path has been marked for purge and whether it's already queued.
@@ -382,7 +400,33 @@ enum ioctl_info_states {
 	IOCTL_INFO_COMPLETED,
 };
 
+/* Upper limit of the service-time path selector's relative_throughput */
+#define MAX_REL_THROUGHPUT 100
+
+/* Block layer I/O statistics, summed over reads and writes */
+struct io_stats {
+	unsigned long long ios;
+	unsigned long long sectors;
+	unsigned long long ticks;	/* ms spent by all requests */
+	unsigned long long io_ticks;	/* ms the device was busy */
+};
+
 struct path {
+	/*
+	 * Fields used by the checker loop for every path on every tick.
+	 * Keep them together at the start of the struct, so that scanning
+	 * the pathvec touches one cache line per path, instead of pulling
+	 * in the identity strings, checker and prio further down.
+	 */
+	enum check_path_states is_checked;
+	int initialized;
+	unsigned int tick;
+	unsigned int checkint;
+	unsigned int pending_ticks;
+	int state;
+	struct multipath * mpp;
+	bool add_when_online;
+
 	char dev[FILE_NAME_SIZE];
 	char dev_t[BLK_DEV_SIZE];
 	struct udev_device *udev;
@@ -396,12 +440,8 @@ struct path {
 	char tgt_node_name[NODE_NAME_SIZE];
 	char *vpd_data;
 	unsigned long long size;
-	unsigned int checkint;
-	unsigned int tick;
-	unsigned int pending_ticks;
 	int bus;
 	int sysfs_state;
-	int state;
 	int dmstate;
 	int chkrstate;
 	int oldstate;
@@ -416,9 +456,7 @@ struct path {
 	const char *uid_attribute;
 	struct prio prio;
 	struct checker checker;
-	struct multipath * mpp;
 	int fd;
-	int initialized;
 	int retriggers;
 	int partial_retrigger_delay;
 	unsigned int path_failures;
@@ -436,15 +474,21 @@ struct path {
 	int fast_io_fail;
 	unsigned int dev_loss;
 	int eh_deadline;
-	enum check_path_states is_checked;
 	bool can_use_env_uid;
-	bool add_when_online;
 	unsigned int checker_timeout;
 	/* configlet pointers */
 	vector hwe;
 	struct gen_path generic_path;
 	int tpg_id;
 	enum ioctl_info_states ioctl_info;
+	/*
+	 * adaptive_weights: last sample, sectors/s while busy, weight
+	 * computed by multipathd, weight in the kernel table
+	 */
+	struct io_stats io_stats;
+	unsigned long long throughput;
+	unsigned int rel_throughput;
+	unsigned int dm_rel_throughput;
 };
 
 typedef int (pgpolicyfn) (struct multipath *, vector);
@@ -468,6 +512,26 @@ enum udev_wait_states {
 	UDEV_WAIT_RELOAD,
 };
 
+/*
+ * Persistent reservation state, as last read by multipathd.
+ * Used to answer PR IN queries from libmpathpersist without
+ * sending SCSI commands, see multipathd/main.c.
+ */
+struct pr_cache {
+	bool keys_valid;
+	bool resv_valid;
+	time_t keys_time;
+	time_t resv_time;
+	uint32_t generation;
+	uint32_t resv_generation;
+	bool resv_held;
+	uint8_t resv_key[8];
+	uint8_t resv_scope_type;
+	unsigned int epoch;	/* incremented on every change */
+	unsigned int nr_keys;
+	uint8_t keys[][8];
+};
+
 struct multipath {
 	char wwid[WWID_SIZE];
 	char alias_old[WWID_SIZE];
@@ -501,6 +565,7 @@ struct multipath {
 	int marginal_path_err_rate_threshold;
 	int marginal_path_err_recheck_gap_time;
 	int marginal_path_double_failed_time;
+	int marginal_path_err_method;
 	int skip_kpartx;
 	int max_sectors_kb;
 	int force_readonly;
@@ -509,9 +574,13 @@ struct multipath {
 	int ghost_delay_tick;
 	int queue_mode;
 	int purge_disconnected;
+	int adaptive_weights;
+	time_t weights_update_time;
 	unsigned int sync_tick;
 	int checker_count;
 	enum prio_update_type prio_update;
+	enum prio_update_type deferred_prio_update;
+	bool deferred_prio_changed;
 	uid_t uid;
 	gid_t gid;
 	mode_t mode;
@@ -528,6 +597,7 @@ struct multipath {
 	char * hwhandler;
 	struct mpentry * mpe;
 	vector hwe;
+	struct mp_settings *settings;	/* only set in setup_map() */
 
 	/* threads */
 	pthread_t waiter;
@@ -552,6 +622,7 @@ struct multipath {
 	int prhold;
 	int all_tg_pt;
 	bool ever_registered_pr;
+	struct pr_cache *pr_cache;
 
 	struct gen_multipath generic_mp;
 	bool fpin_must_reload;
@@ -572,6 +643,27 @@ static inline int san_path_check_enabled(const struct multipath *mpp)
 		mpp->san_path_err_recovery_time > 0;
 }
 
+static inline bool adaptive_weights_enabled(const struct multipath *mpp)
+{
+	return mpp->adaptive_weights == ADAPTIVE_WEIGHTS_ON &&
+		mpp->selector && !strncmp(mpp->selector, "service-time", 12);
+}
+
+/*
+ * The relative_throughput of a path for the service-time selector.
+ * Only multipathd samples the paths. Without samples, e.g. in the
+ * multipath tool, the weight from the current kernel table is kept,
+ * so that reloading the map doesn't reset the weights multipathd has set.
+ */
+static inline unsigned int path_rel_throughput(const struct path *pp)
+{
+	if (pp->rel_throughput)
+		return pp->rel_throughput;
+	if (pp->dm_rel_throughput)
+		return pp->dm_rel_throughput;
+	return MAX_REL_THROUGHPUT;
+}
+
 struct pathgroup {
 	int status;
 	int priority;
@@ -902,6 +902,28 @@ int verify_paths(struct multipath *mpp)
 	return count;
 }
 
+static void
+libmp_path_state_changed(const struct path *pp __attribute__((unused)))
+{
+	/* empty */
+}
+
+/* multipathd overrides this to notify subscribers */
+void path_state_changed(const struct path *pp)
+	__attribute__((weak, alias("libmp_path_state_changed")));
+
+/*
+ * Once a path is in use, all changes of pp->state should go through
+ * here, whether the checker or the kernel caused them.
+ */
+void set_path_state(struct path *pp, int state)
+{
+	if (pp->state == state)
+		return;
+	pp->state = state;
+	path_state_changed(pp);
+}
+
 /*
  * mpp->no_path_retry:
  *   -2 (QUEUE) : queue_if_no_path enabled, never turned off
@@ -925,8 +947,12 @@ void update_queue_mode_del_path(struct multipath *mpp)
 		if (mpp->no_path_retry == NO_PATH_RETRY_FAIL ||
 		    (mpp->no_path_retry == NO_PATH_RETRY_UNDEF && !is_queueing))
 			mpp->stat_map_failures++;
-	}
-	condlog(2, "%s: remaining active paths: %d", mpp->alias, active);
+		condlog(2, "%s: remaining active paths: %d", mpp->alias,
+			active);
+	} else
+		condlog_coalesce(2, mpp->alias,
+				 "%s: remaining active paths: %d",
+				 mpp->alias, active);
 }
 
 /*
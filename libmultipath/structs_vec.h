@@ -32,6 +32,8 @@ void sync_map_state (struct multipath *mpp, bool reinstate_only);
 struct multipath * add_map_with_path (struct vectors * vecs,
 				      struct path * pp, int add_vec,
 				      const struct multipath *current_mpp);
+void set_path_state(struct path *pp, int state);
+void path_state_changed(const struct path *pp);
 void update_queue_mode_del_path(struct multipath *mpp);
 void update_queue_mode_add_path(struct multipath *mpp);
 int update_multipath_table__ (struct multipath *mpp, vector pathvec, int flags,
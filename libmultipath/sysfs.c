@@ -169,6 +169,45 @@ sysfs_get_size (struct path *pp, unsigned long long * size)
 	return 0;
 }
 
+/*
+ * Read the block layer I/O statistics of a path device.
+ * See Documentation/block/stat.rst in the kernel sources for the fields.
+ */
+int
+sysfs_get_io_stats(struct path *pp, struct io_stats *st)
+{
+	char attr[255];
+	unsigned long long rd_ios, rd_merges, rd_sectors, rd_ticks;
+	unsigned long long wr_ios, wr_merges, wr_sectors, wr_ticks;
+	unsigned long long in_flight, io_ticks;
+	int r;
+
+	if (!pp->udev || !st)
+		return 1;
+
+	attr[0] = '\0';
+	if (!sysfs_attr_get_value_ok(pp->udev, "stat", attr, sizeof(attr))) {
+		condlog(3, "%s: No stat attribute in sysfs", pp->dev);
+		return 1;
+	}
+
+	r = sscanf(attr, "%llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+		   &rd_ios, &rd_merges, &rd_sectors, &rd_ticks,
+		   &wr_ios, &wr_merges, &wr_sectors, &wr_ticks,
+		   &in_flight, &io_ticks);
+
+	if (r != 10) {
+		condlog(3, "%s: Cannot parse stat attribute", pp->dev);
+		return 1;
+	}
+
+	st->ios = rd_ios + wr_ios;
+	st->sectors = rd_sectors + wr_sectors;
+	st->ticks = rd_ticks + wr_ticks;
+	st->io_ticks = io_ticks;
+	return 0;
+}
+
 int devt2devname(char *devname, int devname_len, const char *devt)
 {
 	struct udev_device *u_dev;
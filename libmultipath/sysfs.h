@@ -37,6 +37,7 @@ do {									\
 } while(0)
 
 int sysfs_get_size (struct path *pp, unsigned long long * size);
+int sysfs_get_io_stats(struct path *pp, struct io_stats *st);
 int sysfs_check_holders(char * check_devt, char * new_devt);
 bool sysfs_is_multipathed(struct path *pp, bool set_wwid);
 
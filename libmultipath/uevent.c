@@ -33,6 +33,7 @@
 #include "autoconfig.h"
 #include "debug.h"
 #include "list.h"
+#include "mempool.h"
 #include "uevent.h"
 #include "vector.h"
 #include "structs.h"
@@ -81,9 +82,11 @@ int is_uevent_busy(void)
 	return (!empty || servicing || adding);
 }
 
+static DEFINE_MEM_POOL(uevent_pool, "uevent", sizeof(struct uevent));
+
 struct uevent * alloc_uevent (void)
 {
-	struct uevent *uev = calloc(1, sizeof(struct uevent));
+	struct uevent *uev = mem_pool_alloc(&uevent_pool);
 
 	if (uev) {
 		INIT_LIST_HEAD(&uev->node);
@@ -93,6 +96,11 @@ struct uevent * alloc_uevent (void)
 	return uev;
 }
 
+void free_uevent(struct uevent *uev)
+{
+	mem_pool_free(&uevent_pool, uev);
+}
+
 static void uevq_cleanup(struct list_head *tmpq);
 
 static void cleanup_uev(void *arg)
@@ -102,7 +110,7 @@ static void cleanup_uev(void *arg)
 	uevq_cleanup(&uev->merge_node);
 	if (uev->udev)
 		udev_device_unref(uev->udev);
-	free(uev);
+	free_uevent(uev);
 }
 
 static void uevq_cleanup(struct list_head *tmpq)
@@ -621,7 +629,7 @@ static struct uevent *uevent_from_udev_device(struct udev_device *dev)
 	if (!uev->devpath || ! uev->action) {
 		udev_device_unref(dev);
 		condlog(1, "uevent missing necessary fields");
-		free(uev);
+		free_uevent(uev);
 		return NULL;
 	}
 	uev->udev = dev;
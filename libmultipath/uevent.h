@@ -26,6 +26,7 @@ struct uevent {
 };
 
 struct uevent *alloc_uevent(void);
+void free_uevent(struct uevent *uev);
 int is_uevent_busy(void);
 
 int uevent_listen(struct udev *udev);
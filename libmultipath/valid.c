@@ -3,7 +3,13 @@
   Copyright (c) 2020 Benjamin Marzinski, IBM
  */
 #include <stddef.h>
+#include <stdint.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include "mt-udev-wrap.h"
 #include <dirent.h>
 #include <libmount/libmount.h>
@@ -18,6 +24,7 @@
 #include "sysfs.h"
 #include "blacklist.h"
 #include "mpath_cmd.h"
+#include "strbuf.h"
 #include "valid.h"
 
 static int subdir_filter(const struct dirent *ent)
@@ -141,107 +148,284 @@ static void cleanup_table(void *arg)
 		mnt_free_table((struct libmnt_table *)arg);
 }
 
-static void cleanup_cache(void *arg)
+/*
+ * The device numbers of all mounted block devices and swap devices,
+ * kept in an open-addressing hash set. 0 (0:0) marks empty slots.
+ *
+ * The set is built once, and rebuilt only after the kernel has reported
+ * a change of /proc/self/mountinfo or /proc/swaps through poll(2)
+ * (POLLPRI). Checking many candidate paths, e.g. during coldplug or in
+ * multipathd, thus parses these files only once.
+ */
+#define DEVNO_SET_MIN	64
+
+struct devno_set {
+	dev_t *slots;
+	unsigned int size;	/* power of 2 */
+	unsigned int count;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	int mountinfo_fd;
+	int swaps_fd;
+	bool valid;
+	struct devno_set devs;
+} in_use_cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.mountinfo_fd = -1,
+	.swaps_fd = -1,
+};
+
+static const char mountinfo[] = "/proc/self/mountinfo";
+static const char swaps[] = "/proc/swaps";
+
+static unsigned int devno_hash(dev_t devno, unsigned int size)
 {
-	if (arg)
-#ifdef LIBMOUNT_HAS_MNT_UNREF_CACHE
-		mnt_unref_cache((struct libmnt_cache *)arg);
-#else
-		mnt_free_cache((struct libmnt_cache *)arg);
-#endif
+	return (unsigned int)(((uint64_t)devno * 0x9e3779b97f4a7c15ULL) >> 32)
+		& (size - 1);
 }
 
-/*
- * Passed a vector of partitions and a libmount table,
- * check if any of the partitions in the vector is referenced in the table.
- * Note that mnt_table_find_srcpath() also resolves mounts by symlinks.
- */
-static int check_mnt_table(const struct vector_s *parts,
-			   struct libmnt_table *tbl,
-			   const char *table_name)
+static bool devno_set_contains(const struct devno_set *set, dev_t devno)
 {
 	unsigned int i;
-	const char *sysname;
-	char devpath[PATH_MAX];
 
-	vector_foreach_slot(parts, sysname, i) {
-		if (!safe_sprintf(devpath, "/dev/%s", sysname) &&
-		    mnt_table_find_srcpath(tbl, devpath,
-					   MNT_ITER_FORWARD) != NULL) {
-			condlog(4, "%s: found %s in %s", __func__,
-				sysname, table_name);
-			return 1;
-		}
+	if (!set->slots || devno == 0)
+		return false;
+	for (i = devno_hash(devno, set->size); set->slots[i] != 0;
+	     i = (i + 1) & (set->size - 1))
+		if (set->slots[i] == devno)
+			return true;
+	return false;
+}
+
+static void devno_set_insert__(struct devno_set *set, dev_t devno)
+{
+	unsigned int i;
+
+	for (i = devno_hash(devno, set->size); set->slots[i] != 0;
+	     i = (i + 1) & (set->size - 1))
+		if (set->slots[i] == devno)
+			return;
+	set->slots[i] = devno;
+	set->count++;
+}
+
+static int devno_set_add(struct devno_set *set, dev_t devno)
+{
+	if (devno == 0)
+		return 0;
+	/* keep the load factor below 1/2 */
+	if (2 * (set->count + 1) > set->size) {
+		struct devno_set new = { .size = set->size ? 2 * set->size
+					 : DEVNO_SET_MIN };
+		unsigned int i;
+
+		new.slots = calloc(new.size, sizeof(*new.slots));
+		if (!new.slots)
+			return -ENOMEM;
+		for (i = 0; i < set->size; i++)
+			if (set->slots[i] != 0)
+				devno_set_insert__(&new, set->slots[i]);
+		free(set->slots);
+		*set = new;
 	}
+	devno_set_insert__(set, devno);
 	return 0;
 }
 
-static int check_mountinfo(const struct vector_s *parts)
+static void devno_set_clear(struct devno_set *set)
+{
+	free(set->slots);
+	set->slots = NULL;
+	set->size = set->count = 0;
+}
+
+/*
+ * Add the device numbers of all block devices in a libmount table.
+ * Like mnt_table_find_srcpath(), symlinks in the source are resolved
+ * (by stat()). For mountinfo, the device number the kernel reports
+ * for the file system is used, too; it covers "/dev/root".
+ */
+static int add_mnt_table(struct devno_set *set, struct libmnt_table *tbl,
+			 bool use_devno)
+{
+	struct libmnt_iter *itr;
+	struct libmnt_fs *fs;
+	const char *src;
+	struct stat st;
+	int ret = 0;
+
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr)
+		return -ENOMEM;
+	while (ret == 0 && mnt_table_next_fs(tbl, itr, &fs) == 0) {
+		if (use_devno && major(mnt_fs_get_devno(fs)) != 0)
+			ret = devno_set_add(set, mnt_fs_get_devno(fs));
+		src = mnt_fs_get_srcpath(fs);
+		if (ret == 0 && src && stat(src, &st) == 0 &&
+		    S_ISBLK(st.st_mode))
+			ret = devno_set_add(set, st.st_rdev);
+	}
+	mnt_free_iter(itr);
+	return ret;
+}
+
+static int parse_mountinfo(struct devno_set *set)
 {
-	static const char mountinfo[] = "/proc/self/mountinfo";
 	struct libmnt_table *tbl;
-	struct libmnt_cache *cache;
 	FILE *stream;
-	int used = 0, ret;
+	int ret;
 
 	tbl = mnt_new_table();
 	if (!tbl )
 		return -errno;
 
 	pthread_cleanup_push(cleanup_table, tbl);
-	cache = mnt_new_cache();
-	if (cache) {
-		pthread_cleanup_push(cleanup_cache, cache);
-		if (mnt_table_set_cache(tbl, cache) == 0) {
-			stream = fopen(mountinfo, "r");
-			if (stream != NULL) {
-				pthread_cleanup_push(cleanup_fclose, stream);
-				ret = mnt_table_parse_stream(tbl, stream, mountinfo);
-				pthread_cleanup_pop(1);
-
-				if (ret == 0)
-					used = check_mnt_table(parts, tbl,
-							       "mountinfo");
-			}
-		}
+	stream = fopen(mountinfo, "r");
+	if (stream != NULL) {
+		pthread_cleanup_push(cleanup_fclose, stream);
+		ret = mnt_table_parse_stream(tbl, stream, mountinfo);
 		pthread_cleanup_pop(1);
-	}
+
+		if (ret == 0)
+			ret = add_mnt_table(set, tbl, true);
+	} else
+		ret = -errno;
 	pthread_cleanup_pop(1);
-	return used;
+	return ret;
 }
 
 #ifdef LIBMOUNT_SUPPORTS_SWAP
-static int check_swaps(const struct vector_s *parts)
+static int parse_swaps(struct devno_set *set)
 {
 	struct libmnt_table *tbl;
-	struct libmnt_cache *cache;
-	int used = 0, ret;
+	int ret;
 
 	tbl = mnt_new_table();
 	if (!tbl )
 		return -errno;
 
 	pthread_cleanup_push(cleanup_table, tbl);
-	cache = mnt_new_cache();
-	if (cache) {
-		pthread_cleanup_push(cleanup_cache, cache);
-		if (mnt_table_set_cache(tbl, cache) == 0) {
-			ret = mnt_table_parse_swaps(tbl, NULL);
-			if (ret == 0)
-				used = check_mnt_table(parts, tbl, "swaps");
-		}
-		pthread_cleanup_pop(1);
-	}
+	ret = mnt_table_parse_swaps(tbl, NULL);
+	if (ret == 0)
+		ret = add_mnt_table(set, tbl, false);
 	pthread_cleanup_pop(1);
-	return used;
+	return ret;
 }
 #else
-static int check_swaps(const struct vector_s *parts __attribute__((unused)))
+static int parse_swaps(struct devno_set *set __attribute__((unused)))
 {
 	return 0;
 }
 #endif
 
+/*
+ * Returns true if the file has changed since the last call, if it's
+ * being watched for the first time, or if it can't be watched. The
+ * kernel signals changes of mountinfo and swaps with POLLPRI|POLLERR.
+ * A missing file (no swap support in the kernel) never changes.
+ */
+static bool proc_file_changed(int *fd, const char *name)
+{
+	struct pollfd pfd = { .events = POLLPRI };
+
+	if (*fd == -1) {
+		*fd = open(name, O_RDONLY|O_CLOEXEC);
+		if (*fd != -1)
+			return true;
+		if (errno == ENOENT)
+			return false;
+		/* try again next time */
+		condlog(3, "%s: failed to open %s: %m", __func__, name);
+		return true;
+	}
+	pfd.fd = *fd;
+	return poll(&pfd, 1, 0) < 0 ||
+		(pfd.revents & (POLLPRI|POLLERR|POLLNVAL)) != 0;
+}
+
+/* Called with in_use_cache.lock held */
+static int update_in_use_cache(void)
+{
+	bool mnt_changed, swap_changed;
+	int ret;
+
+	/* Check both files, to reset the poll state of both */
+	mnt_changed = proc_file_changed(&in_use_cache.mountinfo_fd,
+					mountinfo);
+	swap_changed = proc_file_changed(&in_use_cache.swaps_fd, swaps);
+	if (in_use_cache.valid && !mnt_changed && !swap_changed)
+		return 0;
+
+	in_use_cache.valid = false;
+	devno_set_clear(&in_use_cache.devs);
+	if ((ret = parse_mountinfo(&in_use_cache.devs)) != 0) {
+		devno_set_clear(&in_use_cache.devs);
+		return ret;
+	}
+	if ((ret = parse_swaps(&in_use_cache.devs)) != 0)
+		condlog(3, "%s: failed to parse %s: %d", __func__, swaps, ret);
+	/* mountinfo can't be watched, parse it again next time */
+	in_use_cache.valid = in_use_cache.mountinfo_fd != -1;
+	condlog(4, "%s: %u mounted or swap devices", __func__,
+		in_use_cache.devs.count);
+	return 0;
+}
+
+static dev_t read_devno(const char *path)
+{
+	char buf[32];
+	unsigned int maj, min;
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+		return 0;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
+	if (sscanf(buf, "%u:%u", &maj, &min) != 2)
+		return 0;
+	return makedev(maj, min);
+}
+
+/*
+ * Check if the whole disk (parts[0]) or any of its partitions is
+ * mounted or used as swap.
+ */
+static int check_mounts_and_swaps(const char *syspath,
+				  const struct vector_s *parts)
+{
+	char path[PATH_MAX];
+	const char *sysname;
+	unsigned int i;
+	dev_t devno;
+	int used = 0, ret;
+
+	pthread_mutex_lock(&in_use_cache.lock);
+	pthread_cleanup_push(cleanup_mutex, &in_use_cache.lock);
+	ret = update_in_use_cache();
+	vector_foreach_slot(parts, sysname, i) {
+		if (ret != 0)
+			break;
+		if (i == 0 ? safe_sprintf(path, "%s/dev", syspath)
+			   : safe_sprintf(path, "%s/%s/dev", syspath, sysname))
+			continue;
+		devno = read_devno(path);
+		if (devno_set_contains(&in_use_cache.devs, devno)) {
+			condlog(4, "%s: %s is mounted or used as swap",
+				__func__, sysname);
+			used = 1;
+			break;
+		}
+	}
+	pthread_cleanup_pop(1);
+	return ret < 0 ? ret : used;
+}
 
 /*
  * Given a block device, check if the device itself or any of its
@@ -267,8 +451,7 @@ static int is_device_in_use(struct udev_device *udevice)
 	pthread_cleanup_push_cast(free_strvec, parts);
 	if ((ret = read_partitions(syspath, parts)) == 0)
 		used =  check_all_holders(parts) > 0 ||
-			check_mountinfo(parts) > 0 ||
-			check_swaps(parts) > 0;
+			check_mounts_and_swaps(syspath, parts) > 0;
 	pthread_cleanup_pop(1);
 
 	if (ret < 0)
@@ -330,6 +513,17 @@ is_path_valid(const char *name, struct config *conf, struct path *pp,
 	if (pp->wwid[0] == '\0')
 		return PATH_IS_NOT_VALID;
 
+	return is_path_wwid_valid(conf, pp);
+}
+
+int
+is_path_wwid_valid(struct config *conf, struct path *pp)
+{
+	int r;
+
+	if (!pp || !conf || !pp->udev || pp->wwid[0] == '\0')
+		return PATH_IS_ERROR;
+
 	r = is_failed_wwid(pp->wwid);
 	if (r != WWID_IS_NOT_FAILED) {
 		if (r == WWID_IS_FAILED)
@@ -358,3 +552,113 @@ is_path_valid(const char *name, struct config *conf, struct path *pp,
 
 	return PATH_IS_MAYBE_VALID;
 }
+
+static const char * const valid_result_names[PATH_MAX_VALID_RESULT] = {
+	[PATH_IS_NOT_VALID] = "not_valid",
+	[PATH_IS_VALID] = "valid",
+	[PATH_IS_VALID_NO_CHECK] = "valid_no_check",
+	[PATH_IS_MAYBE_VALID] = "maybe_valid",
+};
+
+const char *valid_result_name(int result)
+{
+	if (result <= PATH_IS_ERROR || result >= PATH_MAX_VALID_RESULT)
+		return "unknown";
+	return valid_result_names[result];
+}
+
+static int valid_result_id(const char *name, size_t len)
+{
+	int i;
+
+	for (i = 0; i < PATH_MAX_VALID_RESULT; i++)
+		if (strlen(valid_result_names[i]) == len &&
+		    !strncmp(valid_result_names[i], name, len))
+			return i;
+	return PATH_IS_ERROR;
+}
+
+/*
+ * During uevent processing, the udev database may still contain the
+ * previous uid property of the device, and so may multipathd. The
+ * reply contains the uid attribute multipathd used, if any. Accept
+ * the answer only if the value in the environment matches.
+ */
+static bool env_uid_matches(const char *name, const char *attr,
+			    size_t attr_len, const char *wwid, size_t wwid_len)
+{
+	char buf[64];
+	const char *value;
+
+	if (attr_len == 0)
+		return true;
+	if (attr_len >= sizeof(buf))
+		return false;
+	memcpy(buf, attr, attr_len);
+	buf[attr_len] = '\0';
+	value = getenv(buf);
+	if (value && strlen(value) == wwid_len &&
+	    !strncmp(value, wwid, wwid_len))
+		return true;
+	condlog(3, "%s: %s changed, ignoring multipathd's answer", name, buf);
+	return false;
+}
+
+int
+daemon_is_path_valid(const char *name, char *wwid, size_t wwid_len,
+		     bool check_env_uid)
+{
+	STRBUF_ON_STACK(cmd);
+	char *reply = NULL;
+	const char *p, *attr;
+	size_t len, attr_len;
+	int fd, r = PATH_IS_ERROR;
+
+	if (!name || print_strbuf(&cmd, "validate path %s", name) < 0)
+		return PATH_IS_ERROR;
+
+	/* Don't wait for a busy or starting daemon, just fall back */
+	fd = mpath_connect__(1);
+	if (fd < 0)
+		return PATH_IS_ERROR;
+
+	if (mpath_process_cmd(fd, get_strbuf_str(&cmd), &reply,
+			      DEFAULT_REPLY_TIMEOUT) != 0 || !reply) {
+		condlog(3, "%s: no reply from multipathd", name);
+		goto out;
+	}
+
+	len = strcspn(reply, " \n");
+	r = valid_result_id(reply, len);
+	if (r == PATH_IS_ERROR) {
+		condlog(3, "%s: multipathd can't validate path: %s", name,
+			reply);
+		goto out;
+	}
+	p = reply + len;
+	p += strspn(p, " ");
+	len = strcspn(p, " \n");
+	if (r != PATH_IS_NOT_VALID && (len == 0 || len >= WWID_SIZE)) {
+		condlog(2, "%s: invalid reply from multipathd: %s", name,
+			reply);
+		r = PATH_IS_ERROR;
+		goto out;
+	}
+	attr = p + len;
+	attr += strspn(attr, " ");
+	attr_len = strcspn(attr, " \n");
+	if (check_env_uid && r != PATH_IS_NOT_VALID &&
+	    !env_uid_matches(name, attr, attr_len, p, len)) {
+		r = PATH_IS_ERROR;
+		goto out;
+	}
+	if (wwid && wwid_len > len) {
+		memcpy(wwid, p, len);
+		wwid[len] = '\0';
+	}
+	condlog(3, "%s: multipathd says %s", name, valid_result_name(r));
+out:
+	free(reply);
+	mpath_disconnect(fd);
+	return r;
+}
@@ -26,5 +26,22 @@ enum is_path_valid_result {
 
 int is_path_valid(const char *name, struct config *conf, struct path *pp,
 		  bool check_multipathd);
+/*
+ * The part of is_path_valid() after pathinfo(). pp must have udev
+ * and wwid set already. Used by multipathd for paths it knows.
+ */
+int is_path_wwid_valid(struct config *conf, struct path *pp);
+/* "valid", "not_valid", ..., or "unknown" for anything else */
+const char *valid_result_name(int result);
+/*
+ * Ask multipathd to validate a path ("validate path" command).
+ * Returns PATH_IS_ERROR if multipathd isn't reachable or can't
+ * decide, in which case the caller must evaluate the path itself.
+ * On success, the path wwid is copied to wwid, if it's known.
+ * With check_env_uid, the answer is only used if the uid property
+ * in the environment (of a uevent) still matches the wwid.
+ */
+int daemon_is_path_valid(const char *name, char *wwid, size_t wwid_len,
+			 bool check_env_uid);
 
 #endif /* VALID_H_INCLUDED */
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 #include "checkers.h"
 #include "vector.h"
@@ -46,9 +47,206 @@ void rcu_register_thread_memb(void) {}
 void rcu_unregister_thread_memb(void) {}
 
 
-static int verbose, loglevel, noisy;
+static int verbose, loglevel, noisy, parallel;
 
 static int handle_args(int argc, char * argv[], int line);
+static void free_prout_param_descriptor(struct prout_param_descriptor *paramp);
+
+static const char *pr_status_name(int status)
+{
+	switch (status) {
+	case MPATH_PR_SUCCESS:
+		return "success";
+	case MPATH_PR_SYNTAX_ERROR:
+		return "syntax-error";
+	case MPATH_PR_SENSE_NOT_READY:
+		return "not-ready";
+	case MPATH_PR_SENSE_MEDIUM_ERROR:
+		return "medium-error";
+	case MPATH_PR_SENSE_HARDWARE_ERROR:
+		return "hardware-error";
+	case MPATH_PR_ILLEGAL_REQ:
+		return "illegal-request";
+	case MPATH_PR_SENSE_UNIT_ATTENTION:
+		return "unit-attention";
+	case MPATH_PR_SENSE_INVALID_OP:
+		return "invalid-opcode";
+	case MPATH_PR_SENSE_ABORTED_COMMAND:
+		return "aborted-command";
+	case MPATH_PR_NO_SENSE:
+		return "no-sense";
+	case MPATH_PR_SENSE_MALFORMED:
+		return "malformed-response";
+	case MPATH_PR_RESERV_CONFLICT:
+		return "reservation-conflict";
+	case MPATH_PR_FILE_ERROR:
+		return "file-error";
+	case MPATH_PR_DMMP_ERROR:
+		return "dmmp-error";
+	case MPATH_PR_THREAD_ERROR:
+		return "thread-error";
+	default:
+		return "other-error";
+	}
+}
+
+/*
+ * In parallel batch mode, print one line per command, for consumption
+ * by scripts: line number, device, numeric status, status name.
+ * The result lines are the only output on the original stdout, see
+ * redirect_stdout().
+ */
+static FILE *batch_results;
+
+static void print_batch_result(int nline, const char *device, int status)
+{
+	fprintf(batch_results ? batch_results : stdout, "%d\t%s\t%d\t%s\n",
+		nline, device ? device : "-", status, pr_status_name(status));
+}
+
+/*
+ * Send everything else that is printed while the batch file is run,
+ * like PR IN responses and error messages, also from libmpathpersist,
+ * to stderr.
+ */
+static int redirect_stdout(void)
+{
+	int fd;
+
+	fflush(stdout);
+	fd = dup(STDOUT_FILENO);
+	if (fd < 0)
+		return -1;
+	batch_results = fdopen(fd, "w");
+	if (!batch_results) {
+		close(fd);
+		return -1;
+	}
+	setvbuf(batch_results, NULL, _IOLBF, 0);
+	if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+		fclose(batch_results);
+		batch_results = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static void restore_stdout(void)
+{
+	if (!batch_results)
+		return;
+	fflush(stdout);
+	dup2(fileno(batch_results), STDOUT_FILENO);
+	fclose(batch_results);
+	batch_results = NULL;
+}
+
+/*
+ * With --parallel, PR OUT commands from the batch file are queued, and
+ * sent to all queued devices concurrently when the queue is flushed.
+ * The queue is flushed before any PR IN command, before a command for a
+ * device that is already queued, and at the end of the batch file, so
+ * that the order of commands acting on the same device is preserved.
+ */
+struct queued_prout {
+	int nline;
+	char *device;
+	dev_t devt;
+};
+
+static struct mpath_prout_req *prout_reqs;
+static struct queued_prout *prout_queue;
+static unsigned int nr_queued, max_queued;
+/* status of the first failed queued command */
+static int queue_status = MPATH_PR_SUCCESS;
+
+static void flush_prout_queue(void)
+{
+	unsigned int i;
+	int ret;
+
+	if (nr_queued == 0)
+		return;
+
+	if (verbose >= 2)
+		fprintf(stderr, "sending %u queued PR out commands\n", nr_queued);
+	ret = mpath_persistent_reserve_out_batch__(prout_reqs, nr_queued,
+						   noisy);
+	if (ret != MPATH_PR_SUCCESS && queue_status == MPATH_PR_SUCCESS)
+		queue_status = ret;
+	for (i = 0; i < nr_queued; i++) {
+		print_batch_result(prout_queue[i].nline, prout_queue[i].device,
+				   prout_reqs[i].status);
+		close(prout_reqs[i].fd);
+		free_prout_param_descriptor(prout_reqs[i].paramp);
+		free(prout_queue[i].device);
+	}
+	nr_queued = 0;
+}
+
+static void free_prout_queue(void)
+{
+	free(prout_reqs);
+	free(prout_queue);
+	prout_reqs = NULL;
+	prout_queue = NULL;
+	max_queued = 0;
+}
+
+/*
+ * Queue a PR OUT command. If this succeeds, the queue takes over fd and
+ * paramp.
+ */
+static int queue_prout(int nline, const char *device, int fd, int rq_servact,
+		       unsigned int rq_type,
+		       struct prout_param_descriptor *paramp)
+{
+	struct stat st;
+	unsigned int i;
+
+	if (fstat(fd, &st) != 0) {
+		fprintf(stderr, "%s: stat failed: %s\n", device, strerror(errno));
+		return MPATH_PR_FILE_ERROR;
+	}
+	for (i = 0; i < nr_queued; i++) {
+		if (prout_queue[i].devt == st.st_rdev) {
+			flush_prout_queue();
+			break;
+		}
+	}
+
+	if (nr_queued == max_queued) {
+		unsigned int n = max_queued ? 2 * max_queued : 64;
+		struct mpath_prout_req *reqs;
+		struct queued_prout *queue;
+
+		reqs = realloc(prout_reqs, n * sizeof(*reqs));
+		if (!reqs)
+			return MPATH_PR_OTHER;
+		prout_reqs = reqs;
+		queue = realloc(prout_queue, n * sizeof(*queue));
+		if (!queue)
+			return MPATH_PR_OTHER;
+		prout_queue = queue;
+		max_queued = n;
+	}
+
+	prout_queue[nr_queued].device = strdup(device);
+	if (!prout_queue[nr_queued].device)
+		return MPATH_PR_OTHER;
+	prout_queue[nr_queued].nline = nline;
+	prout_queue[nr_queued].devt = st.st_rdev;
+	prout_reqs[nr_queued] = (struct mpath_prout_req) {
+		.fd = fd,
+		.rq_servact = rq_servact,
+		.rq_scope = 0,
+		.rq_type = rq_type,
+		.paramp = paramp,
+		.status = MPATH_PR_SUCCESS,
+	};
+	nr_queued++;
+	return MPATH_PR_SUCCESS;
+}
 
 static int do_batch_file(const char *batch_fn)
 {
@@ -67,7 +265,10 @@ static int do_batch_file(const char *batch_fn)
 	if (argv == NULL)
 		return MPATH_PR_OTHER;
 
-	fl = fopen(batch_fn, "r");
+	if (!strcmp(batch_fn, "-"))
+		fl = stdin;
+	else
+		fl = fopen(batch_fn, "r");
 	if (fl == NULL) {
 		fprintf(stderr, "unable to open %s: %s\n",
 			batch_fn, strerror(errno));
@@ -78,6 +279,14 @@ static int do_batch_file(const char *batch_fn)
 			fprintf(stderr, "running batch file %s\n",
 				batch_fn);
 	}
+	if (parallel && redirect_stdout() != 0) {
+		fprintf(stderr, "failed to redirect stdout: %s\n",
+			strerror(errno));
+		if (fl != stdin)
+			fclose(fl);
+		free(argv);
+		return MPATH_PR_OTHER;
+	}
 
 	while ((n = getline(&line, &len, fl)) != -1) {
 		char *_token, *token;
@@ -132,7 +341,15 @@ static int do_batch_file(const char *batch_fn)
 			ret = rv;
 	}
 
-	fclose(fl);
+	if (parallel) {
+		flush_prout_queue();
+		free_prout_queue();
+		restore_stdout();
+		if (queue_status != MPATH_PR_SUCCESS)
+			ret = queue_status;
+	}
+	if (fl != stdin)
+		fclose(fl);
 	free(argv);
 	free(line);
 	return ret;
@@ -194,6 +411,7 @@ static int handle_args(int argc, char * argv[], int nline)
 	int prout_sa = -1;
 	char *batch_fn = NULL;
 	void *resp = NULL;
+	bool queued = false;
 
 	memset(transportids, 0, MPATH_MX_TIDS * sizeof(struct transportid));
 
@@ -201,7 +419,7 @@ static int handle_args(int argc, char * argv[], int nline)
 	{
 		int option_index = 0;
 
-		c = getopt_long (argc, argv, "v:Cd:hHioYZK:S:PAT:skrGILcRX:l:f:",
+		c = getopt_long (argc, argv, "v:Cd:hHioYZK:S:PAT:skrGILcRX:l:f:p",
 				long_options, &option_index);
 		if (c == -1)
 			break;
@@ -223,6 +441,15 @@ static int handle_args(int argc, char * argv[], int nline)
 				}
 				batch_fn = strdup(optarg);
 				break;
+			case 'p':
+				if (nline != 0) {
+					fprintf(stderr,
+						"ERROR: -p option not allowed in batch file\n");
+					ret = MPATH_PR_SYNTAX_ERROR;
+					goto out;
+				}
+				parallel = 1;
+				break;
 			case 'v':
 				if (nline == 0 && 1 != sscanf (optarg, "%d", &loglevel))
 				{
@@ -397,6 +624,13 @@ static int handle_args(int argc, char * argv[], int nline)
 			goto out;
 	}
 
+	if (nline == 0 && parallel && batch_fn == NULL)
+	{
+		fprintf (stderr, "'--parallel' requires '--batch-file'\n");
+		ret = MPATH_PR_SYNTAX_ERROR;
+		goto out;
+	}
+
 	if ((prout_flag + prin_flag) == 0 && batch_fn == NULL)
 	{
 		fprintf (stderr, "choose either '--in' or '--out' \n");
@@ -495,6 +729,10 @@ static int handle_args(int argc, char * argv[], int nline)
 
 	if (prin)
 	{
+		/* PR IN must see the effect of preceding PR OUT commands */
+		if (nline != 0 && parallel)
+			flush_prout_queue();
+
 		resp = mpath_alloc_prin_response(prin_sa);
 		if (!resp)
 		{
@@ -572,6 +810,18 @@ static int handle_args(int argc, char * argv[], int nline)
 			}
 		}
 
+		if (nline != 0 && parallel) {
+			ret = queue_prout(nline, device_name, fd, prout_sa,
+					  prout_type, paramp);
+			if (ret == MPATH_PR_SUCCESS) {
+				/* fd and paramp are owned by the queue now */
+				queued = true;
+				goto out;
+			}
+			free_prout_param_descriptor(paramp);
+			goto out_fd;
+		}
+
 		/* PROUT commands other than 'register and move' */
 		ret = mpath_persistent_reserve_out__(fd, prout_sa, 0, prout_type,
 						     paramp, noisy);
@@ -595,6 +845,8 @@ static int handle_args(int argc, char * argv[], int nline)
 out_fd:
 	close (fd);
 out :
+	if (nline != 0 && parallel && !queued)
+		print_batch_result(nline, device_name, ret);
 	if (ret == MPATH_PR_SYNTAX_ERROR) {
 		free(batch_fn);
 		if (nline == 0)
@@ -856,7 +1108,9 @@ static void usage(void)
 			"                   4           Informational messages with trace enabled\n"
 			"    --clear|-C                 PR Out: Clear\n"
 			"    --device=DEVICE|-d DEVICE  query or change DEVICE\n"
-			"    --batch-file|-f FILE       run commands from FILE\n"
+			"    --batch-file|-f FILE       run commands from FILE (\"-\" for stdin)\n"
+			"    --parallel|-p              run PR Out commands from batch file\n"
+			"                               concurrently, print results\n"
 			"    --help|-h                  output this usage message\n"
 			"    --hex|-H                   output response in hex\n"
 			"    --in|-i                    request PR In command \n"
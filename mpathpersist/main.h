@@ -6,6 +6,7 @@ static struct option long_options[] = {
 	{"clear", 0, NULL, 'C'},
 	{"device", 1, NULL, 'd'},
 	{"batch-file", 1, NULL, 'f' },
+	{"parallel", 0, NULL, 'p' },
 	{"help", 0, NULL, 'h'},
 	{"hex", 0, NULL, 'H'},
 	{"in", 0, NULL, 'i'},
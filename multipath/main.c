@@ -438,6 +438,55 @@ static bool released_to_systemd(void)
 	return ret;
 }
 
+/*
+ * Fast path for "multipath -u $dev": let multipathd answer from the
+ * configuration and path information it already has, so that we don't
+ * need to parse the configuration and probe the device for every
+ * uevent. Only the plain "-u [-v N] $dev" invocation of the udev rules
+ * is handled here. Returns -1 if the caller has to evaluate the
+ * path itself.
+ */
+static int daemon_check_path_valid(int argc, char *argv[])
+{
+	const char *name = NULL;
+	int i, r;
+
+	if (argc < 3 || getuid() != 0 || strcmp(argv[1], "-u"))
+		return -1;
+	for (i = 2; i < argc; i++) {
+		if (!strcmp(argv[i], "-v") && i + 1 < argc &&
+		    isdigit(argv[i + 1][0]))
+			libmp_verbosity = atoi(argv[++i]);
+		else if (!strncmp(argv[i], "-v", 2) && isdigit(argv[i][2]))
+			libmp_verbosity = atoi(&argv[i][2]);
+		else if (argv[i][0] != '-' && !name)
+			name = argv[i];
+		else
+			return -1;
+	}
+	if (!name || strlen(name) >= FILE_NAME_SIZE)
+		return -1;
+
+	openlog("multipath", 0, LOG_DAEMON);
+	setlogmask(LOG_UPTO(libmp_verbosity + 3));
+	logsink = LOGSINK_SYSLOG;
+	r = daemon_is_path_valid(name, NULL, 0, true);
+	/* smart mode needs local checks and timeouts, see check_path_valid() */
+	if (r != PATH_IS_VALID && r != PATH_IS_VALID_NO_CHECK &&
+	    r != PATH_IS_NOT_VALID) {
+		logsink = LOGSINK_STDERR_WITH_TIME;
+		return -1;
+	}
+
+	if (r == PATH_IS_VALID && released_to_systemd())
+		r = PATH_IS_NOT_VALID;
+	if (r == PATH_IS_VALID_NO_CHECK)
+		r = PATH_IS_VALID;
+	print_cmd_valid(r, NULL, NULL);
+	/* multipath -u must exit with status 0, see check_path_valid() */
+	return RTVL_OK;
+}
+
 static struct vectors vecs;
 static void cleanup_vecs(void)
 {
@@ -844,7 +893,9 @@ main (int argc, char *argv[])
 	if (atexit(dm_lib_exit) || atexit(libmultipath_exit))
 		condlog(1, "failed to register cleanup handler for libmultipath: %m");
 	logsink = LOGSINK_STDERR_WITH_TIME;
-	if (init_config(DEFAULT_CONFIGFILE))
+	if (daemon_check_path_valid(argc, argv) == RTVL_OK)
+		exit(RTVL_OK);
+	if (init_config_cached(DEFAULT_CONFIGFILE))
 		exit(RTVL_FAIL);
 	if (atexit(uninit_config))
 		condlog(1, "failed to register cleanup handler for config: %m");
@@ -8,6 +8,7 @@ void init_handler_callbacks(void)
 	set_handler_callback(VRB_LIST | Q1_MAPS, HANDLER(cli_list_maps));
 	set_handler_callback(VRB_LIST | Q1_STATUS, HANDLER(cli_list_status));
 	set_unlocked_handler_callback(VRB_LIST | Q1_DAEMON, HANDLER(cli_list_daemon));
+	set_unlocked_handler_callback(VRB_LIST | Q1_MEMORY, HANDLER(cli_list_memory));
 	set_handler_callback(VRB_LIST | Q1_MAPS | Q2_STATUS,
 			     HANDLER(cli_list_maps_status));
 	set_handler_callback(VRB_LIST | Q1_MAPS | Q2_STATS,
@@ -18,6 +19,23 @@ void init_handler_callbacks(void)
 	set_handler_callback(VRB_LIST | Q1_MAPS | Q2_TOPOLOGY,
 			     HANDLER(cli_list_maps_topology));
 	set_handler_callback(VRB_LIST | Q1_TOPOLOGY, HANDLER(cli_list_maps_topology));
+	set_handler_stream(VRB_LIST | Q1_PATHS, HANDLER(cli_stream_paths));
+	set_handler_stream(VRB_LIST | Q1_PATHS | Q2_FMT,
+			   HANDLER(cli_stream_paths_fmt));
+	set_handler_stream(VRB_LIST | Q1_PATHS | Q2_RAW | Q3_FMT,
+			   HANDLER(cli_stream_paths_raw));
+	set_handler_stream(VRB_LIST | Q1_MAPS | Q2_TOPOLOGY,
+			   HANDLER(cli_stream_maps_topology));
+	set_handler_stream(VRB_LIST | Q1_TOPOLOGY,
+			   HANDLER(cli_stream_maps_topology));
+	set_handler_stream(VRB_LIST | Q1_MAPS | Q2_JSONL,
+			   HANDLER(cli_stream_maps_jsonl));
+	set_handler_stream(VRB_LIST | Q1_MAPS | Q2_BINARY,
+			   HANDLER(cli_stream_maps_binary));
+	set_handler_stream(VRB_LIST | Q1_PATHS | Q2_JSONL,
+			   HANDLER(cli_stream_paths_jsonl));
+	set_handler_stream(VRB_LIST | Q1_PATHS | Q2_BINARY,
+			   HANDLER(cli_stream_paths_binary));
 	set_handler_callback(VRB_LIST | Q1_MAPS | Q2_JSON, HANDLER(cli_list_maps_json));
 	set_handler_callback(VRB_LIST | Q1_MAP | Q2_TOPOLOGY,
 			     HANDLER(cli_list_map_topology));
@@ -25,6 +43,17 @@ void init_handler_callbacks(void)
 	set_handler_callback(VRB_LIST | Q1_MAP | Q2_RAW | Q3_FMT,
 			     HANDLER(cli_list_map_fmt));
 	set_handler_callback(VRB_LIST | Q1_MAP | Q2_JSON, HANDLER(cli_list_map_json));
+	set_handler_callback(VRB_LIST | Q1_MAP | Q2_JSONL, HANDLER(cli_list_map_jsonl));
+	set_handler_callback(VRB_LIST | Q1_MAP | Q2_BINARY,
+			     HANDLER(cli_list_map_binary));
+	set_handler_callback(VRB_LIST | Q1_MAPS | Q2_JSONL,
+			     HANDLER(cli_list_maps_jsonl));
+	set_handler_callback(VRB_LIST | Q1_MAPS | Q2_BINARY,
+			     HANDLER(cli_list_maps_binary));
+	set_handler_callback(VRB_LIST | Q1_PATHS | Q2_JSONL,
+			     HANDLER(cli_list_paths_jsonl));
+	set_handler_callback(VRB_LIST | Q1_PATHS | Q2_BINARY,
+			     HANDLER(cli_list_paths_binary));
 	set_handler_callback(VRB_LIST | Q1_CONFIG | Q2_LOCAL,
 			     HANDLER(cli_list_config_local));
 	set_handler_callback(VRB_LIST | Q1_CONFIG, HANDLER(cli_list_config));
@@ -74,4 +103,11 @@ void init_handler_callbacks(void)
 	set_handler_callback(VRB_GETPRHOLD | Q1_MAP, HANDLER(cli_getprhold));
 	set_handler_callback(VRB_SETPRHOLD | Q1_MAP, HANDLER(cli_setprhold));
 	set_handler_callback(VRB_UNSETPRHOLD | Q1_MAP, HANDLER(cli_unsetprhold));
+	set_unlocked_handler_callback(VRB_GETPRIN | Q1_MAP,
+				      HANDLER(cli_getprin));
+	set_handler_callback(VRB_INVALIDATEPRIN | Q1_MAP,
+			     HANDLER(cli_invalidateprin));
+	set_unlocked_handler_callback(VRB_SUBSCRIBE | Q1_EVENTS,
+				      HANDLER(cli_subscribe_events));
+	set_handler_callback(VRB_VALIDATE | Q1_PATH, HANDLER(cli_validate_path));
 }
@@ -94,6 +94,14 @@ static struct handler *add_handler(uint32_t fp, cli_handler *fn, bool locked)
 	h->fingerprint = fp;
 	h->fn = fn;
 	h->locked = locked;
+	/*
+	 * "list", "show", "validate" and "getprin" commands only read state
+	 * (refreshing map state from the kernel, or PR state from the
+	 * device, under the vecs lock if they need it).
+	 */
+	h->readonly = (fp & 0xff) == VRB_LIST ||
+		(fp & 0xff) == VRB_VALIDATE ||
+		(fp & 0xff) == VRB_GETPRIN;
 
 	return h;
 }
@@ -129,6 +137,19 @@ set_handler_callback__ (uint32_t fp, cli_handler *fn, bool locked)
 	return 0;
 }
 
+int
+set_handler_stream (uint32_t fp, cli_stream_handler *fn)
+{
+	struct handler *h;
+
+	h = find_handler(fp);
+	assert(h != NULL);
+	if (!h)
+		return 1;
+	h->stream = fn;
+	return 0;
+}
+
 void free_key (struct key * kw)
 {
 	if (kw->str)
@@ -216,6 +237,8 @@ load_keys (void)
 	r += add_key(keys, "unsetprstatus", VRB_UNSETPRSTATUS, 0);
 	r += add_key(keys, "format", KEY_FMT, 1);
 	r += add_key(keys, "json", KEY_JSON, 0);
+	r += add_key(keys, "jsonl", KEY_JSONL, 0);
+	r += add_key(keys, "binary", KEY_BINARY, 0);
 	r += add_key(keys, "getprkey", VRB_GETPRKEY, 0);
 	r += add_key(keys, "setprkey", VRB_SETPRKEY, 0);
 	r += add_key(keys, "unsetprkey", VRB_UNSETPRKEY, 0);
@@ -227,7 +250,13 @@ load_keys (void)
 	r += add_key(keys, "getprhold", VRB_GETPRHOLD, 0);
 	r += add_key(keys, "setprhold", VRB_SETPRHOLD, 0);
 	r += add_key(keys, "unsetprhold", VRB_UNSETPRHOLD, 0);
+	r += add_key(keys, "getprin", VRB_GETPRIN, 0);
+	r += add_key(keys, "invalidateprin", VRB_INVALIDATEPRIN, 0);
 	r += add_key(keys, "pathlist", KEY_PATHLIST, 1);
+	r += add_key(keys, "subscribe", VRB_SUBSCRIBE, 0);
+	r += add_key(keys, "events", KEY_EVENTS, 0);
+	r += add_key(keys, "validate", VRB_VALIDATE, 0);
+	r += add_key(keys, "memory", KEY_MEMORY, 0);
 
 	if (r) {
 		free_keys(keys);
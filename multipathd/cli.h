@@ -1,6 +1,8 @@
 #ifndef CLI_H_INCLUDED
 #define CLI_H_INCLUDED
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /*
@@ -41,6 +43,10 @@ enum {
 	VRB_GETPRHOLD		= 26,
 	VRB_SETPRHOLD		= 27,
 	VRB_UNSETPRHOLD		= 28,
+	VRB_GETPRIN		= 29,
+	VRB_SUBSCRIBE		= 30,
+	VRB_VALIDATE		= 31,
+	VRB_INVALIDATEPRIN	= 32,
 
 	/* Qualifiers, values must be different from verbs */
 	KEY_PATH		= 65,
@@ -63,6 +69,10 @@ enum {
 	KEY_GROUP		= 82,
 	KEY_KEY			= 83,
 	KEY_PATHLIST		= 84,
+	KEY_EVENTS		= 85,
+	KEY_JSONL		= 86,
+	KEY_BINARY		= 87,
+	KEY_MEMORY		= 88,
 };
 
 /*
@@ -84,6 +94,8 @@ enum {
 	Q1_ALL			= KEY_ALL << 8,
 	Q1_DAEMON		= KEY_DAEMON << 8,
 	Q1_STATUS		= KEY_STATUS << 8,
+	Q1_EVENTS		= KEY_EVENTS << 8,
+	Q1_MEMORY		= KEY_MEMORY << 8,
 
 	/* byte 2: qualifier 2 */
 	Q2_FMT			= KEY_FMT << 16,
@@ -92,6 +104,8 @@ enum {
 	Q2_STATS		= KEY_STATS << 16,
 	Q2_TOPOLOGY		= KEY_TOPOLOGY << 16,
 	Q2_JSON			= KEY_JSON << 16,
+	Q2_JSONL		= KEY_JSONL << 16,
+	Q2_BINARY		= KEY_BINARY << 16,
 	Q2_LOCAL		= KEY_LOCAL << 16,
 	Q2_GROUP		= KEY_GROUP << 16,
 	Q2_KEY			= KEY_KEY << 16,
@@ -135,16 +149,43 @@ struct strbuf;
 
 typedef int (cli_handler)(void *keywords, struct strbuf *reply, void *data);
 
+/*
+ * Handlers for potentially huge replies may additionally provide a
+ * stream function, which renders the reply in pieces. It's called
+ * repeatedly with the same struct cli_stream, and should return after
+ * the reply has grown to at least "limit" bytes. Between calls, the
+ * reply is sent to the client and the vecs lock is dropped, so the
+ * stream function must not keep references to paths or maps.
+ * It sets "done" after rendering the last piece. "priv" is for use by
+ * the stream function; it's NULL in the first call, and freed with
+ * "free_priv", or with free() if that isn't set.
+ */
+#define CLI_STREAM_CHUNK	(64 * 1024)
+
+struct cli_stream {
+	size_t limit;
+	bool done;
+	void *priv;
+	void (*free_priv)(void *);
+};
+
+typedef int (cli_stream_handler)(void *keywords, struct strbuf *reply,
+				 void *data, struct cli_stream *st);
+
 struct handler {
 	uint32_t fingerprint;
 	int locked;
+	/* doesn't change daemon state, may run on a CLI worker thread */
+	bool readonly;
 	cli_handler *fn;
+	cli_stream_handler *stream;
 };
 
 int alloc_handlers (void);
 int set_handler_callback__ (uint32_t fp, cli_handler *fn, bool locked);
 #define set_handler_callback(fp, fn) set_handler_callback__(fp, fn, true)
 #define set_unlocked_handler_callback(fp, fn) set_handler_callback__(fp, fn, false)
+int set_handler_stream(uint32_t fp, cli_stream_handler *fn);
 
 int get_cmdvec (char *cmd, vector *v, bool allow_incomplete);
 struct handler *find_handler_for_cmdvec(const struct vector_s *v);
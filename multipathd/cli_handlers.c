@@ -23,6 +23,7 @@
 #include <mpath_persist.h>
 #include "util.h"
 #include "prkey.h"
+#include "unaligned.h"
 #include "propsel.h"
 #include "main.h"
 #include "mpath_cmd.h"
@@ -31,6 +32,8 @@
 #include "foreign.h"
 #include "strbuf.h"
 #include "cli_handlers.h"
+#include "valid.h"
+#include "mempool.h"
 #include <ctype.h>
 
 static struct path *
@@ -47,29 +50,125 @@ find_path_by_str(const struct vector_s *pathvec, const char *str,
 	return pp;
 }
 
-static int
-show_paths (struct strbuf *reply, struct vectors *vecs, char *style, int pretty)
+/*
+ * Resume state of the chunked "show" handlers. The vecs lock is dropped
+ * between chunks, and paths or maps may be added or removed meanwhile.
+ * Therefore the items to print are recorded by identity when the first
+ * chunk is rendered: the dev_t of the paths, or the WWIDs of the maps.
+ * Items added later aren't printed, and removed items are skipped. The
+ * layout is computed once for the full set, too.
+ */
+struct show_stream {
+	fieldwidth_t *width;
+	int nr, next;
+	/* expected index of ids[next] in the vector */
+	int hint;
+	size_t id_size;
+	char ids[];
+};
+
+typedef const char *(show_id_fn)(const void *);
+
+static const char *path_id(const void *pp)
+{
+	return ((const struct path *)pp)->dev_t;
+}
+
+static const char *map_id(const void *mpp)
 {
+	return ((const struct multipath *)mpp)->wwid;
+}
+
+static void free_show_stream(void *arg)
+{
+	struct show_stream *ss = arg;
+
+	if (!ss)
+		return;
+	free(ss->width);
+	free(ss);
+}
+
+static struct show_stream *
+start_show_stream(struct cli_stream *st, const struct vector_s *vec,
+		  show_id_fn *get_id, size_t id_size)
+{
+	struct show_stream *ss;
+	void *item;
 	int i;
+
+	ss = calloc(1, sizeof(*ss) + VECTOR_SIZE(vec) * id_size);
+	if (!ss)
+		return NULL;
+	ss->id_size = id_size;
+	vector_foreach_slot(vec, item, i)
+		strlcpy(ss->ids + ss->nr++ * id_size, get_id(item), id_size);
+	st->priv = ss;
+	st->free_priv = free_show_stream;
+	return ss;
+}
+
+/* Returns the next item to print, or NULL if all have been printed */
+static void *
+next_show_item(struct show_stream *ss, const struct vector_s *vec,
+	       show_id_fn *get_id)
+{
+	void *item;
+	int i;
+
+	for (; ss->next < ss->nr; ss->next++) {
+		const char *id = ss->ids + ss->next * ss->id_size;
+
+		/* unless items have been removed, it's at the expected index */
+		if (ss->hint >= VECTOR_SIZE(vec) ||
+		    strcmp(get_id(VECTOR_SLOT(vec, ss->hint)), id)) {
+			vector_foreach_slot(vec, item, i)
+				if (!strcmp(get_id(item), id))
+					break;
+			if (i == VECTOR_SIZE(vec))
+				/* removed */
+				continue;
+			ss->hint = i;
+		}
+		ss->next++;
+		return VECTOR_SLOT(vec, ss->hint++);
+	}
+	return NULL;
+}
+
+static int
+show_paths_chunk (struct strbuf *reply, struct vectors *vecs, char *style,
+		  int pretty, struct cli_stream *st)
+{
+	struct show_stream *ss = st->priv;
 	struct path * pp;
 	int hdr_len = 0;
-	fieldwidth_t *width __attribute__((cleanup(cleanup_ucharp))) = NULL;
 
-	if (pretty) {
-		if ((width = alloc_path_layout()) == NULL)
+	if (!ss) {
+		ss = start_show_stream(st, vecs->pathvec, path_id,
+				       BLK_DEV_SIZE);
+		if (!ss)
 			return 1;
-		get_path_layout(vecs->pathvec, 1, width);
-		foreign_path_layout(width);
+		if (pretty) {
+			if ((ss->width = alloc_path_layout()) == NULL)
+				return 1;
+			get_path_layout(vecs->pathvec, 1, ss->width);
+			foreign_path_layout(ss->width);
+			if ((hdr_len = snprint_path_header(reply, style,
+							   ss->width)) < 0)
+				return 1;
+		}
 	}
-	if (pretty && (hdr_len = snprint_path_header(reply, style, width)) < 0)
-		return 1;
 
-	vector_foreach_slot(vecs->pathvec, pp, i) {
-		if (snprint_path(reply, style, pp, width) < 0)
+	while ((pp = next_show_item(ss, vecs->pathvec, path_id))) {
+		if (snprint_path(reply, style, pp, ss->width) < 0)
 			return 1;
+		if (get_strbuf_len(reply) >= st->limit)
+			return 0;
 	}
-	if (snprint_foreign_paths(reply, style, width) < 0)
+	if (snprint_foreign_paths(reply, style, ss->width) < 0)
 		return 1;
+	st->done = true;
 
 	if (pretty && get_strbuf_len(reply) == (size_t)hdr_len)
 		/* No output - clear header */
@@ -78,6 +177,17 @@ show_paths (struct strbuf *reply, struct vectors *vecs, char *style, int pretty)
 	return 0;
 }
 
+static int
+show_paths (struct strbuf *reply, struct vectors *vecs, char *style, int pretty)
+{
+	struct cli_stream st = { .limit = SIZE_MAX, };
+	int rc;
+
+	rc = show_paths_chunk(reply, vecs, style, pretty, &st);
+	free_show_stream(st.priv);
+	return rc;
+}
+
 static int
 show_path (struct strbuf *reply, struct vectors *vecs, struct path *pp,
 	   char *style)
@@ -101,31 +211,49 @@ show_map_topology (struct strbuf *reply, struct multipath *mpp,
 }
 
 static int
-show_maps_topology (struct strbuf *reply, struct vectors * vecs)
+show_maps_topology_chunk (struct strbuf *reply, struct vectors * vecs,
+			  struct cli_stream *st)
 {
-	int i;
+	struct show_stream *ss = st->priv;
 	struct multipath * mpp;
-	fieldwidth_t *p_width __attribute__((cleanup(cleanup_ucharp))) = NULL;
 
-	if ((p_width = alloc_path_layout()) == NULL)
-		return 1;
-	get_path_layout(vecs->pathvec, 0, p_width);
-	foreign_path_layout(p_width);
+	if (!ss) {
+		ss = start_show_stream(st, vecs->mpvec, map_id, WWID_SIZE);
+		if (!ss)
+			return 1;
+		if ((ss->width = alloc_path_layout()) == NULL)
+			return 1;
+		get_path_layout(vecs->pathvec, 0, ss->width);
+		foreign_path_layout(ss->width);
+	}
 
-	vector_foreach_slot(vecs->mpvec, mpp, i) {
-		if (refresh_multipath(vecs, mpp)) {
-			i--;
+	while ((mpp = next_show_item(ss, vecs->mpvec, map_id))) {
+		/* on failure, mpp has been removed from mpvec */
+		if (refresh_multipath(vecs, mpp))
 			continue;
-		}
-		if (snprint_multipath_topology(reply, mpp, 2, p_width) < 0)
+		if (snprint_multipath_topology(reply, mpp, 2, ss->width) < 0)
 			return 1;
+		if (get_strbuf_len(reply) >= st->limit)
+			return 0;
 	}
-	if (snprint_foreign_topology(reply, 2, p_width) < 0)
+	if (snprint_foreign_topology(reply, 2, ss->width) < 0)
 		return 1;
+	st->done = true;
 
 	return 0;
 }
 
+static int
+show_maps_topology (struct strbuf *reply, struct vectors * vecs)
+{
+	struct cli_stream st = { .limit = SIZE_MAX, };
+	int rc;
+
+	rc = show_maps_topology_chunk(reply, vecs, &st);
+	free_show_stream(st.priv);
+	return rc;
+}
+
 static int
 show_maps_json (struct strbuf *reply, struct vectors * vecs)
 {
@@ -144,6 +272,94 @@ show_maps_json (struct strbuf *reply, struct vectors * vecs)
 	return 0;
 }
 
+static int
+show_paths_compact_chunk (struct strbuf *reply, struct vectors *vecs,
+			  enum print_compact fmt, struct cli_stream *st)
+{
+	struct show_stream *ss = st->priv;
+	struct path *pp;
+
+	if (!ss) {
+		ss = start_show_stream(st, vecs->pathvec, path_id,
+				       BLK_DEV_SIZE);
+		if (!ss || snprint_compact_header(reply, fmt) < 0)
+			return 1;
+	}
+
+	while ((pp = next_show_item(ss, vecs->pathvec, path_id))) {
+		if (snprint_path_compact(reply, pp, fmt) < 0)
+			return 1;
+		if (get_strbuf_len(reply) >= st->limit)
+			return 0;
+	}
+	st->done = true;
+	return 0;
+}
+
+static int
+show_paths_compact (struct strbuf *reply, struct vectors *vecs,
+		    enum print_compact fmt)
+{
+	struct cli_stream st = { .limit = SIZE_MAX, };
+	int rc;
+
+	rc = show_paths_compact_chunk(reply, vecs, fmt, &st);
+	free_show_stream(st.priv);
+	return rc;
+}
+
+static int
+show_maps_compact_chunk (struct strbuf *reply, struct vectors *vecs,
+			 enum print_compact fmt, struct cli_stream *st)
+{
+	struct show_stream *ss = st->priv;
+	struct multipath *mpp;
+
+	if (!ss) {
+		ss = start_show_stream(st, vecs->mpvec, map_id, WWID_SIZE);
+		if (!ss || snprint_compact_header(reply, fmt) < 0)
+			return 1;
+	}
+
+	while ((mpp = next_show_item(ss, vecs->mpvec, map_id))) {
+		/* on failure, mpp has been removed from mpvec */
+		if (refresh_multipath(vecs, mpp))
+			continue;
+		if (snprint_multipath_compact(reply, mpp, fmt) < 0)
+			return 1;
+		if (get_strbuf_len(reply) >= st->limit)
+			return 0;
+	}
+	st->done = true;
+	return 0;
+}
+
+static int
+show_maps_compact (struct strbuf *reply, struct vectors *vecs,
+		   enum print_compact fmt)
+{
+	struct cli_stream st = { .limit = SIZE_MAX, };
+	int rc;
+
+	rc = show_maps_compact_chunk(reply, vecs, fmt, &st);
+	free_show_stream(st.priv);
+	return rc;
+}
+
+static int
+show_map_compact (struct strbuf *reply, struct multipath *mpp,
+		  struct vectors *vecs, enum print_compact fmt)
+{
+	if (refresh_multipath(vecs, mpp))
+		return 1;
+
+	if (snprint_compact_header(reply, fmt) < 0 ||
+	    snprint_multipath_compact(reply, mpp, fmt) < 0)
+		return 1;
+
+	return 0;
+}
+
 static int
 show_map_json (struct strbuf *reply, struct multipath * mpp,
 	       struct vectors * vecs)
@@ -223,6 +439,18 @@ cli_list_paths (void *v, struct strbuf *reply, void *data)
 	return show_paths(reply, vecs, PRINT_PATH_CHECKER, 1);
 }
 
+static int
+cli_stream_paths (void *v, struct strbuf *reply, void *data,
+		  struct cli_stream *st)
+{
+	struct vectors * vecs = (struct vectors *)data;
+
+	if (!st->priv)
+		condlog(3, "list paths (operator)");
+
+	return show_paths_chunk(reply, vecs, PRINT_PATH_CHECKER, 1, st);
+}
+
 static int
 cli_list_paths_fmt (void *v, struct strbuf *reply, void *data)
 {
@@ -234,6 +462,19 @@ cli_list_paths_fmt (void *v, struct strbuf *reply, void *data)
 	return show_paths(reply, vecs, fmt, 1);
 }
 
+static int
+cli_stream_paths_fmt (void *v, struct strbuf *reply, void *data,
+		      struct cli_stream *st)
+{
+	struct vectors * vecs = (struct vectors *)data;
+	char * fmt = get_keyparam(v, KEY_FMT);
+
+	if (!st->priv)
+		condlog(3, "list paths (operator)");
+
+	return show_paths_chunk(reply, vecs, fmt, 1, st);
+}
+
 static int
 cli_list_paths_raw (void *v, struct strbuf *reply, void * data)
 {
@@ -245,6 +486,19 @@ cli_list_paths_raw (void *v, struct strbuf *reply, void * data)
 	return show_paths(reply, vecs, fmt, 0);
 }
 
+static int
+cli_stream_paths_raw (void *v, struct strbuf *reply, void *data,
+		      struct cli_stream *st)
+{
+	struct vectors * vecs = (struct vectors *)data;
+	char * fmt = get_keyparam(v, KEY_FMT);
+
+	if (!st->priv)
+		condlog(3, "list paths (operator)");
+
+	return show_paths_chunk(reply, vecs, fmt, 0, st);
+}
+
 static int
 cli_list_path (void *v, struct strbuf *reply, void *data)
 {
@@ -294,6 +548,18 @@ cli_list_maps_topology (void *v, struct strbuf *reply, void *data)
 	return show_maps_topology(reply, vecs);
 }
 
+static int
+cli_stream_maps_topology (void *v, struct strbuf *reply, void *data,
+			  struct cli_stream *st)
+{
+	struct vectors * vecs = (struct vectors *)data;
+
+	if (!st->priv)
+		condlog(3, "list multipaths (operator)");
+
+	return show_maps_topology_chunk(reply, vecs, st);
+}
+
 static int
 cli_list_map_json (void *v, struct strbuf *reply, void *data)
 {
@@ -322,6 +588,110 @@ cli_list_maps_json (void *v, struct strbuf *reply, void *data)
 	return show_maps_json(reply, vecs);
 }
 
+static int
+cli_list_map_compact (void *v, struct strbuf *reply, void *data,
+		      enum print_compact fmt)
+{
+	struct multipath * mpp;
+	struct vectors * vecs = (struct vectors *)data;
+	char * param = get_keyparam(v, KEY_MAP);
+
+	param = convert_dev(param, 0);
+	mpp = find_mp_by_str(vecs->mpvec, param);
+
+	if (!mpp)
+		return -ENODEV;
+
+	condlog(3, "list multipath %s %s (operator)", param,
+		fmt == PRINT_BINARY ? "binary" : "jsonl");
+
+	return show_map_compact(reply, mpp, vecs, fmt);
+}
+
+static int
+cli_list_map_jsonl (void *v, struct strbuf *reply, void *data)
+{
+	return cli_list_map_compact(v, reply, data, PRINT_JSONL);
+}
+
+static int
+cli_list_map_binary (void *v, struct strbuf *reply, void *data)
+{
+	return cli_list_map_compact(v, reply, data, PRINT_BINARY);
+}
+
+static int
+cli_list_maps_jsonl (void *v, struct strbuf *reply, void *data)
+{
+	condlog(3, "list multipaths jsonl (operator)");
+
+	return show_maps_compact(reply, data, PRINT_JSONL);
+}
+
+static int
+cli_list_maps_binary (void *v, struct strbuf *reply, void *data)
+{
+	condlog(3, "list multipaths binary (operator)");
+
+	return show_maps_compact(reply, data, PRINT_BINARY);
+}
+
+static int
+cli_stream_maps_jsonl (void *v, struct strbuf *reply, void *data,
+		       struct cli_stream *st)
+{
+	if (!st->priv)
+		condlog(3, "list multipaths jsonl (operator)");
+
+	return show_maps_compact_chunk(reply, data, PRINT_JSONL, st);
+}
+
+static int
+cli_stream_maps_binary (void *v, struct strbuf *reply, void *data,
+			struct cli_stream *st)
+{
+	if (!st->priv)
+		condlog(3, "list multipaths binary (operator)");
+
+	return show_maps_compact_chunk(reply, data, PRINT_BINARY, st);
+}
+
+static int
+cli_list_paths_jsonl (void *v, struct strbuf *reply, void *data)
+{
+	condlog(3, "list paths jsonl (operator)");
+
+	return show_paths_compact(reply, data, PRINT_JSONL);
+}
+
+static int
+cli_list_paths_binary (void *v, struct strbuf *reply, void *data)
+{
+	condlog(3, "list paths binary (operator)");
+
+	return show_paths_compact(reply, data, PRINT_BINARY);
+}
+
+static int
+cli_stream_paths_jsonl (void *v, struct strbuf *reply, void *data,
+			struct cli_stream *st)
+{
+	if (!st->priv)
+		condlog(3, "list paths jsonl (operator)");
+
+	return show_paths_compact_chunk(reply, data, PRINT_JSONL, st);
+}
+
+static int
+cli_stream_paths_binary (void *v, struct strbuf *reply, void *data,
+			 struct cli_stream *st)
+{
+	if (!st->priv)
+		condlog(3, "list paths binary (operator)");
+
+	return show_paths_compact_chunk(reply, data, PRINT_BINARY, st);
+}
+
 static int
 cli_list_wildcards (void *v, struct strbuf *reply, void *data)
 {
@@ -353,6 +723,9 @@ show_daemon (struct strbuf *reply)
 			 daemon_pid, status,
 			 pending_reconfig ? " (pending reconfigure)" : "") < 0)
 		return 1;
+	if (print_strbuf(reply, "dropped log messages %lu\n",
+			 log_thread_dropped()) < 0)
+		return 1;
 
 	return 0;
 }
@@ -496,6 +869,16 @@ cli_list_daemon (void *v, struct strbuf *reply, void *data)
 	return show_daemon(reply);
 }
 
+static int
+cli_list_memory (void *v, struct strbuf *reply, void *data)
+{
+	condlog(3, "list memory (operator)");
+
+	if (print_mem_pools(reply) < 0)
+		return 1;
+	return 0;
+}
+
 static int
 cli_reset_maps_stats (void *v, struct strbuf *reply, void *data)
 {
@@ -1127,7 +1510,7 @@ cli_reinstate(void * v, struct strbuf *reply, void * data)
 	 * will call dm_fail_path() again.
 	 * Avoid that by setting the state to PATH_UNCHECKED.
 	 */
-	pp->state = PATH_UNCHECKED;
+	set_path_state(pp, PATH_UNCHECKED);
 	pp->tick = 1;
 	return dm_reinstate_path(pp->mpp->alias, pp->dev_t);
 }
@@ -1290,6 +1673,7 @@ static int do_setprstatus(void *v, struct strbuf *reply, void *data,
 	if (!mpp)
 		return -ENODEV;
 
+	pr_cache_invalidate(mpp);
 	if (mpp->prflag != PR_SET) {
 		set_pr(mpp);
 		pr_register_active_paths(mpp, registered_paths);
@@ -1344,6 +1728,7 @@ cli_unsetprstatus(void * v, struct strbuf *reply, void * data)
 	if (!mpp)
 		return -ENODEV;
 
+	pr_cache_invalidate(mpp);
 	if (mpp->prflag != PR_UNSET) {
 		condlog(2, "%s: prflag unset", param);
 		if (mpp->prhold != PR_UNSET)
@@ -1397,6 +1782,7 @@ cli_unsetprkey(void * v, struct strbuf *reply, void * data)
 	if (!mpp)
 		return -ENODEV;
 
+	pr_cache_invalidate(mpp);
 	conf = get_multipath_config();
 	pthread_cleanup_push(put_multipath_config, conf);
 	ret = set_prkey(conf, mpp, 0, 0);
@@ -1429,6 +1815,7 @@ cli_setprkey(void * v, struct strbuf *reply, void * data)
 		return 1;
 	}
 
+	pr_cache_invalidate(mpp);
 	conf = get_multipath_config();
 	pthread_cleanup_push(put_multipath_config, conf);
 	ret = set_prkey(conf, mpp, prkey, flags);
@@ -1444,6 +1831,7 @@ static int do_prhold(struct vectors *vecs, char *param, int prhold)
 	if (!mpp)
 		return -ENODEV;
 
+	pr_cache_invalidate(mpp);
 	if (mpp->prhold != prhold) {
 		mpp->prhold = prhold;
 		condlog(2, "%s: prhold %s", param, pr_str[prhold]);
@@ -1479,6 +1867,157 @@ static int cli_getprhold(void *v, struct strbuf *reply, void *data)
 	return 0;
 }
 
+/*
+ * Reply with the registered keys and the reservation of a map, in the
+ * format parsed by libmpathpersist:
+ *
+ * generation 0x<generation>
+ * key 0x<key>                (once per registered key)
+ * reservation 0x<key> 0x<scope_type> | reservation none
+ */
+static int print_pr_cache(struct strbuf *reply, const struct pr_cache *pc)
+{
+	unsigned int i;
+
+	if (print_strbuf(reply, "generation 0x%" PRIx32 "\n",
+			 pc->generation) < 0)
+		return 1;
+	for (i = 0; i < pc->nr_keys; i++)
+		if (print_strbuf(reply, "key 0x%" PRIx64 "\n",
+				 get_unaligned_be64(pc->keys[i])) < 0)
+			return 1;
+	if (pc->resv_held) {
+		if (print_strbuf(reply, "reservation 0x%" PRIx64 " 0x%x\n",
+				 get_unaligned_be64(pc->resv_key),
+				 pc->resv_scope_type) < 0)
+			return 1;
+	} else if (append_strbuf_str(reply, "reservation none\n") < 0)
+		return 1;
+	return 0;
+}
+
+static void cleanup_strvec(vector *arg)
+{
+	free_strvec(*arg);
+}
+
+/*
+ * Runs without the vecs lock. If the cache is stale, the PR IN commands
+ * are sent with the lock dropped, because they may block for a long
+ * time, and the map is looked up again afterwards.
+ */
+static int cli_getprin(void *v, struct strbuf *reply, void *data)
+{
+	struct multipath *mpp;
+	struct vectors *vecs = (struct vectors *)data;
+	char *param = get_keyparam(v, KEY_MAP);
+	char *alias __attribute__((cleanup(cleanup_charp))) = NULL;
+	vector devs __attribute__((cleanup(cleanup_strvec))) = NULL;
+	struct prin_resp keys, resv;
+	unsigned int epoch = 0;
+	int r = 0;
+
+	param = convert_dev(param, 0);
+
+	lock(&vecs->lock);
+	pthread_cleanup_push(cleanup_lock, &vecs->lock);
+	mpp = find_mp_by_str(vecs->mpvec, param);
+	if (!mpp)
+		r = -ENODEV;
+	else if (pr_cache_valid(mpp, &epoch))
+		r = print_pr_cache(reply, mpp->pr_cache);
+	else if (!(alias = strdup(mpp->alias)) ||
+		 !(devs = pr_cache_devs(mpp)))
+		r = 1;
+	lock_cleanup_pop(vecs->lock);
+	if (r != 0 || !devs)
+		return r;
+
+	if (pr_read_state(devs, &keys, &resv) != MPATH_PR_SUCCESS)
+		return 1;
+
+	lock(&vecs->lock);
+	pthread_cleanup_push(cleanup_lock, &vecs->lock);
+	mpp = find_mp_by_alias(vecs->mpvec, alias);
+	if (!mpp)
+		r = -ENODEV;
+	else if (!pr_cache_update(mpp, epoch, &keys, &resv))
+		/* PR OUT has changed the state meanwhile */
+		r = 1;
+	else
+		r = print_pr_cache(reply, mpp->pr_cache);
+	lock_cleanup_pop(vecs->lock);
+	return r;
+}
+
+static int cli_invalidateprin(void *v, struct strbuf *reply, void *data)
+{
+	struct multipath *mpp;
+	struct vectors *vecs = (struct vectors *)data;
+	char *param = get_keyparam(v, KEY_MAP);
+
+	param = convert_dev(param, 0);
+	condlog(3, "%s: invalidate PR cache (operator)", param);
+
+	mpp = find_mp_by_str(vecs->mpvec, param);
+	if (!mpp)
+		return -ENODEV;
+
+	pr_cache_invalidate(mpp);
+	return 0;
+}
+
+/*
+ * The connection is switched to event mode by the listener after the
+ * reply has been sent, see uxlsnr.c.
+ */
+static int cli_subscribe_events(void *v, struct strbuf *reply, void *data)
+{
+	condlog(3, "subscribe events (operator)");
+	return 0;
+}
+
+/*
+ * Answer "multipath -u" and mpathvalid_is_path() for paths multipathd
+ * has already examined, without calling pathinfo() again. Paths we
+ * don't know are reported as "unknown", and the caller evaluates them
+ * itself (see daemon_is_path_valid()).
+ */
+static int cli_validate_path(void *v, struct strbuf *reply, void *data)
+{
+	struct vectors * vecs = (struct vectors *)data;
+	char * param = get_keyparam(v, KEY_PATH);
+	struct config *conf;
+	struct path *pp;
+	int r = PATH_IS_ERROR;
+
+	param = convert_dev(param, 1);
+	condlog(4, "%s: validate path (operator)", param);
+
+	pp = find_path_by_dev(vecs->pathvec, param);
+	if (!pp || pp->initialized == INIT_REMOVED || !pp->udev ||
+	    pp->wwid[0] == '\0')
+		goto out;
+
+	if (sysfs_is_multipathed(pp, false))
+		r = PATH_IS_VALID_NO_CHECK;
+	else {
+		conf = get_multipath_config();
+		pthread_cleanup_push(put_multipath_config, conf);
+		r = is_path_wwid_valid(conf, pp);
+		pthread_cleanup_pop(1);
+	}
+out:
+	if (r == PATH_IS_ERROR)
+		return append_strbuf_str(reply, "unknown\n") < 0 ? 1 : 0;
+	/* Tell the caller which udev property the wwid was taken from */
+	if (print_strbuf(reply, "%s %s%s%s\n", valid_result_name(r), pp->wwid,
+			 pp->uid_attribute && *pp->uid_attribute ? " " : "",
+			 pp->uid_attribute ? pp->uid_attribute : "") < 0)
+		return 1;
+	return 0;
+}
+
 static int cli_set_marginal(void * v, struct strbuf *reply, void * data)
 {
 	struct vectors * vecs = (struct vectors *)data;
@@ -42,6 +42,7 @@
 #include "parser.h"
 #include "vector.h"
 #include "config.h"
+#include "config_diff.h"
 #include "util.h"
 #include "hwtable.h"
 #include "defaults.h"
@@ -105,7 +106,8 @@ do {								\
 				checker_message(&pp->checker);	\
 								\
 			if (strlen(__m))			      \
-				condlog(lvl, "%s: %s - %s checker%s", \
+				condlog_coalesce(lvl, pp->mpp->alias, \
+					"%s: %s - %s checker%s",      \
 					pp->mpp->alias,		      \
 					pp->dev,		      \
 					checker_name(&pp->checker),   \
@@ -454,6 +456,51 @@ need_switch_pathgroup (struct multipath * mpp, bool *need_reload)
 	return (*need_reload || mpp->bestpg != mpp->nextpg);
 }
 
+/* Overrides the default in libmultipath */
+void queueing_changed(const struct multipath *mpp, int enable)
+{
+	publish_event("queueing %s %s", mpp->alias, enable ? "on" : "off");
+}
+
+/* Overrides the default in libmultipath, see set_path_state() */
+void path_state_changed(const struct path *pp)
+{
+	publish_event("path %s %s %s %s", pp->dev, pp->dev_t,
+		      pp->mpp ? pp->mpp->alias : "none",
+		      checker_state_name(pp->state));
+}
+
+static const char *pg_state_name(int status)
+{
+	switch (status) {
+	case PGSTATE_ENABLED:
+		return "enabled";
+	case PGSTATE_DISABLED:
+		return "disabled";
+	case PGSTATE_ACTIVE:
+		return "active";
+	default:
+		return "undef";
+	}
+}
+
+/*
+ * Report path group state changes, e.g. when the kernel has switched
+ * groups after a path failure. old holds the states before the map was
+ * refreshed.
+ */
+static void publish_pg_states(const struct multipath *mpp, const int *old,
+			      int nr_old)
+{
+	struct pathgroup *pgp;
+	int i;
+
+	vector_foreach_slot (mpp->pg, pgp, i)
+		if (i < nr_old && pgp->status != old[i])
+			publish_event("pathgroup %s %i %s", mpp->alias, i + 1,
+				      pg_state_name(pgp->status));
+}
+
 static void
 switch_pathgroup (struct multipath * mpp)
 {
@@ -461,6 +508,7 @@ switch_pathgroup (struct multipath * mpp)
 	dm_switchgroup(mpp->alias, mpp->bestpg);
 	condlog(2, "%s: switch to path group #%i",
 		 mpp->alias, mpp->bestpg);
+	publish_event("switchgroup %s %i", mpp->alias, mpp->bestpg);
 }
 
 static int
@@ -478,6 +526,7 @@ remove_map_and_stop_waiter(struct multipath *mpp, struct vectors *vecs)
 	/* devices are automatically removed by the dmevent polling code,
 	 * so they don't need to be manually removed here */
 	condlog(3, "%s: removing map from internal tables", mpp->alias);
+	publish_event("remove_map %s", mpp->alias);
 	if (!poll_dmevents)
 		stop_waiter_thread(mpp);
 	remove_map_from_mpvec(mpp, vecs->mpvec);
@@ -531,7 +580,8 @@ int update_multipath (struct vectors *vecs, char *mapname)
 	struct multipath *mpp;
 	struct pathgroup  *pgp;
 	struct path *pp;
-	int i, j;
+	int *pg_status = NULL;
+	int i, j, nr_pgs;
 
 	mpp = find_mp_by_alias(vecs->mpvec, mapname);
 
@@ -540,8 +590,19 @@ int update_multipath (struct vectors *vecs, char *mapname)
 		return 2;
 	}
 
-	if (setup_multipath(vecs, mpp))
+	nr_pgs = VECTOR_SIZE(mpp->pg);
+	if (nr_pgs > 0 && (pg_status = calloc(nr_pgs, sizeof(*pg_status))))
+		vector_foreach_slot (mpp->pg, pgp, i)
+			pg_status[i] = pgp->status;
+	else
+		nr_pgs = 0;
+
+	if (setup_multipath(vecs, mpp)) {
+		free(pg_status);
 		return 1; /* mpp freed in setup_multipath */
+	}
+	publish_pg_states(mpp, pg_status, nr_pgs);
+	free(pg_status);
 
 	/*
 	 * compare checkers states with DM states
@@ -561,7 +622,7 @@ int update_multipath (struct vectors *vecs, char *mapname)
 				put_multipath_config(conf);
 				condlog(2, "%s: mark as failed", pp->dev);
 				mpp->stat_path_failures++;
-				pp->state = PATH_DOWN;
+				set_path_state(pp, PATH_DOWN);
 				if (oldstate == PATH_UP ||
 				    oldstate == PATH_GHOST)
 					update_queue_mode_del_path(mpp);
@@ -737,13 +798,16 @@ retry:
 		retries = -1;
 		goto fail;
 	}
-	if (domap(mpp, params, 1) == DOMAP_FAIL && retries-- > 0) {
-		condlog(0, "%s: map_udate sleep", mpp->alias);
-		free(params);
-		params = NULL;
-		sleep(1);
-		goto retry;
-	}
+	if (domap(mpp, params, 1) == DOMAP_FAIL) {
+		if (retries-- > 0) {
+			condlog(0, "%s: map_udate sleep", mpp->alias);
+			free(params);
+			params = NULL;
+			sleep(1);
+			goto retry;
+		}
+	} else
+		publish_event("reload %s", mpp->alias);
 
 fail:
 	if (new_map && wait_for_events(mpp, vecs)) {
@@ -992,6 +1056,7 @@ ev_add_map (char * dev, const char * alias, struct vectors * vecs)
 	 */
 	if ((rc = add_map_without_path(vecs, alias)) == DMP_OK) {
 		condlog(2, "%s: devmap %s registered", alias, dev);
+		publish_event("add_map %s", alias);
 		return 0;
 	} else if (rc == DMP_NO_MATCH) {
 		condlog(4, "%s: not a multipath map", alias);
@@ -1144,6 +1209,18 @@ uev_add_path (struct uevent *uev, struct vectors * vecs, int need_do_map)
 		return 1;
 	}
 
+	/*
+	 * pathinfo() skips hidden devices, like the paths of native NVMe
+	 * multipath devices. Let the foreign libraries track them.
+	 */
+	if (uev->udev) {
+		const char *hidden =
+			udev_device_get_sysattr_value(uev->udev, "hidden");
+
+		if (hidden && !strcmp(hidden, "1"))
+			(void)add_foreign(uev->udev);
+	}
+
 	pthread_cleanup_push(cleanup_lock, &vecs->lock);
 	lock(&vecs->lock);
 	pthread_testcancel();
@@ -1438,6 +1515,10 @@ rescan:
 			pr_register_active_paths(mpp, NULL);
 		condlog(2, "%s [%s]: path added to devmap %s",
 			pp->dev, pp->dev_t, mpp->alias);
+		if (mpp->action == ACT_CREATE)
+			publish_event("add_map %s", mpp->alias);
+		else if (mpp->action == ACT_RELOAD)
+			publish_event("reload %s", mpp->alias);
 		return 0;
 	} else
 		goto fail;
@@ -1541,7 +1622,8 @@ ev_remove_path (struct path *pp, struct vectors * vecs, int need_do_map)
 				"removal of path %s",
 				mpp->alias, pp->dev);
 			retval = REMOVE_PATH_FAILURE;
-		}
+		} else
+			publish_event("reload %s", mpp->alias);
 		/*
 		 * update mpp state from kernel even if domap failed.
 		 * If the path was removed from the mpp, setup_multipath will
@@ -1640,7 +1722,8 @@ int resize_map(struct multipath *mpp, unsigned long long size,
 			strerror(errno));
 		mpp->size = orig_size;
 		ret = 1;
-	}
+	} else
+		publish_event("reload %s", mpp->alias);
 out:
 	if (setup_multipath(vecs, mpp) != 0)
 		return 2;
@@ -2043,8 +2126,8 @@ fail_path (struct path * pp, int del_active)
 	if (!pp->mpp)
 		return;
 
-	condlog(2, "checker failed path %s in map %s",
-		 pp->dev_t, pp->mpp->alias);
+	condlog_coalesce(2, pp->mpp->alias, "checker failed path %s in map %s",
+			 pp->dev_t, pp->mpp->alias);
 
 	dm_fail_path(pp->mpp->alias, pp->dev_t);
 	if (del_active)
@@ -2163,6 +2246,124 @@ ghost_delay_tick(struct  multipath * mpp)
 	return false;
 }
 
+#define ADAPTIVE_WEIGHTS_INTERVAL	60	/* seconds */
+#define ADAPTIVE_WEIGHTS_MIN_BUSY	1000	/* ms of busy time per interval */
+#define ADAPTIVE_WEIGHTS_HYSTERESIS	20	/* percent */
+
+/*
+ * Sample the I/O statistics of a path, and set pp->throughput to the
+ * sectors per second transferred while the device was busy since the
+ * previous sample. Dividing by the busy time instead of the wall clock
+ * time makes the result independent of the share of I/O the path got,
+ * and thus of the relative_throughput currently set for it.
+ * A path that wasn't busy for long enough is not measured (0).
+ */
+static void sample_path_throughput(struct path *pp)
+{
+	struct io_stats st, *old = &pp->io_stats;
+	unsigned long long busy;
+
+	pp->throughput = 0;
+	if (sysfs_get_io_stats(pp, &st) != 0)
+		return;
+	if (old->io_ticks && st.io_ticks >= old->io_ticks &&
+	    st.sectors >= old->sectors && st.ios > old->ios &&
+	    st.ticks >= old->ticks) {
+		busy = st.io_ticks - old->io_ticks;
+		if (busy >= ADAPTIVE_WEIGHTS_MIN_BUSY) {
+			pp->throughput = (st.sectors - old->sectors) * 1000 /
+				busy;
+			condlog(4, "%s: %llu sectors/s while busy, avg service time %llu ms",
+				pp->dev, pp->throughput,
+				(st.ticks - old->ticks) / (st.ios - old->ios));
+		}
+	}
+	*old = st;
+}
+
+static unsigned long long pg_max_throughput(const struct pathgroup *pgp)
+{
+	struct path *pp;
+	unsigned long long max = 0;
+	int i;
+
+	vector_foreach_slot (pgp->paths, pp, i)
+		if (pp->throughput > max)
+			max = pp->throughput;
+	return max;
+}
+
+/* Scale throughput to 1..MAX_REL_THROUGHPUT, relative to the fastest path */
+static unsigned int throughput_weight(const struct path *pp,
+				      unsigned long long max)
+{
+	unsigned long long w;
+
+	w = (pp->throughput * MAX_REL_THROUGHPUT + max / 2) / max;
+	return w > 0 ? w : 1;
+}
+
+/*
+ * Returns true if the relative_throughput values of the paths in mpp
+ * have been updated, and the map needs to be reloaded.
+ * To avoid reloading the map for every small fluctuation, the weights
+ * are only updated if at least one of them has changed by more than
+ * ADAPTIVE_WEIGHTS_HYSTERESIS percent. Paths that couldn't be measured
+ * keep their current weight.
+ */
+static bool adaptive_weights_tick(struct multipath *mpp)
+{
+	struct timespec now;
+	struct pathgroup *pgp;
+	struct path *pp;
+	unsigned long long max;
+	bool changed = false;
+	int i, j;
+
+	if (!adaptive_weights_enabled(mpp) || !mpp->pg)
+		return false;
+	get_monotonic_time(&now);
+	if (now.tv_sec < mpp->weights_update_time)
+		return false;
+	mpp->weights_update_time = now.tv_sec + ADAPTIVE_WEIGHTS_INTERVAL;
+
+	vector_foreach_slot (mpp->pg, pgp, i) {
+		vector_foreach_slot (pgp->paths, pp, j)
+			sample_path_throughput(pp);
+		max = pg_max_throughput(pgp);
+		if (max == 0)
+			continue;
+		vector_foreach_slot (pgp->paths, pp, j) {
+			unsigned int old, new;
+
+			if (pp->throughput == 0)
+				continue;
+			old = path_rel_throughput(pp);
+			new = throughput_weight(pp, max);
+			if ((new > old ? new - old : old - new) * 100 >
+			    old * ADAPTIVE_WEIGHTS_HYSTERESIS)
+				changed = true;
+		}
+	}
+	if (!changed)
+		return false;
+
+	vector_foreach_slot (mpp->pg, pgp, i) {
+		max = pg_max_throughput(pgp);
+		if (max == 0)
+			continue;
+		vector_foreach_slot (pgp->paths, pp, j) {
+			if (pp->throughput == 0)
+				continue;
+			pp->rel_throughput = throughput_weight(pp, max);
+			condlog(3, "%s: %s: relative throughput %u",
+				mpp->alias, pp->dev, pp->rel_throughput);
+		}
+	}
+	condlog(2, "%s: updating path weights", mpp->alias);
+	return true;
+}
+
 static bool deferred_failback_tick(struct multipath *mpp)
 {
 	bool need_reload;
@@ -2289,6 +2490,7 @@ static bool update_prio(struct multipath *mpp, bool refresh_all)
 		vector_foreach_slot (pgp->paths, pp, j) {
 			if (pp->state != PATH_UP && pp->state != PATH_GHOST)
 				continue;
+			oldpriority = pp->priority;
 			/*
 			 * refresh_all will be set if the mpp has any path
 			 * for whom pp->marginal switched values or for whom
@@ -2296,13 +2498,16 @@ static bool update_prio(struct multipath *mpp, bool refresh_all)
 			 */
 			if (!refresh_all &&
 			    pp->is_checked != CHECK_PATH_CHECKED) {
-				skipped_path = true;
+				/* pick up results of earlier async requests */
+				if (!poll_prio(pp))
+					skipped_path = true;
+				else if (pp->priority != oldpriority)
+					changed = true;
 				continue;
 			}
-			oldpriority = pp->priority;
 			conf = get_multipath_config();
 			pthread_cleanup_push(put_multipath_config, conf);
-			pathinfo(pp, conf, DI_PRIO);
+			pathinfo(pp, conf, DI_PRIO | DI_ASYNC_PRIO);
 			pthread_cleanup_pop(1);
 			if (pp->priority != oldpriority)
 				changed = true;
@@ -2322,13 +2527,24 @@ static bool update_prio(struct multipath *mpp, bool refresh_all)
 				continue;
 			conf = get_multipath_config();
 			pthread_cleanup_push(put_multipath_config, conf);
-			pathinfo(pp, conf, DI_PRIO);
+			pathinfo(pp, conf, DI_PRIO | DI_ASYNC_PRIO);
 			pthread_cleanup_pop(1);
 		}
 	}
 	return true;
 }
 
+static bool prio_pending_in_map(const struct multipath *mpp)
+{
+	struct path *pp;
+	int i;
+
+	vector_foreach_slot (mpp->paths, pp, i)
+		if (prio_pending(&pp->prio))
+			return true;
+	return false;
+}
+
 static int reload_map(struct vectors *vecs, struct multipath *mpp,
 		      int is_daemon)
 {
@@ -2348,6 +2564,7 @@ static int reload_map(struct vectors *vecs, struct multipath *mpp,
 			"for reload map", mpp->alias, r);
 		return 1;
 	}
+	publish_event("reload %s", mpp->alias);
 
 	return 0;
 }
@@ -2652,7 +2869,7 @@ update_path_state (struct vectors * vecs, struct path * pp)
 	if ((newstate != PATH_UP && newstate != PATH_GHOST &&
 	     newstate != PATH_PENDING) && (pp->state == PATH_DELAYED)) {
 		/* If path state become failed again cancel path delay state */
-		pp->state = newstate;
+		set_path_state(pp, newstate);
 		/*
 		 * path state bad again should change the check interval time
 		 * to the shortest delay
@@ -2672,7 +2889,7 @@ update_path_state (struct vectors * vecs, struct path * pp)
 					 * so that this path can be recovered
 					 * in time */
 					pp->tick = 1;
-				pp->state = PATH_DELAYED;
+				set_path_state(pp, PATH_DELAYED);
 				return CHECK_PATH_CHECKED;
 			}
 			if (!pp->marginal) {
@@ -2703,8 +2920,8 @@ update_path_state (struct vectors * vecs, struct path * pp)
 	pp->chkrstate = newstate;
 	if (newstate != pp->state) {
 		int oldstate = pp->state;
-		pp->state = newstate;
 
+		set_path_state(pp, newstate);
 		LOG_MSG(1, pp);
 
 		/*
@@ -2807,7 +3024,7 @@ update_path_state (struct vectors * vecs, struct path * pp)
 	if (pp->mpp->prio_update == PRIO_UPDATE_NONE &&
 	    (newstate == PATH_UP || newstate == PATH_GHOST))
 		pp->mpp->prio_update = PRIO_UPDATE_NORMAL;
-	pp->state = newstate;
+	set_path_state(pp, newstate);
 	return chkr_new_path_up ? CHECK_PATH_NEW_UP : CHECK_PATH_CHECKED;
 }
 
@@ -2818,12 +3035,32 @@ static bool update_mpp_prio(struct multipath *mpp)
 	enum prio_update_type prio_update = mpp->prio_update;
 	mpp->prio_update = PRIO_UPDATE_NONE;
 
-	if (mpp->wait_for_udev != UDEV_WAIT_DONE ||
-	    prio_update == PRIO_UPDATE_NONE)
+	if (mpp->wait_for_udev != UDEV_WAIT_DONE)
 		return false;
+	if (prio_update == PRIO_UPDATE_NONE) {
+		/* No path checked, but async prio results may be due */
+		if (mpp->deferred_prio_update == PRIO_UPDATE_NONE &&
+		    !prio_pending_in_map(mpp))
+			return false;
+		prio_update = PRIO_UPDATE_NORMAL;
+	}
 	condlog(4, "prio refresh");
 
 	changed = update_prio(mpp, prio_update != PRIO_UPDATE_NORMAL);
+	if (mpp->deferred_prio_update > prio_update)
+		prio_update = mpp->deferred_prio_update;
+	changed = changed || mpp->deferred_prio_changed;
+	/*
+	 * The failback decision for a new path needs the priorities of
+	 * all paths. Wait for outstanding async requests.
+	 */
+	if (prio_update == PRIO_UPDATE_NEW_PATH && prio_pending_in_map(mpp)) {
+		mpp->deferred_prio_update = prio_update;
+		mpp->deferred_prio_changed = changed;
+		return false;
+	}
+	mpp->deferred_prio_update = PRIO_UPDATE_NONE;
+	mpp->deferred_prio_changed = false;
 	if (prio_update == PRIO_UPDATE_MARGINAL)
 		return true;
 	if (changed && mpp->pgpolicyfn == (pgpolicyfn *)group_by_prio &&
@@ -3174,7 +3411,7 @@ static void checker_finished(struct vectors *vecs, unsigned int ticks,
 	free_orphan_paths(vecs->pathvec);
 	vector_foreach_slot(vecs->mpvec, mpp, i) {
 		bool inconsistent, prio_reload, failback_reload;
-		bool uev_wait_reload, ghost_reload;
+		bool uev_wait_reload, ghost_reload, weights_reload;
 
 		if (sync_mpp(vecs, mpp, ticks) == DMP_NOT_FOUND) {
 			remove_map_and_stop_waiter(mpp, vecs);
@@ -3186,13 +3423,15 @@ static void checker_finished(struct vectors *vecs, unsigned int ticks,
 		failback_reload = deferred_failback_tick(mpp);
 		uev_wait_reload = missing_uev_wait_tick(mpp, &uev_timed_out);
 		ghost_reload = ghost_delay_tick(mpp);
+		weights_reload = adaptive_weights_tick(mpp);
 		if (uev_wait_reload) {
 			if (update_map(mpp, vecs, 0)) {
 				/* multipath device deleted */
 				i--;
 				continue;
 			}
-		} else if (prio_reload || failback_reload || ghost_reload || inconsistent) {
+		} else if (prio_reload || failback_reload || ghost_reload ||
+			   weights_reload || inconsistent) {
 			if (mpp->wait_for_udev != UDEV_WAIT_DONE) {
 				mpp->need_reload = false;
 				mpp->wait_for_udev = UDEV_WAIT_RELOAD;
@@ -3340,6 +3579,7 @@ checkerloop (void *ap)
 		}
 		if (--foreign_tick == 0)
 			check_foreign();
+		log_coalesce_flush();
 
 		post_config_state(DAEMON_IDLE);
 		conf = get_multipath_config();
@@ -3556,10 +3796,112 @@ static void reconfigure_check(struct config *old, struct config *new)
 	}
 }
 
+/* Replace the pointers in hwe from the old hwtable by the new ones */
+static void remap_hwe(vector hwe, const struct config *old,
+		      const struct config *new)
+{
+	struct hwentry *ohwe;
+	int i, j;
+
+	vector_foreach_slot(hwe, ohwe, i) {
+		j = find_slot(old->hwtable, ohwe);
+		if (j >= 0 && j < VECTOR_SIZE(new->hwtable))
+			hwe->slot[i] = VECTOR_SLOT(new->hwtable, j);
+		else
+			vector_del_slot(hwe, i--);
+	}
+}
+
+/*
+ * Check whether the new configuration can be applied without rebuilding
+ * the path and map vectors. That's the case if only multipaths entries
+ * of existing maps have changed, and none of the changes affects a map
+ * alias or path priorities. If so, make the paths and maps refer to the
+ * new configuration, and return the maps that need to be reloaded.
+ * Otherwise, return NULL.
+ *
+ * If the configuration hasn't changed at all, NULL is returned, too.
+ * A reconfigure is also used to resync multipathd with maps changed
+ * behind its back, edited bindings or wwids files, and missed devices,
+ * which needs the full rediscovery.
+ */
+static vector
+reconfigure_incremental(struct vectors *vecs, struct config *old,
+			struct config *new)
+{
+	struct config_diff diff;
+	struct multipath *mpp;
+	struct path *pp;
+	vector changed = NULL;
+	char *wwid;
+	int i;
+
+	if (diff_config(old, new, &diff) != 0)
+		return NULL;
+	if (diff.sections & ~CONFIG_DIFF_MPTABLE) {
+		condlog(3, "%s: global configuration changed", __func__);
+		goto out;
+	}
+	if (VECTOR_SIZE(diff.wwids) == 0) {
+		condlog(3, "%s: configuration unchanged", __func__);
+		goto out;
+	}
+	if (!(changed = vector_alloc()))
+		goto out;
+
+	vector_foreach_slot(diff.wwids, wwid, i) {
+		mpp = find_mp_by_wwid(vecs->mpvec, wwid);
+		if (!mpp) {
+			/* the entry may allow a map to be created */
+			condlog(3, "%s: multipaths entry for %s without map",
+				__func__, wwid);
+			goto fail;
+		}
+		if (mpe_change_affects_paths(mpp->mpe,
+					     find_mpe_sorted(new, wwid))) {
+			condlog(3, "%s: multipaths entry change needs full reconfigure",
+				mpp->alias);
+			goto fail;
+		}
+		if (!vector_alloc_slot(changed))
+			goto fail;
+		vector_set_slot(changed, mpp);
+	}
+
+	/*
+	 * The old configuration will be freed. Apart from the multipaths
+	 * entries, the new one has the same content, so the paths and maps
+	 * just need to point to the corresponding entries.
+	 */
+	vector_foreach_slot(vecs->pathvec, pp, i) {
+		remap_hwe(pp->hwe, old, new);
+		select_getuid(new, pp);
+	}
+	vector_foreach_slot(vecs->mpvec, mpp, i) {
+		mpp->mpe = find_mpe_sorted(new, mpp->wwid);
+		remap_hwe(mpp->hwe, old, new);
+		/* only used while selecting the alias */
+		mpp->alias_prefix = NULL;
+	}
+	goto out;
+
+fail:
+	vector_free(changed);
+	changed = NULL;
+out:
+	free_config_diff(&diff);
+	return changed;
+}
+
 static int
 reconfigure (struct vectors *vecs, enum force_reload_types reload_type)
 {
+	/* set after configure() has succeeded, i.e. the vectors are complete */
+	static bool vecs_configured;
 	struct config * old, *conf;
+	struct multipath *mpp;
+	vector changed = NULL;
+	int i;
 
 	conf = load_config(DEFAULT_CONFIGFILE);
 	if (!conf)
@@ -3568,37 +3910,59 @@ reconfigure (struct vectors *vecs, enum force_reload_types reload_type)
 	if (verbosity)
 		libmp_verbosity = verbosity;
 	setlogmask(LOG_UPTO(libmp_verbosity + 3));
-	condlog(2, "%s: setting up paths and maps", __func__);
 
-	/*
-	 * free old map and path vectors ... they use old conf state
-	 */
-	if (VECTOR_SIZE(vecs->mpvec))
-		remove_maps_and_stop_waiters(vecs);
-
-	free_pathvec(vecs->pathvec, FREE_PATHS);
-	vecs->pathvec = NULL;
-	delete_all_foreign();
-
-	reset_checker_classes();
 	if (bindings_read_only)
 		conf->bindings_read_only = bindings_read_only;
 
 	if (check_alias_settings(conf))
 		return 1;
 
-	uxsock_timeout = conf->uxsock_timeout;
-
 	old = rcu_dereference(multipath_conf);
 	reconfigure_check(old, conf);
 
+	/* "reconfigure all" always rebuilds everything */
+	if (reload_type != FORCE_RELOAD_YES && vecs_configured)
+		changed = reconfigure_incremental(vecs, old, conf);
+
+	if (changed)
+		condlog(2, "%s: reloading %d maps with changed settings",
+			__func__, VECTOR_SIZE(changed));
+	else {
+		condlog(2, "%s: setting up paths and maps", __func__);
+
+		/*
+		 * free old map and path vectors ... they use old conf state
+		 */
+		if (VECTOR_SIZE(vecs->mpvec))
+			remove_maps_and_stop_waiters(vecs);
+
+		free_pathvec(vecs->pathvec, FREE_PATHS);
+		vecs->pathvec = NULL;
+		delete_all_foreign();
+
+		reset_checker_classes();
+	}
+
+	uxsock_timeout = conf->uxsock_timeout;
+
 	conf->sequence_nr = old->sequence_nr + 1;
 	rcu_assign_pointer(multipath_conf, conf);
 	call_rcu(&old->rcu, rcu_free_config);
+
+	if (changed) {
+		vector_foreach_slot(changed, mpp, i) {
+			if (reload_and_sync_map(mpp, vecs) == 2)
+				/* map removed */
+				continue;
+			pr_register_active_paths(mpp, NULL);
+		}
+		vector_free(changed);
+		return 0;
+	}
 #ifdef FPIN_EVENT_HANDLER
 	fpin_clean_marginal_dev_list(NULL);
 #endif
-	configure(vecs, reload_type);
+	vecs_configured = (configure(vecs, reload_type) == 0);
 
 	return 0;
 }
@@ -3850,6 +4214,8 @@ static void cleanup_threads(void)
 		pthread_join(fpin_consumer_thr, NULL);
 
 
+	stop_prio_workers();
+
 	/*
 	 * As all threads are joined now, and we're in DAEMON_SHUTDOWN
 	 * state, no new waiter threads will be created anymore.
@@ -4006,6 +4372,9 @@ child (__attribute__((unused)) void *param)
 		condlog(0, "failed to initialize prioritizers");
 		goto failed;
 	}
+	/* Failing this is non-fatal, prioritizers will run synchronously */
+	if (!conf->force_sync && start_prio_workers(PRIO_ASYNC_WORKERS))
+		condlog(1, "failed to start prio workers");
 	/* Failing this is non-fatal */
 
 	init_foreign(conf->enable_foreign);
@@ -4382,6 +4751,175 @@ main (int argc, char *argv[])
 		return (child(NULL));
 }
 
+/*
+ * PR state changes by other initiators are not signaled to us, so
+ * cached data is only used for a short time.
+ */
+#define PR_CACHE_MAX_AGE 5
+
+/*
+ * Every change of the cached state increments the epoch, so that
+ * pr_cache_update() doesn't overwrite it with data that was read before.
+ */
+void pr_cache_invalidate(struct multipath *mpp)
+{
+	if (!mpp->pr_cache)
+		return;
+	mpp->pr_cache->keys_valid = false;
+	mpp->pr_cache->resv_valid = false;
+	mpp->pr_cache->epoch++;
+}
+
+static void pr_cache_set_keys(struct multipath *mpp,
+			      const struct prin_resp *resp)
+{
+	const struct prin_readdescr *rk = &resp->prin_descriptor.prin_readkeys;
+	unsigned int nr_keys = rk->additional_length / 8;
+	struct pr_cache *pc;
+	struct timespec now;
+
+	if (nr_keys > sizeof(rk->key_list) / 8)
+		nr_keys = sizeof(rk->key_list) / 8;
+	if (!mpp->pr_cache || mpp->pr_cache->nr_keys < nr_keys) {
+		pc = realloc(mpp->pr_cache, sizeof(*pc) + nr_keys * 8);
+		if (!pc) {
+			pr_cache_invalidate(mpp);
+			return;
+		}
+		if (!mpp->pr_cache)
+			memset(pc, 0, sizeof(*pc));
+		mpp->pr_cache = pc;
+	}
+	pc = mpp->pr_cache;
+	get_monotonic_time(&now);
+	pc->generation = rk->prgeneration;
+	pc->nr_keys = nr_keys;
+	memcpy(pc->keys, rk->key_list, nr_keys * 8);
+	pc->keys_time = now.tv_sec;
+	pc->keys_valid = true;
+	pc->epoch++;
+}
+
+static void pr_cache_set_resv(struct multipath *mpp,
+			      const struct prin_resp *resp)
+{
+	const struct prin_resvdescr *rr = &resp->prin_descriptor.prin_readresv;
+	struct pr_cache *pc = mpp->pr_cache;
+	struct timespec now;
+
+	if (!pc) {
+		pc = calloc(1, sizeof(*pc));
+		if (!pc)
+			return;
+		mpp->pr_cache = pc;
+	}
+	get_monotonic_time(&now);
+	pc->resv_generation = rr->prgeneration;
+	pc->resv_held = rr->additional_length != 0;
+	if (pc->resv_held) {
+		memcpy(pc->resv_key, rr->key, 8);
+		pc->resv_scope_type = rr->scope_type;
+	}
+	pc->resv_time = now.tv_sec;
+	pc->resv_valid = true;
+	pc->epoch++;
+}
+
+/*
+ * Returns true if the cached PR state of mpp is recent enough to be
+ * used. Otherwise, *epoch is set for pr_cache_update().
+ */
+bool pr_cache_valid(struct multipath *mpp, unsigned int *epoch)
+{
+	struct pr_cache *pc = mpp->pr_cache;
+	struct timespec now;
+
+	get_monotonic_time(&now);
+	if (pc && pc->keys_valid && pc->resv_valid &&
+	    now.tv_sec - pc->keys_time < PR_CACHE_MAX_AGE &&
+	    now.tv_sec - pc->resv_time < PR_CACHE_MAX_AGE &&
+	    pc->generation == pc->resv_generation)
+		return true;
+
+	/* Allocate the cache now, so that invalidations can be tracked */
+	if (!pc)
+		pc = mpp->pr_cache = calloc(1, sizeof(*pc));
+	*epoch = pc ? pc->epoch : 0;
+	return false;
+}
+
+/*
+ * Collect the devices of mpp that PR IN commands can be sent to,
+ * for pr_read_state().
+ */
+vector pr_cache_devs(const struct multipath *mpp)
+{
+	vector devs = vector_alloc();
+	struct pathgroup *pgp;
+	struct path *pp;
+	char *dev;
+	int i, j;
+
+	if (!devs)
+		return NULL;
+	vector_foreach_slot (mpp->pg, pgp, i) {
+		vector_foreach_slot (pgp->paths, pp, j) {
+			if (pp->bus != SYSFS_BUS_SCSI ||
+			    (pp->state != PATH_UP && pp->state != PATH_GHOST))
+				continue;
+			if (!(dev = strdup(pp->dev)) ||
+			    !vector_alloc_slot(devs)) {
+				free(dev);
+				free_strvec(devs);
+				return NULL;
+			}
+			vector_set_slot(devs, dev);
+		}
+	}
+	return devs;
+}
+
+/*
+ * Read the registered keys and the reservation through the first of
+ * devs that answers. The commands may block, so this must be called
+ * without holding the vecs lock.
+ */
+int pr_read_state(vector devs, struct prin_resp *keys,
+		  struct prin_resp *resv)
+{
+	char *dev;
+	int i, ret = MPATH_PR_DMMP_ERROR;
+
+	vector_foreach_slot (devs, dev, i) {
+		memset(keys, 0, sizeof(*keys));
+		ret = prin_do_scsi_ioctl(dev, MPATH_PRIN_RKEY_SA, keys, 0);
+		if (ret != MPATH_PR_SUCCESS)
+			continue;
+		memset(resv, 0, sizeof(*resv));
+		ret = prin_do_scsi_ioctl(dev, MPATH_PRIN_RRES_SA, resv, 0);
+		if (ret == MPATH_PR_SUCCESS)
+			break;
+	}
+	return ret;
+}
+
+/*
+ * Store the PR state read by pr_read_state(). If the cache has been
+ * invalidated or updated since pr_cache_valid() returned epoch, the
+ * state may be outdated already, and false is returned.
+ */
+bool pr_cache_update(struct multipath *mpp, unsigned int epoch,
+		     const struct prin_resp *keys,
+		     const struct prin_resp *resv)
+{
+	if (!mpp->pr_cache || mpp->pr_cache->epoch != epoch)
+		return false;
+	/* this increments the epoch, too */
+	pr_cache_set_keys(mpp, keys);
+	pr_cache_set_resv(mpp, resv);
+	return mpp->pr_cache->keys_valid && mpp->pr_cache->resv_valid;
+}
+
 static void check_prhold(struct multipath *mpp, struct path *pp)
 {
 	struct prin_resp resp = {{{.prgeneration = 0}}};
@@ -4396,6 +4934,7 @@ static void check_prhold(struct multipath *mpp, struct path *pp)
 			mpp->wwid, status);
 		return;
 	}
+	pr_cache_set_resv(mpp, &resp);
 	mpp->prhold = PR_UNSET;
 	if (!resp.prin_descriptor.prin_readresv.additional_length)
 		return;
@@ -4462,10 +5001,12 @@ static int update_map_pr(struct multipath *mpp, struct path *pp, unsigned int *n
 			unset_pr(mpp);
 			*nr_keys = 0;
 		}
+		pr_cache_invalidate(mpp);
 		condlog(0, "%s : pr in read keys service action failed Error=%d",
 			mpp->alias, ret);
 		return ret;
 	}
+	pr_cache_set_keys(mpp, &resp);
 
 	condlog(4, "%s: Multipath reservation_key: 0x%" PRIx64 " ", mpp->alias,
 		get_be64(mpp->reservation_key));
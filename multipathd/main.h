@@ -54,6 +54,15 @@ int resize_map(struct multipath *mpp, unsigned long long size,
 	       struct vectors *vecs);
 void set_pr(struct multipath *mpp);
 void unset_pr(struct multipath *mpp);
+void pr_cache_invalidate(struct multipath *mpp);
+struct prin_resp;
+bool pr_cache_valid(struct multipath *mpp, unsigned int *epoch);
+struct vector_s *pr_cache_devs(const struct multipath *mpp);
+int pr_read_state(struct vector_s *devs, struct prin_resp *keys,
+		  struct prin_resp *resv);
+bool pr_cache_update(struct multipath *mpp, unsigned int epoch,
+		     const struct prin_resp *keys,
+		     const struct prin_resp *resv);
 void pr_register_active_paths(struct multipath *mpp,
 			      const struct vector_s *registered_paths);
 void cleanup_reset_vec(struct vector_s **v);
@@ -5,6 +5,7 @@
  * Copyright (c) 2005 Benjamin Marzinski, Redhat
  */
 #include <stdio.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -13,33 +14,82 @@
 #include "uxsock.h"
 #include "uxclnt.h"
 
+struct reply_state {
+	bool started;
+	bool failed;
+};
+
+static int print_reply(const char *data, size_t len, void *arg)
+{
+	struct reply_state *st = arg;
+
+	if (!st->started) {
+		st->started = true;
+		st->failed = (len >= 5 && strncmp(data, "fail\n", 5) == 0);
+		/* If there is additional failure information, skip the
+		 * initial 'fail' */
+		if (st->failed && len > 5) {
+			data += 5;
+			len -= 5;
+		}
+	}
+	fwrite(data, 1, len, stdout);
+	return 0;
+}
+
 static int process_req(int fd, char * inbuf, unsigned int timeout)
 {
-	char *reply;
-	int ret;
+	struct reply_state st = { .started = false, };
 
-	if (send_packet(fd, inbuf) != 0) {
+	if (mpath_send_cmd_chunked(fd, inbuf) != 0) {
 		printf("cannot send packet\n");
 		return 1;
 	}
-	ret = recv_packet(fd, &reply, timeout);
-	if (ret < 0) {
-		if (ret == -ETIMEDOUT)
+	/* big replies are printed while they're being received */
+	if (mpath_recv_reply_stream(fd, print_reply, &st, timeout) != 0) {
+		if (errno == ETIMEDOUT)
 			printf("timeout receiving packet\n");
 		else
-			printf("error %d receiving packet\n", ret);
+			printf("error %d receiving packet\n", -errno);
 		return 1;
-	} else {
-		ret = (strncmp(reply, "fail\n", 5) == 0);
-		/* If there is additional failure information, skip the
-		 * initial 'fail' */
-		if (ret && strlen(reply) > 5)
-			printf("%s", reply + 5);
-		else
-			printf("%s", reply);
-		free(reply);
-		return ret;
 	}
+	return st.failed;
+}
+
+/*
+ * "subscribe events" keeps the connection open. Print events until
+ * multipathd goes away or we're interrupted.
+ */
+static bool is_subscribe_cmd(const char *cmd)
+{
+	size_t n = strcspn(cmd, " \t");
+
+	/* "su" would be ambiguous with "suspend" */
+	return n >= 3 && !strncmp(cmd, "subscribe", n);
+}
+
+static int print_events(int fd, unsigned int timeout)
+{
+	char *events;
+
+	if (mpath_subscribe_events(fd, timeout) != 0) {
+		printf("fail\n");
+		return 1;
+	}
+	for (;;) {
+		if (mpath_recv_events(fd, &events, timeout) != 0) {
+			if (errno == ETIMEDOUT)
+				continue;
+			printf("error %d receiving events\n", -errno);
+			return 1;
+		}
+		if (events) {
+			fputs(events, stdout);
+			fflush(stdout);
+			free(events);
+		}
+	}
+	return 0;
 }
 
 /*
@@ -57,7 +107,10 @@ int uxclnt(char * inbuf, unsigned int timeout)
 		return 1;
 	}
 
-	ret = process_req(fd, inbuf, timeout);
+	if (is_subscribe_cmd(inbuf))
+		ret = print_events(fd, timeout);
+	else
+		ret = process_req(fd, inbuf, timeout);
 
 	mpath_disconnect(fd);
 	return ret;
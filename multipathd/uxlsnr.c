@@ -50,6 +50,9 @@ enum {
 	CLT_LOCKED_WORK,
 	CLT_WORK,
 	CLT_SEND,
+	CLT_EVENTS,
+	/* command is being executed by a worker thread */
+	CLT_BUSY,
 };
 
 struct client {
@@ -63,8 +66,27 @@ struct client {
 	struct strbuf reply;
 	struct handler *handler;
 	size_t cmd_len, len;
+	/* length of the next command, as it's being received */
+	size_t req_len;
 	int error;
 	bool is_root;
+	/* client accepts a chunked reply */
+	bool want_chunks;
+	/* reply is being sent in chunks */
+	bool chunked;
+	bool chunk_marker_sent;
+	bool chunk_end_queued;
+	/* length words queued by queue_len(), and how much of them is sent */
+	size_t out_hdr[2];
+	size_t hdr_len, hdr_sent;
+	struct cli_stream stream;
+	/* client has subscribed to events */
+	bool subscribed;
+	/* sequence number of the next event to send */
+	uint64_t event_seq;
+	/* the following fields are protected by worker_lock */
+	struct list_head work_node;
+	bool work_done;
 };
 
 /* Indices for array of poll fds */
@@ -89,6 +111,50 @@ enum {
 /* Compile-time error if POLLFD_CHUNK is too small */
 static __attribute__((unused)) char ___a[-(MIN_POLLS <= 0)];
 
+/*
+ * Event subscriptions.
+ *
+ * Producers add events to a ring buffer, usually with the vecs lock held,
+ * and the listener thread sends them to all subscribed clients. Producers
+ * never wait for clients. If a client doesn't keep up, the oldest events
+ * are overwritten, and the client is sent a "lost" record instead.
+ */
+#define EVENT_RING_SIZE	1024
+#define EVENT_REC_LEN	128
+/* Max number of events sent to a client in one packet */
+#define EVENT_BATCH	64
+
+struct event_rec {
+	uint64_t seq;
+	char text[EVENT_REC_LEN];
+};
+
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct event_rec event_ring[EVENT_RING_SIZE];
+/* sequence number of the next event */
+static uint64_t event_seq;
+static unsigned int nr_subscribers;
+
+/*
+ * Worker threads for read-only commands. Without them, a slow command
+ * like "show maps topology" would keep the listener thread from serving
+ * any other client. Commands that change state are still executed by the
+ * listener thread, one at a time. Locked read-only commands still
+ * serialize on the vecs lock, but meanwhile, other clients and unlocked
+ * commands like "show daemon" are served.
+ */
+#define CLI_WORKERS	4
+
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
+static LIST_HEAD(worker_queue);
+static pthread_t workers[CLI_WORKERS];
+static int nr_workers;
+/* clients in CLT_BUSY state; listener thread only */
+static unsigned int nr_busy_clients;
+/* workers waiting for the vecs lock; uatomic access only */
+static int workers_need_lock;
+
 static LIST_HEAD(clients);
 static struct pollfd *polls;
 static int notify_fd = -1;
@@ -131,6 +197,7 @@ static void new_client(int ux_sock)
 		return;
 	}
 	INIT_LIST_HEAD(&c->node);
+	INIT_LIST_HEAD(&c->work_node);
 	c->fd = fd;
 	c->state = CLT_RECV;
 	c->is_root = _socket_client_is_root(c->fd);
@@ -139,6 +206,17 @@ static void new_client(int ux_sock)
 	list_add_tail(&c->node, &clients);
 }
 
+static void reset_stream(struct client *c)
+{
+	if (c->stream.free_priv)
+		c->stream.free_priv(c->stream.priv);
+	else
+		free(c->stream.priv);
+	memset(&c->stream, 0, sizeof(c->stream));
+	c->want_chunks = c->chunked = c->chunk_marker_sent = false;
+	c->chunk_end_queued = false;
+}
+
 /*
  * kill off a dead client
  */
@@ -148,6 +226,12 @@ static void dead_client(struct client *c)
 	list_del_init(&c->node);
 	c->fd = -1;
 	reset_strbuf(&c->reply);
+	reset_stream(c);
+	if (c->subscribed) {
+		pthread_mutex_lock(&event_lock);
+		nr_subscribers--;
+		pthread_mutex_unlock(&event_lock);
+	}
 	if (c->cmdvec)
 		free_keys(c->cmdvec);
 	free(c);
@@ -161,12 +245,27 @@ static void free_polls (void)
 	polls = NULL;
 }
 
+static void stop_cli_workers(void)
+{
+	int i;
+
+	for (i = 0; i < nr_workers; i++)
+		pthread_cancel(workers[i]);
+	for (i = 0; i < nr_workers; i++)
+		pthread_join(workers[i], NULL);
+	nr_workers = 0;
+	INIT_LIST_HEAD(&worker_queue);
+}
+
 void uxsock_cleanup(void *arg)
 {
 	struct client *client_loop;
 	struct client *client_tmp;
 	long *ux_sock = (long *)arg;
 
+	/* workers may still be using clients */
+	stop_cli_workers();
+
 	close(ux_sock[0]);
 	close(ux_sock[1]);
 	close(notify_fd);
@@ -310,6 +409,9 @@ static struct timespec *get_soonest_timeout(struct timespec *ts)
 	struct client *c;
 
 	list_for_each_entry(c, &clients, node) {
+		/* workers take care of the timeout of busy clients */
+		if (c->state == CLT_BUSY)
+			continue;
 		if (timespeccmp(&c->expires, &ts_zero) != 0 &&
 		    timespeccmp(&c->expires, &ts_min) < 0) {
 			ts_min = c->expires;
@@ -332,7 +434,7 @@ static struct timespec *get_soonest_timeout(struct timespec *ts)
 
 bool waiting_clients(void)
 {
-	return clients_need_lock;
+	return clients_need_lock || uatomic_read(&workers_need_lock) > 0;
 }
 
 static void check_for_locked_work(struct client *skip)
@@ -365,12 +467,40 @@ static int parse_cmd(struct client *c)
 	return r;
 }
 
+/*
+ * Clients may append options after the NUL byte terminating the command.
+ */
+static bool client_wants_chunks(const struct client *c)
+{
+	size_t n = strlen(c->cmd) + 1;
+
+	return n < c->cmd_len && !strcmp(c->cmd + n, MPATH_CMD_OPT_CHUNKED);
+}
+
 static int execute_handler(struct client *c, struct vectors *vecs)
 {
 
 	if (!c->handler || !c->handler->fn)
 		return -EINVAL;
 
+	if (c->want_chunks && c->handler->stream) {
+		int r;
+
+		if (!c->stream.limit)
+			c->stream.limit = CLI_STREAM_CHUNK;
+		r = c->handler->stream(c->cmdvec, &c->reply, vecs, &c->stream);
+		/*
+		 * Replies that are complete after the first call are
+		 * sent normally.
+		 */
+		if (!r && !c->stream.done)
+			c->chunked = true;
+		else if (r && c->chunked)
+			condlog(1, "%s: cli[%d]: error %d, reply truncated",
+				__func__, c->fd, r);
+		return r;
+	}
+
 	return c->handler->fn(c->cmdvec, &c->reply, vecs);
 }
 
@@ -383,6 +513,74 @@ static void wakeup_listener(void)
 		condlog(1, "%s: failed", __func__);
 }
 
+void publish_event(const char *fmt, ...)
+{
+	struct event_rec *ev;
+	va_list ap;
+
+	pthread_mutex_lock(&event_lock);
+	if (nr_subscribers == 0) {
+		pthread_mutex_unlock(&event_lock);
+		return;
+	}
+	ev = &event_ring[event_seq % EVENT_RING_SIZE];
+	ev->seq = event_seq++;
+	va_start(ap, fmt);
+	vsnprintf(ev->text, sizeof(ev->text), fmt, ap);
+	va_end(ap);
+	pthread_mutex_unlock(&event_lock);
+	wakeup_listener();
+}
+
+static void subscribe_events(struct client *c)
+{
+	pthread_mutex_lock(&event_lock);
+	nr_subscribers++;
+	c->event_seq = event_seq;
+	pthread_mutex_unlock(&event_lock);
+	c->subscribed = true;
+	condlog(3, "cli[%d]: subscribed to events", c->fd);
+}
+
+static bool events_pending(const struct client *c)
+{
+	bool pending;
+
+	pthread_mutex_lock(&event_lock);
+	pending = c->event_seq != event_seq;
+	pthread_mutex_unlock(&event_lock);
+	return pending;
+}
+
+/*
+ * Format the client's pending events, one per line:
+ * "<seq> <event>", or "<seq> lost <count>" for overwritten events.
+ */
+static void fill_events(struct client *c)
+{
+	uint64_t oldest;
+	int n;
+
+	pthread_mutex_lock(&event_lock);
+	pthread_cleanup_push(cleanup_mutex, &event_lock);
+	oldest = event_seq > EVENT_RING_SIZE ? event_seq - EVENT_RING_SIZE : 0;
+	if (c->event_seq < oldest) {
+		condlog(3, "cli[%d]: %"PRIu64" events lost", c->fd,
+			oldest - c->event_seq);
+		print_strbuf(&c->reply, "%"PRIu64" lost %"PRIu64"\n",
+			     c->event_seq, oldest - c->event_seq);
+		c->event_seq = oldest;
+	}
+	for (n = 0; n < EVENT_BATCH && c->event_seq < event_seq; n++) {
+		const struct event_rec *ev =
+			&event_ring[c->event_seq % EVENT_RING_SIZE];
+
+		print_strbuf(&c->reply, "%"PRIu64" %s\n", ev->seq, ev->text);
+		c->event_seq++;
+	}
+	pthread_cleanup_pop(1);
+}
+
 static void drain_idle_fd(int fd)
 {
 	uint64_t val;
@@ -426,20 +624,24 @@ static void set_client_state(struct client *c, int state)
 	switch(state)
 	{
 	case CLT_RECV:
-		reset_strbuf(&c->reply);
+		reset_stream(c);
 		memset(c->cmd, '\0', sizeof(c->cmd));
 		c->error = 0;
 		/* fallthrough */
-	case CLT_SEND:
-		/* no timeout while waiting for the client or sending a reply */
-		c->expires = ts_zero;
-		/* reuse these fields for next data transfer */
-		c->len = c->cmd_len = 0;
+	case CLT_EVENTS:
+		reset_strbuf(&c->reply);
 		/* cmdvec isn't needed any more */
 		if (c->cmdvec) {
 			free_keys(c->cmdvec);
 			c->cmdvec = NULL;
 		}
+		/* fallthrough */
+	case CLT_SEND:
+		/* no timeout while waiting for the client or sending a reply */
+		c->expires = ts_zero;
+		/* reuse these fields for next data transfer */
+		c->len = c->cmd_len = 0;
+		c->hdr_len = c->hdr_sent = 0;
 		break;
 	default:
 		break;
@@ -447,11 +649,261 @@ static void set_client_state(struct client *c, int state)
 	c->state = state;
 }
 
+static void rcu_unregister(__attribute__((unused)) void *param)
+{
+	rcu_unregister_thread();
+}
+
+/*
+ * Like the listener, give up waiting for the lock when the client's
+ * timeout expires.
+ */
+static int lock_for_client(struct client *c, struct vectors *vecs)
+{
+	struct timespec now, tmo;
+	int r;
+
+	if (timespeccmp(&c->expires, &ts_zero) == 0) {
+		lock(&vecs->lock);
+		return 0;
+	}
+
+	/* pthread_mutex_timedlock() uses CLOCK_REALTIME */
+	get_monotonic_time(&now);
+	timespecsub(&c->expires, &now, &tmo);
+	clock_gettime(CLOCK_REALTIME, &now);
+	tmo.tv_sec += now.tv_sec;
+	tmo.tv_nsec += now.tv_nsec;
+	normalize_timespec(&tmo);
+
+	uatomic_inc(&workers_need_lock);
+	r = timedlock(&vecs->lock, &tmo);
+	uatomic_dec(&workers_need_lock);
+	return r;
+}
+
+static void *cli_worker(void *arg)
+{
+	struct vectors *vecs = arg;
+	struct client *c;
+
+	rcu_register_thread();
+	pthread_cleanup_push(rcu_unregister, NULL);
+	for (;;) {
+		pthread_mutex_lock(&worker_lock);
+		pthread_cleanup_push(cleanup_mutex, &worker_lock);
+		while (list_empty(&worker_queue))
+			pthread_cond_wait(&worker_cond, &worker_lock);
+		c = list_pop_entry(&worker_queue, struct client, work_node);
+		pthread_cleanup_pop(1);
+
+		if (!c->handler->locked)
+			c->error = execute_handler(c, vecs);
+		else if (lock_for_client(c, vecs) == 0) {
+			pthread_cleanup_push(cleanup_lock, &vecs->lock);
+			c->error = execute_handler(c, vecs);
+			pthread_cleanup_pop(1);
+		} else {
+			condlog(2, "cli[%d]: timed out waiting for lock",
+				c->fd);
+			c->error = -ETIMEDOUT;
+		}
+
+		pthread_mutex_lock(&worker_lock);
+		c->work_done = true;
+		pthread_mutex_unlock(&worker_lock);
+		wakeup_listener();
+	}
+	pthread_cleanup_pop(1);
+	return NULL;
+}
+
+static void start_cli_workers(struct vectors *vecs)
+{
+	pthread_attr_t attr;
+	int rc;
+
+	setup_thread_attr(&attr, 64 * 1024, 0);
+	for (nr_workers = 0; nr_workers < CLI_WORKERS; nr_workers++) {
+		rc = pthread_create(&workers[nr_workers], &attr, cli_worker,
+				    vecs);
+		if (rc) {
+			condlog(1, "uxsock: failed to start CLI worker: %s",
+				strerror(rc));
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+	condlog(3, "uxsock: started %d CLI workers", nr_workers);
+}
+
+/*
+ * Let a worker execute read-only commands. Everything else, or everything
+ * if there are no workers, is executed by the listener thread.
+ */
+static void start_work(struct client *c)
+{
+	if (!c->handler->readonly || nr_workers == 0) {
+		set_client_state(c, c->handler->locked ?
+				 CLT_LOCKED_WORK : CLT_WORK);
+		return;
+	}
+
+	pthread_mutex_lock(&worker_lock);
+	c->work_done = false;
+	list_add_tail(&c->work_node, &worker_queue);
+	pthread_cond_signal(&worker_cond);
+	pthread_mutex_unlock(&worker_lock);
+	nr_busy_clients++;
+	set_client_state(c, CLT_BUSY);
+}
+
+static bool client_work_done(struct client *c)
+{
+	bool done;
+
+	pthread_mutex_lock(&worker_lock);
+	done = c->work_done;
+	pthread_mutex_unlock(&worker_lock);
+	return done;
+}
+
 enum {
 	STM_CONT,
 	STM_BREAK,
 };
 
+static void queue_len(struct client *c, size_t len)
+{
+	if (c->hdr_len + sizeof(len) > sizeof(c->out_hdr)) {
+		condlog(0, "cli[%d]: BUG: too many length words", c->fd);
+		c->error = -ECONNRESET;
+		return;
+	}
+	memcpy((char *)c->out_hdr + c->hdr_len, &len, sizeof(len));
+	c->hdr_len += sizeof(len);
+}
+
+/*
+ * Send the queued length words, then the reply from c->len up to
+ * c->cmd_len, as far as possible without blocking. The listener
+ * never waits for a slow client; it polls for POLLOUT and continues
+ * where it left off. Returns true if everything has been sent.
+ */
+static bool send_pending(struct client *c)
+{
+	const char *buf;
+	ssize_t n;
+
+	while (c->error != -ECONNRESET && c->hdr_sent < c->hdr_len) {
+		n = send(c->fd, (char *)c->out_hdr + c->hdr_sent,
+			 c->hdr_len - c->hdr_sent, MSG_NOSIGNAL|MSG_DONTWAIT);
+		if (n == -1) {
+			if (errno == EAGAIN || errno == EINTR)
+				return false;
+			c->error = -ECONNRESET;
+		} else
+			c->hdr_sent += n;
+	}
+	if (c->error == -ECONNRESET)
+		return false;
+	c->hdr_len = c->hdr_sent = 0;
+
+	buf = get_strbuf_str(&c->reply);
+	while (c->len < c->cmd_len) {
+		n = send(c->fd, buf + c->len, c->cmd_len - c->len,
+			 MSG_NOSIGNAL|MSG_DONTWAIT);
+		if (n == -1) {
+			if (errno != EAGAIN && errno != EINTR)
+				c->error = -ECONNRESET;
+			return false;
+		}
+		c->len += n;
+	}
+	return true;
+}
+
+/*
+ * Send the current piece of a chunked reply, then go back to rendering
+ * the next one. The vecs lock isn't held while sending.
+ */
+static int send_chunk(struct client *c)
+{
+	if (c->cmd_len == 0 && !c->chunk_end_queued) {
+		size_t len = get_strbuf_len(&c->reply);
+
+		if (!c->chunk_marker_sent) {
+			queue_len(c, MPATH_REPLY_CHUNKED);
+			c->chunk_marker_sent = true;
+		}
+		if (len > 0) {
+			queue_len(c, len);
+			c->cmd_len = len;
+		}
+	}
+	if (!send_pending(c))
+		return STM_BREAK;
+
+	if (c->stream.done || c->error) {
+		if (!c->chunk_end_queued) {
+			queue_len(c, 0);
+			c->chunk_end_queued = true;
+			c->len = c->cmd_len = 0;
+			if (!send_pending(c))
+				return STM_BREAK;
+		}
+		condlog(4, "cli[%d]: Chunked reply done", c->fd);
+		set_client_state(c, CLT_RECV);
+		return STM_BREAK;
+	}
+
+	truncate_strbuf(&c->reply, 0);
+	c->len = c->cmd_len = 0;
+	start_work(c);
+	return STM_CONT;
+}
+
+/*
+ * Subscribed clients get batches of events, each sent like a normal
+ * reply. The connection is closed if the client sends anything.
+ */
+static int send_events(struct client *c, short revents)
+{
+	if (revents & POLLIN) {
+		condlog(3, "cli[%d]: closing event subscription", c->fd);
+		c->error = -ECONNRESET;
+		return STM_BREAK;
+	}
+	if (!(revents & POLLOUT))
+		return STM_BREAK;
+
+	if (c->cmd_len == 0) {
+		fill_events(c);
+		if (get_strbuf_len(&c->reply) == 0)
+			return STM_BREAK;
+		c->cmd_len = get_strbuf_len(&c->reply) + 1;
+		queue_len(c, c->cmd_len);
+	}
+
+	if (send_pending(c)) {
+		truncate_strbuf(&c->reply, 0);
+		c->len = c->cmd_len = 0;
+	}
+	return STM_BREAK;
+}
+
+/*
+ * Clients may send further commands before they have received the reply
+ * to the previous one. Check whether we can go on reading without
+ * waiting for poll().
+ */
+static bool client_input_pending(struct client *c)
+{
+	int n;
+
+	return ioctl(c->fd, FIONREAD, &n) == 0 && n > 0;
+}
+
 static int client_state_machine(struct client *c, struct vectors *vecs,
 				short revents)
 {
@@ -462,33 +914,44 @@ static int client_state_machine(struct client *c, struct vectors *vecs,
 
 	switch (c->state) {
 	case CLT_RECV:
-		if (!(revents & POLLIN))
+		if (!(revents & POLLIN) && !client_input_pending(c))
 			return STM_BREAK;
 		if (c->cmd_len == 0) {
-			size_t len;
+			if (c->len == 0) {
+				get_monotonic_time(&c->expires);
+				c->expires.tv_sec += uxsock_timeout / 1000;
+				c->expires.tv_nsec +=
+					(uxsock_timeout % 1000) * 1000000;
+				normalize_timespec(&c->expires);
+			}
 			/*
-			 * We got POLLIN; assume that at least the length can
-			 * be read immediately.
+			 * Pipelining clients don't necessarily send the
+			 * length in one piece.
 			 */
-			get_monotonic_time(&c->expires);
-			c->expires.tv_sec += uxsock_timeout / 1000;
-			c->expires.tv_nsec += (uxsock_timeout % 1000) * 1000000;
-			normalize_timespec(&c->expires);
-			n = recv(c->fd, &len, sizeof(len), 0);
-			if (n < (ssize_t)sizeof(len)) {
+			n = recv(c->fd, (char *)&c->req_len + c->len,
+				 sizeof(c->req_len) - c->len, MSG_DONTWAIT);
+			if (n == -1 && (errno == EINTR || errno == EAGAIN))
+				return STM_BREAK;
+			if (n <= 0) {
 				condlog(1, "%s: cli[%d]: failed to receive reply len: %zd",
 					__func__, c->fd, n);
 				c->error = -ECONNRESET;
-			} else if (len <= 0 || len > MAX_CMD_LEN) {
+				return STM_BREAK;
+			}
+			c->len += n;
+			if (c->len < sizeof(c->req_len))
+				return STM_BREAK;
+			c->len = 0;
+			if (c->req_len <= 0 || c->req_len > MAX_CMD_LEN) {
 				condlog(1, "%s: cli[%d]: invalid command length (%zu bytes)",
-					__func__, c->fd, len);
+					__func__, c->fd, c->req_len);
 				c->error = -ECONNRESET;
-			} else {
-				c->cmd_len = len;
-				condlog(4, "%s: cli[%d]: connected", __func__, c->fd);
+				return STM_BREAK;
 			}
-			/* poll for data */
-			return STM_BREAK;
+			c->cmd_len = c->req_len;
+			condlog(4, "%s: cli[%d]: connected", __func__, c->fd);
+			/* the command may have been queued already */
+			return client_input_pending(c) ? STM_CONT : STM_BREAK;
 		} else if (c->len < c->cmd_len) {
 			n = recv(c->fd, c->cmd + c->len, c->cmd_len - c->len, 0);
 			if (n <= 0 && errno != EINTR && errno != EAGAIN) {
@@ -503,6 +966,7 @@ static int client_state_machine(struct client *c, struct vectors *vecs,
 				return STM_BREAK;
 		}
 		condlog(4, "cli[%d]: Got request [%s]", c->fd, c->cmd);
+		c->want_chunks = client_wants_chunks(c);
 		set_client_state(c, CLT_PARSE);
 		return STM_CONT;
 
@@ -512,18 +976,20 @@ static int client_state_machine(struct client *c, struct vectors *vecs,
 			/* Permission check */
 			struct key *kw = VECTOR_SLOT(c->cmdvec, 0);
 
-			if (!c->is_root && kw->code != VRB_LIST) {
+			if (!c->is_root && kw->code != VRB_LIST &&
+			    kw->code != VRB_SUBSCRIBE) {
 				c->error = -EPERM;
 				condlog(0, "%s: cli[%d]: unauthorized cmd \"%s\"",
 					__func__, c->fd, c->cmd);
 			}
 		}
+		if (!c->error &&
+		    c->handler->fingerprint == (VRB_SUBSCRIBE | Q1_EVENTS))
+			subscribe_events(c);
 		if (c->error)
 			set_client_state(c, CLT_SEND);
-		else if (c->handler->locked)
-			set_client_state(c, CLT_LOCKED_WORK);
 		else
-			set_client_state(c, CLT_WORK);
+			start_work(c);
 		return STM_CONT;
 
 	case CLT_LOCKED_WORK:
@@ -549,35 +1015,27 @@ static int client_state_machine(struct client *c, struct vectors *vecs,
 		return STM_BREAK;
 
 	case CLT_SEND:
+		if (c->chunked)
+			return send_chunk(c);
+
 		if (get_strbuf_len(&c->reply) == 0)
 			default_reply(c, c->error);
 
 		if (c->cmd_len == 0) {
-			size_t len = get_strbuf_len(&c->reply) + 1;
-
-			if (send(c->fd, &len, sizeof(len), MSG_NOSIGNAL)
-			    != sizeof(len))
-				c->error = -ECONNRESET;
-			c->cmd_len = len;
-			return STM_BREAK;
+			c->cmd_len = get_strbuf_len(&c->reply) + 1;
+			queue_len(c, c->cmd_len);
 		}
+		if (!send_pending(c))
+			/* Wait for POLLOUT */
+			return STM_BREAK;
 
-		if (c->len < c->cmd_len) {
-			const char *buf = get_strbuf_str(&c->reply);
-
-			n = send(c->fd, buf + c->len, c->cmd_len - c->len, MSG_NOSIGNAL);
-			if (n == -1) {
-				if (!(errno == EAGAIN || errno == EINTR))
-					c->error = -ECONNRESET;
-			} else
-				c->len += n;
-		}
+		condlog(4, "cli[%d]: Reply [%zu bytes]", c->fd, c->cmd_len);
+		set_client_state(c, c->subscribed ? CLT_EVENTS : CLT_RECV);
+		/* go on with the next queued command, if any */
+		return c->state == CLT_RECV ? STM_CONT : STM_BREAK;
 
-		if (c->len >= c->cmd_len) {
-			condlog(4, "cli[%d]: Reply [%zu bytes]", c->fd, c->cmd_len);
-			set_client_state(c, CLT_RECV);
-		}
-		return STM_BREAK;
+	case CLT_EVENTS:
+		return send_events(c, revents);
 
 	default:
 		return STM_BREAK;
@@ -604,6 +1062,15 @@ static void check_timeout(struct client *c)
 
 static void handle_client(struct client *c, struct vectors *vecs, short revents)
 {
+	/* not polled, and must not be touched while a worker owns it */
+	if (c->state == CLT_BUSY) {
+		if (!client_work_done(c))
+			return;
+		nr_busy_clients--;
+		set_client_state(c, CLT_SEND);
+		return;
+	}
+
 	if (revents & (POLLHUP|POLLERR)) {
 		c->error = -ECONNRESET;
 		return;
@@ -652,6 +1119,7 @@ void *uxsock_listen(int n_socks, long *ux_sock_in, void *trigger_data)
 		exit_daemon();
 	} else
 		set_wakeup_fn(&vecs->lock, wakeup_listener);
+	start_cli_workers(vecs);
 
 	sigfillset(&mask);
 	sigdelset(&mask, SIGINT);
@@ -708,7 +1176,12 @@ void *uxsock_listen(int n_socks, long *ux_sock_in, void *trigger_data)
 
 		polls[POLLFD_IDLE].fd = idle_fd;
 		check_for_locked_work(NULL);
-		if (clients_need_lock)
+		/*
+		 * idle_fd is also used to signal new events, and finished
+		 * work of CLI workers
+		 */
+		if (clients_need_lock || nr_subscribers > 0 ||
+		    nr_busy_clients > 0)
 			polls[POLLFD_IDLE].events = POLLIN;
 		else
 			polls[POLLFD_IDLE].events = 0;
@@ -723,6 +1196,11 @@ void *uxsock_listen(int n_socks, long *ux_sock_in, void *trigger_data)
 			case CLT_SEND:
 				polls[i].events = POLLOUT;
 				break;
+			case CLT_EVENTS:
+				polls[i].events = POLLIN;
+				if (c->cmd_len > 0 || events_pending(c))
+					polls[i].events |= POLLOUT;
+				break;
 			default:
 				/* don't poll for this client */
 				continue;
@@ -19,9 +19,11 @@
 #include "structs.h"
 #include "structs_vec.h"
 #include "config.h"
+#include "config_diff.h"
 #include "debug.h"
 #include "defaults.h"
 #include "pgpolicies.h"
+#include "propsel.h"
 #include "test-lib.h"
 #include "print.h"
 #include "util.h"
@@ -511,6 +513,31 @@ static void replicate_config(const struct hwt_state *hwt, bool local)
 	free(cfg2);
 }
 
+/*
+ * A configuration re-read from its own dump must not differ from the
+ * current one.
+ */
+static void diff_replicated_config(const struct hwt_state *hwt)
+{
+	struct config_diff diff;
+	struct config *conf;
+	char *cfg;
+
+	cfg = snprint_config(_conf, NULL, NULL, NULL);
+	assert_non_null(cfg);
+	reset_configs(hwt);
+	fprintf(hwt->config_file, "%s", cfg);
+	fflush(hwt->config_file);
+	free(cfg);
+
+	conf = LOAD_CONFIG(hwt);
+	assert_int_equal(diff_config(_conf, conf, &diff), 0);
+	assert_int_equal(diff.sections, 0);
+	assert_int_equal(VECTOR_SIZE(diff.wwids), 0);
+	free_config_diff(&diff);
+	FREE_CONFIG(conf);
+}
+
 /*
  * Run hwt->test three times; once with the constructed configuration,
  * once after re-reading the full dumped configuration, and once with the
@@ -526,6 +553,7 @@ static void test_driver(void **state)
 	_conf = LOAD_CONFIG(hwt);
 	hwt->test(hwt);
 
+	diff_replicated_config(hwt);
 	replicate_config(hwt, false);
 	reset_vecs(hwt->vecs);
 	hwt->test(hwt);
@@ -1667,6 +1695,140 @@ static int setup_multipath_config_3(void **state)
 	return 0;
 }
 
+/*
+ * Resolved map settings are shared between maps with the same
+ * multipaths entry and hwe vector.
+ *
+ * Expected: maps without multipaths entry reuse the same settings block,
+ * and get the same properties from it as from the selectors.
+ */
+static struct mp_settings *select_with_settings(struct multipath *mp)
+{
+	struct config *conf;
+	struct mp_settings *ms;
+
+	mp->no_path_retry = NO_PATH_RETRY_UNDEF;
+	mp->pgfailback = 0;
+	conf = get_multipath_config();
+	get_mp_settings(conf, mp);
+	ms = mp->settings;
+	select_pgfailback(conf, mp);
+	select_no_path_retry(conf, mp);
+	put_mp_settings(conf, mp);
+	put_multipath_config(conf);
+	assert_ptr_equal(mp->settings, NULL);
+	return ms;
+}
+
+static void test_mp_settings(const struct hwt_state *hwt)
+{
+	struct path *pp;
+	struct multipath *mp1, *mp2, *mp3;
+	struct mp_settings *ms1, *ms2, *ms3;
+
+	pp = mock_path_wwid(vnd_foo.value, prd_bar.value, default_wwid);
+	mp1 = mock_multipath(pp);
+	assert_ptr_not_equal(mp1->mpe, NULL);
+	pp = mock_path_wwid(vnd_foo.value, prd_bar.value, default_wwid_1);
+	mp2 = mock_multipath(pp);
+	assert_ptr_equal(mp2->mpe, NULL);
+	pp = mock_path_wwid(vnd_foo.value, prd_bar.value, "TEST-WWID-2");
+	mp3 = mock_multipath(pp);
+	assert_ptr_equal(mp3->mpe, NULL);
+
+	ms1 = select_with_settings(mp1);
+	assert_int_equal(mp1->no_path_retry, NO_PATH_RETRY_QUEUE);
+	ms2 = select_with_settings(mp2);
+	assert_int_equal(mp2->no_path_retry, atoi(npr_37.value));
+	assert_ptr_not_equal(ms1, ms2);
+
+	ms3 = select_with_settings(mp3);
+	assert_ptr_equal(ms3, ms2);
+	assert_int_equal(mp3->no_path_retry, atoi(npr_37.value));
+	assert_int_equal(mp3->pgfailback, mp2->pgfailback);
+
+	/* Logic outside of the precedence chain isn't cached */
+	mp3->disable_queueing = 1;
+	select_with_settings(mp3);
+	assert_int_equal(mp3->no_path_retry, NO_PATH_RETRY_FAIL);
+}
+
+static int setup_mp_settings(void **state)
+{
+	const struct key_value kvm[] = { wwid_test, npr_queue };
+	const struct key_value kvp[] = { vnd_foo, prd_bar, npr_37 };
+	struct hwt_state *hwt = CHECK_STATE(state);
+
+	begin_config(hwt);
+	begin_section_all(hwt, "devices");
+	write_section(hwt->config_file, "device", ARRAY_SIZE(kvp), kvp);
+	end_section_all(hwt);
+	begin_section_all(hwt, "multipaths");
+	write_section(hwt->config_file, "multipath", ARRAY_SIZE(kvm), kvm);
+	end_section_all(hwt);
+	finish_config(hwt);
+	SET_TEST_FUNC(hwt, test_mp_settings);
+	return 0;
+}
+
+/*
+ * Changing one multipaths entry shows up in the diff with its WWID only
+ */
+static const char other_wwid[] = "other-wwid";
+static const struct key_value wwid_other = { _wwid, other_wwid };
+static const struct key_value alias_other = { "alias", "other" };
+
+static void write_mptable(const struct hwt_state *hwt,
+			  const struct key_value *npr,
+			  const struct key_value *alias)
+{
+	const struct key_value kv1[] = { wwid_test, minio_99 };
+	const struct key_value kv2[] = { wwid_other, *npr, *alias };
+
+	begin_config(hwt);
+	begin_section_all(hwt, "multipaths");
+	write_section(hwt->config_file, "multipath", ARRAY_SIZE(kv1), kv1);
+	write_section(hwt->config_file, "multipath", ARRAY_SIZE(kv2), kv2);
+	end_section_all(hwt);
+	finish_config(hwt);
+}
+
+static void test_config_diff(void **state)
+{
+	const struct hwt_state *hwt = CHECK_STATE(state);
+	const struct key_value alias_x = { "alias", "x" };
+	struct config_diff diff;
+	struct config *conf;
+
+	write_mptable(hwt, &npr_queue, &alias_other);
+	_conf = LOAD_CONFIG(hwt);
+
+	write_mptable(hwt, &npr_37, &alias_other);
+	conf = LOAD_CONFIG(hwt);
+	assert_int_equal(diff_config(_conf, conf, &diff), 0);
+	assert_int_equal(diff.sections, CONFIG_DIFF_MPTABLE);
+	assert_int_equal(VECTOR_SIZE(diff.wwids), 1);
+	assert_string_equal(VECTOR_SLOT(diff.wwids, 0), other_wwid);
+	assert_false(mpe_change_affects_paths(
+			     find_mpe_sorted(_conf, other_wwid),
+			     find_mpe_sorted(conf, other_wwid)));
+	free_config_diff(&diff);
+	FREE_CONFIG(conf);
+
+	write_mptable(hwt, &npr_queue, &alias_x);
+	conf = LOAD_CONFIG(hwt);
+	assert_int_equal(diff_config(_conf, conf, &diff), 0);
+	assert_int_equal(diff.sections, CONFIG_DIFF_MPTABLE);
+	assert_int_equal(VECTOR_SIZE(diff.wwids), 1);
+	assert_true(mpe_change_affects_paths(
+			    find_mpe_sorted(_conf, other_wwid),
+			    find_mpe_sorted(conf, other_wwid)));
+	free_config_diff(&diff);
+	FREE_CONFIG(conf);
+
+	FREE_CONFIG(_conf);
+}
+
 /*
  * Test for device with "hidden" attribute
  */
@@ -1727,6 +1889,7 @@ define_test(product_blacklist_matching)
 define_test(multipath_config)
 define_test(multipath_config_2)
 define_test(multipath_config_3)
+define_test(mp_settings)
 define_test(hidden)
 
 #define test_entry(x) \
@@ -1767,7 +1930,9 @@ static int test_hwtable(void)
 		test_entry(multipath_config),
 		test_entry(multipath_config_2),
 		test_entry(multipath_config_3),
+		test_entry(mp_settings),
 		test_entry(hidden),
+		cmocka_unit_test(test_config_diff),
 	};
 
 	return cmocka_run_group_tests(tests, setup, teardown);
@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmocka-compat.h"
+
+#include "strbuf.h"
+#include "mempool.h"
+#include "globals.c"
+
+struct obj {
+	char data[1000];
+};
+
+static DEFINE_MEM_POOL(test_pool, "test", sizeof(struct obj));
+
+static int teardown(void **state)
+{
+	mem_pool_destroy(&test_pool);
+	return 0;
+}
+
+static unsigned int objs_per_slab(void)
+{
+	struct mem_pool_stats st;
+	struct obj *o = mem_pool_alloc(&test_pool);
+
+	assert_non_null(o);
+	mem_pool_get_stats(&test_pool, &st);
+	mem_pool_free(&test_pool, o);
+	return st.nr_free + 1;
+}
+
+static void test_alloc_zeroed(void **state)
+{
+	struct obj *o1, *o2;
+	int i;
+
+	o1 = mem_pool_alloc(&test_pool);
+	assert_non_null(o1);
+	for (i = 0; i < (int)sizeof(o1->data); i++)
+		assert_int_equal(o1->data[i], 0);
+	memset(o1, 0xa5, sizeof(*o1));
+	mem_pool_free(&test_pool, o1);
+
+	/* The freed object is reused, and cleared */
+	o2 = mem_pool_alloc(&test_pool);
+	assert_ptr_equal(o1, o2);
+	for (i = 0; i < (int)sizeof(o2->data); i++)
+		assert_int_equal(o2->data[i], 0);
+	mem_pool_free(&test_pool, o2);
+}
+
+static void test_alloc_distinct(void **state)
+{
+	struct obj *o[100];
+	int i, j;
+
+	for (i = 0; i < 100; i++) {
+		o[i] = mem_pool_alloc(&test_pool);
+		assert_non_null(o[i]);
+		assert_int_equal((size_t)o[i] % 16, 0);
+		memset(o[i], i, sizeof(*o[i]));
+	}
+	for (i = 0; i < 100; i++)
+		for (j = 0; j < (int)sizeof(o[i]->data); j++)
+			assert_int_equal(o[i]->data[j], i);
+	for (i = 0; i < 100; i++)
+		mem_pool_free(&test_pool, o[i]);
+}
+
+static void test_stats(void **state)
+{
+	struct mem_pool_stats st;
+	unsigned int n = objs_per_slab();
+	struct obj **o = calloc(3 * n, sizeof(*o));
+	unsigned int i;
+
+	assert_non_null(o);
+	for (i = 0; i < 2 * n + 1; i++)
+		o[i] = mem_pool_alloc(&test_pool);
+	mem_pool_get_stats(&test_pool, &st);
+	assert_int_equal(st.obj_size, sizeof(struct obj));
+	assert_int_equal(st.in_use, 2 * n + 1);
+	assert_int_equal(st.nr_free, n - 1);
+	assert_int_equal(st.nr_slabs, 3);
+	assert_true(st.peak >= 2 * n + 1);
+	assert_true(st.slab_size >= n * sizeof(struct obj));
+
+	for (i = 0; i < 2 * n + 1; i++)
+		mem_pool_free(&test_pool, o[i]);
+	mem_pool_get_stats(&test_pool, &st);
+	assert_int_equal(st.in_use, 0);
+	free(o);
+}
+
+/* Empty slabs are unmapped, but one slab's worth of free objects is kept */
+static void test_release_slabs(void **state)
+{
+	struct mem_pool_stats st;
+	unsigned int n = objs_per_slab();
+	struct obj **o = calloc(4 * n, sizeof(*o));
+	unsigned int i;
+
+	assert_non_null(o);
+	for (i = 0; i < 4 * n; i++)
+		o[i] = mem_pool_alloc(&test_pool);
+	mem_pool_get_stats(&test_pool, &st);
+	assert_int_equal(st.nr_slabs, 4);
+	assert_int_equal(st.nr_free, 0);
+
+	/* Free every other object, no slab becomes empty */
+	for (i = 0; i < 4 * n; i += 2)
+		mem_pool_free(&test_pool, o[i]);
+	mem_pool_get_stats(&test_pool, &st);
+	assert_int_equal(st.nr_slabs, 4);
+	assert_int_equal(st.nr_free, 2 * n);
+
+	for (i = 1; i < 4 * n; i += 2)
+		mem_pool_free(&test_pool, o[i]);
+	mem_pool_get_stats(&test_pool, &st);
+	assert_int_equal(st.in_use, 0);
+	assert_int_equal(st.nr_slabs, 1);
+	assert_int_equal(st.nr_free, n);
+	free(o);
+}
+
+static void test_print(void **state)
+{
+	STRBUF_ON_STACK(buf);
+	struct obj *o = mem_pool_alloc(&test_pool);
+
+	assert_non_null(o);
+	assert_true(print_mem_pools(&buf) > 0);
+	assert_non_null(strstr(get_strbuf_str(&buf), "\ntest "));
+	mem_pool_free(&test_pool, o);
+
+	/* Destroyed pools aren't listed */
+	mem_pool_destroy(&test_pool);
+	reset_strbuf(&buf);
+	assert_true(print_mem_pools(&buf) > 0);
+	assert_null(strstr(get_strbuf_str(&buf), "\ntest "));
+}
+
+static int test_mempool(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_teardown(test_alloc_zeroed, teardown),
+		cmocka_unit_test_teardown(test_alloc_distinct, teardown),
+		cmocka_unit_test_teardown(test_stats, teardown),
+		cmocka_unit_test_teardown(test_release_slabs, teardown),
+		cmocka_unit_test_teardown(test_print, teardown),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+int main(void)
+{
+	int ret = 0;
+
+	init_test_verbosity(-1);
+	ret += test_mempool();
+	return ret;
+}
@@ -13,6 +13,7 @@
 #include "structs.h"
 #include "config.h"
 #include "mpath_valid.h"
+#include "valid.h"
 #include "util.h"
 #include "debug.h"
 
@@ -73,6 +74,21 @@ int __wrap_is_path_valid(const char *name, struct config *conf, struct path *pp,
 	return r;
 }
 
+int __wrap_daemon_is_path_valid(const char *name, char *wwid, size_t wwid_len,
+				bool check_env_uid)
+{
+	int r = mock_type(int);
+
+	assert_ptr_equal(name, test_dev);
+	assert_ptr_not_equal(wwid, NULL);
+	assert_false(check_env_uid);
+	if (r == PATH_IS_ERROR || r == PATH_IS_NOT_VALID)
+		return r;
+
+	strlcpy(wwid, mock_ptr_type(const char *), wwid_len);
+	return r;
+}
+
 int __wrap_libmultipath_init(void)
 {
 	int r = mock_type(int);
@@ -96,9 +112,7 @@ int __wrap_dm_prereq(unsigned int *v)
 	return mock_type(int);
 }
 
-int __real_init_config(const char *file);
-
-int __wrap_init_config(const char *file)
+int __wrap_init_config_cached(const char *file)
 {
 	int r = mock_type(int);
 	struct config *conf;
@@ -108,7 +122,7 @@ int __wrap_init_config(const char *file)
 		return r;
 
 	assert_string_not_equal(conf_name, CONF_TEMPLATE);
-	r = __real_init_config(conf_name);
+	r = init_config(conf_name);
 	conf = get_multipath_config();
 	assert_ptr_not_equal(conf, NULL);
 	assert_int_equal(conf->find_multipaths, mock_type(int));
@@ -189,7 +203,7 @@ static void test_mpathvalid_init_bad1(void **state)
 static void test_mpathvalid_init_bad2(void **state)
 {
 	will_return(__wrap_libmultipath_init, 0);
-	will_return(__wrap_init_config, 1);
+	will_return(__wrap_init_config_cached, 1);
 	assert_int_equal(mpathvalid_init(MPATH_LOG_PRIO_ERR,
 					 MPATH_LOG_STDERR_TIMESTAMP), -1);
 	assert_false(initialized);
@@ -201,8 +215,8 @@ static void test_mpathvalid_init_bad3(void **state)
 {
 	make_config_file(FIND_MULTIPATHS_STRICT);
 	will_return(__wrap_libmultipath_init, 0);
-	will_return(__wrap_init_config, 0);
-	will_return(__wrap_init_config, FIND_MULTIPATHS_STRICT);
+	will_return(__wrap_init_config_cached, 0);
+	will_return(__wrap_init_config_cached, FIND_MULTIPATHS_STRICT);
 	will_return(__wrap_dm_prereq, 1);
 	assert_int_equal(mpathvalid_init(MPATH_LOG_STDERR, MPATH_LOG_PRIO_ERR),
 			 -1);
@@ -214,8 +228,8 @@ static void check_mpathvalid_init(int findmp, int prio, int log_style)
 {
 	make_config_file(findmp);
 	will_return(__wrap_libmultipath_init, 0);
-	will_return(__wrap_init_config, 0);
-	will_return(__wrap_init_config, findmp);
+	will_return(__wrap_init_config_cached, 0);
+	will_return(__wrap_init_config_cached, findmp);
 	will_return(__wrap_dm_prereq, 0);
 	assert_int_equal(mpathvalid_init(prio, log_style), 0);	
 	assert_true(initialized);
@@ -271,7 +285,7 @@ static void test_mpathvalid_get_mode_bad(void **state)
 static void test_mpathvalid_reload_config_bad1(void **state)
 {
 #if 1
-	will_return(__wrap_init_config, 1);
+	will_return(__wrap_init_config_cached, 1);
 #endif
 	assert_int_equal(mpathvalid_reload_config(), -1);
 	check_config(false);
@@ -282,7 +296,7 @@ static void test_mpathvalid_reload_config_bad2(void **state)
 {
 	check_mpathvalid_init(FIND_MULTIPATHS_ON, MPATH_LOG_PRIO_ERR,
 			      MPATH_LOG_STDERR);
-	will_return(__wrap_init_config, 1);
+	will_return(__wrap_init_config_cached, 1);
 	assert_int_equal(mpathvalid_reload_config(), -1);
 	check_config(false);
 	check_mpathvalid_exit();
@@ -293,8 +307,8 @@ static void check_mpathvalid_reload_config(int findmp)
 	assert_string_not_equal(conf_name, CONF_TEMPLATE);
 	unlink(conf_name);
 	make_config_file(findmp);
-	will_return(__wrap_init_config, 0);
-	will_return(__wrap_init_config, findmp);
+	will_return(__wrap_init_config_cached, 0);
+	will_return(__wrap_init_config_cached, findmp);
 	assert_int_equal(mpathvalid_reload_config(), 0);
 	check_config(true);
 	assert_uint_equal(findmp_to_mode(findmp), mpathvalid_get_mode());
@@ -360,6 +374,7 @@ static void test_mpathvalid_is_path_good1(void **state)
 	char *wwid;
 	check_mpathvalid_init(FIND_MULTIPATHS_STRICT, MPATH_LOG_PRIO_ERR,
 			      MPATH_LOG_STDERR);
+	will_return(__wrap_daemon_is_path_valid, PATH_IS_ERROR);
 	will_return(__wrap_is_path_valid, MPATH_IS_NOT_VALID);
 	will_return(__wrap_is_path_valid, FIND_MULTIPATHS_STRICT);
 	assert_int_equal(mpathvalid_is_path(test_dev, MPATH_DEFAULT, &wwid,
@@ -374,6 +389,7 @@ static void test_mpathvalid_is_path_good2(void **state)
 	char *wwid;
 	check_mpathvalid_init(FIND_MULTIPATHS_ON, MPATH_LOG_PRIO_ERR,
 			      MPATH_LOG_STDERR);
+	will_return(__wrap_daemon_is_path_valid, PATH_IS_ERROR);
 	will_return(__wrap_is_path_valid, MPATH_IS_VALID);
 	will_return(__wrap_is_path_valid, FIND_MULTIPATHS_ON);
 	will_return(__wrap_is_path_valid, TEST_WWID);
@@ -405,6 +421,7 @@ static void test_mpathvalid_is_path_good4(void **state)
 	char *wwid;
 	check_mpathvalid_init(FIND_MULTIPATHS_SMART, MPATH_LOG_PRIO_ERR,
 			      MPATH_LOG_STDERR);
+	will_return(__wrap_daemon_is_path_valid, PATH_IS_ERROR);
 	will_return(__wrap_is_path_valid, MPATH_IS_MAYBE_VALID);
 	will_return(__wrap_is_path_valid, FIND_MULTIPATHS_SMART);
 	will_return(__wrap_is_path_valid, TEST_WWID);
@@ -421,6 +438,7 @@ static void test_mpathvalid_is_path_good5(void **state)
 	char *wwid;
 	check_mpathvalid_init(FIND_MULTIPATHS_SMART, MPATH_LOG_PRIO_ERR,
 			      MPATH_LOG_STDERR);
+	will_return(__wrap_daemon_is_path_valid, PATH_IS_ERROR);
 	will_return(__wrap_is_path_valid, MPATH_IS_MAYBE_VALID);
 	will_return(__wrap_is_path_valid, FIND_MULTIPATHS_SMART);
 	will_return(__wrap_is_path_valid, TEST_WWID);
@@ -430,6 +448,35 @@ static void test_mpathvalid_is_path_good5(void **state)
 	free(wwid);
 }
 
+/* multipathd answers, no local evaluation */
+static void test_mpathvalid_is_path_daemon1(void **state)
+{
+	char *wwid;
+	check_mpathvalid_init(FIND_MULTIPATHS_STRICT, MPATH_LOG_PRIO_ERR,
+			      MPATH_LOG_STDERR);
+	will_return(__wrap_daemon_is_path_valid, PATH_IS_VALID_NO_CHECK);
+	will_return(__wrap_daemon_is_path_valid, TEST_WWID);
+	assert_int_equal(mpathvalid_is_path(test_dev, MPATH_STRICT, &wwid,
+					    NULL, 0), MPATH_IS_VALID_NO_CHECK);
+	assert_string_equal(wwid, TEST_WWID);
+	free(wwid);
+}
+
+/* multipathd says maybe valid, matching paths are checked locally */
+static void test_mpathvalid_is_path_daemon2(void **state)
+{
+	const char *wwids[] = { "WWID_A", TEST_WWID };
+	char *wwid;
+	check_mpathvalid_init(FIND_MULTIPATHS_SMART, MPATH_LOG_PRIO_ERR,
+			      MPATH_LOG_STDERR);
+	will_return(__wrap_daemon_is_path_valid, PATH_IS_MAYBE_VALID);
+	will_return(__wrap_daemon_is_path_valid, TEST_WWID);
+	assert_int_equal(mpathvalid_is_path(test_dev, MPATH_DEFAULT, &wwid,
+					    wwids, 2), MPATH_IS_VALID);
+	assert_string_equal(wwid, TEST_WWID);
+	free(wwid);
+}
+
 #define setup_test(name) \
 	cmocka_unit_test_setup_teardown(name, setup, teardown)
 
@@ -457,6 +504,8 @@ int test_mpathvalid(void)
 		setup_test(test_mpathvalid_is_path_good3),
 		setup_test(test_mpathvalid_is_path_good4),
 		setup_test(test_mpathvalid_is_path_good5),
+		setup_test(test_mpathvalid_is_path_daemon1),
+		setup_test(test_mpathvalid_is_path_daemon2),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
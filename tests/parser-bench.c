@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Parser throughput for a synthetic 50k line config, with linear and
+ * hashed keyword lookup. Not part of the test suite, run "make bench".
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "parser.h"
+#include "vector.h"
+
+#include "globals.c"
+
+/* Keyword tree modeled after dict.c */
+#define N_SUBKW 48
+#define N_MPATHS 10000
+#define N_RUNS 5
+static char subkw_names[N_SUBKW][8];
+static int n_handled;
+
+static int handler(struct config *conf, vector strvec,
+		   const char *file, int line_nr)
+{
+	n_handled++;
+	return 0;
+}
+
+static vector bench_keywords(void)
+{
+	vector keywords = vector_alloc();
+	int i, r = 0;
+
+	if (!keywords)
+		return NULL;
+	r |= install_keyword_root("defaults", NULL);
+	for (i = 0; i < N_SUBKW; i++) {
+		snprintf(subkw_names[i], sizeof(subkw_names[i]), "opt%02d", i);
+		r |= install_keyword(subkw_names[i], handler, NULL);
+	}
+	r |= install_keyword_root("multipaths", handler);
+	r |= install_keyword_multi("multipath", handler, NULL);
+	install_sublevel();
+	for (i = 0; i < N_SUBKW; i++)
+		r |= install_keyword(subkw_names[i], handler, NULL);
+	install_sublevel_end();
+	if (r) {
+		free_keywords(keywords);
+		return NULL;
+	}
+	return keywords;
+}
+
+/* Writes a config with 5 lines per multipath section */
+static int write_bench_config(char *name)
+{
+	int fd, i;
+	FILE *f;
+
+	fd = mkstemp(name);
+	if (fd < 0)
+		return -1;
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		return -1;
+	}
+	fprintf(f, "defaults {\n\topt00 yes\n\topt47 no\n}\nmultipaths {\n");
+	for (i = 0; i < N_MPATHS; i++)
+		fprintf(f, "\tmultipath {\n\t\topt%02d %d\n\t\topt%02d \"x\"\n"
+			"\t\topt%02d x%d\n\t}\n", i % 23, i,
+			23 + i % 24, N_SUBKW - 1, i);
+	fprintf(f, "}\n");
+	return fclose(f);
+}
+
+/* best of N_RUNS, in seconds */
+static double parse_bench_config(const char *name)
+{
+	struct timespec start, end;
+	double t, best = 1e9;
+	int i;
+
+	for (i = 0; i < N_RUNS; i++) {
+		n_handled = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (process_file(&conf, name) != 0)
+			return -1;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		t = (end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9;
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+int main(void)
+{
+	char name[] = "/tmp/parser-bench-XXXXXX";
+	double t_linear, t_hashed;
+	int rc = 1;
+
+	init_test_verbosity(1);
+	conf.keywords = bench_keywords();
+	if (!conf.keywords) {
+		fprintf(stderr, "failed to set up keywords\n");
+		return 1;
+	}
+	if (write_bench_config(name) != 0) {
+		fprintf(stderr, "failed to write %s\n", name);
+		goto out_free;
+	}
+
+	conf.keyword_table = NULL;
+	t_linear = parse_bench_config(name);
+	conf.keyword_table = index_keywords(conf.keywords);
+	if (!conf.keyword_table) {
+		fprintf(stderr, "failed to index keywords\n");
+		goto out_unlink;
+	}
+	t_hashed = parse_bench_config(name);
+	if (t_linear < 0 || t_hashed < 0) {
+		fprintf(stderr, "failed to parse %s\n", name);
+		goto out_unlink;
+	}
+	printf("parsed %d lines, %d keywords handled: linear lookup %.1f ms, hashed lookup %.1f ms\n",
+	       5 * N_MPATHS + 6, n_handled, t_linear * 1e3, t_hashed * 1e3);
+	rc = 0;
+
+out_unlink:
+	unlink(name);
+	free(conf.keyword_table);
+	conf.keyword_table = NULL;
+out_free:
+	free_keywords(conf.keywords);
+	conf.keywords = NULL;
+	return rc;
+}
@@ -8,6 +8,8 @@
 #include <stddef.h>
 #include <setjmp.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
 #include "cmocka-compat.h"
 // #include "list.h"
 #include "parser.h"
@@ -467,6 +469,110 @@ static void test20(void **state)
 	free_strvec(v);
 }
 
+/* Keyword tree for the process_file() tests, modeled after dict.c */
+#define N_SUBKW 48
+#define N_MPATHS 1000
+static char subkw_names[N_SUBKW][8];
+static int handled[N_SUBKW];
+static int n_sections;
+
+static int section_handler(struct config *conf, vector strvec,
+			   const char *file, int line_nr)
+{
+	n_sections++;
+	return 0;
+}
+
+static int subkw_handler(struct config *conf, vector strvec,
+			 const char *file, int line_nr)
+{
+	const char *str = VECTOR_SLOT(strvec, 0);
+
+	handled[atoi(str + 3)]++;
+	return 0;
+}
+
+static vector test_keywords(void)
+{
+	vector keywords = vector_alloc();
+	int i;
+
+	assert_non_null(keywords);
+	assert_int_equal(install_keyword_root("defaults", NULL), 0);
+	for (i = 0; i < N_SUBKW; i++) {
+		snprintf(subkw_names[i], sizeof(subkw_names[i]), "opt%02d", i);
+		assert_int_equal(install_keyword(subkw_names[i], subkw_handler,
+						 NULL), 0);
+	}
+	assert_int_equal(install_keyword_root("multipaths", section_handler),
+			 0);
+	assert_int_equal(install_keyword_multi("multipath", section_handler,
+					       NULL), 0);
+	install_sublevel();
+	for (i = 0; i < N_SUBKW; i++)
+		assert_int_equal(install_keyword(subkw_names[i], subkw_handler,
+						 NULL), 0);
+	install_sublevel_end();
+	return keywords;
+}
+
+/* Writes a config with 5 lines per multipath section */
+static void write_test_config(char *name)
+{
+	int fd, i;
+	FILE *f;
+
+	fd = mkstemp(name);
+	assert_true(fd >= 0);
+	f = fdopen(fd, "w");
+	assert_non_null(f);
+	fprintf(f, "defaults {\n\topt00 yes\n\topt47 no\n}\nmultipaths {\n");
+	for (i = 0; i < N_MPATHS; i++)
+		fprintf(f, "\tmultipath {\n\t\topt%02d %d\n\t\topt%02d \"x\"\n"
+			"\t\topt%02d x%d\n\t}\n", i % 23, i,
+			23 + i % 24, N_SUBKW - 1, i);
+	fprintf(f, "}\n");
+	fclose(f);
+}
+
+static void parse_test_config(const char *name)
+{
+	memset(handled, 0, sizeof(handled));
+	n_sections = 0;
+	assert_int_equal(process_file(&conf, name), 0);
+}
+
+/* hashed and linear keyword lookup must give the same result */
+static void test21(void **state)
+{
+	char name[] = "/tmp/parser-XXXXXX";
+	int linear[N_SUBKW];
+	int i;
+
+	conf.keywords = test_keywords();
+	conf.keyword_table = NULL;
+	write_test_config(name);
+
+	parse_test_config(name);
+	assert_int_equal(n_sections, N_MPATHS + 1);
+	assert_int_equal(handled[0], N_MPATHS / 23 + 2);
+	assert_int_equal(handled[N_SUBKW - 1], N_MPATHS + 1);
+	memcpy(linear, handled, sizeof(linear));
+
+	conf.keyword_table = index_keywords(conf.keywords);
+	assert_non_null(conf.keyword_table);
+	parse_test_config(name);
+	assert_int_equal(n_sections, N_MPATHS + 1);
+	for (i = 0; i < N_SUBKW; i++)
+		assert_int_equal(handled[i], linear[i]);
+
+	unlink(name);
+	free(conf.keyword_table);
+	conf.keyword_table = NULL;
+	free_keywords(conf.keywords);
+	conf.keywords = NULL;
+}
+
 int test_config_parser(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -490,6 +596,7 @@ int test_config_parser(void)
 		cmocka_unit_test(test18),
 		cmocka_unit_test(test19),
 		cmocka_unit_test(test20),
+		cmocka_unit_test(test21),
 	};
 	return cmocka_run_group_tests(tests, setup, teardown);
 }
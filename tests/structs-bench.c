@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Checker loop scan over a synthetic 50k path pathvec. Not part of the
+ * test suite, run "make bench".
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "vector.h"
+#include "structs.h"
+#include "globals.c"
+
+#define N_PATHS 50000
+#define N_TICKS 20
+#define N_RUNS 5
+#define CHECKINT 5
+
+static vector alloc_bench_pathvec(void)
+{
+	vector pathvec = vector_alloc();
+	struct path *pp;
+	int i;
+
+	if (!pathvec)
+		return NULL;
+	for (i = 0; i < N_PATHS; i++) {
+		if (!(pp = alloc_path()) || !vector_alloc_slot(pathvec)) {
+			free_path(pp);
+			free_pathvec(pathvec, FREE_PATHS);
+			return NULL;
+		}
+		vector_set_slot(pathvec, pp);
+		pp->initialized = INIT_OK;
+		pp->checkint = CHECKINT;
+		pp->tick = 1 + i % CHECKINT;
+		pp->state = PATH_UP;
+		/* the stand-ins used by old_layout_tick() */
+		pp->bus = pp->tick;
+		pp->sysfs_state = pp->checkint;
+		pp->dmstate = pp->state;
+	}
+	return pathvec;
+}
+
+/*
+ * One tick of the checker loop, as far as it is decided by the hot
+ * fields: reset is_checked on all paths, then find the paths that are
+ * due for a check.
+ */
+static int checker_tick(vector pathvec)
+{
+	struct path *pp;
+	int i, due = 0;
+
+	vector_foreach_slot(pathvec, pp, i)
+		pp->is_checked = CHECK_PATH_UNCHECKED;
+	vector_foreach_slot(pathvec, pp, i) {
+		if (pp->is_checked != CHECK_PATH_UNCHECKED ||
+		    pp->initialized == INIT_REMOVED)
+			continue;
+		if (pp->tick && --pp->tick)
+			pp->is_checked = CHECK_PATH_SKIPPED;
+		else {
+			pp->tick = pp->checkint;
+			pp->is_checked = pp->mpp || pp->state != PATH_UP ?
+				CHECK_PATH_STARTED : CHECK_PATH_CHECKED;
+			due++;
+		}
+	}
+	return due;
+}
+
+/*
+ * The same tick, on fields that sit where the hot fields were before they
+ * were grouped at the start of struct path: tick, checkint and state next
+ * to bus, sysfs_state and dmstate; mpp and initialized next to fd and
+ * retriggers; is_checked next to eh_deadline.
+ */
+static int old_layout_tick(vector pathvec)
+{
+	struct path *pp;
+	int i, due = 0;
+
+	vector_foreach_slot(pathvec, pp, i)
+		pp->eh_deadline = CHECK_PATH_UNCHECKED;
+	vector_foreach_slot(pathvec, pp, i) {
+		if (pp->eh_deadline != CHECK_PATH_UNCHECKED ||
+		    pp->retriggers == INIT_REMOVED)
+			continue;
+		if (pp->bus && --pp->bus)
+			pp->eh_deadline = CHECK_PATH_SKIPPED;
+		else {
+			pp->bus = pp->sysfs_state;
+			pp->eh_deadline = pp->fd >= 0 || pp->dmstate != PATH_UP ?
+				CHECK_PATH_STARTED : CHECK_PATH_CHECKED;
+			due++;
+		}
+	}
+	return due;
+}
+
+/* best of N_RUNS, in seconds per tick */
+static double bench_ticks(vector pathvec, int (*tick)(vector))
+{
+	struct timespec start, end;
+	double t, best = 1e9;
+	int i, j, due;
+
+	for (i = 0; i < N_RUNS; i++) {
+		due = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (j = 0; j < N_TICKS; j++)
+			due += tick(pathvec);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (due != N_TICKS * N_PATHS / CHECKINT)
+			return -1;
+		t = ((end.tv_sec - start.tv_sec) +
+		     (end.tv_nsec - start.tv_nsec) / 1e9) / N_TICKS;
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+int main(void)
+{
+	vector pathvec;
+	double t_hot, t_old;
+
+	init_test_verbosity(1);
+	pathvec = alloc_bench_pathvec();
+	if (!pathvec) {
+		fprintf(stderr, "failed to allocate %d paths\n", N_PATHS);
+		return 1;
+	}
+	t_hot = bench_ticks(pathvec, checker_tick);
+	t_old = bench_ticks(pathvec, old_layout_tick);
+	free_pathvec(pathvec, FREE_PATHS);
+	if (t_hot < 0 || t_old < 0) {
+		fprintf(stderr, "wrong number of paths due\n");
+		return 1;
+	}
+	printf("%d paths, sizeof(struct path) = %zu: grouped fields %.2f ms/tick, old layout %.2f ms/tick\n",
+	       N_PATHS, sizeof(struct path), t_hot * 1e3, t_old * 1e3);
+	return 0;
+}
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include "cmocka-compat.h"
+
+#include "structs.h"
+#include "globals.c"
+
+#define CACHE_LINE 64
+
+#define end_of(s, m) (offsetof(s, m) + sizeof(((s *)0)->m))
+
+/* The fields used by the checker loop must share the first cache line */
+static void test_path_hot_fields(void **state)
+{
+	assert_int_equal(offsetof(struct path, is_checked), 0);
+	assert_true(end_of(struct path, initialized) <= CACHE_LINE);
+	assert_true(end_of(struct path, tick) <= CACHE_LINE);
+	assert_true(end_of(struct path, checkint) <= CACHE_LINE);
+	assert_true(end_of(struct path, pending_ticks) <= CACHE_LINE);
+	assert_true(end_of(struct path, state) <= CACHE_LINE);
+	assert_true(end_of(struct path, mpp) <= CACHE_LINE);
+	assert_true(end_of(struct path, add_when_online) <= CACHE_LINE);
+}
+
+static int test_structs(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_path_hot_fields),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+int main(void)
+{
+	int ret = 0;
+
+	init_test_verbosity(-1);
+	ret += test_structs();
+	return ret;
+}
@@ -53,7 +53,7 @@ static int setup_uev(void **state)
 
 static int teardown(void **state)
 {
-	free(*state);
+	free_uevent(*state);
 	return 0;
 }
 
@@ -13,6 +13,7 @@
 #include <endian.h>
 #include <string.h>
 #include "util.h"
+#include "debug.h"
 
 #include "globals.c"
 
@@ -956,6 +957,89 @@ static int test_strchop(void)
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
 
+#define coalesce_fmt "%s: path %s failed"
+#define other_fmt "%s: other message"
+
+static int setup_coalesce(void **state)
+{
+	log_coalesce_interval = 5;
+	log_coalesce_level = 2;
+	return 0;
+}
+
+static int teardown_coalesce(void **state)
+{
+	/* forget all entries */
+	log_coalesce_interval = 0;
+	log_coalesce_flush();
+	return 0;
+}
+
+static void test_coalesce_repeat(void **state)
+{
+	assert_false(log_coalesce(2, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	assert_true(log_coalesce(2, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	assert_true(log_coalesce(3, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	/* not expired yet */
+	log_coalesce_flush();
+	assert_true(log_coalesce(2, "mpatha", coalesce_fmt, "mpatha", "sda"));
+}
+
+static void test_coalesce_keys(void **state)
+{
+	assert_false(log_coalesce(2, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	assert_false(log_coalesce(2, "mpathb", coalesce_fmt, "mpathb", "sda"));
+	assert_false(log_coalesce(2, "mpatha", other_fmt, "mpatha"));
+	assert_false(log_coalesce(2, NULL, coalesce_fmt, "mpatha", "sda"));
+	assert_true(log_coalesce(2, "mpathb", coalesce_fmt, "mpathb", "sda"));
+	assert_true(log_coalesce(2, "mpatha", other_fmt, "mpatha"));
+	assert_true(log_coalesce(2, NULL, coalesce_fmt, "mpatha", "sda"));
+}
+
+static void test_coalesce_level(void **state)
+{
+	assert_false(log_coalesce(1, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	assert_false(log_coalesce(1, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	log_coalesce_level = 4;
+	assert_false(log_coalesce(3, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	assert_false(log_coalesce(3, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	assert_false(log_coalesce(4, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	assert_true(log_coalesce(4, "mpatha", coalesce_fmt, "mpatha", "sda"));
+}
+
+static void test_coalesce_disabled(void **state)
+{
+	assert_false(log_coalesce(2, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	assert_true(log_coalesce(2, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	log_coalesce_interval = 0;
+	assert_false(log_coalesce(2, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	assert_false(log_coalesce(2, "mpatha", coalesce_fmt, "mpatha", "sda"));
+	/* flushing with coalescing disabled forgets all entries */
+	log_coalesce_flush();
+	log_coalesce_interval = 5;
+	assert_false(log_coalesce(2, "mpatha", coalesce_fmt, "mpatha", "sda"));
+}
+
+static int test_coalesce(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_coalesce_repeat,
+						setup_coalesce,
+						teardown_coalesce),
+		cmocka_unit_test_setup_teardown(test_coalesce_keys,
+						setup_coalesce,
+						teardown_coalesce),
+		cmocka_unit_test_setup_teardown(test_coalesce_level,
+						setup_coalesce,
+						teardown_coalesce),
+		cmocka_unit_test_setup_teardown(test_coalesce_disabled,
+						setup_coalesce,
+						teardown_coalesce),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
 int main(void)
 {
 	int ret = 0;
@@ -967,5 +1051,6 @@ int main(void)
 	ret += test_strlcpy();
 	ret += test_strlcat();
 	ret += test_strchop();
+	ret += test_coalesce();
 	return ret;
 }
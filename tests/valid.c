@@ -13,6 +13,9 @@
 #include <errno.h>
 #include "cmocka-compat.h"
 #include <sys/sysmacros.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libmount/libmount.h>
 
 #include "globals.c"
 #include "util.h"
@@ -184,6 +187,18 @@ int __wrap_dm_find_map_by_wwid(const char *wwid, char *name,
 	return ret;
 }
 
+int mountinfo_parsed;
+
+int __real_mnt_table_parse_stream(struct libmnt_table *tb, FILE *f,
+				  const char *filename);
+
+int __wrap_mnt_table_parse_stream(struct libmnt_table *tb, FILE *f,
+				  const char *filename)
+{
+	mountinfo_parsed++;
+	return __real_mnt_table_parse_stream(tb, f, filename);
+}
+
 enum {
 	STAGE_IS_MULTIPATHED,
 	STAGE_CHECK_MULTIPATHD,
@@ -552,6 +567,79 @@ static void test_find_multipaths(void **state)
 	assert_string_equal(pp.wwid, wwid);
 }
 
+static void write_devno(const char *dir, const char *file, dev_t devno)
+{
+	char path[PATH_MAX];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	f = fopen(path, "w");
+	assert_non_null(f);
+	fprintf(f, "%u:%u\n", major(devno), minor(devno));
+	fclose(f);
+}
+
+static void remove_file(const char *dir, const char *file)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	unlink(path);
+}
+
+static int check_in_use(char *name, char *wwid, const char *syspath)
+{
+	struct path pp;
+
+	memset(&pp, 0, sizeof(pp));
+	setup_passing(name, wwid, CHECK_MPATHD_SKIP, STAGE_FILTER_PROPERTY);
+	will_return(__wrap_is_failed_wwid, WWID_IS_NOT_FAILED);
+	will_return(__wrap_is_failed_wwid, wwid);
+	will_return(__wrap_udev_device_get_syspath, syspath);
+	return is_path_valid(name, &conf, &pp, false);
+}
+
+/* mountinfo is parsed only once, regardless of the number of paths */
+static void test_in_use_cache(void **state)
+{
+	char disk[] = "/tmp/valid-test-XXXXXX";
+	char part[PATH_MAX];
+	char *name = "test";
+	char *wwid = "test-wwid";
+	struct stat st;
+	int i, parsed;
+
+	assert_non_null(mkdtemp(disk));
+	snprintf(part, sizeof(part), "%s/test1", disk);
+	assert_int_equal(mkdir(part, 0700), 0);
+	write_devno(part, "partition", makedev(0, 1));
+	write_devno(disk, "dev", makedev(7, 250));
+	write_devno(part, "dev", makedev(7, 251));
+
+	conf.find_multipaths = FIND_MULTIPATHS_GREEDY;
+	assert_int_equal(check_in_use(name, wwid, disk), PATH_IS_VALID);
+	parsed = mountinfo_parsed;
+	assert_int_equal(parsed, 1);
+	for (i = 0; i < 100; i++)
+		assert_int_equal(check_in_use(name, wwid, disk),
+				 PATH_IS_VALID);
+	assert_int_equal(mountinfo_parsed, parsed);
+
+	/* a partition with the device number of the root file system */
+	if (stat("/", &st) == 0 && major(st.st_dev) != 0) {
+		write_devno(part, "dev", st.st_dev);
+		assert_int_equal(check_in_use(name, wwid, disk),
+				 PATH_IS_NOT_VALID);
+		assert_int_equal(mountinfo_parsed, parsed);
+	}
+
+	remove_file(part, "partition");
+	remove_file(part, "dev");
+	remove_file(disk, "dev");
+	rmdir(part);
+	rmdir(disk);
+}
+
 int test_valid(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -565,6 +653,7 @@ int test_valid(void)
 		cmocka_unit_test(test_check_wwids),
 		cmocka_unit_test(test_check_uuid_present),
 		cmocka_unit_test(test_find_multipaths),
+		cmocka_unit_test(test_in_use_cache),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }